@@ -0,0 +1,76 @@
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use gs2compiler::{compile_many, Gs2Context};
+use std::path::{Path, PathBuf};
+
+/// Every .gs2 script under tests/scripts, the ones expected to fail excluded.
+/// As in tests/tools/run_tests.py, those are the scripts under error_cases
+/// (.gs2fail files aren't .gs2 scripts to begin with)
+fn load_scripts() -> Vec<(PathBuf, Vec<u8>)> {
+    let mut scripts = Vec::new();
+    let mut dirs = vec![Path::new(env!("CARGO_MANIFEST_DIR")).join("tests/scripts")];
+
+    while let Some(dir) = dirs.pop() {
+        for entry in std::fs::read_dir(&dir).expect("tests/scripts is readable") {
+            let path = entry.unwrap().path();
+            if path.is_dir() {
+                if path.file_name().map_or(true, |name| name != "error_cases") {
+                    dirs.push(path);
+                }
+            } else if path.extension().map_or(false, |ext| ext == "gs2") {
+                let source = std::fs::read(&path).unwrap();
+                scripts.push((path, source));
+            }
+        }
+    }
+
+    scripts.sort_by(|a, b| a.0.cmp(&b.0));
+    scripts
+}
+
+fn bench_compile(c: &mut Criterion) {
+    let scripts = load_scripts();
+    let sources: Vec<&[u8]> = scripts.iter().map(|(_, source)| source.as_slice()).collect();
+    let total_bytes: usize = sources.iter().map(|source| source.len()).sum();
+
+    let mut group = c.benchmark_group("compile");
+    group.throughput(Throughput::Bytes(total_bytes as u64));
+
+    // One warm context compiling the whole suite
+    group.bench_function("sequential", |b| {
+        let context = Gs2Context::new();
+        b.iter(|| {
+            for source in &sources {
+                let _ = context.compile_bytes(source);
+            }
+        })
+    });
+
+    // compile_many pays for its contexts on every call, as a pipeline run would
+    let max_threads = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+    let mut threads = 1;
+    while threads <= max_threads {
+        group.bench_with_input(BenchmarkId::new("compile_many", threads), &threads, |b, &threads| {
+            b.iter(|| compile_many(&sources, threads))
+        });
+        threads *= 2;
+    }
+    group.finish();
+
+    // The largest scripts on their own, where per-script overhead matters least
+    let mut largest: Vec<_> = scripts.iter().collect();
+    largest.sort_by_key(|(_, source)| std::cmp::Reverse(source.len()));
+
+    let mut group = c.benchmark_group("compile_script");
+    let context = Gs2Context::new();
+    for (path, source) in largest.into_iter().take(3) {
+        let name = path.file_stem().unwrap().to_string_lossy().into_owned();
+        group.throughput(Throughput::Bytes(source.len() as u64));
+        group.bench_with_input(BenchmarkId::from_parameter(name), source, |b, source| {
+            b.iter(|| context.compile_bytes(source))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_compile);
+criterion_main!(benches);
@@ -0,0 +1,173 @@
+# Profile-guided build of gs2compiler, run in script mode by the pgo target:
+#
+#   cmake -DSOURCE_DIR=<repo> -DPGO_DIR=<build>/pgo [-DTRAINING_DIR=<scripts>]
+#         [-DGENERATOR=Ninja] [-DCXX_COMPILER=clang++] [-DC_COMPILER=clang]
+#         -P cmake/GS2PGO.cmake
+#
+# Steps:
+#   0. build a plain Release tree in PGO_DIR/baseline, first because every tree
+#      writes its libraries to the shared lib/ directory
+#   1. configure + build PGO_DIR/build with GS2_PGO=GENERATE
+#   2. training: copy tests/scripts (and TRAINING_DIR) into PGO_DIR/training,
+#      compile it with gs2test (directory mode is recursive), disassemble the
+#      output, and run gs2bench once over the copy
+#   3. merge the raw profiles (clang only, gcc reads .gcda files directly)
+#   4. reconfigure the same tree with GS2_PGO=USE (profile + LTO) and rebuild,
+#      gcc matches profiles by object path so the tree can't move in between
+#   5. write a gs2bench before/after report to PGO_DIR/pgo-report.txt
+#
+# The optimized gs2test/gs2bench land in bin/pgo, the baseline ones in
+# bin/pgo-baseline. The optimized gs2compiler library replaces the one in lib/.
+
+cmake_minimum_required(VERSION 3.10)
+
+if (NOT SOURCE_DIR OR NOT PGO_DIR)
+	message(FATAL_ERROR "SOURCE_DIR and PGO_DIR are required")
+endif()
+
+if (NOT DEFINED BENCH_ITERATIONS)
+	set(BENCH_ITERATIONS 20)
+endif()
+
+set(BUILD_DIR ${PGO_DIR}/build)
+set(BASELINE_DIR ${PGO_DIR}/baseline)
+set(PROFILE_DIR ${PGO_DIR}/profile)
+set(TRAINING_COPY ${PGO_DIR}/training)
+
+set(CONFIGURE_ARGS -DCMAKE_BUILD_TYPE=Release -DGS2_BUILD_BENCH=ON)
+if (GENERATOR)
+	list(APPEND CONFIGURE_ARGS -G ${GENERATOR})
+endif()
+if (CXX_COMPILER)
+	list(APPEND CONFIGURE_ARGS -DCMAKE_CXX_COMPILER=${CXX_COMPILER})
+endif()
+if (C_COMPILER)
+	list(APPEND CONFIGURE_ARGS -DCMAKE_C_COMPILER=${C_COMPILER})
+endif()
+
+function(run_step description)
+	message(STATUS "pgo: ${description}")
+	execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "pgo: ${description} failed (${result})")
+	endif()
+endfunction()
+
+function(configure_and_build dir bin_dir)
+	run_step("configuring ${dir}" ${CMAKE_COMMAND} -S ${SOURCE_DIR} -B ${dir} ${CONFIGURE_ARGS} -DBIN_DIR=${bin_dir} ${ARGN})
+	run_step("building ${dir}" ${CMAKE_COMMAND} --build ${dir} --config Release --parallel)
+endfunction()
+
+# 0. baseline build for the report
+configure_and_build(${BASELINE_DIR} bin/pgo-baseline -DGS2_PGO=)
+
+# 1. instrumented build, starting from an empty profile
+file(REMOVE_RECURSE ${PROFILE_DIR})
+file(MAKE_DIRECTORY ${PROFILE_DIR})
+configure_and_build(${BUILD_DIR} bin/pgo -DGS2_PGO=GENERATE -DGS2_PGO_PROFILE_DIR=${PROFILE_DIR})
+
+set(GS2TEST ${SOURCE_DIR}/bin/pgo/gs2test${CMAKE_EXECUTABLE_SUFFIX})
+set(GS2BENCH ${SOURCE_DIR}/bin/pgo/gs2bench${CMAKE_EXECUTABLE_SUFFIX})
+
+# 2. training workload, run over a copy since gs2test writes its output next to the input
+file(REMOVE_RECURSE ${TRAINING_COPY})
+file(MAKE_DIRECTORY ${TRAINING_COPY})
+file(COPY ${SOURCE_DIR}/tests/scripts DESTINATION ${TRAINING_COPY})
+if (TRAINING_DIR)
+	if (NOT IS_DIRECTORY ${TRAINING_DIR})
+		message(FATAL_ERROR "pgo: training directory ${TRAINING_DIR} does not exist")
+	endif()
+	file(COPY ${TRAINING_DIR}/ DESTINATION ${TRAINING_COPY}/user)
+endif()
+
+file(GLOB_RECURSE TRAINING_FILES ${TRAINING_COPY}/*.gs2 ${TRAINING_COPY}/*.txt)
+list(LENGTH TRAINING_FILES TRAINING_COUNT)
+message(STATUS "pgo: training on ${TRAINING_COUNT} scripts")
+
+# error_cases are part of the workload, so failing scripts are expected here
+execute_process(COMMAND ${GS2TEST} ${TRAINING_COPY} OUTPUT_QUIET ERROR_QUIET)
+execute_process(COMMAND ${GS2TEST} -d ${TRAINING_COPY} OUTPUT_QUIET ERROR_QUIET)
+run_step("training gs2bench" ${GS2BENCH} -w 0 -i 3 --no-scaling ${TRAINING_COPY})
+
+# 3. clang writes raw profiles that have to be merged
+file(GLOB RAW_PROFILES ${PROFILE_DIR}/*.profraw)
+if (RAW_PROFILES)
+	get_filename_component(compiler_dir "${CXX_COMPILER}" DIRECTORY)
+	find_program(LLVM_PROFDATA NAMES llvm-profdata HINTS ${compiler_dir})
+	if (NOT LLVM_PROFDATA)
+		message(FATAL_ERROR "pgo: llvm-profdata is required to merge clang profiles")
+	endif()
+	run_step("merging profiles" ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/gs2.profdata ${RAW_PROFILES})
+endif()
+
+# 4. optimized rebuild of the same tree
+configure_and_build(${BUILD_DIR} bin/pgo -DGS2_PGO=USE -DGS2_PGO_PROFILE_DIR=${PROFILE_DIR})
+
+# Remember the optimized libraries, nothing after this point may replace them
+file(GLOB PGO_LIBRARIES ${SOURCE_DIR}/lib/*gs2compiler*)
+if (NOT PGO_LIBRARIES)
+	message(FATAL_ERROR "pgo: no gs2compiler library in ${SOURCE_DIR}/lib after the optimized build")
+endif()
+foreach(library ${PGO_LIBRARIES})
+	file(SHA256 ${library} hash)
+	list(APPEND PGO_LIBRARY_HASHES ${hash})
+endforeach()
+
+# 5. before/after report
+
+function(run_bench binary out_var)
+	message(STATUS "pgo: benchmarking ${binary}")
+	execute_process(COMMAND ${binary} -i ${BENCH_ITERATIONS} --no-scaling
+		WORKING_DIRECTORY ${SOURCE_DIR}
+		OUTPUT_VARIABLE output
+		RESULT_VARIABLE result)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "pgo: ${binary} failed (${result})")
+	endif()
+	set(${out_var} "${output}" PARENT_SCOPE)
+endfunction()
+
+# gs2bench prints medians with three decimals, compare them as integer microseconds
+function(phase_median output phase out_var)
+	set(${out_var} "" PARENT_SCOPE)
+	if (output MATCHES "\n${phase} +([0-9]+)\\.([0-9][0-9][0-9]) ")
+		math(EXPR us "${CMAKE_MATCH_1} * 1000 + 1${CMAKE_MATCH_2} - 1000")
+		set(${out_var} ${us} PARENT_SCOPE)
+	endif()
+endfunction()
+
+run_bench(${SOURCE_DIR}/bin/pgo-baseline/gs2bench${CMAKE_EXECUTABLE_SUFFIX} BEFORE)
+run_bench(${GS2BENCH} AFTER)
+
+set(REPORT "gs2bench median per iteration, Release vs Release+PGO+LTO (positive is faster)\n\n")
+foreach(phase lex parse compile header decompile)
+	phase_median("${BEFORE}" ${phase} before_us)
+	phase_median("${AFTER}" ${phase} after_us)
+	if (before_us AND after_us)
+		# speedup as a percentage with one decimal
+		math(EXPR pct "(${before_us} - ${after_us}) * 1000 / ${before_us}")
+		if (pct LESS 0)
+			math(EXPR abs_pct "0 - (${pct})")
+			set(sign "-")
+		else()
+			set(abs_pct ${pct})
+			set(sign "+")
+		endif()
+		math(EXPR whole "${abs_pct} / 10")
+		math(EXPR frac "${abs_pct} % 10")
+		string(APPEND REPORT "${phase}: ${before_us} us -> ${after_us} us (${sign}${whole}.${frac}%)\n")
+	endif()
+endforeach()
+
+string(APPEND REPORT "\n--- before ---\n${BEFORE}\n--- after ---\n${AFTER}")
+file(WRITE ${PGO_DIR}/pgo-report.txt "${REPORT}")
+
+foreach(library ${PGO_LIBRARIES})
+	file(SHA256 ${library} hash)
+	list(FIND PGO_LIBRARY_HASHES ${hash} found)
+	if (found EQUAL -1)
+		message(FATAL_ERROR "pgo: ${library} is no longer the optimized build")
+	endif()
+endforeach()
+message("${REPORT}")
+message(STATUS "pgo: report written to ${PGO_DIR}/pgo-report.txt")
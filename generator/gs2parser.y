@@ -7,6 +7,26 @@
 %code {
   int yylex(YYSTYPE* yylvalp, YYLTYPE* yyllocp, class ParserContext *parser, yyscan_t scanner);
   void yyerror(YYLTYPE* yyllocp, class ParserContext *parser, yyscan_t unused, const char* msg);
+
+  // Bison's default location (@$ spans @1 to @N), which is also handed to the
+  // parser context so every node allocated by the rule is stamped with @1
+  #define YYLLOC_DEFAULT(Current, Rhs, N)                                          \
+    do                                                                             \
+    {                                                                              \
+      if (N)                                                                       \
+      {                                                                            \
+        (Current).first_line   = YYRHSLOC(Rhs, 1).first_line;                      \
+        (Current).first_column = YYRHSLOC(Rhs, 1).first_column;                    \
+        (Current).last_line    = YYRHSLOC(Rhs, N).last_line;                       \
+        (Current).last_column  = YYRHSLOC(Rhs, N).last_column;                     \
+      }                                                                            \
+      else                                                                         \
+      {                                                                            \
+        (Current).first_line   = (Current).last_line   = YYRHSLOC(Rhs, 0).last_line;   \
+        (Current).first_column = (Current).last_column = YYRHSLOC(Rhs, 0).last_column; \
+      }                                                                            \
+      parser->setNodeLocation((Current).first_line, (Current).first_column);        \
+    } while (0)
 }
 
 %{
@@ -455,7 +475,7 @@ expr_new:
 
 #include "lex.yy.h"
 
-void yyerror(YYLTYPE* yyllocp, class ParserContext *parser, yyscan_t unused, const char* s)
+void yyerror(YYLTYPE*, class ParserContext *parser, yyscan_t, const char*)
 {
 	/*
 	std::string msg;
@@ -3,6 +3,8 @@
 #ifndef COMPILERTHREADJOB_H
 #define COMPILERTHREADJOB_H
 
+#include <exception>
+#include <functional>
 #include <future>
 #include <memory>
 #include <string>
@@ -33,12 +35,27 @@ public:
 	{
 	}
 	
+	// The callback sets the promise. An exception it lets through goes to the
+	// future instead of ending the worker thread
 	void run(thread_context& th_context, promise_type& promise)
 	{
-		_fn(th_context, promise);
+		try
+		{
+			_fn(th_context, promise);
+		}
+		catch (...)
+		{
+			try
+			{
+				promise.set_exception(std::current_exception());
+			}
+			catch (const std::future_error&)
+			{
+			}
+		}
 	}
 
-	static void init(thread_context& th_context)
+	static void init(thread_context&)
 	{
 
 	}
@@ -72,7 +89,7 @@ public:
 		promise.set_value({ std::move(response) });
 	}
 
-	static void init(thread_context& th_context)
+	static void init(thread_context&)
 	{
 
 	}
@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef DECOMPILERTHREADJOB_H
+#define DECOMPILERTHREADJOB_H
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <string>
+#include <utility>
+
+/////// Renders a piece of disassembly on a CustomThreadPool, either a range of
+/////// functions of one GS2Decompiler or a whole file
+
+class DecompilerThreadJob
+{
+public:
+	struct job_result {
+		std::string output;
+		bool success = true;
+	};
+
+	struct thread_context {
+	};
+
+	using promise_type = std::promise<job_result>;
+	using callback_type = std::function<job_result()>;
+
+public:
+	DecompilerThreadJob(callback_type fn)
+		: _fn(std::move(fn))
+	{
+	}
+
+	void run(thread_context&, promise_type& promise)
+	{
+		try
+		{
+			promise.set_value(_fn());
+		}
+		catch (...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}
+
+	static void init(thread_context&)
+	{
+
+	}
+
+private:
+	callback_type _fn;
+};
+
+#endif
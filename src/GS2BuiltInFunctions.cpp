@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <array>
 #include "GS2BuiltInFunctions.h"
 
 // Signature characters: [return][...params]
@@ -7,7 +9,7 @@
 // o -> OP_CONV_TO_OBJECT
 // s -> OP_CONV_TO_STRING
 
-const BuiltInCmd builtInCmds[] = {
+constexpr BuiltInCmd builtInCmds[] = {
 	{
 		.name = "sleep",
 		.op = opcode::OP_SLEEP,
@@ -149,7 +151,7 @@ const BuiltInCmd builtInCmds[] = {
 	}
 };
 
-const BuiltInCmd builtInObjCmds[] = {
+constexpr BuiltInCmd builtInObjCmds[] = {
 	{
 		.name = "index",
 		.op = opcode::OP_OBJ_INDEX,
@@ -286,15 +288,49 @@ const BuiltInCmd builtInObjCmds[] = {
 	},
 };
 
-GS2BuiltInFunctions GS2BuiltInFunctions::getBuiltIn()
+namespace
 {
-	GS2BuiltInFunctions functions;
+	template<size_t N>
+	constexpr std::array<BuiltInCmd, N> sortByName(const BuiltInCmd (&cmds)[N])
+	{
+		std::array<BuiltInCmd, N> sorted;
+		std::copy(std::begin(cmds), std::end(cmds), sorted.begin());
+		std::sort(sorted.begin(), sorted.end(), [](const BuiltInCmd& a, const BuiltInCmd& b) {
+			return a.name < b.name;
+		});
+		return sorted;
+	}
+
+	template<size_t N>
+	constexpr bool uniqueNames(const std::array<BuiltInCmd, N>& cmds)
+	{
+		return std::adjacent_find(cmds.begin(), cmds.end(), [](const BuiltInCmd& a, const BuiltInCmd& b) {
+			return a.name == b.name;
+		}) == cmds.end();
+	}
+
+	template<size_t N>
+	const BuiltInCmd *findByName(const std::array<BuiltInCmd, N>& cmds, std::string_view name)
+	{
+		auto iter = std::lower_bound(cmds.begin(), cmds.end(), name, [](const BuiltInCmd& cmd, std::string_view name) {
+			return cmd.name < name;
+		});
+		return (iter != cmds.end() && iter->name == name ? &*iter : nullptr);
+	}
+
+	constexpr auto sortedCmds = sortByName(builtInCmds);
+	constexpr auto sortedObjCmds = sortByName(builtInObjCmds);
 
-	for (const auto& cmd : builtInCmds)
-		functions.builtInCmdMap.insert({ cmd.name, cmd });
+	static_assert(uniqueNames(sortedCmds), "duplicate name in builtInCmds");
+	static_assert(uniqueNames(sortedObjCmds), "duplicate name in builtInObjCmds");
+}
 
-	for (const auto& cmd : builtInObjCmds)
-		functions.builtInObjMap.insert({ cmd.name, cmd });
+const BuiltInCmd *GS2BuiltInFunctions::findCmd(std::string_view name)
+{
+	return findByName(sortedCmds, name);
+}
 
-	return functions;
+const BuiltInCmd *GS2BuiltInFunctions::findObjCmd(std::string_view name)
+{
+	return findByName(sortedObjCmds, name);
 }
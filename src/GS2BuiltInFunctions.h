@@ -3,9 +3,8 @@
 #ifndef GS2BUILTINFUNCTIONS_H
 #define GS2BUILTINFUNCTIONS_H
 
-#include <string>
+#include <string_view>
 #include <cstdint>
-#include <unordered_map>
 #include "opcodes.h"
 
 enum CmdFlags
@@ -22,57 +21,37 @@ const uint8_t DEFAULT_OBJ_CMD_FLAGS = CMD_USE_ARRAY | CMD_REVERSE_ARGS | CMD_RET
 
 struct BuiltInCmd
 {
-	std::string name;										// Function Name
+	std::string_view name;									// Function Name
 	opcode::Opcode op;										// Op-code for built in command, or OP_CALL
 	opcode::Opcode convert_object_op{ opcode::OP_NONE };			// Convert object to this type [used for object.call() functions]
 	uint8_t flags = (CMD_REVERSE_ARGS | CMD_RETURN_VALUE);	// See above for cmd options
-	std::string sig;
+	std::string_view sig{};
 };
 
-const BuiltInCmd defaultCall = {
+constexpr BuiltInCmd defaultCall = {
 	"",
 	opcode::OP_CALL,
 	opcode::OP_NONE,
 	DEFAULT_CMD_FLAGS
 };
 
-const BuiltInCmd defaultObjCall = {
+constexpr BuiltInCmd defaultObjCall = {
 	"",
 	opcode::OP_CALL,
 	opcode::OP_CONV_TO_OBJECT,
 	DEFAULT_OBJ_CMD_FLAGS
 };
 
+/*
+ * The built-in tables are sorted at compile time and looked up with a binary
+ * search, so there's nothing to build when a context is created and every
+ * context shares the same read-only data
+ */
 struct GS2BuiltInFunctions
 {
-	std::unordered_map<std::string, BuiltInCmd> builtInCmdMap;
-	std::unordered_map<std::string, BuiltInCmd> builtInObjMap;
-
-	GS2BuiltInFunctions() { }
-
-	GS2BuiltInFunctions(GS2BuiltInFunctions&& o) noexcept;
-	GS2BuiltInFunctions(const GS2BuiltInFunctions&) = delete;
-
-	GS2BuiltInFunctions& operator= (GS2BuiltInFunctions&& o) noexcept;
-	GS2BuiltInFunctions& operator= (const GS2BuiltInFunctions&) = delete;
-
-	static GS2BuiltInFunctions getBuiltIn();
+	// nullptr when name isn't a built-in command
+	static const BuiltInCmd *findCmd(std::string_view name);
+	static const BuiltInCmd *findObjCmd(std::string_view name);
 };
 
-inline GS2BuiltInFunctions& GS2BuiltInFunctions::operator=(GS2BuiltInFunctions&& o) noexcept
-{
-	if (this != &o)
-	{
-		builtInCmdMap = std::move(o.builtInCmdMap);
-		builtInObjMap = std::move(o.builtInObjMap);
-	}
-
-	return *this;
-}
-
-inline GS2BuiltInFunctions::GS2BuiltInFunctions(GS2BuiltInFunctions&& o) noexcept
-{
-	*this = std::move(o);
-}
-
 #endif
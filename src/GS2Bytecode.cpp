@@ -13,17 +13,10 @@
 	 SEGMENT_BYTECODE = 4
  };
 
-int32_t GS2Bytecode::getStringConst(const std::string& str)
+int32_t GS2Bytecode::getStringConst(std::string_view str)
 {
-	auto it = stringTableMapping.find(str);
-	if (it != stringTableMapping.end())
-		return it->second;
-
-	stringTable.push_back(str);
-	auto idx = int32_t(stringTable.size() - 1);
-
-	stringTableMapping[str] = idx;
-	return idx;
+	GS2_ALLOC_PHASE(Bytecode);
+	return stringTable.insert(str);
 }
 
 Buffer GS2Bytecode::getByteCode()
@@ -37,7 +30,9 @@ Buffer GS2Bytecode::getByteCode()
 	// - joey
 	emit(opcode::OP_RET);
 
-	Buffer byteCode;
+	// Reserve enough room for the segments up-front so the output buffer
+	// doesn't need to grow while being written
+	Buffer byteCode(bytecode.length() + stringTable.data().length() + functionTable.size() * 16 + 64);
 
 	// GS1EventFlags
 	{
@@ -58,47 +53,42 @@ Buffer GS2Bytecode::getByteCode()
 		// 
 		// note: this may not actually be the case, and it may be related to the
 		// function bug i mentioned a few lines up
-		std::vector<std::string> functionTableOrder;
-		std::unordered_set<std::string> visitedFunctions;
+		//
+		// Functions are referenced by their index in functionTable, so building
+		// the order and writing the table is linear in the number of functions
+		std::vector<size_t> functionTableOrder;
+		std::vector<bool> visitedFunctions(functionTable.size(), false);
+
+		functionTableOrder.reserve(functionTable.size());
 
-		for (const auto& ident : stringTable)
+		for (size_t i = 0; i < stringTable.size(); i++)
 		{
-			if (functionSet.find(ident) != functionSet.end() && visitedFunctions.insert(ident).second)
+			auto it = functionIndex.find(stringTable[i]);
+			if (it != functionIndex.end() && !visitedFunctions[it->second])
 			{
-				functionTableOrder.push_back(ident);
+				visitedFunctions[it->second] = true;
+				functionTableOrder.push_back(it->second);
 			}
 		}
 
-		for (const auto& func : functionTable)
+		for (size_t i = 0; i < functionTable.size(); i++)
 		{
-			if (functionSet.find(func.functionName) != functionSet.end() && visitedFunctions.insert(func.functionName).second)
-			{
-				functionTableOrder.push_back(func.functionName);
-			}
+			if (!visitedFunctions[i])
+				functionTableOrder.push_back(i);
 		}
 
 		Buffer functionTableBuffer;
-		for (const auto& funcName : functionTableOrder)
+		for (auto idx : functionTableOrder)
 		{
-			// Not a defined function, so skip
-			assert(functionSet.find(funcName) != functionSet.end());
+			auto& func = functionTable[idx];
+			functionTableBuffer.Write<encoding::Int32>(func.opIndex);
+			functionTableBuffer.write(func.functionName.c_str(), func.functionName.length());
+			functionTableBuffer.write('\0');
 
-			auto it = std::find_if(functionTable.begin(), functionTable.end(), [funcName](const FunctionEntry& e) {
-				return (funcName == e.functionName);
-			});
-
-			if (it != functionTable.end())
+			// emit a jump before the function declaration to the last op index
+			if (func.jmpLoc != SIZE_MAX)
 			{
-				auto& func = *it;
-				functionTableBuffer.Write<encoding::Int32>(func.opIndex);
-				functionTableBuffer.write(func.functionName.c_str(), func.functionName.length());
-				functionTableBuffer.write('\0');
-
-				// emit a jump before the function declaration to the last op index
-				if (func.jmpLoc != 0)
-				{
-					emit(short(opIndex), func.jmpLoc - 2);
-				}
+				setJumpTarget(func.jmpLoc, opIndex);
 			}
 		}
 
@@ -109,19 +99,17 @@ Buffer GS2Bytecode::getByteCode()
 
 	// String Table
 	{
-		Buffer stringTableBuffer;
-		for (const auto& str : stringTable)
-		{
-			stringTableBuffer.write(str.c_str(), str.length());
-			stringTableBuffer.write('\0');
-		}
+		// The table is already stored as a list of null-terminated strings
+		auto stringTableData = stringTable.data();
 
 		byteCode.Write<encoding::Int32>(SEGMENT_STRINGTABLE);
-		byteCode.Write<encoding::Int32>(uint32_t(stringTableBuffer.length()));
-		byteCode.write(stringTableBuffer);
+		byteCode.Write<encoding::Int32>(uint32_t(stringTableData.length()));
+		byteCode.write(stringTableData.data(), stringTableData.length());
 	}
 
 	// Bytecode
+	layoutJumps();
+
 	byteCode.Write<encoding::Int32>(SEGMENT_BYTECODE);
 	byteCode.Write<encoding::Int32>(uint32_t(bytecode.length()));
 	byteCode.write(bytecode);
@@ -130,9 +118,68 @@ Buffer GS2Bytecode::getByteCode()
 	return byteCode;
 }
 
+size_t GS2Bytecode::emitJump(opcode::Opcode op)
+{
+	emit(op);
+
+	GS2_ALLOC_PHASE(Bytecode);
+	jumpSites.push_back(JumpSite{ bytecode.length(), 0 });
+	emit(char(0xF4));
+	emit(short(0));
+
+	return jumpSites.size() - 1;
+}
+
+void GS2Bytecode::layoutJumps()
+{
+	// Jump targets are operation indices rather than byte offsets, so widening
+	// an operand never moves a target and a single pass is enough to settle the
+	// layout. Most scripts never need a wide jump and are patched in place.
+	size_t wideJumps = std::count_if(jumpSites.begin(), jumpSites.end(), [](const JumpSite& site) {
+		return site.target > uint32_t(std::numeric_limits<int16_t>::max());
+	});
+
+	if (wideJumps == 0)
+	{
+		for (const auto& site : jumpSites)
+			emit(short(site.target), site.pos + 1);
+
+		return;
+	}
+
+	// Every wide jump grows by two bytes, so the bytecode is copied into a new
+	// buffer with the 32-bit operands spliced in
+	Buffer relaidOut(bytecode.length() + wideJumps * 2);
+	auto src = reinterpret_cast<const char *>(bytecode.buffer());
+	size_t copyPos = 0;
+
+	for (const auto& site : jumpSites)
+	{
+		relaidOut.write(src + copyPos, site.pos - copyPos);
+
+		if (site.target > uint32_t(std::numeric_limits<int16_t>::max()))
+		{
+			relaidOut.write(char(0xF5));
+			relaidOut.Write<encoding::Int32>(site.target);
+		}
+		else
+		{
+			relaidOut.write(char(0xF4));
+			relaidOut.Write<encoding::Int16>(uint16_t(site.target));
+		}
+
+		// skip over the prefix and the placeholder short
+		copyPos = site.pos + 3;
+	}
+
+	relaidOut.write(src + copyPos, bytecode.length() - copyPos);
+	bytecode = std::move(relaidOut);
+}
+
 void GS2Bytecode::addFunction(std::string functionName, uint32_t opIdx, size_t jmpLoc)
 {
-	auto ret = functionSet.insert(functionName);
+	GS2_ALLOC_PHASE(Bytecode);
+	auto ret = functionIndex.try_emplace(functionName, functionTable.size());
 
 	if (ret.second)
 	{
@@ -150,12 +197,30 @@ void GS2Bytecode::addFunction(std::string functionName, uint32_t opIdx, size_t j
 	}
 }
 
+Buffer GS2Bytecode::getLineTable(const linetable::Fingerprint& fingerprint) const
+{
+	if (!lineTableEnabled)
+		return {};
+
+	return linetable::encode(lineTable, fingerprint);
+}
+
 void GS2Bytecode::emit(opcode::Opcode op)
 {
 #ifdef DBGEMITTERS
 	printf("%5zu EMIT OPER: %s (%d) loc: %d\n", bytecode.length(), opcode::OpcodeToString(op).c_str(), op, opIndex);
 #endif
 
+	// Only start a new entry when the location changes
+	if (lineTableEnabled && sourceLocation.line != 0)
+	{
+		if (lineTable.empty() || lineTable.back().line != sourceLocation.line || lineTable.back().column != sourceLocation.column)
+		{
+			sourceLocation.opIndex = opIndex;
+			lineTable.push_back(sourceLocation);
+		}
+	}
+
 	bytecode.write((char)op);
 	lastOp = op;
 	++opIndex;
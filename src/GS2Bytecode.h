@@ -5,19 +5,27 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "ast/ast.h"
 #include "encoding/buffer.h"
+#include "encoding/linetable.h"
+#include "utils/StringConstTable.h"
 #include "opcodes.h"
 
 struct FunctionEntry
 {
     std::string functionName;
     uint32_t opIndex;
-    size_t jmpLoc;
+    size_t jmpLoc; // jump emitted before the declaration, SIZE_MAX if none
+};
+
+struct JumpSite
+{
+    size_t pos;      // position of the number prefix following the jump opcode
+    uint32_t target; // operation index to jump to
 };
 
 class GS2Bytecode
@@ -25,10 +33,11 @@ class GS2Bytecode
     friend class GS2CompilerVisitor;
 
     private:
-        GS2Bytecode() : opIndex(0), lastOp(opcode::Opcode::OP_NONE) {}
+        GS2Bytecode() : opIndex(0), lastOp(opcode::Opcode::OP_NONE), lineTableEnabled(false), sourceLocation{} {}
         
         Buffer getByteCode();
-        int32_t getStringConst(const std::string& str);
+        Buffer getLineTable(const linetable::Fingerprint& fingerprint) const;
+        int32_t getStringConst(std::string_view str);
 
         void addFunction(std::string functionName, uint32_t opIdx, size_t jmpLoc);
         
@@ -45,6 +54,32 @@ class GS2Bytecode
         void emitDynamicNumberUnsigned(uint32_t val);
         void emitDoubleNumber(const std::string& num);
 
+        /**
+         * Emits a jump opcode with a placeholder target. The operand width is
+         * decided once the bytecode is finalized, so targets should only be set
+         * through setJumpTarget()
+         *
+         * @return id of the jump to pass to setJumpTarget
+         */
+        size_t emitJump(opcode::Opcode op);
+        void setJumpTarget(size_t jump, uint32_t target);
+
+        /**
+         * Writes out every jump target, widening any jump whose target doesn't
+         * fit in a signed 16-bit operand (0xF4) to a 32-bit operand (0xF5)
+         */
+        void layoutJumps();
+
+        /**
+         * Enables recording the source location of each emitted operation
+         */
+        void enableLineTable();
+
+        /**
+         * Sets the source location for any operations emitted after this call
+         */
+        void setSourceLocation(uint32_t line, uint32_t column);
+
         /**
          * Gets the last emitted opcode
          *
@@ -59,6 +94,13 @@ class GS2Bytecode
          */
         uint32_t getOpIndex() const;
 
+        /**
+         * Gets the number of strings in the string table, and the size
+         * of the string table segment in bytes
+         */
+        size_t getStringCount() const;
+        size_t getStringTableBytes() const;
+
         /**
          * Gets the current length of the bytecode buffer
          *
@@ -71,13 +113,35 @@ class GS2Bytecode
         uint32_t opIndex;
         opcode::Opcode lastOp;
 
-        std::vector<std::string> stringTable;
-        std::unordered_map<std::string, int32_t> stringTableMapping;
+        StringConstTable stringTable;
+
+        struct FunctionNameHash
+        {
+            using is_transparent = void;
+
+            size_t operator()(std::string_view str) const {
+                return std::hash<std::string_view>{}(str);
+            }
+        };
 
         std::vector<FunctionEntry> functionTable;
-        std::unordered_set<std::string> functionSet;
+        std::unordered_map<std::string, size_t, FunctionNameHash, std::equal_to<>> functionIndex; // name -> functionTable index
+
+        std::vector<JumpSite> jumpSites;
+
+        bool lineTableEnabled;
+        linetable::Entry sourceLocation;
+        std::vector<linetable::Entry> lineTable;
 };
 
+inline size_t GS2Bytecode::getStringCount() const {
+    return stringTable.size();
+}
+
+inline size_t GS2Bytecode::getStringTableBytes() const {
+    return stringTable.data().length();
+}
+
 inline opcode::Opcode GS2Bytecode::getLastOp() const {
     return lastOp;
 }
@@ -90,4 +154,18 @@ inline size_t GS2Bytecode::getBytecodePos() const {
     return bytecode.length();
 }
 
+inline void GS2Bytecode::setJumpTarget(size_t jump, uint32_t target) {
+    jumpSites[jump].target = target;
+}
+
+inline void GS2Bytecode::enableLineTable() {
+    lineTableEnabled = true;
+    lineTable.reserve(256);
+}
+
+inline void GS2Bytecode::setSourceLocation(uint32_t line, uint32_t column) {
+    sourceLocation.line = line;
+    sourceLocation.column = column;
+}
+
 #endif
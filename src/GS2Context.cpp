@@ -1,14 +1,27 @@
-#include <format>
+#include <chrono>
 #include "GS2Context.h"
 #include "encoding/graalencoding.h"
 #include "visitors/GS2CompilerVisitor.h"
 #include "GS2Bytecode.h"
 #include "Parser.h"
+#include "utils/MurmurHash3.h"
+
+namespace
+{
+	// Header bytes are GraalByte encoded, which only round-trips values below 0xFF
+	HeaderChecksum randomChecksum(std::mt19937_64& rng)
+	{
+		HeaderChecksum checksum;
+		std::uniform_int_distribution<int> dist(0, 0xFE);
+		for (auto& byte : checksum)
+			byte = uint8_t(dist(rng));
+		return checksum;
+	}
+}
 
 GS2Context::GS2Context()
-	: errorService([this](auto && PH1) { handleError(std::forward<decltype(PH1)>(PH1)); })
+	: errorService([this](auto && PH1) { handleError(std::forward<decltype(PH1)>(PH1)); }), rng(std::random_device{}())
 {
-	builtIn = GS2BuiltInFunctions::getBuiltIn();
 }
 
 void GS2Context::handleError(GS2CompilerError& error)
@@ -18,12 +31,42 @@ void GS2Context::handleError(GS2CompilerError& error)
 
 CompilerResponse GS2Context::compile(const std::string& script)
 {
+	using clock = std::chrono::steady_clock;
+	auto elapsedNs = [](clock::time_point since) {
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - since).count());
+	};
+
 	errors.clear();
 
+	std::optional<CompilerStats> stats;
+	if (options.collectStats)
+		stats.emplace();
+
+	allocstats::Tracker allocTracker;
+	std::optional<allocstats::TrackerScope> allocScope;
+	if (stats)
+		allocScope.emplace(allocTracker);
+
+	auto collectAllocs = [&] {
+		if (stats)
+		{
+			stats->allocs = allocTracker.phases;
+			stats->peakLiveBytes = uint64_t(allocTracker.peakLiveBytes);
+			stats->allocsComplete = allocstats::operatorNewHooked;
+		}
+	};
+
 	// Parse the script into an AST tree
+	auto phaseStart = clock::now();
 	ParserContext parserContext(errorService);
 	bool success = parserContext.parse(script);
 
+	if (stats)
+	{
+		stats->parseNs = elapsedNs(phaseStart);
+		stats->nodeCount = uint32_t(parserContext.getNodeCount());
+	}
+
 	// Check for parser errors
 	if (success)
 	{
@@ -33,15 +76,52 @@ CompilerResponse GS2Context::compile(const std::string& script)
 		if (stmtBlock)
 		{
 			// Walk the AST tree to produce bytecode
-			GS2CompilerVisitor compilerVisitor(parserContext, builtIn);
-			compilerVisitor.Visit(stmtBlock);
+			phaseStart = clock::now();
+			GS2CompilerVisitor compilerVisitor(parserContext);
+			{
+				GS2_ALLOC_PHASE(Visitor);
+				if (options.emitLineTable)
+					compilerVisitor.enableLineTable();
+
+				compilerVisitor.Visit(stmtBlock);
+			}
+
+			if (stats)
+			{
+				stats->codegenNs = elapsedNs(phaseStart);
+				phaseStart = clock::now();
+			}
+
+			Buffer bytecode;
+			{
+				GS2_ALLOC_PHASE(Bytecode);
+				bytecode = compilerVisitor.getByteCode();
+			}
 
-			return CompilerResponse{
+			CompilerResponse response{
 				true,
 				std::move(errors),
-				compilerVisitor.getByteCode(),
+				std::move(bytecode),
 				compilerVisitor.getJoinedClasses()
 			};
+
+			if (stats)
+			{
+				stats->finalizeNs = elapsedNs(phaseStart);
+				stats->stringCount = uint32_t(compilerVisitor.getStringCount());
+				stats->stringTableBytes = uint32_t(compilerVisitor.getStringTableBytes());
+				stats->labelCount = uint32_t(compilerVisitor.getLabelCount());
+				stats->outputBytes = uint32_t(response.bytecode.length());
+			}
+
+			// Outside the finalize phase, so phase timings stay comparable with runs from before fingerprints
+			response.fingerprint = ComputeFingerprint({ response.bytecode.buffer(), response.bytecode.length() });
+
+			response.lineTable = compilerVisitor.getLineTable(response.fingerprint);
+
+			collectAllocs();
+			response.stats = stats;
+			return response;
 		}
 	}
 	
@@ -49,14 +129,46 @@ CompilerResponse GS2Context::compile(const std::string& script)
 	if (errors.empty())
 		parserContext.addParserError("malformed input");
 	
-	return CompilerResponse{
+	CompilerResponse response{
 		false,
 		std::move(errors),
 		Buffer{},
 	};
+
+	collectAllocs();
+	response.stats = stats;
+	return response;
+}
+
+Buffer GS2Context::createHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk)
+{
+	auto checksum = options.deterministicHeader ? ContentChecksum(bytecode, options.headerSalt) : randomChecksum(rng);
+	return CreateHeader(bytecode, scriptType, scriptName, saveToDisk, checksum);
 }
 
 Buffer GS2Context::CreateHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk)
+{
+	// No shared state between threads, unlike rand()
+	thread_local std::mt19937_64 threadRng(std::random_device{}());
+	return CreateHeader(bytecode, scriptType, scriptName, saveToDisk, randomChecksum(threadRng));
+}
+
+HeaderChecksum GS2Context::ContentChecksum(const Buffer& bytecode, uint64_t salt)
+{
+	auto hash = murmur3::hash128(bytecode.buffer(), bytecode.length(), salt);
+
+	HeaderChecksum checksum;
+	for (size_t i = 0; i < checksum.size(); i++)
+		checksum[i] = uint8_t((hash[i / 8] >> ((i % 8) * 8)) % 0xFF);
+	return checksum;
+}
+
+Fingerprint GS2Context::ComputeFingerprint(std::span<const uint8_t> data)
+{
+	return murmur3::hash128(data.data(), data.size());
+}
+
+Buffer GS2Context::CreateHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk, const HeaderChecksum& checksum)
 {
 	// Empty bytecode buffer indicates there was a compilation error
 	if (!bytecode.length())
@@ -80,9 +192,9 @@ Buffer GS2Context::CreateHeader(const Buffer& bytecode, const std::string& scrip
 	bytecodeWithHeader.write(',');
 
 	// Checksum or key for encrypted files
-	// Needs to be new every time script gets generated, otherwise the client won't request updated script
-	for (int i = 0; i < 10; i++)
-		bytecodeWithHeader.Write<GraalByte>(rand() % 0xFF);
+	// Needs to change whenever the script changes, otherwise the client won't request the updated script
+	for (auto byte : checksum)
+		bytecodeWithHeader.Write<GraalByte>(byte);
 
 	// Write out the bytecode to the buffer
 	bytecodeWithHeader.write(bytecode);
@@ -3,11 +3,51 @@
 #ifndef GS2CONTEXT_H
 #define GS2CONTEXT_H
 
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <random>
 #include <set>
+#include <span>
+#include <string>
 #include <vector>
 #include "encoding/buffer.h"
 #include "exceptions/GS2CompilerError.h"
-#include "GS2BuiltInFunctions.h"
+#include "utils/AllocTracker.h"
+
+struct CompilerStats
+{
+	// Phase timings, in nanoseconds
+	uint64_t parseNs = 0;		// scanning and parsing into the AST
+	uint64_t codegenNs = 0;		// walking the AST to emit operations
+	uint64_t finalizeNs = 0;	// getByteCode(): jump patching and segment layout
+
+	uint32_t nodeCount = 0;
+	uint32_t stringCount = 0;
+	uint32_t stringTableBytes = 0;
+	uint32_t labelCount = 0;
+	uint32_t outputBytes = 0;
+
+	// Allocations per allocstats::Phase. Unless allocsComplete, operator new
+	// wasn't hooked (the library, wasm) and only Buffer growth is counted
+	std::array<allocstats::Counters, allocstats::PhaseCount> allocs{};
+	uint64_t peakLiveBytes = 0;
+	bool allocsComplete = false;
+
+	allocstats::Counters totalAllocs() const
+	{
+		allocstats::Counters total;
+		for (const auto& phase : allocs)
+		{
+			total.count += phase.count;
+			total.bytes += phase.bytes;
+		}
+		return total;
+	}
+};
+
+// 128-bit MurmurHash3 of header-less bytecode, see CompilerResponse::fingerprint
+using Fingerprint = std::array<uint64_t, 2>;
 
 struct CompilerResponse
 {
@@ -15,25 +55,62 @@ struct CompilerResponse
 	std::vector<GS2CompilerError> errors;
 
 	Buffer bytecode;
-	std::set<std::string> joinedClasses;
+	std::set<std::string> joinedClasses{};
+
+	// Hash of the bytecode above before any header is added. Comments and
+	// whitespace don't reach the bytecode, so a script that only changed in
+	// formatting keeps its fingerprint and doesn't need redistributing
+	Fingerprint fingerprint{};
+
+	// Delta-encoded opIndex -> (line, column) table, see encoding/linetable.h.
+	// Only filled in when CompilerOptions::emitLineTable is set
+	Buffer lineTable{};
+
+	// Only filled in when CompilerOptions::collectStats is set
+	std::optional<CompilerStats> stats{};
 };
 
+struct CompilerOptions
+{
+	bool emitLineTable = false;
+	bool collectStats = false;
+
+	// Derive the header checksum from the bytecode and headerSalt instead of
+	// random bytes, so the same script always compiles to the same output.
+	// Bump the salt (e.g. a generation number) to make clients refetch anyway
+	bool deterministicHeader = false;
+	uint64_t headerSalt = 0;
+};
+
+// The 10 checksum bytes of the script header, before GraalByte encoding
+using HeaderChecksum = std::array<uint8_t, 10>;
+
 class GS2Context
 {
 	public:
 		GS2Context();
 
+		const CompilerOptions& getOptions() const;
+		void setOptions(const CompilerOptions& opts);
+
 		CompilerResponse compile(const std::string& script);
 		CompilerResponse compile(const std::string& script, const std::string& scriptType, const std::string& scriptName, bool saveToDisk);
 
+		// Prefixes the bytecode with the script header, using the checksum mode from the options
+		Buffer createHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk);
+
 		static Buffer CreateHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk);
+		static Buffer CreateHeader(const Buffer& bytecode, const std::string& scriptType, const std::string& scriptName, bool saveToDisk, const HeaderChecksum& checksum);
+		static HeaderChecksum ContentChecksum(const Buffer& bytecode, uint64_t salt);
+		static Fingerprint ComputeFingerprint(std::span<const uint8_t> data);
 		static CompilerResponse Compile(const std::string& script);
 		static CompilerResponse Compile(const std::string& script, const std::string& scriptType, const std::string& scriptName, bool saveToDisk);
 
 	private:
-		GS2BuiltInFunctions builtIn;
+		CompilerOptions options;
 		GS2ErrorService errorService;
 		std::vector<GS2CompilerError> errors;
+		std::mt19937_64 rng;
 
 		/*
 		 * Called whenever an error occurs during any stage of compilation,
@@ -43,11 +120,25 @@ class GS2Context
 		void handleError(GS2CompilerError &error);
 };
 
+inline const CompilerOptions& GS2Context::getOptions() const
+{
+	return options;
+}
+
+inline void GS2Context::setOptions(const CompilerOptions& opts)
+{
+	options = opts;
+}
+
 inline CompilerResponse GS2Context::compile(const std::string& script, const std::string& scriptType, const std::string& scriptName, bool saveToDisk)
 {
 	CompilerResponse results = compile(script);
 	if (results.success)
-		results.bytecode = CreateHeader(results.bytecode, scriptType, scriptName, saveToDisk);
+	{
+		results.bytecode = createHeader(results.bytecode, scriptType, scriptName, saveToDisk);
+		if (results.stats)
+			results.stats->outputBytes = uint32_t(results.bytecode.length());
+	}
 
 	return results;
 }
@@ -5,23 +5,7 @@
 #include "gs2parser.tab.hh"
 #include "lex.yy.h"
 
-std::string GetLineByLineNumber(const std::string& subject, uint32_t lineNumber)
-{
-	size_t pos = 0;
-	for (uint32_t i = 0; i < lineNumber - 1; i++)
-	{
-		pos = subject.find("\n", pos);
-		if (pos == std::string::npos)
-			return {};
-
-		++pos;
-	}
-
-	auto end = subject.find("\n", pos);
-	if (end == std::string::npos)
-		return subject.substr(pos);
-	return subject.substr(pos, end - pos);
-}
+int yylex(YYSTYPE* yylvalp, YYLTYPE* yyllocp, class ParserContext *parser, yyscan_t scanner);
 
 void ReplaceStringInPlace(std::string& subject, const std::string& search, const std::string& replace)
 {
@@ -63,7 +47,7 @@ std::string unquoteString(std::string_view str)
 
 ParserContext::ParserContext(GS2ErrorService& service)
 		: lineNumber(0), columnNumber(0), buffer(nullptr), failed(false), inputStringPtr(nullptr),
-		  lambdaFunctionCount(0), programNode(nullptr), errorService(service)
+		  lambdaFunctionCount(0), programNode(nullptr), nodeLine(0), nodeColumn(0), errorService(service)
 {
 	yylex_init_extra(this, &scanner);
 }
@@ -97,6 +81,7 @@ void ParserContext::reset()
 	constantsTable = {};
 	switchCases = {};
 	stringTable = {};
+	lineStarts.clear();
 
 	// Delete the buffer associated with the parser
 	if (buffer)
@@ -107,6 +92,8 @@ void ParserContext::reset()
 
 	lineNumber = 1;
 	columnNumber = 0;
+	nodeLine = 1;
+	nodeColumn = 1;
 	programNode = nullptr;
 	inputStringPtr = nullptr;
 	lambdaFunctionCount = 0;
@@ -115,6 +102,8 @@ void ParserContext::reset()
 
 std::string* ParserContext::saveString(const char* str, int length, bool unquote)
 {
+	GS2_ALLOC_PHASE(Scanner);
+
 	auto tmpStr = unquote ? unquoteString(std::string_view(str, length)) : std::string(str, length);
 
 	auto it = stringTable.find(tmpStr);
@@ -128,7 +117,7 @@ std::string* ParserContext::saveString(const char* str, int length, bool unquote
 
 std::string * ParserContext::generateLambdaFuncName()
 {
-	const std::string fnName = std::format("function_{}_1", 100 + lambdaFunctionCount);
+	const std::string fnName = "function_" + std::to_string(100 + lambdaFunctionCount) + "_1";
 	lambdaFunctionCount++;
 	return saveString(fnName.c_str(), static_cast<int>(fnName.length()));
 }
@@ -160,7 +149,7 @@ void ParserContext::addConstant(const std::string& ident, ExpressionIdentifierNo
 	if (getConstant(ident))
 	{
 		// report error - redefining constant
-		addParserError(std::format("redefinition of constant {}", ident));
+		addParserError("redefinition of constant " + ident);
 		return;
 	}
 
@@ -187,7 +176,7 @@ void ParserContext::addConstant(const std::string& ident, ExpressionIdentifierNo
 		else
 		{
 			// report error - constant does not exist
-			addParserError(std::format("constant {} is undefined", ident));
+			addParserError("constant " + ident + " is undefined");
 			return;
 		}
 	}
@@ -205,29 +194,50 @@ void ParserContext::addConstant(const std::string& ident, ExpressionNode *node)
 
 	if (getConstant(ident))
 	{
-		addParserError(std::format("redefinition of constant {}", ident));
+		addParserError("redefinition of constant " + ident);
 		return;
 	}
 
 	constantsTable[ident] = node;
 }
 
+std::string ParserContext::getSourceLine(uint32_t line)
+{
+	const auto& subject = *inputStringPtr;
+
+	if (lineStarts.empty())
+	{
+		lineStarts.push_back(0);
+		for (size_t pos = subject.find('\n'); pos != std::string::npos; pos = subject.find('\n', pos + 1))
+			lineStarts.push_back(pos + 1);
+	}
+
+	if (line == 0 || line > lineStarts.size())
+		return {};
+
+	auto start = lineStarts[line - 1];
+	auto end = subject.find('\n', start);
+	if (end == std::string::npos)
+		return subject.substr(start);
+	return subject.substr(start, end - start);
+}
+
 void ParserContext::addParserError(const std::string& errmsg)
 {
 	assert(inputStringPtr != nullptr);
 
 	std::string lineText;
 	if (inputStringPtr)
-		lineText = GetLineByLineNumber(*inputStringPtr, lineNumber);
+		lineText = getSourceLine(uint32_t(lineNumber));
 
 	std::string msg;
 	if (lineText.empty())
 	{
-		msg = std::format("parser error occurred near line {}: {}", lineNumber, errmsg);
+		msg = "parser error occurred near line " + std::to_string(lineNumber) + ": " + errmsg;
 	}
 	else
 	{
-		msg = std::format("{} at line {}: {}", errmsg, lineNumber, lineText);
+		msg = errmsg + " at line " + std::to_string(lineNumber) + ": " + lineText;
 	}
 
 	addError({ ErrorLevel::E_ERROR, GS2CompilerError::ErrorCategory::Parser, std::move(msg) });
@@ -239,7 +249,29 @@ bool ParserContext::parse(const std::string& source)
 
 	// Holding a pointer to the source incase we have an error msg raised
 	inputStringPtr = &source;
-	buffer = yy_scan_string(source.c_str(), scanner);
+	{
+		GS2_ALLOC_PHASE(Scanner);
+		buffer = yy_scan_string(source.c_str(), scanner);
+	}
+
+	GS2_ALLOC_PHASE(Parser);
 	yyparse(this, scanner);
 	return !failed;
 }
+
+size_t ParserContext::scan(const std::string& source)
+{
+	reset();
+
+	inputStringPtr = &source;
+	buffer = yy_scan_string(source.c_str(), scanner);
+
+	YYSTYPE lval{};
+	YYLTYPE lloc{};
+
+	size_t tokenCount = 0;
+	while (yylex(&lval, &lloc, this, scanner) != 0)
+		tokenCount++;
+
+	return tokenCount;
+}
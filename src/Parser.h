@@ -3,6 +3,7 @@
 #ifndef MYPARSER_H
 #define MYPARSER_H
 
+#include <algorithm>
 #include <memory>
 #include <optional>
 #include <string>
@@ -12,9 +13,9 @@
 #include <unordered_set>
 #include <vector>
 
-#include <format>
 #include "ast/ast.h"
 #include "exceptions/GS2CompilerError.h"
+#include "utils/AllocTracker.h"
 
 typedef void* yyscan_t;
 typedef struct yy_buffer_state* YY_BUFFER_STATE;
@@ -49,6 +50,15 @@ class ParserContext
 		 */
 		bool parse(const std::string& source);
 
+		/**
+		 * Run only the scanner over an input, discarding the tokens.
+		 * Used to measure lexing separately from parsing
+		 * @param source
+		 *
+		 * @return number of tokens scanned
+		 */
+		size_t scan(const std::string& source);
+
 		/**
 		 * Pushes a compile error to the error service
 		 * 
@@ -98,12 +108,24 @@ class ParserContext
 		 */
 		StatementBlock * getRootStatement() const;
 
+		/*
+		 * Number of nodes currently allocated by this context
+		 */
+		size_t getNodeCount() const;
+
 		/*
 		 * Used by bison to set the root statement from the parser
 		 * ** Should not be used normally
 		 */
 		void setRootStatement(StatementBlock *block);
 
+		/*
+		 * Used by bison before each reduction: nodes allocated by the rule
+		 * take the location where its first symbol starts, rather than the
+		 * scanner's position, which for compound statements is past their body
+		 */
+		void setNodeLocation(int line, int column);
+
 		/*
 		 * Allocates a node for the parser, the memory is managed
 		 * by the parser context
@@ -143,9 +165,27 @@ class ParserContext
 
 		std::vector<Node*> nodes;
 		StatementBlock* programNode;
+		int nodeLine;
+		int nodeColumn;
+
+		// Offsets of the start of each line in the input, built on the first
+		// parser error so reporting many errors stays linear
+		std::vector<size_t> lineStarts;
+		std::string getSourceLine(uint32_t line);
 		GS2ErrorService& errorService;
 };
 
+inline size_t ParserContext::getNodeCount() const
+{
+	return nodes.size();
+}
+
+inline void ParserContext::setNodeLocation(int line, int column)
+{
+	nodeLine = line;
+	nodeColumn = column;
+}
+
 /*
  * Constants Table
  */
@@ -208,7 +248,11 @@ inline void ParserContext::addError(GS2CompilerError error)
 template<typename T, typename ...P>
 inline T *ParserContext::alloc(P && ...params)
 {
+	GS2_ALLOC_PHASE(Nodes);
+
 	T *n = new T(std::forward<P>(params)...);
+	n->lineNumber = uint32_t(nodeLine);
+	n->columnNumber = uint32_t(nodeColumn);
 	nodes.push_back(n);
 	return n;
 }
@@ -221,7 +265,15 @@ inline void ParserContext::dealloc(T *n)
 {
 	if (n)
 	{
-		nodes.erase(std::remove(nodes.begin(), nodes.end(), n), nodes.end());
+		// Nodes are almost always released right after being allocated, so
+		// search from the back and swap-remove (order of nodes is irrelevant)
+		auto it = std::find(nodes.rbegin(), nodes.rend(), n);
+		if (it != nodes.rend())
+		{
+			*it = nodes.back();
+			nodes.pop_back();
+		}
+
 		delete n;
 	}
 }
@@ -50,7 +50,7 @@ void inspectNodeForUnary(Node *node)
 }
 
 Node::Node()
-	: parent(nullptr)
+	: parent(nullptr), lineNumber(0), columnNumber(0)
 {
 #ifdef DBGALLOCATIONS
 	{
@@ -51,6 +51,11 @@ public:
 	}
 
 	Node *parent;
+
+	// Position of the parser when this node was created, used for
+	// mapping bytecode back to the source
+	uint32_t lineNumber;
+	uint32_t columnNumber;
 };
 
 class StatementNode : public Node
@@ -456,6 +461,9 @@ class ExpressionBinaryOpNode : public ExpressionNode
 
 				case ExpressionOp::Concat:
 					return ExpressionType::EXPR_STRING;
+
+				default:
+					break;
 			}
 
 			return left->expressionType();
@@ -506,6 +514,9 @@ class ExpressionUnaryOpNode : public ExpressionNode
 				case ExpressionOp::UnaryMinus:
 				case ExpressionOp::UnaryNot:
 					return ExpressionType::EXPR_NUMBER;
+
+				default:
+					break;
 			}
 
 			return expr->expressionType();
@@ -696,7 +707,7 @@ public:
 	_NodeName("StatementFnDeclNode")
 
 	StatementFnDeclNode(std::string *id, std::vector<ExpressionNode *> *argList, StatementBlock *block, std::string *objName = nullptr)
-		: StatementNode(), stmtBlock(block), pub(false), emit_prejump(true), ident(id), objectName(objName)
+		: StatementNode(), pub(false), emit_prejump(true), ident(id), objectName(objName), stmtBlock(block)
 	{
 		if (argList)
 		{
@@ -726,7 +737,7 @@ public:
 	_NodeName("StatementNewNode")
 
 	StatementNewNode(std::string *objName, std::vector<ExpressionNode *> *argList, StatementBlock *block)
-		: StatementNode(), stmtBlock(block), ident(objName)
+		: StatementNode(), ident(objName), stmtBlock(block)
 	{
 		if (argList)
 		{
@@ -922,13 +933,13 @@ struct EnumMember
 	int idx;
 
 	EnumMember(std::string *n)
-		: node(n), idx(0), hasIndex(false)
+		: node(n), hasIndex(false), idx(0)
 	{
 
 	}
 
 	EnumMember(std::string *n, int idx)
-		: node(n), idx(idx), hasIndex(true)
+		: node(n), hasIndex(true), idx(idx)
 	{
 
 	}
@@ -8,17 +8,17 @@
 class ASTNodeVisitor : public NodeVisitor
 {
 public:
-	virtual void Visit(Node *node) {}
-	virtual void Visit(StatementNode *node) {}
-	virtual void Visit(ExpressionNode *node) {}
-	virtual void Visit(StatementBreakNode *node) {}
-	virtual void Visit(StatementContinueNode *node) {}
-	virtual void Visit(ExpressionIdentifierNode *node) {}
-	virtual void Visit(ExpressionStringConstNode *node) {}
-	virtual void Visit(ExpressionIntegerNode *node) {}
-	virtual void Visit(ExpressionNumberNode *node) {}
-	virtual void Visit(ExpressionConstantNode *node) {}
-	virtual void Visit(ExpressionNewArrayNode *node) {}
+	virtual void Visit(Node *) {}
+	virtual void Visit(StatementNode *) {}
+	virtual void Visit(ExpressionNode *) {}
+	virtual void Visit(StatementBreakNode *) {}
+	virtual void Visit(StatementContinueNode *) {}
+	virtual void Visit(ExpressionIdentifierNode *) {}
+	virtual void Visit(ExpressionStringConstNode *) {}
+	virtual void Visit(ExpressionIntegerNode *) {}
+	virtual void Visit(ExpressionNumberNode *) {}
+	virtual void Visit(ExpressionConstantNode *) {}
+	virtual void Visit(ExpressionNewArrayNode *) {}
 
 	virtual void Visit(StatementBlock* node)
 	{
@@ -162,8 +162,7 @@ public:
 
 	virtual void Visit(ExpressionBinaryOpNode *node)
 	{
-		node->left->visit(this);
-		node->right->visit(this);
+		visitBinaryChain(node);
 	}
 
 	virtual void Visit(ExpressionUnaryOpNode *node)
@@ -173,8 +172,7 @@ public:
 
 	virtual void Visit(ExpressionStrConcatNode *node)
 	{
-		node->left->visit(this);
-		node->right->visit(this);
+		visitBinaryChain(node);
 	}
 
 	virtual void Visit(ExpressionListNode *node)
@@ -187,6 +185,33 @@ public:
 	{
 		Visit(&node->fnNode);
 	}
+
+private:
+	static bool isBinaryNode(const ExpressionNode *node)
+	{
+		return node->NodeType() == ExpressionBinaryOpNode::NodeName || node->NodeType() == ExpressionStrConcatNode::NodeName;
+	}
+
+	/*
+	 * Left-associative chains nest one level per operator, so walk the left
+	 * spine instead of recursing. Binary nodes on the spine are visited here
+	 * rather than through their own Visit overload
+	 */
+	void visitBinaryChain(ExpressionBinaryOpNode *node)
+	{
+		std::vector<ExpressionBinaryOpNode *> spine;
+		ExpressionNode *expr = node;
+		while (isBinaryNode(expr))
+		{
+			auto link = static_cast<ExpressionBinaryOpNode *>(expr);
+			spine.push_back(link);
+			expr = link->left;
+		}
+
+		expr->visit(this);
+		for (auto it = spine.rbegin(); it != spine.rend(); ++it)
+			(*it)->right->visit(this);
+	}
 };
 
 #endif
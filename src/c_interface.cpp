@@ -1,4 +1,14 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
 #include "GS2Context.h"
+#include "daemon/DaemonClient.h"
+#include "encoding/bundle.h"
+#include "encoding/bytecodeview.h"
+#include "utils/MappedFile.h"
+#include "visitors/GS2Decompiler.h"
 
 #ifdef _WIN32
 #define DLL_EXPORT __declspec(dllexport)
@@ -13,80 +23,374 @@ extern "C" {
                 unsigned char *ByteCode;
                 uint32_t ByteCodeSize;
         };
+}
 
-        DLL_EXPORT void *get_context() {
-                return new GS2Context();
+namespace {
+        /*
+         * What get_context and gs2d_connect hand out: a compiler in this process,
+         * or a connection to gs2d. Both compile the same way
+         */
+        struct ContextHandle {
+                std::unique_ptr<GS2Context> local;
+                std::unique_ptr<DaemonClient> remote;
+
+                const CompilerOptions &getOptions() const {
+                        return local ? local->getOptions() : remote->getOptions();
+                }
+
+                void setOptions(const CompilerOptions &opts) {
+                        if (local)
+                                local->setOptions(opts);
+                        else
+                                remote->setOptions(opts);
+                }
+
+                CompilerResponse compile(const std::string &script) {
+                        return local ? local->compile(script) : remote->compile(script);
+                }
+
+                CompilerResponse compile(const std::string &script, const std::string &scriptType, const std::string &scriptName, bool saveToDisk) {
+                        return local ? local->compile(script, scriptType, scriptName, saveToDisk) : remote->compile(script, scriptType, scriptName, saveToDisk);
+                }
+        };
+
+        struct Bundle {
+                MappedFile file;
+                bundle::View view;
+        };
+
+        struct Disassembly {
+                bool success = false;
+                std::string text;   // error message when disassembly failed
+        };
+
+        struct CompileResult {
+                CompilerResponse response;
+                std::string errors;   // one message per line, as compile_code reports them
+        };
+
+        Disassembly disassembleBytecode(const uint8_t *bytecode, size_t length) {
+                Disassembly result;
+                gs2decompiler::GS2Decompiler decompiler;
+
+                // The caller's buffer is only read for the duration of the call
+                if (bytecode == nullptr || !decompiler.loadBytecode(std::span<const uint8_t>(bytecode, length))) {
+                        result.text = bytecode == nullptr ? "No bytecode given" : decompiler.getError();
+                        return result;
+                }
+
+                result.text = decompiler.decompile();
+                result.success = true;
+                return result;
         }
 
-        DLL_EXPORT Response compile_code_no_header(void *context, const char *code) {
+        /*
+         * Copies a compile response into the C struct, the errors one per line
+         * when there are any, otherwise the bytecode. Both are new[] allocations
+         * owned by the caller
+         */
+        Response toResponse(const CompilerResponse &response) {
                 Response result{};
-                result.Success = false;
-
-                auto gs2Context = (GS2Context *) context;
+                result.Success = response.success;
 
-                if (gs2Context != nullptr) {
-                        std::string script = code;
+                if (!response.errors.empty()) {
                         std::string errMsg;
-                        auto response = gs2Context->compile(script);
-
-                        if (!response.errors.empty()) {
-                                errMsg.clear();
-                                for (const auto &err: response.errors)
-                                        errMsg.append(err.msg()).append("\n");
-
-                                int lenStr = errMsg.length() + 1;
-                                result.ErrMsg = new char[lenStr];
-                                strcpy(const_cast<char *>(result.ErrMsg), errMsg.c_str());
-
-                                result.ByteCode = nullptr;
-                                result.ByteCodeSize = 0;
-                        } else {
-                                result.ErrMsg = nullptr;
-                                result.ByteCode = new unsigned char[response.bytecode.length()];  // Allocate memory
-                                memcpy((void *) result.ByteCode, response.bytecode.buffer(), response.bytecode.length());
-                                result.ByteCodeSize = response.bytecode.length();
-                        }
-                        result.Success = response.success;
+                        for (const auto &err: response.errors)
+                                errMsg.append(err.msg()).append("\n");
+
+                        result.ErrMsg = new char[errMsg.length() + 1];
+                        strcpy(const_cast<char *>(result.ErrMsg), errMsg.c_str());
+                } else {
+                        result.ByteCode = new unsigned char[response.bytecode.length()];
+                        memcpy((void *) result.ByteCode, response.bytecode.buffer(), response.bytecode.length());
+                        result.ByteCodeSize = response.bytecode.length();
                 }
 
                 return result;
         }
+}
 
-        DLL_EXPORT Response compile_code(void *context, const char *code, const char *type, const char *name) {
-                Response result{};
-                result.Success = false;
+extern "C" {
+        DLL_EXPORT void *get_context() {
+                return new ContextHandle{std::make_unique<GS2Context>(), nullptr};
+        }
 
-                auto gs2Context = (GS2Context *) context;
+        /*
+         * Connects to a running gs2d instead of compiling in this process, null
+         * or empty socketPath for the daemon's default. The handle works with
+         * every function taking a context and is released with delete_context.
+         * Returns null when no daemon is listening
+         */
+        DLL_EXPORT void *gs2d_connect(const char *socketPath) {
+                auto client = std::make_unique<DaemonClient>();
+                std::string error;
+
+                if (!client->connect(socketPath != nullptr ? socketPath : "", error))
+                        return nullptr;
+                return new ContextHandle{nullptr, std::move(client)};
+        }
+
+        /*
+         * Nanoseconds the daemon spent on the context's last request, queueing
+         * included. Always 0 for contexts from get_context
+         */
+        DLL_EXPORT uint64_t gs2d_last_latency_ns(void *context) {
+                auto handle = (ContextHandle *) context;
+                return handle != nullptr && handle->remote ? handle->remote->lastLatencyNs() : 0;
+        }
+
+        /*
+         * Writes the 128-bit fingerprint of compiled bytecode to out[0..1], the
+         * CreateHeader prefix is skipped so compile_code and compile_code_no_header
+         * output of the same script match. Scripts that only differ in comments or
+         * whitespace have the same fingerprint and don't need to be resent
+         */
+        DLL_EXPORT void bytecode_fingerprint(const uint8_t *bytecode, size_t length, uint64_t *out) {
+                if (out == nullptr)
+                        return;
+
+                auto data = bytecode != nullptr ? std::span<const uint8_t>(bytecode, length) : std::span<const uint8_t>();
+                auto fingerprint = GS2Context::ComputeFingerprint(BytecodeView::skipHeader(data));
+                out[0] = fingerprint[0];
+                out[1] = fingerprint[1];
+        }
+
+        /*
+         * With enabled set, compile_code derives the header checksum from the
+         * bytecode and salt, so identical scripts give identical output. Change
+         * the salt to force clients to refetch unchanged scripts
+         */
+        DLL_EXPORT void set_deterministic_header(void *context, bool enabled, uint64_t salt) {
+                auto gs2Context = (ContextHandle *) context;
 
                 if (gs2Context != nullptr) {
-                        std::string script = code;
-                        std::string errMsg;
-                        auto response = gs2Context->compile(script, type, name, true);
-
-                        if (!response.errors.empty()) {
-                                errMsg.clear();
-                                for (const auto &err: response.errors)
-                                        errMsg.append(err.msg()).append("\n");
-
-                                int lenStr = errMsg.length() + 1;
-                                result.ErrMsg = new char[lenStr];
-                                strcpy(const_cast<char *>(result.ErrMsg), errMsg.c_str());
-
-                                result.ByteCode = nullptr;
-                                result.ByteCodeSize = 0;
-                        } else {
-                                result.ErrMsg = nullptr;
-                                result.ByteCode = new unsigned char[response.bytecode.length()];  // Allocate memory
-                                memcpy((void *) result.ByteCode, response.bytecode.buffer(), response.bytecode.length());
-                                result.ByteCodeSize = response.bytecode.length();
-                        }
-                        result.Success = response.success;
+                        auto options = gs2Context->getOptions();
+                        options.deterministicHeader = enabled;
+                        options.headerSalt = salt;
+                        gs2Context->setOptions(options);
                 }
+        }
 
-                return result;
+        DLL_EXPORT Response compile_code_no_header(void *context, const char *code) {
+                auto gs2Context = (ContextHandle *) context;
+                if (gs2Context == nullptr)
+                        return Response{};
+
+                return toResponse(gs2Context->compile(code));
+        }
+
+        DLL_EXPORT Response compile_code(void *context, const char *code, const char *type, const char *name) {
+                auto gs2Context = (ContextHandle *) context;
+                if (gs2Context == nullptr)
+                        return Response{};
+
+                return toResponse(gs2Context->compile(code, type, name, true));
+        }
+
+        struct CompileStats {
+                uint64_t ParseNs;
+                uint64_t CodegenNs;
+                uint64_t FinalizeNs;
+                uint32_t NodeCount;
+                uint32_t StringCount;
+                uint32_t StringTableBytes;
+                uint32_t LabelCount;
+                uint32_t OutputBytes;
+                uint64_t AllocCount;
+                uint64_t AllocBytes;
+                uint64_t PeakLiveBytes;
+                bool AllocsComplete;       // false: Buffer growth only, operator new isn't hooked in the library
+        };
+
+        /*
+         * Same as compile_code_no_header, additionally filling in per-phase timings
+         * and counters when stats is not null
+         */
+        DLL_EXPORT Response compile_code_no_header_stats(void *context, const char *code, CompileStats *stats) {
+                auto gs2Context = (ContextHandle *) context;
+                if (gs2Context == nullptr)
+                        return Response{};
+
+                auto options = gs2Context->getOptions();
+                if (stats != nullptr) {
+                        auto statsOptions = options;
+                        statsOptions.collectStats = true;
+                        gs2Context->setOptions(statsOptions);
+                }
+
+                auto response = gs2Context->compile(code);
+                gs2Context->setOptions(options);
+
+                if (stats != nullptr && response.stats) {
+                        const auto &s = *response.stats;
+                        auto allocs = s.totalAllocs();
+                        *stats = CompileStats{
+                                s.parseNs, s.codegenNs, s.finalizeNs,
+                                s.nodeCount, s.stringCount, s.stringTableBytes, s.labelCount, s.outputBytes,
+                                allocs.count, allocs.bytes, s.peakLiveBytes, s.allocsComplete
+                        };
+                }
+
+                return toResponse(response);
+        }
+
+        /*
+         * Compiles length bytes of code, no terminator needed. With a type the
+         * bytecode gets the script header, as compile_code does. Returns a handle
+         * owning the response, read in place through the compile_result_ functions
+         * so nothing is copied until the caller takes it. Release it with
+         * free_compile_result. Returns null when context is null
+         */
+        DLL_EXPORT void *compile_buffer(void *context, const char *code, size_t length, const char *type, const char *name) {
+                auto gs2Context = (ContextHandle *) context;
+                if (gs2Context == nullptr)
+                        return nullptr;
+
+                auto result = std::make_unique<CompileResult>();
+                std::string script = code != nullptr ? std::string(code, length) : std::string();
+
+                if (type != nullptr)
+                        result->response = gs2Context->compile(script, type, name != nullptr ? name : "", true);
+                else
+                        result->response = gs2Context->compile(script);
+
+                for (const auto &err: result->response.errors)
+                        result->errors.append(err.msg()).append("\n");
+
+                return result.release();
+        }
+
+        DLL_EXPORT bool compile_result_success(void *handle) {
+                return handle != nullptr && ((CompileResult *) handle)->response.success;
+        }
+
+        // The compiled bytecode and its length, valid until free_compile_result
+        DLL_EXPORT const uint8_t *compile_result_bytecode(void *handle, size_t *length) {
+                size_t size = 0;
+                const uint8_t *data = nullptr;
+
+                if (handle != nullptr) {
+                        const auto &bytecode = ((CompileResult *) handle)->response.bytecode;
+                        data = bytecode.buffer();
+                        size = bytecode.length();
+                }
+
+                if (length != nullptr)
+                        *length = size;
+                return data;
+        }
+
+        DLL_EXPORT const char *compile_result_errors(void *handle) {
+                return handle != nullptr ? ((CompileResult *) handle)->errors.c_str() : "";
+        }
+
+        DLL_EXPORT void free_compile_result(void *handle) {
+                delete (CompileResult *) handle;
+        }
+
+        /*
+         * Disassembles bytecode held in memory, with or without the CreateHeader
+         * prefix. Returns a handle owning the text (or the error message when
+         * disassembly_success is false), release it with free_disassembly
+         */
+        DLL_EXPORT void *disassemble(const uint8_t *bytecode, size_t length) {
+                return new Disassembly(disassembleBytecode(bytecode, length));
+        }
+
+        DLL_EXPORT bool disassembly_success(void *handle) {
+                return handle != nullptr && ((Disassembly *) handle)->success;
+        }
+
+        DLL_EXPORT const char *disassembly_text(void *handle) {
+                return handle != nullptr ? ((Disassembly *) handle)->text.c_str() : "";
+        }
+
+        DLL_EXPORT size_t disassembly_length(void *handle) {
+                return handle != nullptr ? ((Disassembly *) handle)->text.length() : 0;
+        }
+
+        DLL_EXPORT void free_disassembly(void *handle) {
+                delete (Disassembly *) handle;
+        }
+
+        /*
+         * Disassembles into a caller-owned buffer, writing at most bufferSize - 1
+         * bytes plus a terminator. Returns the full text length, so the call can be
+         * retried with a larger buffer, or -1 when the bytecode can't be read
+         */
+        DLL_EXPORT int64_t disassemble_to_buffer(const uint8_t *bytecode, size_t length, char *buffer, size_t bufferSize) {
+                auto result = disassembleBytecode(bytecode, length);
+                if (!result.success)
+                        return -1;
+
+                if (buffer != nullptr && bufferSize > 0) {
+                        size_t count = std::min(result.text.length(), bufferSize - 1);
+                        memcpy(buffer, result.text.data(), count);
+                        buffer[count] = '\0';
+                }
+
+                return int64_t(result.text.length());
+        }
+
+        /*
+         * Maps a bundle written by gs2test --bundle. Returns null when the file
+         * can't be opened or isn't a bundle, release it with bundle_close
+         */
+        DLL_EXPORT void *bundle_open(const char *path) {
+                auto handle = std::make_unique<Bundle>();
+
+                if (path == nullptr || !handle->file.open(path) || !handle->view.open(handle->file.data()))
+                        return nullptr;
+                return handle.release();
+        }
+
+        DLL_EXPORT size_t bundle_count(void *handle) {
+                return handle != nullptr ? ((Bundle *) handle)->view.size() : 0;
+        }
+
+        /*
+         * Looks a script up by name (its path in the bundled directory without
+         * the extension, e.g. "weapons/bow"). Returns 1 and sets data and length
+         * when found, 0 when the script isn't in the bundle and -1 when its index
+         * entry points outside the file. The data is valid until bundle_close
+         */
+        DLL_EXPORT int bundle_lookup(void *handle, const char *name, const uint8_t **data, size_t *length) {
+                if (handle == nullptr || name == nullptr)
+                        return 0;
+
+                std::span<const uint8_t> found;
+                switch (((Bundle *) handle)->view.find(name, found)) {
+                        case bundle::Lookup::Missing:
+                                return 0;
+                        case bundle::Lookup::Corrupt:
+                                return -1;
+                        case bundle::Lookup::Found:
+                                break;
+                }
+
+                if (data != nullptr)
+                        *data = found.data();
+                if (length != nullptr)
+                        *length = found.size();
+                return 1;
+        }
+
+        /*
+         * Same lookup returning the script, or null when it's missing or its
+         * entry is corrupt. Use bundle_lookup to tell those apart
+         */
+        DLL_EXPORT const uint8_t *bundle_find(void *handle, const char *name, size_t *length) {
+                const uint8_t *data = nullptr;
+                if (bundle_lookup(handle, name, &data, length) != 1)
+                        return nullptr;
+                return data;
+        }
+
+        DLL_EXPORT void bundle_close(void *handle) {
+                delete (Bundle *) handle;
         }
 
         DLL_EXPORT void delete_context(void *context) {
-                delete (GS2Context *) context;
+                delete (ContextHandle *) context;
         }
 }
\ No newline at end of file
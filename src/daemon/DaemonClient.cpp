@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <cstring>
+#include "DaemonClient.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	CompilerResponse failedResponse(const std::string& error)
+	{
+		CompilerResponse response{};
+		response.success = false;
+		response.errors.emplace_back(ErrorLevel::E_ERROR, GS2CompilerError::ErrorCategory::Undefined, "gs2d: " + error);
+		return response;
+	}
+}
+
+DaemonClient::~DaemonClient()
+{
+#ifndef _WIN32
+	if (_fd >= 0)
+		::close(_fd);
+#endif
+}
+
+bool DaemonClient::connect(const std::string& socketPath, std::string& error)
+{
+#ifndef _WIN32
+	auto path = socketPath.empty() ? gs2d::defaultSocketPath() : socketPath;
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		error = "Socket path too long: " + path;
+		return false;
+	}
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+	{
+		error = "Cannot connect to " + path + ": " + std::string(strerror(errno));
+		if (fd >= 0)
+			::close(fd);
+		return false;
+	}
+
+	std::scoped_lock lock(_mutex);
+	if (_fd >= 0)
+		::close(_fd);
+	_fd = fd;
+	return true;
+#else
+	error = "gs2d requires Unix domain sockets";
+	return false;
+#endif
+}
+
+uint32_t DaemonClient::beginRequest(gs2d::Writer& request, gs2d::RequestType type)
+{
+	uint32_t id;
+	{
+		std::scoped_lock lock(_mutex);
+		id = _nextId++;
+	}
+
+	request.u8(uint8_t(type));
+	request.u32(id);
+	return id;
+}
+
+std::optional<gs2d::Reader> DaemonClient::exchange(gs2d::Writer& request, uint32_t id, std::string& response, std::string& error)
+{
+#ifndef _WIN32
+	std::scoped_lock lock(_mutex);
+	if (_fd < 0)
+	{
+		error = "Not connected";
+		return std::nullopt;
+	}
+
+	if (!gs2d::writeFrame(_fd, request.frame()) || !gs2d::readFrame(_fd, response))
+	{
+		error = "Connection lost";
+		::close(_fd);
+		_fd = -1;
+		return std::nullopt;
+	}
+
+	gs2d::Reader reader(response);
+	reader.u8();
+	uint32_t responseId = reader.u32();
+	auto status = gs2d::Status(reader.u8());
+	_lastLatencyNs = reader.u64();
+
+	if (!reader.ok() || responseId != id)
+	{
+		error = "Malformed response";
+		return std::nullopt;
+	}
+
+	if (status != gs2d::Status::Ok)
+	{
+		if (status == gs2d::Status::BadRequest)
+			error = "Request rejected";
+		else if (status == gs2d::Status::Internal)
+			error = "Request failed in the daemon";
+		else
+			error = "Request not supported by this daemon";
+		return std::nullopt;
+	}
+
+	return reader;
+#else
+	error = "Not connected";
+	return std::nullopt;
+#endif
+}
+
+CompilerResponse DaemonClient::send(gs2d::RequestType type, const gs2d::CompileRequest& request)
+{
+	gs2d::Writer writer;
+	uint32_t id = beginRequest(writer, type);
+	gs2d::encode(writer, request);
+
+	std::string response;
+	std::string error;
+	auto reader = exchange(writer, id, response, error);
+	if (!reader)
+		return failedResponse(error);
+
+	CompilerResponse result{};
+	if (!gs2d::decode(*reader, result))
+		return failedResponse("Malformed response");
+	return result;
+}
+
+CompilerResponse DaemonClient::compile(const std::string& script)
+{
+	gs2d::CompileRequest request;
+	request.source = script;
+	request.options = _options;
+	return send(gs2d::RequestType::Compile, request);
+}
+
+CompilerResponse DaemonClient::compile(const std::string& script, const std::string& scriptType, const std::string& scriptName, bool saveToDisk)
+{
+	gs2d::CompileRequest request;
+	request.source = script;
+	request.header = true;
+	request.scriptType = scriptType;
+	request.scriptName = scriptName;
+	request.saveToDisk = saveToDisk;
+	request.options = _options;
+	return send(gs2d::RequestType::Compile, request);
+}
+
+CompilerResponse DaemonClient::check(const std::string& script)
+{
+	gs2d::CompileRequest request;
+	request.source = script;
+	request.options = _options;
+	return send(gs2d::RequestType::Check, request);
+}
+
+std::vector<CompilerResponse> DaemonClient::compileBatch(const std::vector<gs2d::CompileRequest>& requests)
+{
+	gs2d::Writer writer;
+	uint32_t id = beginRequest(writer, gs2d::RequestType::CompileBatch);
+	writer.u32(uint32_t(requests.size()));
+	for (const auto& request : requests)
+		gs2d::encode(writer, request);
+
+	std::vector<CompilerResponse> results;
+	results.reserve(requests.size());
+
+	std::string response;
+	std::string error;
+	auto reader = exchange(writer, id, response, error);
+
+	if (reader && reader->u32() == requests.size())
+	{
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			CompilerResponse result{};
+			if (!gs2d::decode(*reader, result))
+				break;
+			results.push_back(std::move(result));
+		}
+	}
+
+	if (results.size() != requests.size())
+	{
+		results.clear();
+		for (size_t i = 0; i < requests.size(); i++)
+			results.push_back(failedResponse(reader ? "Malformed response" : error));
+	}
+
+	return results;
+}
+
+bool DaemonClient::disassemble(std::span<const uint8_t> bytecode, std::string& text)
+{
+	gs2d::Writer writer;
+	uint32_t id = beginRequest(writer, gs2d::RequestType::Disassemble);
+	writer.bytes(bytecode.data(), bytecode.size());
+
+	std::string response;
+	std::string error;
+	auto reader = exchange(writer, id, response, error);
+	if (!reader)
+	{
+		text = "gs2d: " + error;
+		return false;
+	}
+
+	bool success = reader->u8() != 0;
+	text = reader->bytes();
+	if (!reader->ok())
+	{
+		text = "gs2d: Malformed response";
+		return false;
+	}
+	return success;
+}
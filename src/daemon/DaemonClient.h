@@ -0,0 +1,71 @@
+#pragma once
+
+#ifndef DAEMONCLIENT_H
+#define DAEMONCLIENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "DaemonProtocol.h"
+#include "GS2Context.h"
+
+/*
+ * Connection to a running gs2d. Mirrors the GS2Context compile interface, so
+ * callers can swap a local context for the daemon. Requests are serialized on
+ * the one connection, open several clients to compile in parallel. Options
+ * aren't synchronized, as with GS2Context: set them before sharing the client
+ * between threads, not while another thread compiles. When the daemon goes away
+ * compiles fail with a "gs2d: ..." error.
+ */
+class DaemonClient
+{
+public:
+	DaemonClient() = default;
+	~DaemonClient();
+
+	DaemonClient(const DaemonClient&) = delete;
+	DaemonClient& operator=(const DaemonClient&) = delete;
+
+	// Empty path for gs2d::defaultSocketPath(). Returns false with error set when nothing listens there
+	bool connect(const std::string& socketPath, std::string& error);
+
+	const CompilerOptions& getOptions() const { return _options; }
+	void setOptions(const CompilerOptions& opts) { _options = opts; }
+
+	CompilerResponse compile(const std::string& script);
+	CompilerResponse compile(const std::string& script, const std::string& scriptType, const std::string& scriptName, bool saveToDisk);
+
+	// Compiled across the daemon's workers, results in request order
+	std::vector<CompilerResponse> compileBatch(const std::vector<gs2d::CompileRequest>& requests);
+
+	// Errors only, no bytecode is sent back
+	CompilerResponse check(const std::string& script);
+
+	// text holds the disassembly, or the error when false is returned
+	bool disassemble(std::span<const uint8_t> bytecode, std::string& text);
+
+	// Time the daemon spent on the last request, queueing included
+	uint64_t lastLatencyNs() const { return _lastLatencyNs; }
+
+private:
+	// Sends the request and waits for its response, leaving reader on the response body
+	std::optional<gs2d::Reader> exchange(gs2d::Writer& request, uint32_t id, std::string& response, std::string& error);
+
+	uint32_t beginRequest(gs2d::Writer& request, gs2d::RequestType type);
+	CompilerResponse send(gs2d::RequestType type, const gs2d::CompileRequest& request);
+
+	// Guarded by _mutex
+	int _fd = -1;
+	uint32_t _nextId = 1;
+	std::mutex _mutex;
+
+	// Read by every compile without the lock, see above
+	CompilerOptions _options;
+	std::atomic<uint64_t> _lastLatencyNs = 0;
+};
+
+#endif
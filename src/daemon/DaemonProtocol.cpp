@@ -0,0 +1,310 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "DaemonProtocol.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace gs2d
+{
+	std::string defaultSocketPath()
+	{
+		if (const char *runtimeDir = std::getenv("XDG_RUNTIME_DIR"); runtimeDir && *runtimeDir)
+			return std::string(runtimeDir) + "/gs2d.sock";
+
+#ifndef _WIN32
+		return "/tmp/gs2d-" + std::to_string(getuid()) + "/gs2d.sock";
+#else
+		return "gs2d.sock";
+#endif
+	}
+
+	Writer::Writer()
+	{
+		_data.resize(4);
+	}
+
+	void Writer::u8(uint8_t val)
+	{
+		_data.push_back(char(val));
+	}
+
+	void Writer::u32(uint32_t val)
+	{
+		for (int i = 0; i < 4; i++)
+			_data.push_back(char(val >> (i * 8)));
+	}
+
+	void Writer::u64(uint64_t val)
+	{
+		for (int i = 0; i < 8; i++)
+			_data.push_back(char(val >> (i * 8)));
+	}
+
+	void Writer::bytes(const void *data, size_t length)
+	{
+		u32(uint32_t(length));
+		if (length > 0)
+			_data.append(static_cast<const char *>(data), length);
+	}
+
+	const std::string& Writer::frame()
+	{
+		auto length = uint32_t(_data.size() - 4);
+		for (int i = 0; i < 4; i++)
+			_data[i] = char(length >> (i * 8));
+		return _data;
+	}
+
+	bool Reader::take(size_t length)
+	{
+		if (!_ok || _data.size() - _pos < length)
+		{
+			_ok = false;
+			return false;
+		}
+		return true;
+	}
+
+	uint8_t Reader::u8()
+	{
+		if (!take(1))
+			return 0;
+		return uint8_t(_data[_pos++]);
+	}
+
+	uint32_t Reader::u32()
+	{
+		if (!take(4))
+			return 0;
+
+		uint32_t val = 0;
+		for (int i = 0; i < 4; i++)
+			val |= uint32_t(uint8_t(_data[_pos++])) << (i * 8);
+		return val;
+	}
+
+	uint64_t Reader::u64()
+	{
+		if (!take(8))
+			return 0;
+
+		uint64_t val = 0;
+		for (int i = 0; i < 8; i++)
+			val |= uint64_t(uint8_t(_data[_pos++])) << (i * 8);
+		return val;
+	}
+
+	std::string_view Reader::bytes()
+	{
+		uint32_t length = u32();
+		if (!take(length))
+			return {};
+
+		auto val = _data.substr(_pos, length);
+		_pos += length;
+		return val;
+	}
+
+	void encode(Writer& writer, const CompileRequest& request)
+	{
+		uint8_t requestFlags = 0;
+		if (request.header)
+			requestFlags |= flags::Header;
+		if (request.saveToDisk)
+			requestFlags |= flags::SaveToDisk;
+		if (request.options.emitLineTable)
+			requestFlags |= flags::LineTable;
+		if (request.options.deterministicHeader)
+			requestFlags |= flags::DeterministicHeader;
+		if (request.options.collectStats)
+			requestFlags |= flags::Stats;
+
+		writer.u8(requestFlags);
+		writer.u64(request.options.headerSalt);
+		if (request.header)
+		{
+			writer.str(request.scriptType);
+			writer.str(request.scriptName);
+		}
+		writer.str(request.source);
+	}
+
+	bool decode(Reader& reader, CompileRequest& request)
+	{
+		uint8_t requestFlags = reader.u8();
+		request.header = requestFlags & flags::Header;
+		request.saveToDisk = requestFlags & flags::SaveToDisk;
+		request.options.emitLineTable = requestFlags & flags::LineTable;
+		request.options.deterministicHeader = requestFlags & flags::DeterministicHeader;
+		request.options.collectStats = requestFlags & flags::Stats;
+		request.options.headerSalt = reader.u64();
+
+		if (request.header)
+		{
+			request.scriptType = reader.bytes();
+			request.scriptName = reader.bytes();
+		}
+		request.source = reader.bytes();
+		return reader.ok();
+	}
+
+	void encode(Writer& writer, const CompilerResponse& response, bool withBytecode)
+	{
+		writer.u8(response.success);
+
+		writer.u32(uint32_t(response.errors.size()));
+		for (const auto& error : response.errors)
+		{
+			writer.u8(uint8_t(error.level()));
+			writer.u8(uint8_t(error.code()));
+			writer.str(error.msg());
+		}
+
+		writer.u32(uint32_t(response.joinedClasses.size()));
+		for (const auto& name : response.joinedClasses)
+			writer.str(name);
+
+		if (withBytecode)
+		{
+			writer.bytes(response.bytecode.buffer(), response.bytecode.length());
+			writer.bytes(response.lineTable.buffer(), response.lineTable.length());
+		}
+		else
+		{
+			writer.bytes(nullptr, 0);
+			writer.bytes(nullptr, 0);
+		}
+
+		writer.u64(response.fingerprint[0]);
+		writer.u64(response.fingerprint[1]);
+
+		writer.u8(response.stats.has_value());
+		if (response.stats)
+		{
+			const auto& stats = *response.stats;
+			writer.u64(stats.parseNs);
+			writer.u64(stats.codegenNs);
+			writer.u64(stats.finalizeNs);
+			writer.u32(stats.nodeCount);
+			writer.u32(stats.stringCount);
+			writer.u32(stats.stringTableBytes);
+			writer.u32(stats.labelCount);
+			writer.u32(stats.outputBytes);
+			for (const auto& phase : stats.allocs)
+			{
+				writer.u64(phase.count);
+				writer.u64(phase.bytes);
+			}
+			writer.u64(stats.peakLiveBytes);
+			writer.u8(stats.allocsComplete);
+		}
+	}
+
+	bool decode(Reader& reader, CompilerResponse& response)
+	{
+		response.success = reader.u8() != 0;
+
+		uint32_t errorCount = reader.u32();
+		for (uint32_t i = 0; i < errorCount && reader.ok(); i++)
+		{
+			auto level = ErrorLevel(reader.u8());
+			auto category = GS2CompilerError::ErrorCategory(reader.u8());
+			response.errors.emplace_back(level, category, std::string(reader.bytes()));
+		}
+
+		uint32_t classCount = reader.u32();
+		for (uint32_t i = 0; i < classCount && reader.ok(); i++)
+			response.joinedClasses.emplace(reader.bytes());
+
+		if (auto bytecode = reader.bytes(); !bytecode.empty())
+			response.bytecode.write(bytecode.data(), bytecode.size());
+		if (auto lineTable = reader.bytes(); !lineTable.empty())
+			response.lineTable.write(lineTable.data(), lineTable.size());
+
+		response.fingerprint[0] = reader.u64();
+		response.fingerprint[1] = reader.u64();
+
+		if (reader.u8())
+		{
+			CompilerStats stats;
+			stats.parseNs = reader.u64();
+			stats.codegenNs = reader.u64();
+			stats.finalizeNs = reader.u64();
+			stats.nodeCount = reader.u32();
+			stats.stringCount = reader.u32();
+			stats.stringTableBytes = reader.u32();
+			stats.labelCount = reader.u32();
+			stats.outputBytes = reader.u32();
+			for (auto& phase : stats.allocs)
+			{
+				phase.count = reader.u64();
+				phase.bytes = reader.u64();
+			}
+			stats.peakLiveBytes = reader.u64();
+			stats.allocsComplete = reader.u8() != 0;
+			response.stats = stats;
+		}
+
+		return reader.ok();
+	}
+
+#ifndef _WIN32
+	namespace
+	{
+		bool readAll(int fd, char *data, size_t length)
+		{
+			while (length > 0)
+			{
+				ssize_t count = recv(fd, data, length, 0);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count <= 0)
+					return false;
+
+				data += count;
+				length -= size_t(count);
+			}
+			return true;
+		}
+	}
+
+	bool readFrame(int fd, std::string& payload)
+	{
+		unsigned char prefix[4];
+		if (!readAll(fd, reinterpret_cast<char *>(prefix), sizeof(prefix)))
+			return false;
+
+		uint32_t length = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) | (uint32_t(prefix[3]) << 24);
+		if (length > MAX_FRAME)
+			return false;
+
+		payload.resize(length);
+		return readAll(fd, payload.data(), length);
+	}
+
+	bool writeFrame(int fd, std::string_view frame)
+	{
+#ifdef MSG_NOSIGNAL
+		constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+		constexpr int SEND_FLAGS = 0;
+#endif
+
+		while (!frame.empty())
+		{
+			ssize_t count = send(fd, frame.data(), frame.size(), SEND_FLAGS);
+			if (count < 0 && errno == EINTR)
+				continue;
+			if (count <= 0)
+				return false;
+
+			frame.remove_prefix(size_t(count));
+		}
+		return true;
+	}
+#endif
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#ifndef DAEMONPROTOCOL_H
+#define DAEMONPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "GS2Context.h"
+
+/*
+ * Wire format between gs2d and DaemonClient, over a Unix stream socket.
+ *
+ * Every message is a frame: u32 payload length, then the payload. Integers are
+ * little-endian, strings and byte blobs are a u32 length followed by the data.
+ *
+ *   request:  u8 type, u32 id, body
+ *   response: u8 type, u32 id, u8 status, u64 server latency (ns), body
+ *
+ * Requests on one connection may be answered out of order, match them by id.
+ * The latency covers queueing and compiling, from the request being read to
+ * the response being sent.
+ *
+ *   Compile       CompileRequest            -> CompilerResponse
+ *   CompileBatch  u32 count, CompileRequest -> u32 count, CompilerResponse (same order)
+ *   Check         CompileRequest            -> CompilerResponse without bytecode
+ *   Disassemble   bytes bytecode            -> u8 success, str text or error
+ */
+namespace gs2d
+{
+	// Larger frames close the connection
+	constexpr uint32_t MAX_FRAME = 64 * 1024 * 1024;
+
+	enum class RequestType : uint8_t
+	{
+		Compile = 1,
+		CompileBatch = 2,
+		Check = 3,
+		Disassemble = 4
+	};
+
+	enum class Status : uint8_t
+	{
+		Ok = 0,
+		BadRequest = 1,		// the body couldn't be decoded
+		Unsupported = 2,	// unknown request type
+		Internal = 3		// the daemon failed while handling it, e.g. out of memory
+	};
+
+	// CompileRequest flags
+	namespace flags
+	{
+		constexpr uint8_t Header = 1;				// u32 script type and name follow the salt
+		constexpr uint8_t SaveToDisk = 2;
+		constexpr uint8_t LineTable = 4;
+		constexpr uint8_t DeterministicHeader = 8;
+		constexpr uint8_t Stats = 16;
+	}
+
+	struct CompileRequest
+	{
+		std::string source;
+
+		// Prefix the bytecode with the script header, as GS2Context::compile(script, type, name, saveToDisk)
+		bool header = false;
+		std::string scriptType;
+		std::string scriptName;
+		bool saveToDisk = false;
+
+		CompilerOptions options;
+	};
+
+	// $XDG_RUNTIME_DIR/gs2d.sock, or /tmp/gs2d-<uid>/gs2d.sock
+	std::string defaultSocketPath();
+
+	// Builds one frame, the length prefix is filled in by frame()
+	class Writer
+	{
+	public:
+		Writer();
+
+		void u8(uint8_t val);
+		void u32(uint32_t val);
+		void u64(uint64_t val);
+		void bytes(const void *data, size_t length);
+		void str(std::string_view val) { bytes(val.data(), val.size()); }
+
+		const std::string& frame();
+
+	private:
+		std::string _data;
+	};
+
+	// Reads a payload. Reads past the end return zero/empty and clear ok()
+	class Reader
+	{
+	public:
+		explicit Reader(std::string_view data)
+			: _data(data)
+		{
+		}
+
+		uint8_t u8();
+		uint32_t u32();
+		uint64_t u64();
+		std::string_view bytes();
+
+		bool ok() const { return _ok; }
+		bool atEnd() const { return _pos == _data.size(); }
+
+	private:
+		bool take(size_t length);
+
+		std::string_view _data;
+		size_t _pos = 0;
+		bool _ok = true;
+	};
+
+	void encode(Writer& writer, const CompileRequest& request);
+	bool decode(Reader& reader, CompileRequest& request);
+
+	// Check responses leave out the bytecode and line table
+	void encode(Writer& writer, const CompilerResponse& response, bool withBytecode);
+	bool decode(Reader& reader, CompilerResponse& response);
+
+#ifndef _WIN32
+	// Blocking frame I/O on a socket, false once the peer is gone or the frame is too large
+	bool readFrame(int fd, std::string& payload);
+	bool writeFrame(int fd, std::string_view frame);
+#endif
+}
+
+#endif
@@ -9,6 +9,8 @@ void Buffer::resize(size_t len)
 	if (buf)
 	{
 		auto tmp = buf;
+		GS2_ALLOC_RELEASE(buflen);
+
 		buflen = (len > buflen ? len : buflen * 2);
 		buf = (uint8_t *)realloc(buf, buflen);
 		assert(buf);
@@ -16,6 +18,8 @@ void Buffer::resize(size_t len)
 		// silencing msvc warning C6308
 		if (!buf)
 			free(tmp);
+
+		GS2_ALLOC_RECORD(Buffer, buflen);
 	}
 	else
 	{
@@ -24,6 +28,8 @@ void Buffer::resize(size_t len)
 		
 		buf = (uint8_t *)malloc(len);
 		buflen = len;
+
+		GS2_ALLOC_RECORD(Buffer, buflen);
 	}
 }
 
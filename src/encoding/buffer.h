@@ -8,6 +8,7 @@
 #include <cstddef>
 #include <cstdlib>
 #include <utility>
+#include "utils/AllocTracker.h"
 
 class Buffer
 {
@@ -81,6 +82,7 @@ inline Buffer::Buffer(size_t len)
 }
 
 inline Buffer::Buffer(Buffer&& o) noexcept
+    : Buffer()
 {
     *this = std::move(o);
 }
@@ -89,12 +91,22 @@ inline Buffer::~Buffer()
 {
     if (buf)
     {
+        GS2_ALLOC_RELEASE(buflen);
         free(buf);
     }
 }
 
 inline Buffer& Buffer::operator=(Buffer&& o) noexcept
 {
+    if (this == &o)
+        return *this;
+
+    if (buf)
+    {
+        GS2_ALLOC_RELEASE(buflen);
+        free(buf);
+    }
+
 	buf = o.buf;
     buflen = o.buflen;
     readpos = o.readpos;
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include "bundle.h"
+
+namespace
+{
+	void writeU32(Buffer& buf, uint32_t val)
+	{
+		for (int i = 0; i < 4; i++)
+			buf.write(char(val >> (i * 8)));
+	}
+
+	void writeU64(Buffer& buf, uint64_t val)
+	{
+		for (int i = 0; i < 8; i++)
+			buf.write(char(val >> (i * 8)));
+	}
+
+	uint32_t readU32(const uint8_t *data)
+	{
+		return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24;
+	}
+
+	uint64_t readU64(const uint8_t *data)
+	{
+		return uint64_t(readU32(data)) | uint64_t(readU32(data + 4)) << 32;
+	}
+
+	uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + bundle::ALIGNMENT - 1) / bundle::ALIGNMENT * bundle::ALIGNMENT;
+	}
+
+	void pad(Buffer& buf, uint64_t offset)
+	{
+		while (buf.length() < offset)
+			buf.write(char(0));
+	}
+}
+
+namespace bundle
+{
+	bool Writer::add(std::string name, Buffer data)
+	{
+		if (!_names.insert(name).second)
+			return false;
+
+		_entries.push_back({ std::move(name), std::move(data) });
+		return true;
+	}
+
+	Buffer Writer::encode()
+	{
+		std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) {
+			return a.name < b.name;
+		});
+
+		// Lay everything out first so the index can be written in one pass
+		uint64_t indexOffset = HEADER_SIZE;
+		uint64_t namesOffset = indexOffset + _entries.size() * INDEX_ENTRY_SIZE;
+		uint64_t namesLength = 0;
+		for (const auto& entry : _entries)
+			namesLength += entry.name.length();
+
+		std::vector<uint64_t> dataOffsets;
+		dataOffsets.reserve(_entries.size());
+
+		uint64_t offset = namesOffset + namesLength;
+		for (const auto& entry : _entries)
+		{
+			offset = alignUp(offset);
+			dataOffsets.push_back(offset);
+			offset += entry.data.length();
+		}
+		uint64_t fileSize = offset;
+
+		Buffer buf{ size_t(fileSize) };
+		buf.write("GS2B", 4);
+		writeU32(buf, VERSION);
+		writeU32(buf, uint32_t(_entries.size()));
+		writeU32(buf, ALIGNMENT);
+		writeU64(buf, indexOffset);
+		writeU64(buf, namesOffset);
+		writeU64(buf, fileSize);
+
+		uint32_t nameOffset = 0;
+		for (size_t i = 0; i < _entries.size(); i++)
+		{
+			writeU32(buf, nameOffset);
+			writeU32(buf, uint32_t(_entries[i].name.length()));
+			writeU64(buf, dataOffsets[i]);
+			writeU64(buf, _entries[i].data.length());
+			nameOffset += uint32_t(_entries[i].name.length());
+		}
+
+		for (const auto& entry : _entries)
+			buf.write(entry.name.data(), entry.name.length());
+
+		for (size_t i = 0; i < _entries.size(); i++)
+		{
+			pad(buf, dataOffsets[i]);
+			if (_entries[i].data.length() > 0)
+				buf.write(_entries[i].data);
+		}
+
+		return buf;
+	}
+
+	bool View::open(std::span<const uint8_t> data)
+	{
+		_data = {};
+		_count = 0;
+
+		if (data.size() < HEADER_SIZE || data[0] != 'G' || data[1] != 'S' || data[2] != '2' || data[3] != 'B'
+			|| readU32(data.data() + 4) != VERSION)
+			return false;
+
+		uint64_t count = readU32(data.data() + 8);
+		uint64_t indexOffset = readU64(data.data() + 16);
+		uint64_t namesOffset = readU64(data.data() + 24);
+		uint64_t fileSize = readU64(data.data() + 32);
+
+		// A truncated file, or an index that doesn't fit before the names
+		if (fileSize != data.size() || indexOffset > namesOffset || namesOffset > data.size()
+			|| (namesOffset - indexOffset) / INDEX_ENTRY_SIZE < count)
+			return false;
+
+		_data = data;
+		_count = size_t(count);
+		_indexOffset = indexOffset;
+		_namesOffset = namesOffset;
+		return true;
+	}
+
+	std::optional<std::string_view> View::nameAt(size_t index) const
+	{
+		const uint8_t *entry = _data.data() + _indexOffset + index * INDEX_ENTRY_SIZE;
+		uint64_t offset = _namesOffset + readU32(entry);
+		uint64_t length = readU32(entry + 4);
+
+		if (offset > _data.size() || _data.size() - offset < length)
+			return std::nullopt;
+		return std::string_view{ reinterpret_cast<const char *>(_data.data() + offset), size_t(length) };
+	}
+
+	std::optional<View::Entry> View::entry(size_t index) const
+	{
+		if (index >= _count)
+			return std::nullopt;
+
+		const uint8_t *entry = _data.data() + _indexOffset + index * INDEX_ENTRY_SIZE;
+		uint64_t offset = readU64(entry + 8);
+		uint64_t length = readU64(entry + 16);
+
+		auto name = nameAt(index);
+		if (!name || offset > _data.size() || _data.size() - offset < length)
+			return std::nullopt;
+		return Entry{ *name, _data.subspan(size_t(offset), size_t(length)) };
+	}
+
+	Lookup View::find(std::string_view name, std::span<const uint8_t>& data) const
+	{
+		size_t low = 0;
+		size_t high = _count;
+
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			auto candidate = nameAt(mid);
+
+			// The search can't go on without the name to compare against
+			if (!candidate)
+				return Lookup::Corrupt;
+
+			if (*candidate < name)
+				low = mid + 1;
+			else if (name < *candidate)
+				high = mid;
+			else
+			{
+				auto found = entry(mid);
+				if (!found)
+					return Lookup::Corrupt;
+
+				data = found->data;
+				return Lookup::Found;
+			}
+		}
+
+		return Lookup::Missing;
+	}
+}
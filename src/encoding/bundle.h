@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+#include "buffer.h"
+
+/*
+ * A set of compiled scripts in one file, meant to be memory mapped and read
+ * in place.
+ *
+ * Layout, integers little-endian:
+ *   "GS2B" [version: u32] [count: u32] [alignment: u32]
+ *          [index offset: u64] [names offset: u64] [file size: u64]
+ *   index:    count x [name offset: u32] [name length: u32] [data offset: u64] [data length: u64]
+ *   names:    back to back, name offsets are relative to the names offset
+ *   payloads: script bytecode as written by GS2Context::CreateHeader, each
+ *             starting on a multiple of the alignment
+ *
+ * The index is sorted by name (bytewise), so a lookup is a binary search that
+ * only touches the index entries and names it compares against.
+ */
+namespace bundle
+{
+	constexpr uint32_t VERSION = 1;
+	constexpr uint32_t ALIGNMENT = 16;
+
+	constexpr size_t HEADER_SIZE = 40;
+	constexpr size_t INDEX_ENTRY_SIZE = 24;
+
+	// Missing means no script has the name, Corrupt that its index entry points
+	// outside the file
+	enum class Lookup
+	{
+		Found,
+		Missing,
+		Corrupt
+	};
+
+	class Writer
+	{
+	public:
+		// False when a script of that name was already added
+		bool add(std::string name, Buffer data);
+
+		size_t size() const { return _entries.size(); }
+
+		Buffer encode();
+
+	private:
+		struct Entry
+		{
+			std::string name;
+			Buffer data;
+		};
+
+		std::vector<Entry> _entries;
+		std::unordered_set<std::string> _names;
+	};
+
+	/*
+	 * Read-only view over a bundle, nothing is copied and the data must outlive
+	 * the view. open() only checks the header, index entries are bounds-checked
+	 * as they're read
+	 */
+	class View
+	{
+	public:
+		struct Entry
+		{
+			std::string_view name;
+			std::span<const uint8_t> data;
+		};
+
+		bool open(std::span<const uint8_t> data);
+
+		size_t size() const { return _count; }
+
+		// Index order, which is sorted by name. nullopt when the entry is out of bounds
+		std::optional<Entry> entry(size_t index) const;
+
+		// Sets data only when the script is found
+		Lookup find(std::string_view name, std::span<const uint8_t>& data) const;
+
+	private:
+		std::optional<std::string_view> nameAt(size_t index) const;
+
+		std::span<const uint8_t> _data;
+		size_t _count = 0;
+		uint64_t _indexOffset = 0;
+		uint64_t _namesOffset = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <array>
+#include "bytecodeview.h"
+
+namespace
+{
+	uint32_t readU32(const uint8_t *p)
+	{
+		return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+	}
+
+	// Big-endian value of 1, 2 or 4 bytes, sign extended
+	int32_t readSigned(const uint8_t *p, int byteCount)
+	{
+		if (byteCount == 1)
+			return int8_t(p[0]);
+		if (byteCount == 2)
+			return int16_t((uint16_t(p[0]) << 8) | uint16_t(p[1]));
+		return int32_t(readU32(p));
+	}
+
+	uint32_t readUnsigned(const uint8_t *p, int byteCount)
+	{
+		if (byteCount == 1)
+			return p[0];
+		if (byteCount == 2)
+			return (uint32_t(p[0]) << 8) | uint32_t(p[1]);
+		return readU32(p);
+	}
+
+	// Length of a null-terminated string starting at pos, the terminator may be missing at the end of data
+	size_t cstrLength(std::span<const uint8_t> data, size_t pos)
+	{
+		auto end = std::find(data.begin() + pos, data.end(), uint8_t(0));
+		return size_t(end - (data.begin() + pos));
+	}
+
+	std::string_view asString(std::span<const uint8_t> data, size_t pos, size_t len)
+	{
+		return { reinterpret_cast<const char *>(data.data() + pos), len };
+	}
+}
+
+BytecodeView::BytecodeView(std::span<const uint8_t> data)
+	: _data(data)
+{
+}
+
+bool BytecodeView::fail(std::string msg) const
+{
+	_error = std::move(msg);
+	return false;
+}
+
+bool BytecodeView::index() const
+{
+	return indexSegments() && indexFunctions() && indexStrings();
+}
+
+bool BytecodeView::indexSegments() const
+{
+	if (_segmentsIndexed)
+		return _error.empty();
+	_segmentsIndexed = true;
+
+	size_t pos = 0;
+
+	// A trailing partial segment header is ignored
+	while (pos + 8 <= _data.size())
+	{
+		uint32_t type = readU32(_data.data() + pos);
+		uint32_t length = readU32(_data.data() + pos + 4);
+		pos += 8;
+
+		if (type < GS1FLAGS || type > BYTECODE)
+			return fail("Invalid segment type: " + std::to_string(type));
+
+		if (length > _data.size() - pos)
+			return fail("Segment extends beyond file bounds");
+
+		_segments.push_back({ type, pos, length });
+		pos += length;
+	}
+
+	return true;
+}
+
+std::span<const uint8_t> BytecodeView::segment(Segment type) const
+{
+	if (indexSegments())
+	{
+		for (const auto& seg : _segments)
+		{
+			if (seg.type == type)
+				return _data.subspan(seg.offset, seg.length);
+		}
+	}
+
+	return {};
+}
+
+std::span<const uint8_t> BytecodeView::skipHeader(std::span<const uint8_t> data)
+{
+	// Raw bytecode starts with a big-endian segment type
+	auto isSegmentStart = [&](size_t pos) {
+		return pos + 4 <= data.size() && data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 0
+			&& data[pos + 3] >= GS1FLAGS && data[pos + 3] <= BYTECODE;
+	};
+
+	if (isSegmentStart(0) || data.size() < 2 || data[0] < 32 || data[1] < 32)
+		return data;
+
+	// The header length is a GraalShort: two bytes of 7 bits each, offset by 32
+	size_t headerLength = (size_t(data[0] - 32) << 7) + size_t(data[1] - 32);
+	size_t start = 2 + headerLength;
+
+	return isSegmentStart(start) ? data.subspan(start) : data;
+}
+
+bool BytecodeView::indexFunctions() const
+{
+	if (_functionsIndexed)
+		return _error.empty();
+	_functionsIndexed = true;
+
+	if (!indexSegments())
+		return false;
+
+	// Names may run past the segment into the rest of the data, same as the original reader
+	for (const auto& seg : _segments)
+	{
+		if (seg.type != FUNCTIONTABLE)
+			continue;
+
+		size_t pos = seg.offset;
+		while (pos < seg.offset + seg.length)
+		{
+			if (pos + 4 > _data.size())
+				return fail("Invalid function table entry");
+
+			uint32_t opIndex = readU32(_data.data() + pos);
+			pos += 4;
+
+			size_t len = cstrLength(_data, pos);
+			_functions.push_back({ asString(_data, pos, len), opIndex });
+			pos += len + (pos + len < _data.size() ? 1 : 0);
+		}
+	}
+
+	_functionOrder.resize(_functions.size());
+	for (uint32_t i = 0; i < _functionOrder.size(); i++)
+		_functionOrder[i] = i;
+
+	std::stable_sort(_functionOrder.begin(), _functionOrder.end(), [this](uint32_t a, uint32_t b) {
+		return _functions[a].opIndex < _functions[b].opIndex;
+	});
+
+	_functionRank.resize(_functions.size());
+	for (uint32_t i = 0; i < _functionOrder.size(); i++)
+		_functionRank[_functionOrder[i]] = i;
+
+	return true;
+}
+
+const std::vector<BytecodeView::Function>& BytecodeView::functions() const
+{
+	indexFunctions();
+	return _functions;
+}
+
+bool BytecodeView::indexStrings() const
+{
+	if (_stringsIndexed)
+		return _error.empty();
+	_stringsIndexed = true;
+
+	if (!indexSegments())
+		return false;
+
+	for (const auto& seg : _segments)
+	{
+		if (seg.type != STRINGTABLE)
+			continue;
+
+		size_t pos = seg.offset;
+		while (pos < seg.offset + seg.length)
+		{
+			_stringOffsets.push_back(uint32_t(pos));
+			size_t len = cstrLength(_data, pos);
+			pos += len + (pos + len < _data.size() ? 1 : 0);
+		}
+	}
+
+	return true;
+}
+
+size_t BytecodeView::stringCount() const
+{
+	indexStrings();
+	return _stringOffsets.size();
+}
+
+std::string_view BytecodeView::string(size_t index) const
+{
+	if (!indexStrings() || index >= _stringOffsets.size())
+		return {};
+
+	size_t pos = _stringOffsets[index];
+	return asString(_data, pos, cstrLength(_data, pos));
+}
+
+namespace
+{
+	using OperandKind = BytecodeView::OperandKind;
+
+	constexpr std::array<OperandKind, 256> operandKinds = [] {
+		std::array<OperandKind, 256> kinds{};
+		for (auto op : { opcode::OP_SET_INDEX, opcode::OP_SET_INDEX_TRUE, opcode::OP_JMP, opcode::OP_IF,
+						 opcode::OP_AND, opcode::OP_OR, opcode::OP_WITH, opcode::OP_FOREACH, opcode::OP_WITHEND })
+			kinds[op] = OperandKind::Jump;
+
+		kinds[opcode::OP_TYPE_NUMBER] = OperandKind::Number;
+		kinds[opcode::OP_TYPE_STRING] = OperandKind::StringRef;
+		kinds[opcode::OP_TYPE_VAR] = OperandKind::StringRef;
+		return kinds;
+	}();
+
+	// Operand byte count per kind and prefix (0xF0 - 0xF6), 0 when the prefix isn't
+	// valid for the kind, TEXT_OPERAND for a null-terminated string
+	constexpr int8_t TEXT_OPERAND = -1;
+	constexpr int8_t operandWidths[4][7] = {
+		{ 0, 0, 0, 0, 0, 0, 0 },	// None
+		{ 0, 0, 0, 1, 2, 4, 0 },	// Jump: signed, 0xF3 - 0xF5
+		{ 1, 2, 4, 1, 2, 4, -1 },	// Number: 0xF6 is a null-terminated double
+		{ 1, 2, 4, 0, 0, 0, 0 },	// StringRef: unsigned, 0xF0 - 0xF2
+	};
+}
+
+BytecodeView::OperandKind BytecodeView::operandKind(opcode::Opcode op)
+{
+	return operandKinds[uint8_t(op)];
+}
+
+bool BytecodeView::decodeOp(std::span<const uint8_t> code, size_t offset, Op& out)
+{
+	if (offset >= code.size())
+		return false;
+
+	out = Op{};
+	out.op = opcode::Opcode(code[offset]);
+	out.offset = offset;
+
+	size_t pos = offset + 1;
+	auto kind = operandKinds[code[offset]];
+
+	if (kind != OperandKind::None && pos < code.size())
+	{
+		uint8_t prefix = code[pos];
+		int width = prefix >= 0xF0 && prefix <= 0xF6 ? operandWidths[size_t(kind)][prefix - 0xF0] : 0;
+
+		// Jumps leave an unknown prefix alone, numbers and string references always consume it
+		if (width != 0 || kind != OperandKind::Jump)
+		{
+			pos++;
+
+			if (width == TEXT_OPERAND)
+			{
+				size_t len = cstrLength(code, pos);
+				out.text = asString(code, pos, len);
+				pos += len + (pos + len < code.size() ? 1 : 0);
+			}
+			else if (width > 0 && pos + width <= code.size())
+			{
+				out.operand = kind == OperandKind::StringRef
+					? int32_t(readUnsigned(code.data() + pos, width))
+					: readSigned(code.data() + pos, width);
+				pos += width;
+			}
+		}
+	}
+
+	out.length = pos - offset;
+	return true;
+}
+
+bool BytecodeView::indexOps() const
+{
+	if (_opsIndexed)
+		return _error.empty();
+	_opsIndexed = true;
+
+	if (!indexSegments())
+		return false;
+
+	auto bytecode = code();
+
+	Op op;
+	for (size_t pos = 0; decodeOp(bytecode, pos, op); pos += op.length)
+		_opOffsets.push_back(uint32_t(pos));
+
+	return true;
+}
+
+size_t BytecodeView::opCount() const
+{
+	indexOps();
+	return _opOffsets.size();
+}
+
+const std::vector<uint32_t>& BytecodeView::opOffsets() const
+{
+	indexOps();
+	return _opOffsets;
+}
+
+std::span<const uint8_t> BytecodeView::functionCode(size_t functionIndex) const
+{
+	if (!indexFunctions() || !indexOps() || functionIndex >= _functions.size())
+		return {};
+
+	// The function runs until the next one in operation order
+	size_t next = size_t(_functionRank[functionIndex]) + 1;
+	size_t first = _functions[functionIndex].opIndex;
+	size_t last = next < _functionOrder.size() ? _functions[_functionOrder[next]].opIndex : SIZE_MAX;
+
+	auto bytecode = code();
+	auto byteOffset = [&](size_t opIndex) {
+		return opIndex < _opOffsets.size() ? size_t(_opOffsets[opIndex]) : bytecode.size();
+	};
+
+	size_t start = byteOffset(first);
+	size_t end = std::max(start, byteOffset(last));
+	return bytecode.subspan(start, end - start);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef BYTECODEVIEW_H
+#define BYTECODEVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "opcodes.h"
+
+/*
+ * Read-only view over compiled GS2 bytecode (without the script header).
+ *
+ * Nothing is copied: segments, function names, strings and function code are
+ * all views into the underlying data, which must outlive the view. Indexing is
+ * lazy, the segment headers are read on first access, and the string offsets
+ * and operation offsets only when strings or function code are asked for.
+ * The lazy indices make a single view unsafe to share between threads before
+ * they are built, call index() and opCount() up-front to build them all.
+ */
+class BytecodeView
+{
+public:
+	enum Segment : uint32_t
+	{
+		GS1FLAGS = 1,
+		FUNCTIONTABLE = 2,
+		STRINGTABLE = 3,
+		BYTECODE = 4
+	};
+
+	// Immediate operand of an opcode, see decodeOp
+	enum class OperandKind : uint8_t
+	{
+		None,
+		Jump,		// target operation index
+		Number,		// integer, or double as text
+		StringRef	// string table index
+	};
+
+	struct Function
+	{
+		std::string_view name;
+		uint32_t opIndex;
+	};
+
+	/*
+	 * A single decoded operation. Operands are only present on jumps (target
+	 * operation index), numbers (value, or text for doubles) and string/variable
+	 * references (string table index)
+	 */
+	struct Op
+	{
+		opcode::Opcode op = opcode::OP_NONE;
+		size_t offset = 0;		// byte offset within the bytecode segment
+		size_t length = 0;		// encoded length including operands
+		int32_t operand = 0;
+		std::string_view text;	// double literal text for OP_TYPE_NUMBER
+	};
+
+	BytecodeView() = default;
+	explicit BytecodeView(std::span<const uint8_t> data);
+
+	std::span<const uint8_t> data() const { return _data; }
+
+	// Reads the segment, function and string tables, returns false (see error())
+	// when the data is malformed. Operation offsets are built on first use
+	bool index() const;
+	const std::string& error() const { return _error; }
+
+	// First segment of the given type, empty when missing
+	std::span<const uint8_t> segment(Segment type) const;
+	std::span<const uint8_t> code() const { return segment(BYTECODE); }
+
+	// Function table in file order
+	const std::vector<Function>& functions() const;
+
+	// Bytecode of a function, up to the next function in operation order
+	std::span<const uint8_t> functionCode(size_t functionIndex) const;
+
+	size_t stringCount() const;
+	std::string_view string(size_t index) const;
+
+	// Number of operations in the bytecode segment, and their byte offsets
+	size_t opCount() const;
+	const std::vector<uint32_t>& opOffsets() const;
+
+	// Strips the GS2Context::CreateHeader prefix (script type, name and
+	// checksum) when present, raw bytecode is returned unchanged
+	static std::span<const uint8_t> skipHeader(std::span<const uint8_t> data);
+
+	// Decodes the operation at a byte offset in code, returns false past the end.
+	// Operand widths come from a lookup table keyed by opcode and number prefix
+	static bool decodeOp(std::span<const uint8_t> code, size_t offset, Op& out);
+	static OperandKind operandKind(opcode::Opcode op);
+
+private:
+	bool indexSegments() const;
+	bool indexFunctions() const;
+	bool indexStrings() const;
+	bool indexOps() const;
+	bool fail(std::string msg) const;
+
+	std::span<const uint8_t> _data;
+
+	struct SegmentRef
+	{
+		uint32_t type;
+		size_t offset;
+		size_t length;
+	};
+
+	mutable std::string _error;
+	mutable bool _segmentsIndexed = false, _functionsIndexed = false, _stringsIndexed = false, _opsIndexed = false;
+	mutable std::vector<SegmentRef> _segments;
+	mutable std::vector<Function> _functions;
+	mutable std::vector<uint32_t> _functionOrder;	// function table indices sorted by opIndex
+	mutable std::vector<uint32_t> _functionRank;	// position of each function in _functionOrder
+	mutable std::vector<uint32_t> _stringOffsets;	// offset of each string within the string table
+	mutable std::vector<uint32_t> _opOffsets;
+};
+
+#endif
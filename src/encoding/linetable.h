@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef LINETABLE_H
+#define LINETABLE_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "buffer.h"
+
+/*
+ * Maps operation indices back to source locations.
+ *
+ * Layout:
+ *   "GS2L" [version: 1 byte] [bytecode fingerprint: 2 x u64 LE] [entry count: varint]
+ *   per entry: [opIndex delta: varint] [line delta: zigzag varint] [column: varint]
+ *
+ * An entry covers every operation from its opIndex up to the next entry. The
+ * fingerprint is CompilerResponse::fingerprint of the bytecode the table was
+ * written for, so a table left next to rebuilt bytecode can be told apart.
+ */
+namespace linetable
+{
+	constexpr uint8_t VERSION = 2;
+	constexpr size_t HEADER_SIZE = 5 + 16;
+
+	using Fingerprint = std::array<uint64_t, 2>;
+
+	struct Entry
+	{
+		uint32_t opIndex;
+		uint32_t line;
+		uint32_t column;
+	};
+
+	inline void writeVarint(Buffer& buf, uint32_t val)
+	{
+		while (val >= 0x80)
+		{
+			buf.write(char((val & 0x7F) | 0x80));
+			val >>= 7;
+		}
+		buf.write(char(val));
+	}
+
+	inline bool readVarint(const uint8_t *data, size_t len, size_t& pos, uint32_t& val)
+	{
+		val = 0;
+		for (int shift = 0; shift < 35 && pos < len; shift += 7)
+		{
+			uint8_t byte = data[pos++];
+			val |= uint32_t(byte & 0x7F) << shift;
+
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	inline Buffer encode(const std::vector<Entry>& entries, const Fingerprint& fingerprint)
+	{
+		Buffer buf(HEADER_SIZE + 3 + entries.size() * 3);
+		buf.write("GS2L", 4);
+		buf.write(char(VERSION));
+		for (auto half : fingerprint)
+		{
+			for (int i = 0; i < 8; i++)
+				buf.write(char(half >> (i * 8)));
+		}
+		writeVarint(buf, uint32_t(entries.size()));
+
+		Entry prev{ 0, 0, 0 };
+		for (const auto& entry : entries)
+		{
+			int32_t lineDelta = int32_t(entry.line) - int32_t(prev.line);
+
+			writeVarint(buf, entry.opIndex - prev.opIndex);
+			writeVarint(buf, uint32_t(lineDelta << 1) ^ uint32_t(lineDelta >> 31));
+			writeVarint(buf, entry.column);
+			prev = entry;
+		}
+
+		return buf;
+	}
+
+	inline bool decode(const uint8_t *data, size_t len, std::vector<Entry>& entries, Fingerprint& fingerprint)
+	{
+		entries.clear();
+
+		if (len < HEADER_SIZE || data[0] != 'G' || data[1] != 'S' || data[2] != '2' || data[3] != 'L' || data[4] != VERSION)
+			return false;
+
+		for (size_t half = 0; half < 2; half++)
+		{
+			fingerprint[half] = 0;
+			for (size_t i = 0; i < 8; i++)
+				fingerprint[half] |= uint64_t(data[5 + half * 8 + i]) << (i * 8);
+		}
+
+		size_t pos = HEADER_SIZE;
+		uint32_t count;
+		if (!readVarint(data, len, pos, count))
+			return false;
+
+		entries.reserve(count);
+
+		Entry cur{ 0, 0, 0 };
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t opDelta, lineZigZag, column;
+			if (!readVarint(data, len, pos, opDelta) || !readVarint(data, len, pos, lineZigZag) || !readVarint(data, len, pos, column))
+				return false;
+
+			int32_t lineDelta = int32_t(lineZigZag >> 1) ^ -int32_t(lineZigZag & 1);
+
+			cur.opIndex += opDelta;
+			cur.line = uint32_t(int32_t(cur.line) + lineDelta);
+			cur.column = column;
+			entries.push_back(cur);
+		}
+
+		return true;
+	}
+}
+
+#endif
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "CompilerThreadJob.h"
+#include "GS2Context.h"
+#include "Parser.h"
+#include "utils/ContextThreadPool.h"
+#include "visitors/GS2Decompiler.h"
+
+/*
+ * Microbenchmark over a script corpus.
+ *
+ * Every phase is run over the whole corpus once per iteration, and the
+ * per-iteration wall time is used as a sample. Phases:
+ *   lex        - scanner only (ParserContext::scan)
+ *   parse      - scanner + parser into the AST
+ *   compile    - GS2Context::compile
+ *   header     - GS2Context::CreateHeader over the compiled bytecode
+ *   decompile  - GS2Decompiler load + decompile over the compiled bytecode
+ *   allocs     - allocation counts per compile phase
+ *
+ * Afterwards the whole corpus is compiled through CustomThreadPool<CompilerThreadJob>
+ * with 1 to N workers to measure thread scaling.
+ */
+
+using bench_clock = std::chrono::steady_clock;
+
+struct BenchArguments
+{
+	std::vector<std::filesystem::path> paths;
+	std::vector<std::string> phases;
+	int warmup = 3;
+	int iterations = 20;
+	int max_threads = 0;
+	bool scaling = true;
+	bool help = false;
+	std::string error;
+};
+
+struct Script
+{
+	std::filesystem::path path;
+	std::string source;
+	Buffer bytecode{};
+};
+
+struct PhaseResult
+{
+	std::string name;
+	std::vector<double> samples; // seconds per iteration
+	size_t bytes = 0;            // bytes processed per iteration
+};
+
+constexpr const char* BENCH_HELP_TEXT = R"(
+GS2 Compiler Benchmark
+
+Usage:
+  %s [OPTIONS] [PATH...]
+
+Arguments:
+  PATH                 Script files or directories (searched recursively).
+                       Defaults to tests/scripts/advanced/{graalx,g2k1,loginserver}
+
+Options:
+  -w, --warmup N       Warmup iterations per phase (default 3)
+  -i, --iterations N   Measured iterations per phase (default 20)
+  -p, --phase NAME     Only run the given phase, may be repeated
+                       (lex, parse, compile, header, decompile, allocs)
+  -t, --threads N      Maximum worker count for thread scaling (default: hardware concurrency)
+      --no-scaling     Skip the thread scaling run
+  -h, --help           Show this help message
+)";
+
+BenchArguments parseBenchArguments(int argc, const char* argv[])
+{
+	BenchArguments args;
+
+	auto readInt = [&](int& i, int& out) {
+		if (++i >= argc)
+		{
+			args.error = std::string("Missing value after ") + argv[i - 1];
+			return false;
+		}
+
+		out = std::atoi(argv[i]);
+		return true;
+	};
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg = argv[i];
+
+		if (arg == "--help" || arg == "-h")
+		{
+			args.help = true;
+			return args;
+		}
+		else if (arg == "--warmup" || arg == "-w")
+		{
+			if (!readInt(i, args.warmup))
+				return args;
+		}
+		else if (arg == "--iterations" || arg == "-i")
+		{
+			if (!readInt(i, args.iterations))
+				return args;
+		}
+		else if (arg == "--threads" || arg == "-t")
+		{
+			if (!readInt(i, args.max_threads))
+				return args;
+		}
+		else if (arg == "--phase" || arg == "-p")
+		{
+			if (++i >= argc)
+			{
+				args.error = "Missing phase name after " + std::string(arg);
+				return args;
+			}
+			args.phases.emplace_back(argv[i]);
+		}
+		else if (arg == "--no-scaling")
+		{
+			args.scaling = false;
+		}
+		else if (arg.starts_with('-'))
+		{
+			args.error = "Unknown option: " + std::string(arg);
+			return args;
+		}
+		else
+			args.paths.emplace_back(arg);
+	}
+
+	if (args.paths.empty())
+	{
+		args.paths.emplace_back("tests/scripts/advanced/graalx");
+		args.paths.emplace_back("tests/scripts/advanced/g2k1");
+		args.paths.emplace_back("tests/scripts/advanced/loginserver");
+	}
+
+	if (args.iterations < 1)
+		args.iterations = 1;
+	if (args.warmup < 0)
+		args.warmup = 0;
+	if (args.max_threads < 1)
+		args.max_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	return args;
+}
+
+bool loadScript(const std::filesystem::path& path, std::vector<Script>& scripts)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	Script script{ path, std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) };
+	scripts.push_back(std::move(script));
+	return true;
+}
+
+std::vector<Script> loadCorpus(const std::vector<std::filesystem::path>& paths)
+{
+	std::vector<Script> scripts;
+
+	for (const auto& path : paths)
+	{
+		if (std::filesystem::is_directory(path))
+		{
+			std::vector<std::filesystem::path> files;
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+			{
+				auto ext = entry.path().extension();
+				if (entry.is_regular_file() && (ext == ".gs2" || ext == ".txt"))
+					files.push_back(entry.path());
+			}
+
+			// keep the order stable between runs
+			std::sort(files.begin(), files.end());
+			for (const auto& file : files)
+				loadScript(file, scripts);
+		}
+		else if (!loadScript(path, scripts))
+			fprintf(stderr, "Skipping %s: cannot open file\n", path.string().c_str());
+	}
+
+	return scripts;
+}
+
+double percentile(std::vector<double> samples, double pct)
+{
+	std::sort(samples.begin(), samples.end());
+	auto rank = size_t(std::ceil(pct / 100.0 * double(samples.size())));
+	return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+PhaseResult runPhase(const std::string& name, size_t bytes, const BenchArguments& args, const std::function<void()>& fn)
+{
+	PhaseResult result{ name, {}, bytes };
+	result.samples.reserve(args.iterations);
+
+	for (int i = 0; i < args.warmup; i++)
+		fn();
+
+	for (int i = 0; i < args.iterations; i++)
+	{
+		auto start = bench_clock::now();
+		fn();
+		result.samples.push_back(std::chrono::duration<double>(bench_clock::now() - start).count());
+	}
+
+	return result;
+}
+
+void printPhase(const PhaseResult& result)
+{
+	double median = percentile(result.samples, 50.0);
+	double p99 = percentile(result.samples, 99.0);
+	double mbps = median > 0 ? double(result.bytes) / (1024.0 * 1024.0) / median : 0.0;
+
+	printf("%-10s %12.3f %12.3f %12.2f\n", result.name.c_str(), median * 1e3, p99 * 1e3, mbps);
+}
+
+void reportAllocations(const std::vector<Script>& scripts)
+{
+	GS2Context context;
+	context.setOptions(CompilerOptions{ .collectStats = true });
+
+	std::array<allocstats::Counters, allocstats::PhaseCount> totals{};
+	uint64_t peakLiveBytes = 0;
+
+	for (const auto& script : scripts)
+	{
+		auto response = context.compile(script.source);
+		if (!response.stats)
+			continue;
+
+		for (size_t i = 0; i < allocstats::PhaseCount; i++)
+		{
+			totals[i].count += response.stats->allocs[i].count;
+			totals[i].bytes += response.stats->allocs[i].bytes;
+		}
+		peakLiveBytes = std::max(peakLiveBytes, response.stats->peakLiveBytes);
+	}
+
+	auto perScript = [&](uint64_t v) { return double(v) / double(scripts.size()); };
+
+	printf("\n%-10s %14s %14s %14s\n", "allocs", "count/script", "bytes/script", "total bytes");
+	for (size_t i = 0; i < allocstats::PhaseCount; i++)
+	{
+		printf("%-10s %14.1f %14.1f %14llu\n", allocstats::PhaseNames[i],
+			perScript(totals[i].count), perScript(totals[i].bytes), (unsigned long long)totals[i].bytes);
+	}
+	printf("%-10s %14s %14s %14llu\n", "peak live", "", "", (unsigned long long)peakLiveBytes);
+	if (!allocstats::operatorNewHooked)
+		printf("operator new isn't hooked (GS2_ALLOC_TRACKING=OFF), only buffer growth is counted\n");
+}
+
+void runScaling(const std::vector<Script>& scripts, size_t totalBytes, const BenchArguments& args)
+{
+	std::vector<CompilerThreadJob> jobs;
+	jobs.reserve(scripts.size());
+	for (const auto& script : scripts)
+		jobs.emplace_back(script.source);
+
+	std::vector<int> counts;
+	for (int n = 1; n < args.max_threads; n <<= 1)
+		counts.push_back(n);
+	counts.push_back(args.max_threads);
+
+	printf("\n%-10s %12s %12s %12s %10s\n", "threads", "median ms", "scripts/s", "MB/s", "speedup");
+
+	double baseline = 0;
+	for (int count : counts)
+	{
+		CustomThreadPool<CompilerThreadJob> pool(count);
+
+		auto compileAll = [&] {
+			auto futures = pool.queue(jobs);
+			for (auto& future : futures)
+				future.wait();
+		};
+
+		auto result = runPhase(std::to_string(count), totalBytes, args, compileAll);
+		double median = percentile(result.samples, 50.0);
+		if (baseline == 0)
+			baseline = median;
+
+		printf("%-10d %12.3f %12.1f %12.2f %9.2fx\n", count, median * 1e3,
+			double(scripts.size()) / median,
+			double(totalBytes) / (1024.0 * 1024.0) / median,
+			baseline / median);
+	}
+}
+
+int main(int argc, const char* argv[])
+{
+	BenchArguments args = parseBenchArguments(argc, argv);
+
+	if (args.help)
+	{
+		printf(BENCH_HELP_TEXT, argv[0]);
+		return 0;
+	}
+
+	if (!args.error.empty())
+	{
+		fprintf(stderr, "Error: %s\nUse --help for usage information.\n", args.error.c_str());
+		return 1;
+	}
+
+	auto scripts = loadCorpus(args.paths);
+	if (scripts.empty())
+	{
+		fprintf(stderr, "Error: no scripts found\n");
+		return 1;
+	}
+
+	auto runs = [&](std::string_view phase) {
+		return args.phases.empty() || std::find(args.phases.begin(), args.phases.end(), phase) != args.phases.end();
+	};
+
+	// Compile once up-front, the header and decompile phases work on the output.
+	// Scripts that fail to compile are dropped from the corpus
+	GS2Context context;
+	size_t sourceBytes = 0, bytecodeBytes = 0;
+
+	std::erase_if(scripts, [&](Script& script) {
+		auto response = context.compile(script.source);
+		if (!response.success)
+		{
+			fprintf(stderr, "Skipping %s: compile failed\n", script.path.string().c_str());
+			return true;
+		}
+
+		script.bytecode = std::move(response.bytecode);
+		sourceBytes += script.source.length();
+		bytecodeBytes += script.bytecode.length();
+		return false;
+	});
+
+	printf("Corpus: %zu scripts, %zu source bytes, %zu bytecode bytes\n", scripts.size(), sourceBytes, bytecodeBytes);
+	printf("Warmup %d, iterations %d\n\n", args.warmup, args.iterations);
+	printf("%-10s %12s %12s %12s\n", "phase", "median ms", "p99 ms", "MB/s");
+
+	GS2ErrorService errorService([](GS2CompilerError&) {});
+
+	if (runs("lex"))
+	{
+		printPhase(runPhase("lex", sourceBytes, args, [&] {
+			for (const auto& script : scripts)
+			{
+				ParserContext parser(errorService);
+				parser.scan(script.source);
+			}
+		}));
+	}
+
+	if (runs("parse"))
+	{
+		printPhase(runPhase("parse", sourceBytes, args, [&] {
+			for (const auto& script : scripts)
+			{
+				ParserContext parser(errorService);
+				parser.parse(script.source);
+			}
+		}));
+	}
+
+	if (runs("compile"))
+	{
+		printPhase(runPhase("compile", sourceBytes, args, [&] {
+			for (const auto& script : scripts)
+				context.compile(script.source);
+		}));
+	}
+
+	if (runs("header"))
+	{
+		printPhase(runPhase("header", bytecodeBytes, args, [&] {
+			for (const auto& script : scripts)
+				GS2Context::CreateHeader(script.bytecode, "weapon", "bench", true);
+		}));
+	}
+
+	if (runs("decompile"))
+	{
+		printPhase(runPhase("decompile", bytecodeBytes, args, [&] {
+			gs2decompiler::GS2Decompiler decompiler;
+			for (const auto& script : scripts)
+			{
+				if (decompiler.loadBytecode(std::span<const uint8_t>(script.bytecode.buffer(), script.bytecode.length())))
+					decompiler.decompile();
+			}
+		}));
+	}
+
+	if (runs("allocs"))
+		reportAllocations(scripts);
+
+	if (args.scaling)
+		runScaling(scripts, sourceBytes, args);
+
+	return 0;
+}
@@ -0,0 +1,716 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "CompilerThreadJob.h"
+#include "GS2Context.h"
+#include "daemon/DaemonProtocol.h"
+#include "utils/ContextThreadPool.h"
+#include "visitors/GS2Decompiler.h"
+
+/*
+ * Resident compiler. Listens on a Unix socket and serves the requests in
+ * daemon/DaemonProtocol.h from a pool of warm GS2Contexts, so callers don't pay
+ * for a cold compiler per process. Every connection gets a reader and a writer
+ * thread, the requests it reads are compiled on the shared pool and answered as
+ * they finish, a compile-batch is spread over all workers.
+ */
+
+using daemon_clock = std::chrono::steady_clock;
+using DaemonPool = CustomThreadPool<CallbackThreadJob>;
+
+struct DaemonArguments
+{
+	std::string socket_path;
+	bool default_socket = false;
+	int workers = 0;
+	bool verbose = false;
+	bool help = false;
+	std::string error;
+};
+
+constexpr const char* DAEMON_HELP_TEXT = R"(
+GS2 Compiler Daemon
+
+Usage:
+  %s [OPTIONS]
+
+Options:
+  -s, --socket PATH    Unix socket to listen on
+                       (default: $XDG_RUNTIME_DIR/gs2d.sock, or /tmp/gs2d-<uid>/gs2d.sock)
+  -j, --jobs N         Compiler workers (default: hardware concurrency)
+  -v, --verbose        Log every request with its latency
+  -h, --help           Show this help message
+)";
+
+// A client that accepts no response data for this long is dropped
+constexpr int SEND_TIMEOUT_SECONDS = 30;
+
+// Requests read from one connection and not yet answered. At the limit the
+// connection's next frame isn't read until a response has been sent
+constexpr size_t MAX_IN_FLIGHT = 64;
+
+/*
+ * One client connection. The pool threads only queue responses, the
+ * connection's writer thread sends them, so a client that stops reading stalls
+ * nobody but itself. The socket closes once the reader is done, no job holds
+ * the connection and the queued responses have been sent.
+ *
+ * Every request taken with begin() is finished by exactly one send(), or by
+ * release() when no response could be queued
+ */
+class Connection
+{
+public:
+	explicit Connection(int fd)
+		: _outbox(std::make_shared<Outbox>(fd))
+	{
+		timeval timeout{ SEND_TIMEOUT_SECONDS, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		std::thread(&Outbox::run, _outbox).detach();
+	}
+
+	~Connection()
+	{
+		_outbox->close();
+	}
+
+	int fd() const { return _outbox->fd; }
+
+	// Blocks while MAX_IN_FLIGHT requests are unanswered
+	void waitForSlot()
+	{
+		std::unique_lock lock(_outbox->mutex);
+		_outbox->slots.wait(lock, [this] { return _outbox->inFlight < MAX_IN_FLIGHT || _outbox->failed; });
+	}
+
+	void begin()
+	{
+		std::scoped_lock lock(_outbox->mutex);
+		_outbox->inFlight++;
+	}
+
+	void send(gs2d::Writer& writer)
+	{
+		_outbox->push(writer.frame());
+	}
+
+	void release()
+	{
+		_outbox->finish(1);
+	}
+
+private:
+	// Shared with the writer thread, which may outlive the connection while it
+	// sends the last responses
+	struct Outbox
+	{
+		explicit Outbox(int fd)
+			: fd(fd)
+		{
+		}
+
+		~Outbox()
+		{
+			::close(fd);
+		}
+
+		void push(const std::string& frame)
+		{
+			{
+				std::unique_lock lock(mutex);
+				if (failed)
+				{
+					lock.unlock();
+					finish(1);
+					return;
+				}
+				frames.push_back(frame);
+			}
+			ready.notify_one();
+		}
+
+		void finish(size_t count)
+		{
+			{
+				std::scoped_lock lock(mutex);
+				inFlight -= count;
+			}
+			slots.notify_one();
+		}
+
+		void close()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				closed = true;
+			}
+			ready.notify_one();
+		}
+
+		void run()
+		{
+			std::unique_lock lock(mutex);
+			for (;;)
+			{
+				ready.wait(lock, [this] { return closed || !frames.empty(); });
+				if (frames.empty())
+					return;
+
+				auto frame = std::move(frames.front());
+				frames.pop_front();
+
+				lock.unlock();
+				bool sent = gs2d::writeFrame(fd, frame);
+				lock.lock();
+				inFlight--;
+
+				// Gone or timed out, the reader sees the shutdown and stops taking requests
+				if (!sent)
+				{
+					failed = true;
+					inFlight -= frames.size();
+					frames.clear();
+					shutdown(fd, SHUT_RDWR);
+				}
+				slots.notify_one();
+			}
+		}
+
+		int fd;
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::condition_variable slots;
+		std::deque<std::string> frames;
+		size_t inFlight = 0;
+		bool closed = false;
+		bool failed = false;
+	};
+
+	std::shared_ptr<Outbox> _outbox;
+};
+
+struct Request
+{
+	std::shared_ptr<Connection> connection;
+	gs2d::RequestType type;
+	uint32_t id;
+	daemon_clock::time_point received;
+};
+
+namespace
+{
+	std::atomic<bool> g_verbose = false;
+
+	// Kept in static storage for the signal handler
+	char g_socketPath[sizeof(sockaddr_un::sun_path)];
+
+	void onTerminate(int)
+	{
+		unlink(g_socketPath);
+		_exit(0);
+	}
+
+	uint64_t elapsedNs(daemon_clock::time_point since)
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(daemon_clock::now() - since).count());
+	}
+
+	const char *requestName(gs2d::RequestType type)
+	{
+		switch (type)
+		{
+			case gs2d::RequestType::Compile: return "compile";
+			case gs2d::RequestType::CompileBatch: return "compile-batch";
+			case gs2d::RequestType::Check: return "check";
+			case gs2d::RequestType::Disassemble: return "disassemble";
+		}
+		return "unknown";
+	}
+
+	// Response header, the latency is taken here so it covers everything but the send
+	gs2d::Writer beginResponse(const Request& request, gs2d::Status status, uint64_t& latencyNs)
+	{
+		latencyNs = elapsedNs(request.received);
+
+		gs2d::Writer writer;
+		writer.u8(uint8_t(request.type));
+		writer.u32(request.id);
+		writer.u8(uint8_t(status));
+		writer.u64(latencyNs);
+		return writer;
+	}
+
+	// The log line is built first, nothing throws once the response is queued
+	void finishResponse(const Request& request, gs2d::Writer& writer, uint64_t latencyNs, const std::string& detail)
+	{
+		std::string line;
+		if (g_verbose)
+			line = std::format("[gs2d] #{} {}: {:.3f} ms{}\n", request.id, requestName(request.type), double(latencyNs) / 1e6, detail);
+
+		request.connection->send(writer);
+
+		if (!line.empty())
+		{
+			fputs(line.c_str(), stdout);
+			fflush(stdout);
+		}
+	}
+
+	const char *statusDetail(gs2d::Status status)
+	{
+		switch (status)
+		{
+			case gs2d::Status::BadRequest: return ", bad request";
+			case gs2d::Status::Unsupported: return ", unsupported";
+			case gs2d::Status::Internal: return ", failed in the daemon";
+			default: return "";
+		}
+	}
+
+	void replyStatus(const Request& request, gs2d::Status status)
+	{
+		uint64_t latencyNs;
+		auto writer = beginResponse(request, status, latencyNs);
+		finishResponse(request, writer, latencyNs, statusDetail(status));
+	}
+
+	// A job that threw answers with Internal. When even that can't be queued the
+	// request is given up, so the connection doesn't wait on it
+	void replyFailed(const Request& request, const char *what)
+	{
+		fprintf(stderr, "[gs2d] #%u %s failed: %s\n", request.id, requestName(request.type), what);
+		try
+		{
+			replyStatus(request, gs2d::Status::Internal);
+		}
+		catch (...)
+		{
+			request.connection->release();
+		}
+	}
+
+	// Runs a job's body on a pool thread, which must not see an exception
+	template<typename Fn>
+	void runGuarded(const Request& request, Fn&& fn)
+	{
+		try
+		{
+			fn();
+		}
+		catch (const std::exception& e)
+		{
+			replyFailed(request, e.what());
+		}
+		catch (...)
+		{
+			replyFailed(request, "unknown exception");
+		}
+	}
+
+	CompilerResponse compileRequest(GS2Context& context, const gs2d::CompileRequest& request)
+	{
+		// Options travel with every request, the worker's context is shared by all clients
+		context.setOptions(request.options);
+		if (request.header)
+			return context.compile(request.source, request.scriptType, request.scriptName, request.saveToDisk);
+		return context.compile(request.source);
+	}
+
+	void queueCompile(DaemonPool& pool, Request request, gs2d::CompileRequest compile)
+	{
+		pool.queue(CallbackThreadJob([request = std::move(request), compile = std::move(compile)](auto& thread, auto& promise) {
+			runGuarded(request, [&] {
+				auto response = compileRequest(thread.gs2context, compile);
+
+				uint64_t latencyNs;
+				auto writer = beginResponse(request, gs2d::Status::Ok, latencyNs);
+				gs2d::encode(writer, response, request.type == gs2d::RequestType::Compile);
+				finishResponse(request, writer, latencyNs, response.success ? std::format(", {} bytes", response.bytecode.length()) : ", failed");
+			});
+			promise.set_value({});
+		}));
+	}
+
+	// Items go to the pool separately, the last one to finish sends the response,
+	// or Internal when any item failed
+	void queueBatch(DaemonPool& pool, Request request, std::vector<gs2d::CompileRequest> compiles)
+	{
+		struct Batch
+		{
+			Request request;
+			std::vector<gs2d::CompileRequest> compiles;
+			std::vector<CompilerResponse> responses;
+			std::atomic<size_t> remaining;
+			std::atomic<bool> failed = false;
+		};
+
+		auto batch = std::make_shared<Batch>();
+		batch->request = std::move(request);
+		batch->compiles = std::move(compiles);
+		batch->responses.resize(batch->compiles.size());
+		batch->remaining = batch->compiles.size();
+
+		auto respond = [](Batch& batch) {
+			uint64_t latencyNs;
+			auto writer = beginResponse(batch.request, gs2d::Status::Ok, latencyNs);
+			writer.u32(uint32_t(batch.responses.size()));
+
+			size_t bytes = 0;
+			for (const auto& response : batch.responses)
+			{
+				gs2d::encode(writer, response, true);
+				bytes += response.bytecode.length();
+			}
+			finishResponse(batch.request, writer, latencyNs, std::format(", {} scripts, {} bytes", batch.responses.size(), bytes));
+		};
+
+		if (batch->compiles.empty())
+		{
+			respond(*batch);
+			return;
+		}
+
+		for (size_t i = 0; i < batch->compiles.size(); i++)
+		{
+			pool.queue(CallbackThreadJob([batch, i, respond](auto& thread, auto& promise) {
+				try
+				{
+					batch->responses[i] = compileRequest(thread.gs2context, batch->compiles[i]);
+				}
+				catch (const std::exception& e)
+				{
+					fprintf(stderr, "[gs2d] #%u compile-batch item %zu failed: %s\n", batch->request.id, i, e.what());
+					batch->failed = true;
+				}
+				catch (...)
+				{
+					batch->failed = true;
+				}
+
+				if (--batch->remaining == 0)
+				{
+					if (batch->failed)
+						replyFailed(batch->request, "an item failed");
+					else
+						runGuarded(batch->request, [&] { respond(*batch); });
+				}
+				promise.set_value({});
+			}));
+		}
+	}
+
+	void queueDisassemble(DaemonPool& pool, Request request, std::string bytecode)
+	{
+		pool.queue(CallbackThreadJob([request = std::move(request), bytecode = std::move(bytecode)](auto&, auto& promise) {
+			runGuarded(request, [&] {
+				gs2decompiler::GS2Decompiler decompiler;
+				auto data = std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(bytecode.data()), bytecode.size());
+
+				bool success = decompiler.loadBytecode(data);
+				auto text = success ? decompiler.decompile() : decompiler.getError();
+
+				uint64_t latencyNs;
+				auto writer = beginResponse(request, gs2d::Status::Ok, latencyNs);
+				writer.u8(success);
+				writer.str(text);
+				finishResponse(request, writer, latencyNs, success ? std::format(", {} bytes", bytecode.size()) : ", failed");
+			});
+			promise.set_value({});
+		}));
+	}
+
+	void dispatch(DaemonPool& pool, const std::shared_ptr<Connection>& connection, std::string_view payload)
+	{
+		gs2d::Reader reader(payload);
+		Request request{ connection, gs2d::RequestType(reader.u8()), reader.u32(), daemon_clock::now() };
+		connection->begin();
+		if (!reader.ok())
+		{
+			replyStatus(request, gs2d::Status::BadRequest);
+			return;
+		}
+
+		switch (request.type)
+		{
+			case gs2d::RequestType::Compile:
+			case gs2d::RequestType::Check:
+			{
+				gs2d::CompileRequest compile;
+				if (!gs2d::decode(reader, compile))
+					return replyStatus(request, gs2d::Status::BadRequest);
+
+				queueCompile(pool, std::move(request), std::move(compile));
+				break;
+			}
+
+			case gs2d::RequestType::CompileBatch:
+			{
+				// Every item takes at least 13 bytes, don't trust the count beyond that
+				uint32_t count = reader.u32();
+				std::vector<gs2d::CompileRequest> compiles;
+				compiles.reserve(std::min<size_t>(count, payload.size() / 13));
+
+				for (uint32_t i = 0; i < count && reader.ok(); i++)
+				{
+					gs2d::CompileRequest compile;
+					if (gs2d::decode(reader, compile))
+						compiles.push_back(std::move(compile));
+				}
+
+				if (!reader.ok())
+					return replyStatus(request, gs2d::Status::BadRequest);
+
+				queueBatch(pool, std::move(request), std::move(compiles));
+				break;
+			}
+
+			case gs2d::RequestType::Disassemble:
+			{
+				auto bytecode = reader.bytes();
+				if (!reader.ok())
+					return replyStatus(request, gs2d::Status::BadRequest);
+
+				queueDisassemble(pool, std::move(request), std::string(bytecode));
+				break;
+			}
+
+			default:
+				replyStatus(request, gs2d::Status::Unsupported);
+				break;
+		}
+	}
+
+	void serveConnection(DaemonPool& pool, std::shared_ptr<Connection> connection)
+	{
+		std::string payload;
+		for (;;)
+		{
+			connection->waitForSlot();
+			if (!gs2d::readFrame(connection->fd(), payload))
+				break;
+
+			// Decoding and queueing the request, e.g. a batch's items, can run out of memory too
+			try
+			{
+				dispatch(pool, connection, payload);
+			}
+			catch (const std::exception& e)
+			{
+				fprintf(stderr, "[gs2d] client %d: %s, disconnecting\n", connection->fd(), e.what());
+				break;
+			}
+		}
+
+		if (g_verbose)
+		{
+			printf("[gs2d] client %d disconnected\n", connection->fd());
+			fflush(stdout);
+		}
+	}
+
+	// The default socket's directory under /tmp, created 0700. An existing one
+	// must be a real directory owned by this user, or others could swap the socket
+	bool makePrivateDirectory(const std::string& path, std::string& error)
+	{
+		if (mkdir(path.c_str(), 0700) < 0 && errno != EEXIST)
+		{
+			error = "Cannot create " + path + ": " + std::string(strerror(errno));
+			return false;
+		}
+
+		struct stat info;
+		if (lstat(path.c_str(), &info) < 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid())
+		{
+			error = path + " is not a directory owned by this user";
+			return false;
+		}
+
+		if ((info.st_mode & 0777) != 0700 && chmod(path.c_str(), 0700) < 0)
+		{
+			error = "Cannot restrict " + path + ": " + std::string(strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	// Fails when another daemon answers on the path, a stale socket file is replaced.
+	// The socket is only accessible to this user
+	int listenOn(const std::string& path, std::string& error)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			error = "Socket path too long: " + path;
+			return -1;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool running = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+		if (probe >= 0)
+			close(probe);
+
+		if (running)
+		{
+			error = "Another gs2d is already listening on " + path;
+			return -1;
+		}
+		unlink(path.c_str());
+
+		// Created 0600 rather than narrowed after bind, so there's no window where others can connect
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		mode_t mask = umask(0177);
+		bool bound = fd >= 0 && bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+		umask(mask);
+
+		if (!bound || chmod(path.c_str(), 0600) < 0 || listen(fd, SOMAXCONN) < 0)
+		{
+			error = "Cannot listen on " + path + ": " + std::string(strerror(errno));
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+}
+
+DaemonArguments parseDaemonArguments(int argc, const char* argv[])
+{
+	DaemonArguments args;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg = argv[i];
+
+		if (arg == "--help" || arg == "-h")
+		{
+			args.help = true;
+			return args;
+		}
+		else if (arg == "--verbose" || arg == "-v")
+			args.verbose = true;
+		else if (arg == "--socket" || arg == "-s" || arg == "--jobs" || arg == "-j")
+		{
+			if (++i >= argc)
+			{
+				args.error = "Missing value after " + std::string(arg);
+				return args;
+			}
+
+			if (arg == "--socket" || arg == "-s")
+				args.socket_path = argv[i];
+			else
+				args.workers = std::atoi(argv[i]);
+		}
+		else
+		{
+			args.error = "Unknown option: " + std::string(arg);
+			return args;
+		}
+	}
+
+	if (args.socket_path.empty())
+	{
+		args.socket_path = gs2d::defaultSocketPath();
+		args.default_socket = true;
+	}
+	if (args.workers < 1)
+		args.workers = std::max(1, int(std::thread::hardware_concurrency()));
+
+	return args;
+}
+
+int main(int argc, const char* argv[])
+{
+	auto args = parseDaemonArguments(argc, argv);
+
+	if (args.help)
+	{
+		printf(DAEMON_HELP_TEXT, argv[0]);
+		return 0;
+	}
+
+	if (!args.error.empty())
+	{
+		fprintf(stderr, "Error: %s\n", args.error.c_str());
+		return 1;
+	}
+
+	std::string error;
+	bool inTmp = args.default_socket && args.socket_path.starts_with("/tmp/");
+	if (inTmp && !makePrivateDirectory(args.socket_path.substr(0, args.socket_path.rfind('/')), error))
+	{
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return 1;
+	}
+
+	int listenFd = listenOn(args.socket_path, error);
+	if (listenFd < 0)
+	{
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return 1;
+	}
+
+	memcpy(g_socketPath, args.socket_path.c_str(), args.socket_path.size() + 1);
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, onTerminate);
+	signal(SIGTERM, onTerminate);
+	g_verbose = args.verbose;
+
+	// Workers are started, and their contexts built, before the first client connects
+	DaemonPool pool(args.workers);
+
+	printf("gs2d listening on %s with %d workers\n", args.socket_path.c_str(), args.workers);
+	fflush(stdout);
+
+	for (;;)
+	{
+		int fd = accept(listenFd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			// Out of descriptors, wait for clients to disconnect
+			if (errno == EMFILE || errno == ENFILE)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+
+			fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+			break;
+		}
+
+		if (g_verbose)
+		{
+			printf("[gs2d] client %d connected\n", fd);
+			fflush(stdout);
+		}
+
+		std::thread(serveConnection, std::ref(pool), std::make_shared<Connection>(fd)).detach();
+	}
+
+	unlink(g_socketPath);
+	return 1;
+}
@@ -1,21 +1,82 @@
 #include <emscripten/bind.h>
+#include <cstdio>
+#include <span>
 #include "GS2Context.h"
+#include "visitors/GS2Decompiler.h"
 using namespace emscripten;
 
 EMSCRIPTEN_BINDINGS(module) {
     register_vector<std::string>("VectorString");
 }
 
+/* The salt is exposed as a double, 64-bit integers would need BigInt support */
+double getHeaderSalt(const CompilerOptions &options) {
+    return double(options.headerSalt);
+}
+
+void setHeaderSalt(CompilerOptions &options, double salt) {
+    options.headerSalt = uint64_t(salt);
+}
+
+EMSCRIPTEN_BINDINGS(CompilerOptions_bindings) {
+    value_object<CompilerOptions>("CompilerOptions")
+        .field("emitLineTable", &CompilerOptions::emitLineTable)
+        .field("collectStats", &CompilerOptions::collectStats)
+        .field("deterministicHeader", &CompilerOptions::deterministicHeader)
+        .field("headerSalt", &getHeaderSalt, &setHeaderSalt);
+}
+
 EMSCRIPTEN_BINDINGS(GS2Context_bindings) {
     class_<GS2Context>("GS2Context")
         .constructor<>()
+        .function("getOptions", &GS2Context::getOptions)
+        .function("setOptions", &GS2Context::setOptions)
         .function("compile", select_overload<CompilerResponse(const std::string&, const std::string&, const std::string&, bool)>(&GS2Context::compile), emscripten::return_value_policy::take_ownership())
         .function("compile", select_overload<CompilerResponse(const std::string&)>(&GS2Context::compile), emscripten::return_value_policy::take_ownership());
 }
 
+/* A view into wasm memory of exactly the bytecode length, valid until the response
+ * is deleted or memory grows. slice() it to keep or transfer the bytes */
 emscripten::val getBytecodeFromBuffer(const CompilerResponse &response) {
     const Buffer &buf = response.bytecode;
-    return emscripten::val(emscripten::typed_memory_view(buf.size(), buf.buffer()));
+    return emscripten::val(emscripten::typed_memory_view(buf.length(), buf.buffer()));
+}
+
+/* Stats are returned as a plain object, or null when they weren't collected.
+ * Timings are passed as doubles since 64-bit integers need BigInt support */
+emscripten::val getStats(const CompilerResponse &response) {
+    if (!response.stats)
+        return emscripten::val::null();
+
+    const CompilerStats &stats = *response.stats;
+    emscripten::val obj = emscripten::val::object();
+    obj.set("parseNs", double(stats.parseNs));
+    obj.set("codegenNs", double(stats.codegenNs));
+    obj.set("finalizeNs", double(stats.finalizeNs));
+    obj.set("nodeCount", stats.nodeCount);
+    obj.set("stringCount", stats.stringCount);
+    obj.set("stringTableBytes", stats.stringTableBytes);
+    obj.set("labelCount", stats.labelCount);
+    obj.set("outputBytes", stats.outputBytes);
+
+    emscripten::val allocs = emscripten::val::object();
+    for (size_t i = 0; i < allocstats::PhaseCount; i++) {
+        emscripten::val phase = emscripten::val::object();
+        phase.set("count", double(stats.allocs[i].count));
+        phase.set("bytes", double(stats.allocs[i].bytes));
+        allocs.set(allocstats::PhaseNames[i], phase);
+    }
+    obj.set("allocs", allocs);
+    obj.set("peakLiveBytes", double(stats.peakLiveBytes));
+    obj.set("allocsComplete", stats.allocsComplete);
+    return obj;
+}
+
+/* The fingerprint as 32 hex digits, compare it to skip resending unchanged scripts */
+std::string getFingerprint(const CompilerResponse &response) {
+    char hex[33];
+    snprintf(hex, sizeof(hex), "%016llx%016llx", (unsigned long long)response.fingerprint[0], (unsigned long long)response.fingerprint[1]);
+    return hex;
 }
 
 /* getErrors is simply a list of strings for now */
@@ -33,5 +94,26 @@ EMSCRIPTEN_BINDINGS(CompilerResponse_bindings) {
     class_<CompilerResponse>("CompilerResponse")
         .property("success", &CompilerResponse::success)
         .function("getBytecode", &getBytecodeFromBuffer, emscripten::return_value_policy::take_ownership())
-        .function("getErrors", &getErrors, emscripten::return_value_policy::take_ownership());
-}
\ No newline at end of file
+        .function("getErrors", &getErrors, emscripten::return_value_policy::take_ownership())
+        .function("getStats", &getStats)
+        .function("getFingerprint", &getFingerprint);
+}
+/* Disassembles a Uint8Array of bytecode, with or without the CreateHeader prefix.
+ * Returns { success, text } where text is the error message on failure */
+emscripten::val disassemble(const emscripten::val &bytes) {
+    // One copy into wasm memory through TypedArray.set
+    std::vector<uint8_t> data(bytes["length"].as<size_t>());
+    emscripten::val(emscripten::typed_memory_view(data.size(), data.data())).call<void>("set", bytes);
+
+    gs2decompiler::GS2Decompiler decompiler;
+    bool success = decompiler.loadBytecode(std::span<const uint8_t>(data));
+
+    emscripten::val result = emscripten::val::object();
+    result.set("success", success);
+    result.set("text", success ? decompiler.decompile() : decompiler.getError());
+    return result;
+}
+
+EMSCRIPTEN_BINDINGS(Disassembler_bindings) {
+    function("disassemble", &disassemble);
+}
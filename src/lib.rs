@@ -1,7 +1,9 @@
 extern crate libc;
 
-use libc::{c_char, c_void};
-use std::ffi::CStr;
+use libc::{c_char, c_void, size_t};
+use std::ffi::{CStr, CString};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
 
 #[repr(C)]
 pub struct Gs2CompilerResult {
@@ -11,10 +13,15 @@ pub struct Gs2CompilerResult {
     pub bytecode_size: u32,
 }
 
-extern {
+extern "C" {
     fn get_context() -> *mut c_void;
-    fn compile_code_no_header(context: *mut c_void, code: *const c_char) -> Gs2CompilerResult;
     fn delete_context(context: *mut c_void);
+
+    fn compile_buffer(context: *mut c_void, code: *const c_char, length: size_t, script_type: *const c_char, name: *const c_char) -> *mut c_void;
+    fn compile_result_success(result: *mut c_void) -> bool;
+    fn compile_result_bytecode(result: *mut c_void, length: *mut size_t) -> *const u8;
+    fn compile_result_errors(result: *mut c_void) -> *const c_char;
+    fn free_compile_result(result: *mut c_void);
 }
 
 /// Custom error type for the Gs2Context
@@ -37,10 +44,28 @@ impl std::fmt::Display for Gs2CompilerError {
     }
 }
 
+impl std::error::Error for Gs2CompilerError {}
+
+/// A compiler context. Contexts keep no thread-local state, so one can be moved
+/// to another thread (`Send`), but compiling mutates it, so it can't be shared
+/// between threads (not `Sync`). Use one context per thread, as `compile_many` does.
 pub struct Gs2Context {
     context: *mut c_void,
 }
 
+unsafe impl Send for Gs2Context {}
+
+/// Owns a compile_buffer response until it has been read
+struct CompileResult(*mut c_void);
+
+impl Drop for CompileResult {
+    fn drop(&mut self) {
+        unsafe {
+            free_compile_result(self.0);
+        }
+    }
+}
+
 impl Gs2Context {
     pub fn new() -> Self {
         unsafe {
@@ -51,30 +76,113 @@ impl Gs2Context {
     }
 
     pub fn compile_code(&self, code: &str) -> Result<Vec<u8>, Gs2CompilerError> {
-        let c_code = std::ffi::CString::new(code).unwrap();
+        self.compile_bytes(code.as_bytes())
+    }
+
+    /// Compiles without the script header. The source is borrowed, and the
+    /// bytecode is copied once, from the compiler's buffer into the returned Vec
+    pub fn compile_bytes(&self, code: &[u8]) -> Result<Vec<u8>, Gs2CompilerError> {
+        self.compile_raw(code, None)
+    }
+
+    /// Compiles with the script header, as gs2test does when saving a script
+    pub fn compile_script(&self, code: &[u8], script_type: &str, name: &str) -> Result<Vec<u8>, Gs2CompilerError> {
+        let c_type = CString::new(script_type).map_err(|_| Gs2CompilerError::new("script type contains a NUL byte"))?;
+        let c_name = CString::new(name).map_err(|_| Gs2CompilerError::new("script name contains a NUL byte"))?;
+        self.compile_raw(code, Some((&c_type, &c_name)))
+    }
+
+    fn compile_raw(&self, code: &[u8], header: Option<(&CString, &CString)>) -> Result<Vec<u8>, Gs2CompilerError> {
+        let (c_type, c_name) = match header {
+            Some((script_type, name)) => (script_type.as_ptr(), name.as_ptr()),
+            None => (std::ptr::null(), std::ptr::null()),
+        };
 
         unsafe {
-            let response = compile_code_no_header(self.context, c_code.as_ptr());
+            let handle = compile_buffer(self.context, code.as_ptr() as *const c_char, code.len(), c_type, c_name);
+            if handle.is_null() {
+                return Err(Gs2CompilerError::new("No compiler context"));
+            }
+            let result = CompileResult(handle);
 
-            if response.success {
-                let bytecode = std::slice::from_raw_parts(response.bytecode, response.bytecode_size as usize).to_vec();
-                Ok(bytecode)
+            if compile_result_success(result.0) {
+                let mut length: size_t = 0;
+                let data = compile_result_bytecode(result.0, &mut length);
+                if data.is_null() || length == 0 {
+                    return Ok(Vec::new());
+                }
+                Ok(std::slice::from_raw_parts(data, length).to_vec())
             } else {
-                let err_msg = if response.err_msg.is_null() {
-                    String::from("Unknown error")
+                let err_msg = CStr::from_ptr(compile_result_errors(result.0)).to_string_lossy();
+                if err_msg.is_empty() {
+                    Err(Gs2CompilerError::new("Unknown error"))
                 } else {
-                    CStr::from_ptr(response.err_msg).to_string_lossy().into_owned()
-                };
-                Err(Gs2CompilerError::new(&err_msg))
+                    Err(Gs2CompilerError::new(err_msg.trim_end()))
+                }
             }
         }
     }
 }
 
+impl Default for Gs2Context {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
 impl Drop for Gs2Context {
     fn drop(&mut self) {
         unsafe {
             delete_context(self.context);
         }
     }
-}
\ No newline at end of file
+}
+
+/// Compiles every script without the header on up to `threads` threads, each
+/// with its own context. 0 uses the available parallelism. Scripts are handed
+/// out one at a time, so a large script doesn't hold up the rest. Results are
+/// in the order of `scripts`.
+pub fn compile_many<S: AsRef<[u8]> + Sync>(scripts: &[S], threads: usize) -> Vec<Result<Vec<u8>, Gs2CompilerError>> {
+    let threads = if threads == 0 {
+        thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    } else {
+        threads
+    };
+    let threads = threads.min(scripts.len());
+
+    if threads <= 1 {
+        let context = Gs2Context::new();
+        return scripts.iter().map(|script| context.compile_bytes(script.as_ref())).collect();
+    }
+
+    let next = AtomicUsize::new(0);
+    let mut results: Vec<Option<Result<Vec<u8>, Gs2CompilerError>>> = Vec::with_capacity(scripts.len());
+    results.resize_with(scripts.len(), || None);
+
+    thread::scope(|scope| {
+        let workers: Vec<_> = (0..threads)
+            .map(|_| {
+                scope.spawn(|| {
+                    let context = Gs2Context::new();
+                    let mut done = Vec::new();
+                    loop {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+                        if index >= scripts.len() {
+                            break;
+                        }
+                        done.push((index, context.compile_bytes(scripts[index].as_ref())));
+                    }
+                    done
+                })
+            })
+            .collect();
+
+        for worker in workers {
+            for (index, result) in worker.join().expect("compile worker panicked") {
+                results[index] = Some(result);
+            }
+        }
+    });
+
+    results.into_iter().map(|result| result.expect("every script is compiled")).collect()
+}
@@ -1,19 +1,54 @@
+#include <array>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <format>
+#include <future>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <span>
+#include "CompilerThreadJob.h"
+#include "DecompilerThreadJob.h"
 #include "GS2Context.h"
+#include "encoding/bundle.h"
+#include "utils/ContextThreadPool.h"
+#include "utils/FileDiscovery.h"
+#include "utils/FilePipeline.h"
+#include "utils/FileWatcher.h"
+#include "utils/JsonLine.h"
+#include "utils/MappedFile.h"
 #include "visitors/GS2Decompiler.h"
 
+using DecompilerPool = CustomThreadPool<DecompilerThreadJob>;
+
 struct Response
 {
 	CompilerResponse response;
 	std::filesystem::path output_file;
 	std::string errmsg;
+	size_t input_bytes = 0;
+	bool unchanged = false;	// output already held this bytecode and wasn't rewritten
+	std::shared_future<bool> written;	// unchanged, once the pipeline has compared and written the output
+};
+
+struct CompileTotals
+{
+	size_t files = 0;
+	size_t input_bytes = 0;
+	size_t output_bytes = 0;
+	uint64_t parse_ns = 0;
+	uint64_t codegen_ns = 0;
+	uint64_t finalize_ns = 0;
+	double seconds = 0;
 };
 
 struct Arguments
@@ -25,6 +60,14 @@ struct Arguments
 	bool directory_mode = false;
 	bool multi_file_mode = false;
 	bool decompile_mode = false;
+	bool line_table = false;
+	bool stats = false;
+	bool watch = false;
+	bool stdio = false;
+	int jobs = 0;
+	std::filesystem::path bundle_path;
+	std::string script_type = "weapon";
+	DiscoveryOptions discovery;
 	std::string error;
 };
 
@@ -43,6 +86,16 @@ Arguments:
 Options:
   -o, --output FILE  Specify output file
   -d, --disassemble  Disassemble .gs2bc to .gs2 format
+  -l, --line-table   Write a .gs2lines source line table next to the output
+  -s, --stats        Print per-phase compile timings and counters
+  -j, --jobs N       Worker threads for compiling, disassembly and watch mode (default: hardware concurrency)
+  -w, --watch        Stay resident and recompile scripts in the INPUT directory as they change
+  --stdio            Compile NDJSON requests from stdin, streaming results to stdout
+  -b, --bundle FILE  Write all compiled scripts to one indexed bundle instead of .gs2bc files
+  --script-type TYPE Script type in the headers of bundled scripts (default: weapon)
+  --include GLOB     Directory mode: only process files matching GLOB (repeatable)
+  --exclude GLOB     Directory mode: skip files and directories matching GLOB (repeatable)
+  --ignore-file NAME Directory mode: also read .gitignore-style NAME files (default: .gs2ignore)
   -v, --verbose      Verbose output
   -h, --help         Show this help message
 
@@ -53,6 +106,8 @@ Examples:
   %s script.gs2bc -o output.gs2 -d # Creates output.gs2 (disassemble)
   %s scripts/                      # Process directory
   %s file1.gs2 file2.gs2 file3.gs2 # Process multiple files (drag & drop)
+  %s scripts/ -b scripts.gs2pack   # Bundle a directory into scripts.gs2pack
+  %s --stdio < requests.ndjson     # Compile requests piped in as JSON lines
 )";
 
 constexpr size_t count_placeholders(const std::string_view str)
@@ -107,6 +162,57 @@ Arguments parseArguments(int argc, const char* argv[])
 		{
 			args.decompile_mode = true;
 		}
+		else if (arg == "--line-table" || arg == "-l")
+		{
+			args.line_table = true;
+		}
+		else if (arg == "--stats" || arg == "-s")
+		{
+			args.stats = true;
+		}
+		else if (arg == "--watch" || arg == "-w")
+		{
+			args.watch = true;
+		}
+		else if (arg == "--stdio")
+		{
+			args.stdio = true;
+		}
+		else if (arg == "--jobs" || arg == "-j")
+		{
+			if (++i >= arg_span.size())
+			{
+				args.error = "Missing worker count after " + std::string(arg);
+				return args;
+			}
+			args.jobs = std::atoi(arg_span[i]);
+		}
+		else if (arg == "--bundle" || arg == "-b" || arg == "--script-type")
+		{
+			if (++i >= arg_span.size())
+			{
+				args.error = "Missing value after " + std::string(arg);
+				return args;
+			}
+
+			if (arg == "--script-type")
+				args.script_type = arg_span[i];
+			else
+				args.bundle_path = arg_span[i];
+		}
+		else if (arg == "--include" || arg == "--exclude" || arg == "--ignore-file")
+		{
+			if (++i >= arg_span.size())
+			{
+				args.error = "Missing value after " + std::string(arg);
+				return args;
+			}
+
+			auto& list = arg == "--include" ? args.discovery.include
+				: arg == "--exclude" ? args.discovery.exclude
+				: args.discovery.ignoreFiles;
+			list.emplace_back(arg_span[i]);
+		}
 		else if (arg == "--output" || arg == "-o")
 		{
 			if (++i >= arg_span.size())
@@ -125,12 +231,36 @@ Arguments parseArguments(int argc, const char* argv[])
 			args.input_paths.emplace_back(arg);
 	}
 
+	if (args.stdio)
+	{
+		if (!args.input_paths.empty() || !args.output_path.empty() || args.watch || args.decompile_mode || !args.bundle_path.empty())
+			args.error = "--stdio reads scripts from stdin and takes no files, bundle, watch or disassembly";
+		else if (args.jobs < 1)
+			args.jobs = std::max(1, int(std::thread::hardware_concurrency()));
+		return args;
+	}
+
 	if (args.input_paths.empty())
 	{
 		args.error = "No input file specified";
 		return args;
 	}
 
+	if (args.watch && args.input_paths.size() != 1)
+	{
+		args.error = "Watch mode takes a single directory";
+		return args;
+	}
+
+	if (!args.bundle_path.empty() && (args.watch || args.decompile_mode || args.line_table))
+	{
+		args.error = "A bundle can't be combined with watch, disassembly or line tables";
+		return args;
+	}
+
+	if (args.jobs < 1)
+		args.jobs = std::max(1, int(std::thread::hardware_concurrency()));
+
 	// Handle positional INPUT OUTPUT form
 	if (args.input_paths.size() == 2 && args.output_path.empty())
 	{
@@ -138,10 +268,22 @@ Arguments parseArguments(int argc, const char* argv[])
 		args.input_paths.pop_back();
 	}
 
+	if (!args.bundle_path.empty() && !args.output_path.empty())
+	{
+		args.error = "Output file cannot be specified with a bundle";
+		return args;
+	}
+
 	if (args.input_paths.size() == 1)
 	{
 		const auto& input_path = args.input_paths[0];
 
+		if (args.watch && !std::filesystem::is_directory(input_path))
+		{
+			args.error = "Watch mode needs a directory";
+			return args;
+		}
+
 		if (std::filesystem::is_directory(input_path))
 		{
 			args.directory_mode = true;
@@ -151,7 +293,7 @@ Arguments parseArguments(int argc, const char* argv[])
 				return args;
 			}
 		}
-		else if (args.output_path.empty() && !args.decompile_mode)
+		else if (args.output_path.empty() && !args.decompile_mode && args.bundle_path.empty())
 		{
 			args.output_path = input_path;
 			args.output_path.replace_extension(".gs2bc");
@@ -179,20 +321,90 @@ Arguments parseArguments(int argc, const char* argv[])
 	return args;
 }
 
-Response compileFile(const std::filesystem::path& filePath, const std::filesystem::path& outputPath = {})
+// Compiled scripts collected for --bundle instead of being written as .gs2bc files
+struct BundleTarget
+{
+	std::filesystem::path root;		// scripts are named by their path below it, without extension
+	std::string script_type;
+	bundle::Writer writer;
+};
+
+GS2Context& getCompilerContext()
 {
 	static GS2Context context;
+	return context;
+}
+
+// True when the file at path already holds exactly these contents
+bool fileMatches(const std::filesystem::path& path, const Buffer& contents)
+{
+	std::error_code ec;
+	if (std::filesystem::file_size(path, ec) != contents.length() || ec)
+		return false;
+
+	MappedFile existing;
+	if (!existing.open(path.string()) || existing.data().size() != contents.length())
+		return false;
+	return contents.length() == 0 || memcmp(existing.data().data(), contents.buffer(), contents.length()) == 0;
+}
+
+void writeFile(const std::filesystem::path& path, const Buffer& contents)
+{
+	std::ofstream stream(path, std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(contents.buffer()), static_cast<std::streamsize>(contents.length()));
+}
+
+// Adds the script with its header to the bundle, output_file is set to its name there
+void addToBundle(BundleTarget& bundle, const std::filesystem::path& filePath, Response& result)
+{
+	auto name = bundle.root.empty() ? filePath.filename() : filePath.lexically_relative(bundle.root);
+	if (name.empty() || *name.begin() == "..")
+		name = filePath.filename();
+	name.replace_extension();
+	result.output_file = name.generic_string();
+
+	// Content checksums, so a rebuilt bundle only makes clients refetch scripts that changed
+	const auto& bytecode = result.response.bytecode;
+	auto data = GS2Context::CreateHeader(bytecode, bundle.script_type, result.output_file.string(), true,
+		GS2Context::ContentChecksum(bytecode, 0));
+
+	if (!bundle.writer.add(result.output_file.string(), std::move(data)))
+		result.errmsg = "Another script is already bundled as " + result.output_file.string();
+}
+
+// With a pipeline the input was read ahead and the outputs are written in batches.
+// Compiles on the shared context unless another one is given. Nothing is
+// written when bundling, the caller adds the result to the bundle
+Response compileFile(const std::filesystem::path& filePath, const std::filesystem::path& outputPath = {},
+	FilePipeline* io = nullptr, FilePipeline::ReadResult* prefetched = nullptr, GS2Context* compiler = nullptr,
+	bool bundling = false)
+{
+	auto& context = compiler ? *compiler : getCompilerContext();
 	Response result{};
+	std::string script;
 
-	// Read file using C++ streams
-	std::ifstream file(filePath, std::ios::binary);
-	if (!file)
+	if (prefetched)
 	{
-		result.errmsg = "Cannot open file.";
-		return result;
+		if (prefetched->error)
+		{
+			result.errmsg = "Cannot open file.";
+			return result;
+		}
+		script = std::move(prefetched->data);
 	}
+	else
+	{
+		// Read file using C++ streams
+		std::ifstream file(filePath, std::ios::binary);
+		if (!file)
+		{
+			result.errmsg = "Cannot open file.";
+			return result;
+		}
 
-	std::string script((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		script.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	result.input_bytes = script.length();
 
 	result.response = context.compile(script);
 
@@ -203,27 +415,98 @@ Response compileFile(const std::filesystem::path& filePath, const std::filesyste
 		return result;
 	}
 
+	if (bundling)
+		return result;
+
 	// Determine output path
 	result.output_file = outputPath.empty()
 							 ? filePath.parent_path() / filePath.stem().concat(".gs2bc")
 							 : outputPath;
 
-	// Write bytecode
-	std::ofstream outstream(result.output_file, std::ios::binary);
-	outstream.write(reinterpret_cast<const char*>(result.response.bytecode.buffer()),
-		static_cast<std::streamsize>(result.response.bytecode.length()));
+	// Write bytecode, unless it's unchanged so the file keeps its mtime. Write
+	// line table, which does change with formatting. Without -l an earlier one
+	// is removed, it wouldn't describe this bytecode
+	const auto& bytecode = result.response.bytecode;
+	const auto& lineTable = result.response.lineTable;
+	auto linesPath = result.output_file;
+	linesPath.replace_extension(".gs2lines");
+
+	// The pipeline's writer does the comparing and removing, the compile
+	// threads only hand it the buffers
+	if (io)
+	{
+		result.written = io->write(result.output_file, { bytecode.buffer(), bytecode.length() }, true);
+		if (lineTable.length() > 0)
+			io->write(linesPath, { lineTable.buffer(), lineTable.length() }, true);
+		else
+			io->remove(linesPath);
+		return result;
+	}
+
+	result.unchanged = fileMatches(result.output_file, bytecode);
+	if (!result.unchanged)
+		writeFile(result.output_file, bytecode);
+
+	if (lineTable.length() > 0)
+	{
+		if (!fileMatches(linesPath, lineTable))
+			writeFile(linesPath, lineTable);
+	}
+	else
+	{
+		std::error_code ec;
+		std::filesystem::remove(linesPath, ec);
+	}
 
 	return result;
 }
 
+// Replaces the file through a rename, so servers that have the old bundle mapped keep reading it intact
+bool writeBundle(BundleTarget& bundle, const std::filesystem::path& path)
+{
+	auto data = bundle.writer.encode();
+	bool unchanged = fileMatches(path, data);
+
+	if (!unchanged)
+	{
+		auto temp_path = path;
+		temp_path += ".tmp";
+
+		std::ofstream stream(temp_path, std::ios::binary);
+		stream.write(reinterpret_cast<const char*>(data.buffer()), static_cast<std::streamsize>(data.length()));
+		stream.close();
+
+		std::error_code ec;
+		if (stream)
+			std::filesystem::rename(temp_path, path, ec);
+
+		if (!stream || ec)
+		{
+			std::filesystem::remove(temp_path, ec);
+			printf("[ERROR] Cannot write bundle %s\n", path.c_str());
+			return false;
+		}
+	}
+
+	printf("\nBundled %zu scripts, %zu bytes, %s %s\n", bundle.writer.size(), data.length(),
+		unchanged ? "unchanged" : "saved to", path.c_str());
+	return true;
+}
+
 struct DecompileResult
 {
-	std::string source;
 	std::filesystem::path output_file;
 	std::string errmsg;
+	std::string warning;
+	size_t functions = 0;
+	size_t strings = 0;
+	size_t code_bytes = 0;
 };
 
-DecompileResult decompileFile(const std::filesystem::path& filePath, const std::filesystem::path& outputPath = {})
+// Files with more bytecode than this render their functions on the pool
+constexpr size_t PARALLEL_DISASSEMBLY_BYTES = 64 * 1024;
+
+DecompileResult decompileFile(const std::filesystem::path& filePath, const std::filesystem::path& outputPath = {}, DecompilerPool* pool = nullptr)
 {
 	DecompileResult result{};
 	gs2decompiler::GS2Decompiler decompiler;
@@ -234,7 +517,16 @@ DecompileResult decompileFile(const std::filesystem::path& filePath, const std::
 		return result;
 	}
 
-	result.source = decompiler.decompile();
+	// Annotate with source lines when a line table was written next to the bytecode
+	auto linesPath = filePath;
+	linesPath.replace_extension(".gs2lines");
+	if (std::filesystem::exists(linesPath) && !decompiler.loadLineTable(linesPath.string()))
+		result.warning = decompiler.getError();
+
+	const auto& view = decompiler.getView();
+	result.functions = view.functions().size();
+	result.strings = view.stringCount();
+	result.code_bytes = view.code().size();
 
 	// Determine output path
 	if (outputPath.empty())
@@ -242,65 +534,155 @@ DecompileResult decompileFile(const std::filesystem::path& filePath, const std::
 	else
 		result.output_file = outputPath;
 
-	// Write source
+	// Stream the source straight to the file
 	std::ofstream outstream(result.output_file);
-	outstream << result.source;
+	if (pool && result.code_bytes > PARALLEL_DISASSEMBLY_BYTES)
+		decompiler.decompile(outstream, *pool);
+	else
+		decompiler.decompile(outstream);
 
 	return result;
 }
 
-bool decompileAndReport(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath = {}, bool verbose = false)
+DecompilerThreadJob::job_result decompileAndReport(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath = {}, bool verbose = false, DecompilerPool* pool = nullptr)
 {
+	DecompilerThreadJob::job_result report;
+
 	if (!std::filesystem::exists(inputPath))
 	{
-		printf(" -> [ERROR] File does not exist\n");
-		return false;
+		report.output = " -> [ERROR] File does not exist\n";
+		report.success = false;
+		return report;
 	}
 
 	if (verbose)
-		printf("Disassembling file %s\n", inputPath.c_str());
+		report.output += std::format("Disassembling file {}\n", inputPath.string());
 
 	auto start = std::chrono::high_resolution_clock::now();
-	auto result = decompileFile(inputPath, outputPath);
+	auto result = decompileFile(inputPath, outputPath, pool);
 	auto finish = std::chrono::high_resolution_clock::now();
 
 	if (verbose)
 	{
 		std::chrono::duration<double> diff = finish - start;
-		printf("Disassembled in %f seconds\n", diff.count());
+		report.output += std::format("Disassembled in {:f} seconds\n", diff.count());
 	}
 
 	if (!result.errmsg.empty())
 	{
-		printf(" -> [ERROR] %s\n", result.errmsg.c_str());
-		return false;
+		report.output += std::format(" -> [ERROR] {}\n", result.errmsg);
+		report.success = false;
+		return report;
 	}
 
+	if (!result.warning.empty())
+		report.output += std::format(" -> [WARNING] {}, not annotating source lines\n", result.warning);
+
 	if (verbose)
-		printf(" -> saved to %s\n", result.output_file.c_str());
+	{
+		report.output += std::format(" -> {} functions, {} strings, {} bytes of code\n", result.functions, result.strings, result.code_bytes);
+		report.output += std::format(" -> saved to {}\n", result.output_file.string());
+	}
 
-	return true;
+	return report;
 }
 
-bool compileAndReport(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath = {}, bool verbose = false)
+void printStats(const CompilerStats& stats)
 {
-	if (!std::filesystem::exists(inputPath))
+	printf(" -> parse %.3f ms, codegen %.3f ms, finalize %.3f ms\n",
+		double(stats.parseNs) / 1e6, double(stats.codegenNs) / 1e6, double(stats.finalizeNs) / 1e6);
+	printf(" -> %u nodes, %u strings (%u bytes), %u labels, %u bytes output\n",
+		stats.nodeCount, stats.stringCount, stats.stringTableBytes, stats.labelCount, stats.outputBytes);
+
+	auto allocs = stats.totalAllocs();
+	if (allocs.count > 0)
 	{
-		printf(" -> [ERROR] File does not exist\n");
-		return false;
+		printf(" -> %llu allocations, %llu bytes, %llu bytes peak live%s\n",
+			(unsigned long long)allocs.count, (unsigned long long)allocs.bytes, (unsigned long long)stats.peakLiveBytes,
+			stats.allocsComplete ? "" : " (buffer growth only)");
+
+		for (size_t i = 0; i < allocstats::PhaseCount; i++)
+		{
+			if (stats.allocs[i].count > 0)
+				printf("      %-9s %8llu allocations, %10llu bytes\n", allocstats::PhaseNames[i],
+					(unsigned long long)stats.allocs[i].count, (unsigned long long)stats.allocs[i].bytes);
+		}
 	}
+}
 
-	if (verbose)
-		printf("Compiling file %s\n", inputPath.c_str());
+void printTotals(const CompileTotals& totals)
+{
+	double mb = double(totals.input_bytes) / (1024.0 * 1024.0);
+	double seconds = totals.seconds > 0 ? totals.seconds : 1e-9;
+
+	printf("\nCompiled %zu files, %zu bytes in, %zu bytes out, %f seconds\n",
+		totals.files, totals.input_bytes, totals.output_bytes, totals.seconds);
+	printf("Phases: parse %.3f ms, codegen %.3f ms, finalize %.3f ms\n",
+		double(totals.parse_ns) / 1e6, double(totals.codegen_ns) / 1e6, double(totals.finalize_ns) / 1e6);
+	printf("Throughput: %.2f MB/s, %.1f scripts/s\n", mb / seconds, double(totals.files) / seconds);
+}
+
+// A compiled file waiting to be reported, see reportCompile
+struct CompiledFile
+{
+	Response result;
+	double seconds = 0;
+	bool missing = false;	// the input doesn't exist, nothing was compiled
+};
+
+CompiledFile compileTimed(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath = {},
+	FilePipeline* io = nullptr, FilePipeline::ReadResult* prefetched = nullptr, GS2Context* compiler = nullptr, bool bundling = false)
+{
+	CompiledFile file;
+	if (prefetched ? prefetched->error == ENOENT : !std::filesystem::exists(inputPath))
+	{
+		file.missing = true;
+		return file;
+	}
 
 	auto start = std::chrono::high_resolution_clock::now();
-	auto result = compileFile(inputPath, outputPath);
+	file.result = compileFile(inputPath, outputPath, io, prefetched, compiler, bundling);
 	auto finish = std::chrono::high_resolution_clock::now();
+	file.seconds = std::chrono::duration<double>(finish - start).count();
+	return file;
+}
+
+// Prints the report for a compiled file and adds it to the totals and the bundle,
+// only ever called from one thread so reports keep the input order
+bool reportCompile(const std::filesystem::path& inputPath, CompiledFile& file, bool verbose = false,
+	CompileTotals* totals = nullptr, BundleTarget* bundle = nullptr)
+{
+	if (file.missing)
+	{
+		printf(" -> [ERROR] File does not exist\n");
+		return false;
+	}
+
+	auto& result = file.result;
+	if (bundle && result.errmsg.empty())
+		addToBundle(*bundle, inputPath, result);
 
 	if (verbose)
 	{
-		std::chrono::duration<double> diff = finish - start;
-		printf("Compiled in %f seconds\n", diff.count());
+		printf("Compiling file %s\n", inputPath.c_str());
+		printf("Compiled in %f seconds\n", file.seconds);
+	}
+
+	if (result.response.stats)
+	{
+		const auto& stats = *result.response.stats;
+		printStats(stats);
+
+		if (totals)
+		{
+			totals->files++;
+			totals->input_bytes += result.input_bytes;
+			totals->output_bytes += stats.outputBytes;
+			totals->parse_ns += stats.parseNs;
+			totals->codegen_ns += stats.codegenNs;
+			totals->finalize_ns += stats.finalizeNs;
+			totals->seconds += file.seconds;
+		}
 	}
 
 	if (!result.errmsg.empty())
@@ -310,22 +692,182 @@ bool compileAndReport(const std::filesystem::path& inputPath, const std::filesys
 	}
 
 	if (verbose)
-		printf(" -> saved to %s\n", result.output_file.c_str());
+	{
+		if (result.written.valid())
+			result.unchanged = result.written.get();
+
+		const auto& fingerprint = result.response.fingerprint;
+		printf(" -> fingerprint %s\n", std::format("{:016x}{:016x}", fingerprint[0], fingerprint[1]).c_str());
+		if (bundle)
+			printf(" -> bundled as %s\n", result.output_file.c_str());
+		else
+			printf(result.unchanged ? " -> unchanged, kept %s\n" : " -> saved to %s\n", result.output_file.c_str());
+	}
 
 	return true;
 }
 
-void processFileList(const std::vector<std::filesystem::path>& files, bool verbose, std::string_view mode_name = "",
-	const std::filesystem::path& single_output = {}, bool decompile_mode = false)
+bool compileAndReport(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath = {}, bool verbose = false,
+	CompileTotals* totals = nullptr, BundleTarget* bundle = nullptr)
+{
+	auto file = compileTimed(inputPath, outputPath, nullptr, nullptr, nullptr, bundle != nullptr);
+	return reportCompile(inputPath, file, verbose, totals, bundle);
+}
+
+/////// Compiles one file of a list or directory on the worker's own GS2Context
+
+class CompileFileJob
+{
+public:
+	using job_result = CompiledFile;
+
+	struct thread_context {
+		GS2Context gs2context;
+	};
+
+	using promise_type = std::promise<job_result>;
+	using callback_type = std::function<job_result(GS2Context&)>;
+
+public:
+	CompileFileJob(callback_type fn)
+		: _fn(std::move(fn))
+	{
+	}
+
+	void run(thread_context& th_context, promise_type& promise)
+	{
+		try
+		{
+			promise.set_value(_fn(th_context.gs2context));
+		}
+		catch (...)
+		{
+			promise.set_exception(std::current_exception());
+		}
+	}
+
+	static void init(thread_context&)
+	{
+
+	}
+
+private:
+	callback_type _fn;
+};
+
+struct FileListResult
 {
 	int processed = 0;
 	int errors = 0;
+	CompileTotals totals;
+};
+
+void printSummary(const FileListResult& result, std::string_view mode_name, bool show_stats)
+{
+	if (!mode_name.empty())
+		printf("\n%s processing complete: %d files processed, %d errors\n", mode_name.data(), result.processed, result.errors);
+
+	if (show_stats && result.totals.files > 1)
+		printTotals(result.totals);
+}
+
+// Compiles the files of the pipeline on jobs threads, each with its own GS2Context,
+// until it's closed and drained. Reports are printed in the order the files were added
+void compilePipeline(FilePipeline& io, bool verbose, bool print_names, FileListResult& result, BundleTarget* bundle = nullptr,
+	int jobs = 1)
+{
+	using clock = std::chrono::steady_clock;
+
+	if (verbose)
+		printf("File I/O: %s\n", io.usesIoUring() ? "io_uring" : "threads");
+
+	CustomThreadPool<CompileFileJob> pool(jobs);
+	auto options = getCompilerContext().getOptions();
+	auto start = clock::now();
+
+	// Compiles run a few files ahead of the reports, holding on to their bytecode
+	std::deque<std::pair<std::filesystem::path, std::future<CompiledFile>>> pending;
+	const size_t max_pending = size_t(jobs) * 4;
+
+	auto reportNext = [&] {
+		auto& [path, compile] = pending.front();
+		if (print_names)
+			printf("Processing: %s\n", path.filename().c_str());
+
+		auto file = compile.get();
+		reportCompile(path, file, verbose, &result.totals, bundle) ? result.processed++ : result.errors++;
+		pending.pop_front();
+	};
+
+	while (auto input = io.next())
+	{
+		auto read = std::make_shared<FilePipeline::ReadResult>(std::move(*input));
+		pending.emplace_back(read->path, pool.queue(CompileFileJob([read, &io, options, bundling = bundle != nullptr](GS2Context& context) {
+			context.setOptions(options);
+			return compileTimed(read->path, {}, &io, read.get(), &context, bundling);
+		})));
+
+		if (pending.size() >= max_pending)
+			reportNext();
+	}
+
+	while (!pending.empty())
+		reportNext();
+
+	// The per-file times overlap, throughput is over the wall time
+	if (result.totals.files > 0)
+		result.totals.seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+	if (size_t failed = io.finish())
+	{
+		printf("[ERROR] %zu output files could not be written\n", failed);
+		result.errors += int(failed);
+	}
+}
+
+void processFileList(const std::vector<std::filesystem::path>& files, bool verbose, std::string_view mode_name = "",
+	const std::filesystem::path& single_output = {}, bool decompile_mode = false, bool show_stats = false, int jobs = 1,
+	BundleTarget* bundle = nullptr)
+{
+	FileListResult result;
 
 	if (!mode_name.empty())
 		printf("Processing %zu files (%s mode):\n\n", files.size(), mode_name.data());
 
-	for (const auto& file_path: files)
+	// Compiling several files reads them ahead and batches the writes
+	if (!decompile_mode && files.size() > 1)
+	{
+		FilePipeline io(files);
+		compilePipeline(io, verbose, !mode_name.empty(), result, bundle, jobs);
+		printSummary(result, mode_name, show_stats);
+		return;
+	}
+
+	// Disassembly fans out over the pool: whole files when there are several,
+	// otherwise the functions of the single file. Reports are printed in input order
+	std::optional<DecompilerPool> pool;
+	std::vector<std::future<DecompilerThreadJob::job_result>> reports;
+
+	if (decompile_mode && jobs > 1)
+	{
+		pool.emplace(jobs);
+
+		if (files.size() > 1)
+		{
+			reports.reserve(files.size());
+			for (const auto& file_path: files)
+			{
+				reports.push_back(pool->queue(DecompilerThreadJob([file_path, verbose] {
+					return decompileAndReport(file_path, {}, verbose);
+				})));
+			}
+		}
+	}
+
+	for (size_t i = 0; i < files.size(); i++)
 	{
+		const auto& file_path = files[i];
+
 		if (!mode_name.empty())
 			printf("Processing: %s\n", file_path.filename().c_str());
 
@@ -333,11 +875,15 @@ void processFileList(const std::vector<std::filesystem::path>& files, bool verbo
 		bool success;
 
 		if (decompile_mode)
-			success = decompileAndReport(file_path, output, verbose);
+		{
+			auto report = !reports.empty() ? reports[i].get() : decompileAndReport(file_path, output, verbose, pool ? &*pool : nullptr);
+			fputs(report.output.c_str(), stdout);
+			success = report.success;
+		}
 		else
-			success = compileAndReport(file_path, output, verbose);
+			success = compileAndReport(file_path, output, verbose, &result.totals, bundle);
 
-		if (files.size() == 1 && !verbose && success)
+		if (files.size() == 1 && !verbose && success && !bundle)
 		{
 			auto final_output = output.empty() ?
 				(decompile_mode ?
@@ -349,53 +895,283 @@ void processFileList(const std::vector<std::filesystem::path>& files, bool verbo
 				final_output.c_str());
 		}
 
-		success ? processed++ : errors++;
+		success ? result.processed++ : result.errors++;
 	}
 
-	if (!mode_name.empty())
-		printf("\n%s processing complete: %d files processed, %d errors\n", mode_name.data(), processed, errors);
+	printSummary(result, mode_name, show_stats);
+}
+
+int processDirectory(const std::filesystem::path& input_path, bool verbose, bool decompile_mode, bool show_stats, int jobs,
+	DiscoveryOptions discovery = {}, BundleTarget* bundle = nullptr)
+{
+	if (!std::filesystem::exists(input_path) || !std::filesystem::is_directory(input_path))
+	{
+		std::cerr << "Error: Invalid directory: " << input_path << "\n";
+		return 1;
+	}
+
+	if (verbose)
+		printf("Scanning directory: %s\n", input_path.c_str());
+
+	if (decompile_mode)
+		discovery.extensions = { ".gs2bc" };
+	else
+		discovery.extensions = { ".gs2", ".txt" };
+
+	FileDiscovery finder(input_path, std::move(discovery));
+	auto onSkip = [verbose](const std::filesystem::path& path) {
+		if (verbose)
+			printf("Skipping file %s\n", path.c_str());
+	};
+
+	// Disassembly output is in sorted order, compilation starts on the first
+	// file found while the walk carries on in the background
+	if (decompile_mode)
+	{
+		processFileList(finder.collect(onSkip), verbose, "Directory", {}, decompile_mode, show_stats, jobs);
+		return 0;
+	}
+
+	printf("Processing files (Directory mode):\n\n");
+
+	FileListResult result;
+	FilePipeline io;
+	std::thread walker([&] {
+		finder.run([&io](const std::filesystem::path& path) { io.add(path); }, onSkip);
+		io.close();
+	});
+
+	compilePipeline(io, verbose, true, result, bundle, jobs);
+	walker.join();
+
+	printSummary(result, "Directory", show_stats);
+	return 0;
 }
 
-std::vector<std::filesystem::path> gatherFilesFromDirectory(const std::filesystem::path& dir_path, bool verbose, bool decompile_mode)
+// Quiet period after the last change before compiling, short enough to keep
+// edit-to-bytecode well under 10 ms while still coalescing an editor's save.
+// Every [watch] line reports the time since the save
+constexpr std::chrono::milliseconds WATCH_DEBOUNCE{ 3 };
+
+// Recompiles scripts as they're saved. Compiles run on pool threads that each
+// keep one GS2Context for the whole watch, rather than creating one per edit
+int watchDirectory(const std::filesystem::path& input_path, bool verbose, int jobs, DiscoveryOptions discovery = {})
 {
-	std::vector<std::filesystem::path> files;
+	using clock = FileWatcher::clock;
+
+	discovery.extensions = { ".gs2", ".txt" };
+	FileDiscovery filter(input_path, std::move(discovery));
 
-	for (const auto& entry: std::filesystem::directory_iterator(dir_path))
+	FileWatcher watcher;
+	std::string error;
+	if (!watcher.open(input_path, error))
 	{
-		const auto& path = entry.path();
-		auto ext = path.extension();
+		std::cerr << "Error: " << error << "\n";
+		return 1;
+	}
 
-		if (decompile_mode)
-		{
-			if (ext == ".gs2bc")
-				files.push_back(path);
-			else if (verbose)
-				printf("Skipping file %s\n", path.c_str());
-		}
-		else
+	printf("Watching %s (%zu directories), press Ctrl+C to stop\n", input_path.c_str(), watcher.directoryCount());
+	fflush(stdout);
+
+	CustomThreadPool<CallbackThreadJob> pool(jobs);
+	auto options = getCompilerContext().getOptions();
+
+	for (;;)
+	{
+		std::vector<CallbackThreadJob::future_type> compiles;
+
+		for (auto& change : watcher.wait(WATCH_DEBOUNCE))
 		{
-			if (ext == ".gs2" || ext == ".txt")
-				files.push_back(path);
-			else if (verbose)
-				printf("Skipping file %s\n", path.c_str());
+			if (!filter.accepts(change.path))
+			{
+				if (verbose)
+					printf("Ignoring %s\n", change.path.c_str());
+				continue;
+			}
+
+			auto name = change.path.lexically_relative(input_path).string();
+			// The promise is always set, the loop below waits on every compile
+			compiles.push_back(pool.queue(CallbackThreadJob([change, name, options](auto& thread, auto& promise) {
+				std::string line;
+				try
+				{
+					thread.gs2context.setOptions(options);
+
+					auto start = clock::now();
+					auto result = compileFile(change.path, {}, nullptr, nullptr, &thread.gs2context);
+					auto finish = clock::now();
+
+					auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+					if (!result.errmsg.empty())
+						line = std::format("[watch] {}: failed in {:.2f} ms\n -> [ERROR] {}\n", name, ms(finish - start), result.errmsg);
+					else
+					{
+						line = std::format("[watch] {}: {} in {:.2f} ms, {:.2f} ms since save, {} bytes\n", name,
+							result.unchanged ? "unchanged" : "compiled", ms(finish - start), ms(finish - change.seen),
+							result.response.bytecode.length());
+					}
+				}
+				catch (const std::exception& e)
+				{
+					line = "[watch] " + name + ": failed\n -> [ERROR] " + e.what() + "\n";
+				}
+				catch (...)
+				{
+					line = "[watch] " + name + ": failed\n";
+				}
+
+				fputs(line.c_str(), stdout);
+				fflush(stdout);
+				promise.set_value({});
+			})));
 		}
-	}
 
-	return files;
+		// One batch at a time, so a file is never compiled twice at once
+		for (auto& compile : compiles)
+			compile.wait();
+	}
 }
 
-int processDirectory(const std::filesystem::path& input_path, bool verbose, bool decompile_mode)
+// Result line for one --stdio request, see serveStdio
+std::string stdioResult(const std::string& id, const std::string& name, const CompilerResponse& response, double ms)
 {
-	if (!std::filesystem::exists(input_path) || !std::filesystem::is_directory(input_path))
+	jsonline::Writer out;
+	out.raw("id", id);
+	if (!name.empty())
+		out.string("name", name);
+	out.boolean("success", response.success);
+
+	if (response.success)
 	{
-		std::cerr << "Error: Invalid directory: " << input_path << "\n";
-		return 1;
+		out.string("bytecode", jsonline::encodeBase64({ response.bytecode.buffer(), response.bytecode.length() }));
+		if (response.lineTable.length() > 0)
+			out.string("lineTable", jsonline::encodeBase64({ response.lineTable.buffer(), response.lineTable.length() }));
+		out.string("fingerprint", std::format("{:016x}{:016x}", response.fingerprint[0], response.fingerprint[1]));
 	}
 
-	if (verbose)
-		printf("Scanning directory: %s\n", input_path.c_str());
+	std::vector<std::string_view> errors;
+	for (const auto& err : response.errors)
+		errors.push_back(err.msg());
+	out.strings("errors", errors);
+	out.strings("joinedClasses", response.joinedClasses);
 
-	processFileList(gatherFilesFromDirectory(input_path, verbose, decompile_mode), verbose, "Directory", {}, decompile_mode);
+	if (response.stats)
+	{
+		jsonline::Writer stats;
+		stats.number("parseNs", response.stats->parseNs);
+		stats.number("codegenNs", response.stats->codegenNs);
+		stats.number("finalizeNs", response.stats->finalizeNs);
+		stats.number("outputBytes", uint64_t(response.stats->outputBytes));
+		out.raw("stats", stats.finish());
+	}
+
+	out.number("ms", ms);
+	return out.finish();
+}
+
+std::string stdioError(const std::string& id, const std::string& message)
+{
+	jsonline::Writer out;
+	out.raw("id", id);
+	out.boolean("success", false);
+	out.strings("errors", std::array{ message });
+	return out.finish();
+}
+
+// Serves NDJSON compile requests, {"id","name","type","source"} per line, from
+// stdin. Requests compile on the pool and every result is written to stdout as
+// soon as it's done, so lines can come back out of order: match them by id.
+// A type adds the script header, as compile_code does. At most a few requests per
+// job are in flight, stdin isn't read further until the oldest one finishes
+int serveStdio(bool verbose, int jobs)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::ios::sync_with_stdio(false);
+
+	CustomThreadPool<CallbackThreadJob> pool(jobs);
+	auto options = getCompilerContext().getOptions();
+	std::deque<CallbackThreadJob::future_type> pending;
+	const size_t max_pending = size_t(jobs) * 4;
+
+	auto output_lock = std::make_shared<std::mutex>();
+	auto emit = [output_lock](const std::string& line) {
+		std::scoped_lock lock(*output_lock);
+		fwrite(line.data(), 1, line.size(), stdout);
+		fputc('\n', stdout);
+		fflush(stdout);
+	};
+
+	std::string line;
+	size_t line_number = 0;
+	while (std::getline(std::cin, line))
+	{
+		line_number++;
+		if (line.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+
+		jsonline::Object request;
+		std::string error;
+		if (!jsonline::parseObject(line, request, error))
+		{
+			emit(stdioError("null", std::format("Invalid request on line {}: {}", line_number, error)));
+			continue;
+		}
+
+		auto text = [&request](const char* key) -> const std::string* {
+			auto it = request.find(key);
+			return it != request.end() && it->second.kind == jsonline::Value::Kind::String ? &it->second.text : nullptr;
+		};
+
+		auto id_field = request.find("id");
+		auto id = id_field != request.end() ? id_field->second.raw : "null";
+		auto source = text("source");
+		if (!source)
+		{
+			emit(stdioError(id, std::format("Request on line {} has no \"source\" string", line_number)));
+			continue;
+		}
+
+		auto name = text("name") ? *text("name") : std::string();
+		auto type = text("type") ? *text("type") : std::string();
+
+		// Every request gets exactly one line, a failed compile one from stdioError
+		pending.push_back(pool.queue(CallbackThreadJob([id, name, type, script = std::move(*source), options, emit, verbose](auto& thread, auto& promise) {
+			try
+			{
+				thread.gs2context.setOptions(options);
+
+				auto start = clock::now();
+				auto response = type.empty() ? thread.gs2context.compile(script) : thread.gs2context.compile(script, type, name, true);
+				double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+				auto result = stdioResult(id, name, response, ms);
+				auto log = verbose ? std::format("[stdio] {} {}: {} in {:.2f} ms\n", id, name, response.success ? "compiled" : "failed", ms) : std::string();
+
+				emit(result);
+				fputs(log.c_str(), stderr);
+			}
+			catch (const std::exception& e)
+			{
+				emit(stdioError(id, std::string("Compile failed: ") + e.what()));
+			}
+			catch (...)
+			{
+				emit(stdioError(id, "Compile failed"));
+			}
+			promise.set_value({});
+		})));
+
+		// A long-lived process shouldn't queue up the sources of a whole pipeline stage
+		if (pending.size() >= max_pending)
+		{
+			pending.front().wait();
+			pending.pop_front();
+		}
+	}
+
+	for (auto& future : pending)
+		future.wait();
 	return 0;
 }
 
@@ -420,20 +1196,40 @@ int main(int argc, const char* argv[])
 		return 1;
 	}
 
+	if (args.line_table || args.stats)
+	{
+		CompilerOptions options = getCompilerContext().getOptions();
+		options.emitLineTable = args.line_table;
+		options.collectStats = args.stats;
+		getCompilerContext().setOptions(options);
+	}
+
+	std::optional<BundleTarget> bundle;
+	if (!args.bundle_path.empty())
+		bundle.emplace(BundleTarget{ args.directory_mode ? args.input_paths[0] : std::filesystem::path{}, args.script_type, {} });
+	auto bundle_target = bundle ? &*bundle : nullptr;
+
 	int result;
-	if (args.directory_mode)
-		result = processDirectory(args.input_paths[0], args.verbose, args.decompile_mode);
+	if (args.stdio)
+		result = serveStdio(args.verbose, args.jobs);
+	else if (args.watch)
+		result = watchDirectory(args.input_paths[0], args.verbose, args.jobs, args.discovery);
+	else if (args.directory_mode)
+		result = processDirectory(args.input_paths[0], args.verbose, args.decompile_mode, args.stats, args.jobs, args.discovery, bundle_target);
 	else if (args.multi_file_mode)
 	{
-		processFileList(args.input_paths, args.verbose, "Multi-file", {}, args.decompile_mode);
+		processFileList(args.input_paths, args.verbose, "Multi-file", {}, args.decompile_mode, args.stats, args.jobs, bundle_target);
 		result = 0;
 	}
 	else
 	{
-		processFileList(args.input_paths, args.verbose, "", args.output_path, args.decompile_mode);
+		processFileList(args.input_paths, args.verbose, "", args.output_path, args.decompile_mode, args.stats, args.jobs, bundle_target);
 		result = 0;
 	}
 
+	if (bundle && result == 0 && !writeBundle(*bundle, args.bundle_path))
+		result = 1;
+
 #ifdef DBGALLOCATIONS
 	checkNodeOwnership();
 	checkForNodeLeaks();
@@ -0,0 +1,150 @@
+#pragma once
+
+#ifndef ALLOCTRACKER_H
+#define ALLOCTRACKER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Per-phase allocation accounting.
+ *
+ * Always compiled in. Counting only happens on a thread that has a Tracker
+ * installed (GS2Context::compile does this when CompilerOptions::collectStats
+ * is set), otherwise every hook is a single thread_local load and branch.
+ *
+ * Buffer reports its own malloc/realloc traffic, everything going through
+ * operator new is only seen when utils/AllocTrackingHook.cpp is linked into
+ * the executable, since a library can't replace the global allocator.
+ * operatorNewHooked tells the two apart.
+ */
+namespace allocstats
+{
+	enum class Phase : uint8_t
+	{
+		Other,
+		Scanner,	// ParserContext::saveString, flex buffers
+		Parser,		// bison stacks, constant/switch tables
+		Nodes,		// ParserContext::alloc
+		Visitor,	// GS2CompilerVisitor temporaries
+		Bytecode,	// GS2Bytecode string/function/jump tables
+		Buffer,		// Buffer growth
+		Count
+	};
+
+	constexpr size_t PhaseCount = size_t(Phase::Count);
+
+	constexpr std::array<const char *, PhaseCount> PhaseNames = {
+		"other", "scanner", "parser", "nodes", "visitor", "bytecode", "buffer"
+	};
+
+	struct Counters
+	{
+		uint64_t count = 0;
+		uint64_t bytes = 0;
+	};
+
+	struct Tracker
+	{
+		Phase phase = Phase::Other;
+		std::array<Counters, PhaseCount> phases{};
+		int64_t liveBytes = 0;
+		int64_t peakLiveBytes = 0;
+	};
+
+	inline thread_local Tracker *currentTracker = nullptr;
+
+	// Set by utils/AllocTrackingHook.cpp, counts are Buffer traffic only without it
+	inline bool operatorNewHooked = false;
+
+	inline void recordAlloc(size_t bytes, Phase phase)
+	{
+		if (auto tracker = currentTracker)
+		{
+			auto& counters = tracker->phases[size_t(phase)];
+			counters.count++;
+			counters.bytes += bytes;
+
+			tracker->liveBytes += int64_t(bytes);
+			if (tracker->liveBytes > tracker->peakLiveBytes)
+				tracker->peakLiveBytes = tracker->liveBytes;
+		}
+	}
+
+	inline void recordAlloc(size_t bytes)
+	{
+		if (auto tracker = currentTracker)
+			recordAlloc(bytes, tracker->phase);
+	}
+
+	inline void recordFree(size_t bytes)
+	{
+		if (auto tracker = currentTracker)
+			tracker->liveBytes -= int64_t(bytes);
+	}
+
+	/*
+	 * Installs a tracker on the current thread for the lifetime of the scope
+	 */
+	class TrackerScope
+	{
+	public:
+		explicit TrackerScope(Tracker& tracker)
+			: _prev(currentTracker)
+		{
+			currentTracker = &tracker;
+		}
+
+		~TrackerScope()
+		{
+			currentTracker = _prev;
+		}
+
+		TrackerScope(const TrackerScope&) = delete;
+		TrackerScope& operator=(const TrackerScope&) = delete;
+
+	private:
+		Tracker *_prev;
+	};
+
+	/*
+	 * Attributes allocations to a phase for the lifetime of the scope,
+	 * restoring the enclosing phase afterwards
+	 */
+	class PhaseScope
+	{
+	public:
+		explicit PhaseScope(Phase phase)
+			: _tracker(currentTracker), _prev(Phase::Other)
+		{
+			if (_tracker)
+			{
+				_prev = _tracker->phase;
+				_tracker->phase = phase;
+			}
+		}
+
+		~PhaseScope()
+		{
+			if (_tracker)
+				_tracker->phase = _prev;
+		}
+
+		PhaseScope(const PhaseScope&) = delete;
+		PhaseScope& operator=(const PhaseScope&) = delete;
+
+	private:
+		Tracker *_tracker;
+		Phase _prev;
+	};
+}
+
+#define GS2_ALLOC_CONCAT_IMPL(a, b) a##b
+#define GS2_ALLOC_CONCAT(a, b) GS2_ALLOC_CONCAT_IMPL(a, b)
+
+#define GS2_ALLOC_PHASE(phase) allocstats::PhaseScope GS2_ALLOC_CONCAT(_allocPhase, __LINE__)(allocstats::Phase::phase)
+#define GS2_ALLOC_RECORD(phase, bytes) allocstats::recordAlloc((bytes), allocstats::Phase::phase)
+#define GS2_ALLOC_RELEASE(bytes) allocstats::recordFree(bytes)
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Global operator new/delete replacement feeding utils/AllocTracker.h.
+ *
+ * Only link this into executables, it replaces the allocator for the whole
+ * process. Sizes are taken from the C allocator so unsized deletes can be
+ * accounted for, and nothing is counted unless the calling thread has a
+ * tracker installed.
+ */
+
+#include <cstdlib>
+#include <new>
+#include "utils/AllocTracker.h"
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define GS2_MALLOC_SIZE(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define GS2_MALLOC_SIZE(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define GS2_MALLOC_SIZE(p) malloc_usable_size(p)
+#endif
+
+namespace
+{
+	[[maybe_unused]] const bool hooked = (allocstats::operatorNewHooked = true);
+
+	void *trackedAlloc(size_t size)
+	{
+		void *p = std::malloc(size ? size : 1);
+		if (p && allocstats::currentTracker)
+			allocstats::recordAlloc(GS2_MALLOC_SIZE(p));
+		return p;
+	}
+
+	void trackedFree(void *p)
+	{
+		if (p && allocstats::currentTracker)
+			allocstats::recordFree(GS2_MALLOC_SIZE(p));
+		std::free(p);
+	}
+}
+
+void *operator new(size_t size)
+{
+	if (void *p = trackedAlloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	if (void *p = trackedAlloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+	trackedFree(p);
+}
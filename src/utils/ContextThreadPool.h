@@ -118,7 +118,7 @@ public:
 			_queueCond.notify_all();
 		}
 
-		return std::move(futureList);
+		return futureList;
 	}
 
 private:
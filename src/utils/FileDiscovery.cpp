@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "FileDiscovery.h"
+
+namespace
+{
+	bool matchClass(std::string_view pattern, size_t& pos, char c, bool& valid)
+	{
+		// pattern[pos] is '[', on success pos ends up past the closing ']'
+		size_t i = pos + 1;
+		bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+		if (negate)
+			i++;
+
+		bool matched = false;
+		bool first = true;
+		for (; i < pattern.size() && (first || pattern[i] != ']'); i++, first = false)
+		{
+			char lo = pattern[i];
+			char hi = lo;
+			if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']')
+			{
+				hi = pattern[i + 2];
+				i += 2;
+			}
+
+			if (c >= lo && c <= hi)
+				matched = true;
+		}
+
+		valid = i < pattern.size();
+		if (valid)
+			pos = i + 1;
+		return matched != negate;
+	}
+
+	// Globs without a slash match the name at any depth, others the whole relative path
+	bool matchesAny(const std::vector<std::string>& patterns, std::string_view relative, std::string_view name)
+	{
+		return std::any_of(patterns.begin(), patterns.end(), [&](const std::string& pattern) {
+			return FileDiscovery::globMatch(pattern, pattern.find('/') == std::string::npos ? name : relative);
+		});
+	}
+
+	struct IgnoreRule
+	{
+		std::string pattern;
+		bool negated = false;
+		bool dirOnly = false;
+		bool anchored = false;	// matched against the path from the ignore file's directory
+	};
+
+	std::vector<IgnoreRule> parseIgnoreFile(const std::filesystem::path& path)
+	{
+		std::vector<IgnoreRule> rules;
+		std::ifstream file(path);
+		std::string line;
+
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			// Trailing spaces are ignored unless escaped
+			while (!line.empty() && line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\'))
+				line.pop_back();
+
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			IgnoreRule rule;
+			std::string_view pattern = line;
+			if (pattern[0] == '!')
+			{
+				rule.negated = true;
+				pattern.remove_prefix(1);
+			}
+			else if (pattern.starts_with("\\!") || pattern.starts_with("\\#"))
+				pattern.remove_prefix(1);
+
+			if (!pattern.empty() && pattern.back() == '/')
+			{
+				rule.dirOnly = true;
+				pattern.remove_suffix(1);
+			}
+
+			if (!pattern.empty() && pattern.front() == '/')
+			{
+				rule.anchored = true;
+				pattern.remove_prefix(1);
+			}
+			else
+				rule.anchored = pattern.find('/') != std::string_view::npos;
+
+			if (!pattern.empty())
+			{
+				rule.pattern = pattern;
+				rules.push_back(std::move(rule));
+			}
+		}
+
+		return rules;
+	}
+
+	// Rules of one ignore file, chained to the ones found further up the tree
+	struct IgnoreRules
+	{
+		std::shared_ptr<const IgnoreRules> parent;
+		std::string base;	// directory relative to the root, empty or ending in '/'
+		std::vector<IgnoreRule> rules;
+
+		// 1 when ignored, -1 when re-included by a negated rule, 0 when no rule matched.
+		// The last matching rule wins, deeper files override their parents
+		int match(std::string_view relative, std::string_view name, bool isDir) const
+		{
+			int result = parent ? parent->match(relative, name, isDir) : 0;
+			auto local = relative.substr(base.size());
+
+			for (const auto& rule : rules)
+			{
+				if (rule.dirOnly && !isDir)
+					continue;
+
+				if (FileDiscovery::globMatch(rule.pattern, rule.anchored ? local : name))
+					result = rule.negated ? -1 : 1;
+			}
+
+			return result;
+		}
+	};
+
+	// Chains the rules of an ignore file found in the directory at relative
+	std::shared_ptr<const IgnoreRules> chainRules(std::shared_ptr<const IgnoreRules> parent, const std::string& relative, const std::filesystem::path& file)
+	{
+		auto parsed = parseIgnoreFile(file);
+		if (parsed.empty())
+			return parent;
+
+		return std::make_shared<const IgnoreRules>(IgnoreRules{ std::move(parent), relative.empty() ? "" : relative + "/", std::move(parsed) });
+	}
+
+	bool hasExtension(const std::vector<std::string>& extensions, const std::filesystem::path& path)
+	{
+		return extensions.empty() || std::find(extensions.begin(), extensions.end(), path.extension().string()) != extensions.end();
+	}
+
+	struct DirectoryTask
+	{
+		std::filesystem::path path;
+		std::string relative;
+		std::shared_ptr<const IgnoreRules> rules;
+	};
+
+	struct Entry
+	{
+		std::filesystem::path path;
+		std::string name;
+		bool isDirectory;
+	};
+}
+
+FileDiscovery::FileDiscovery(std::filesystem::path root, DiscoveryOptions options)
+	: _root(std::move(root)), _options(std::move(options))
+{
+}
+
+bool FileDiscovery::globMatch(std::string_view pattern, std::string_view text)
+{
+	size_t p = 0;
+	size_t t = 0;
+
+	while (p < pattern.size())
+	{
+		char c = pattern[p];
+
+		if (c == '*')
+		{
+			bool crossesDirectories = p + 1 < pattern.size() && pattern[p + 1] == '*';
+			p += crossesDirectories ? 2 : 1;
+
+			// "**/" also matches no directory at all
+			if (crossesDirectories && p < pattern.size() && pattern[p] == '/' && globMatch(pattern.substr(p + 1), text.substr(t)))
+				return true;
+
+			for (size_t k = t; k <= text.size(); k++)
+			{
+				if (globMatch(pattern.substr(p), text.substr(k)))
+					return true;
+				if (!crossesDirectories && k < text.size() && text[k] == '/')
+					break;
+			}
+			return false;
+		}
+
+		if (t >= text.size())
+			return false;
+
+		if (c == '?')
+		{
+			if (text[t] == '/')
+				return false;
+		}
+		else if (c == '[')
+		{
+			bool valid;
+			size_t next = p;
+			bool matched = matchClass(pattern, next, text[t], valid);
+
+			// An unterminated class is a literal '['
+			if (valid)
+			{
+				if (!matched || text[t] == '/')
+					return false;
+				p = next;
+				t++;
+				continue;
+			}
+			if (text[t] != '[')
+				return false;
+		}
+		else
+		{
+			if (c == '\\' && p + 1 < pattern.size())
+				c = pattern[++p];
+			if (c != text[t])
+				return false;
+		}
+
+		p++;
+		t++;
+	}
+
+	return t == text.size();
+}
+
+void FileDiscovery::run(const Callback& onFile, const Callback& onSkip) const
+{
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<DirectoryTask> queue;
+	size_t pending = 1;		// directories queued or being walked
+	queue.push_back({ _root, {}, nullptr });
+
+	auto walk = [&](const DirectoryTask& task) {
+		std::vector<Entry> entries;
+		std::error_code ec;
+		for (std::filesystem::directory_iterator it(task.path, ec), end; !ec && it != end; it.increment(ec))
+		{
+			std::error_code typeEc;
+			bool isDirectory = it->is_directory(typeEc) && !it->is_symlink(typeEc);
+			entries.push_back({ it->path(), it->path().filename().string(), isDirectory });
+		}
+
+		// The directory's own ignore files apply to everything in it
+		auto rules = task.rules;
+		for (const auto& ignoreFile : _options.ignoreFiles)
+		{
+			auto found = std::find_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+				return !entry.isDirectory && entry.name == ignoreFile;
+			});
+
+			if (found != entries.end())
+				rules = chainRules(std::move(rules), task.relative, found->path);
+		}
+
+		for (const auto& entry : entries)
+		{
+			auto relative = task.relative.empty() ? entry.name : task.relative + "/" + entry.name;
+
+			if ((rules && rules->match(relative, entry.name, entry.isDirectory) == 1) || matchesAny(_options.exclude, relative, entry.name))
+				continue;
+
+			if (entry.isDirectory)
+			{
+				if (entry.name != ".git")
+				{
+					std::scoped_lock lock(mutex);
+					queue.push_back({ entry.path, std::move(relative), rules });
+					pending++;
+					cv.notify_one();
+				}
+				continue;
+			}
+
+			if (!hasExtension(_options.extensions, entry.path))
+			{
+				if (onSkip)
+					onSkip(entry.path);
+				continue;
+			}
+
+			if (_options.include.empty() || matchesAny(_options.include, relative, entry.name))
+				onFile(entry.path);
+		}
+	};
+
+	auto worker = [&] {
+		std::unique_lock lock(mutex);
+		for (;;)
+		{
+			cv.wait(lock, [&] { return !queue.empty() || pending == 0; });
+			if (queue.empty())
+				return;
+
+			auto task = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+
+			walk(task);
+
+			lock.lock();
+			if (--pending == 0)
+				cv.notify_all();
+		}
+	};
+
+	size_t threads = _options.threads ? _options.threads : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> walkers;
+	for (size_t i = 1; i < threads; i++)
+		walkers.emplace_back(worker);
+
+	worker();
+	for (auto& walker : walkers)
+		walker.join();
+}
+
+std::vector<std::filesystem::path> FileDiscovery::collect(const Callback& onSkip) const
+{
+	std::mutex mutex;
+	std::vector<std::filesystem::path> files;
+
+	run([&](const std::filesystem::path& path) {
+		std::scoped_lock lock(mutex);
+		files.push_back(path);
+	}, onSkip);
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+bool FileDiscovery::accepts(const std::filesystem::path& file) const
+{
+	auto relativePath = file.lexically_relative(_root);
+	if (relativePath.empty() || *relativePath.begin() == ".." || !hasExtension(_options.extensions, file))
+		return false;
+
+	std::vector<std::string> parts;
+	for (const auto& part : relativePath)
+		parts.push_back(part.string());
+
+	// Same order as the walk: a directory's ignore files, then its entry on the way down
+	std::shared_ptr<const IgnoreRules> rules;
+	std::string relative;
+	auto directory = _root;
+
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		for (const auto& ignoreFile : _options.ignoreFiles)
+		{
+			std::error_code ec;
+			auto path = directory / ignoreFile;
+			if (std::filesystem::is_regular_file(path, ec))
+				rules = chainRules(std::move(rules), relative, path);
+		}
+
+		bool isDirectory = i + 1 < parts.size();
+		relative = relative.empty() ? parts[i] : relative + "/" + parts[i];
+
+		if ((isDirectory && parts[i] == ".git") || (rules && rules->match(relative, parts[i], isDirectory) == 1)
+			|| matchesAny(_options.exclude, relative, parts[i]))
+			return false;
+
+		directory /= parts[i];
+	}
+
+	return _options.include.empty() || matchesAny(_options.include, relative, parts.back());
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef FILEDISCOVERY_H
+#define FILEDISCOVERY_H
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct DiscoveryOptions
+{
+	// File extensions to pick up, including the dot
+	std::vector<std::string> extensions;
+
+	// Globs on the path relative to the root, '/' separated. Patterns without a
+	// slash match the file name at any depth. When include is non-empty a file
+	// has to match one of them, exclude also prunes whole directories
+	std::vector<std::string> include;
+	std::vector<std::string> exclude;
+
+	// .gitignore-style files read from every directory on the way down
+	std::vector<std::string> ignoreFiles = { ".gs2ignore" };
+
+	// Directory walkers, 0 for hardware concurrency
+	size_t threads = 0;
+};
+
+/*
+ * Recursive file discovery. Directories are walked in parallel, every match is
+ * passed to the callback as soon as it's found, so the caller can start work
+ * before the walk finishes. Symlinked directories aren't followed and .git
+ * directories are always skipped.
+ */
+class FileDiscovery
+{
+public:
+	using Callback = std::function<void(const std::filesystem::path&)>;
+
+	FileDiscovery(std::filesystem::path root, DiscoveryOptions options);
+
+	// Returns once the whole tree has been walked. The callbacks are invoked from
+	// the walker threads, concurrently. onSkip gets files filtered out by extension
+	void run(const Callback& onFile, const Callback& onSkip = {}) const;
+
+	// All matches, sorted
+	std::vector<std::filesystem::path> collect(const Callback& onSkip = {}) const;
+
+	// Whether a single file below the root passes the same filters as run(),
+	// reading the ignore files on its way down. For files reported by a watcher
+	bool accepts(const std::filesystem::path& file) const;
+
+	// Shell glob: * and ? don't cross '/', ** does, [a-z] / [!a-z] classes, \ escapes
+	static bool globMatch(std::string_view pattern, std::string_view text);
+
+private:
+	std::filesystem::path _root;
+	DiscoveryOptions _options;
+};
+
+#endif
@@ -0,0 +1,832 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <unordered_set>
+#include <utility>
+#include "FilePipeline.h"
+
+#ifdef GS2_HAVE_IO_URING
+#include <atomic>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Files per io_uring batch, each takes two ring entries per round
+	constexpr size_t RING_BATCH = 64;
+
+	void readFile(FilePipeline::ReadResult& result)
+	{
+		std::ifstream file(result.path, std::ios::binary);
+		if (!file)
+		{
+			result.error = errno ? errno : ENOENT;
+			return;
+		}
+
+		file.seekg(0, std::ios::end);
+		auto size = file.tellg();
+		file.seekg(0, std::ios::beg);
+
+		if (size > 0)
+		{
+			result.data.resize(size_t(size));
+			file.read(result.data.data(), size);
+		}
+
+		if (!file)
+			result.error = EIO;
+	}
+
+	// True when the file at path holds exactly data
+	bool fileHolds(const std::filesystem::path& path, const std::string& data)
+	{
+		std::error_code ec;
+		if (std::filesystem::file_size(path, ec) != data.size() || ec)
+			return false;
+
+		FilePipeline::ReadResult existing{ path };
+		readFile(existing);
+		return !existing.error && existing.data == data;
+	}
+
+	void writeFile(FilePipeline::WriteRequest& request)
+	{
+		if (request.remove)
+		{
+			std::error_code ec;
+			std::filesystem::remove(request.path, ec);
+			request.error = ec.value();
+			return;
+		}
+
+		if (request.keepUnchanged && fileHolds(request.path, request.data))
+		{
+			request.unchanged = true;
+			return;
+		}
+
+		std::ofstream file(request.path, std::ios::binary);
+		if (file)
+			file.write(request.data.data(), std::streamsize(request.data.size()));
+
+		if (!file)
+			request.error = errno ? errno : EIO;
+	}
+}
+
+#ifdef GS2_HAVE_IO_URING
+
+/*
+ * Minimal io_uring wrapper on the raw syscalls, so there's no liburing
+ * dependency. Each batch takes two rounds: open (+ statx for reads) for every
+ * file, then read or write linked to close. Short transfers sever the link and
+ * are finished with blocking calls. When io_uring_enter fails for good, read()
+ * and write() drain the ring and return false, the ring mustn't be used again
+ */
+class FilePipeline::Ring
+{
+public:
+	static std::unique_ptr<Ring> create(unsigned entries)
+	{
+		auto ring = std::unique_ptr<Ring>(new Ring());
+		return ring->setup(entries) ? std::move(ring) : nullptr;
+	}
+
+	~Ring()
+	{
+		if (_sqes)
+			munmap(_sqes, _sqesSize);
+		if (_cqRing && _cqRing != _sqRing)
+			munmap(_cqRing, _cqRingSize);
+		if (_sqRing)
+			munmap(_sqRing, _sqRingSize);
+		if (_fd >= 0)
+			::close(_fd);
+	}
+
+	// With sizes, files of any other size are left empty rather than read
+	bool read(std::span<ReadResult> batch, std::span<const size_t> sizes = {})
+	{
+		std::vector<struct statx> stats(batch.size());
+		std::vector<int> fds(batch.size(), -1);
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			auto *open = nextSqe();
+			open->opcode = IORING_OP_OPENAT;
+			open->fd = AT_FDCWD;
+			open->addr = uint64_t(batch[i].path.c_str());
+			open->open_flags = O_RDONLY | O_CLOEXEC;
+			open->user_data = i * 2;
+
+			auto *stat = nextSqe();
+			stat->opcode = IORING_OP_STATX;
+			stat->fd = AT_FDCWD;
+			stat->addr = uint64_t(batch[i].path.c_str());
+			stat->len = STATX_SIZE;
+			stat->off = uint64_t(&stats[i]);
+			stat->user_data = i * 2 + 1;
+		}
+
+		bool ok = submitAndWait(unsigned(batch.size() * 2), [&](const io_uring_cqe& cqe) {
+			size_t i = cqe.user_data / 2;
+			if (cqe.res < 0)
+				batch[i].error = -cqe.res;
+			else if (cqe.user_data % 2 == 0)
+				fds[i] = cqe.res;
+		});
+
+		if (!ok)
+		{
+			closeFiles(fds, {});
+			return false;
+		}
+
+		unsigned count = 0;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (fds[i] < 0)
+				continue;
+
+			bool wanted = sizes.empty() || stats[i].stx_size == sizes[i];
+			if (!batch[i].error && wanted && stats[i].stx_size > 0)
+			{
+				batch[i].data.resize(size_t(stats[i].stx_size));
+
+				auto *read = nextSqe();
+				read->opcode = IORING_OP_READ;
+				read->fd = fds[i];
+				read->addr = uint64_t(batch[i].data.data());
+				read->len = unsigned(batch[i].data.size());
+				read->flags = IOSQE_IO_LINK;
+				read->user_data = i * 2;
+				count++;
+			}
+
+			auto *close = nextSqe();
+			close->opcode = IORING_OP_CLOSE;
+			close->fd = fds[i];
+			close->user_data = i * 2 + 1;
+			count++;
+		}
+
+		std::vector<size_t> transferred(batch.size(), 0);
+		std::vector<uint8_t> closed(batch.size(), 0);
+		ok = submitAndWait(count, [&](const io_uring_cqe& cqe) {
+			size_t i = cqe.user_data / 2;
+			if (cqe.user_data % 2 == 1)
+				closed[i] = cqe.res != -ECANCELED;
+			else if (cqe.res < 0)
+				batch[i].error = -cqe.res;
+			else
+				transferred[i] = size_t(cqe.res);
+		});
+
+		if (!ok)
+		{
+			closeFiles(fds, closed);
+			return false;
+		}
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (fds[i] < 0)
+				continue;
+
+			auto& data = batch[i].data;
+			if (!batch[i].error && transferred[i] < data.size())
+			{
+				if (closed[i])
+				{
+					// The link wasn't severed, start over with a blocking read
+					data.clear();
+					readFile(batch[i]);
+				}
+				else
+				{
+					while (transferred[i] < data.size())
+					{
+						auto n = pread(fds[i], data.data() + transferred[i], data.size() - transferred[i], off_t(transferred[i]));
+						if (n <= 0)
+						{
+							// File shrank since statx
+							data.resize(transferred[i]);
+							break;
+						}
+						transferred[i] += size_t(n);
+					}
+				}
+			}
+
+			if (!closed[i])
+				::close(fds[i]);
+		}
+
+		return true;
+	}
+
+	bool write(std::span<WriteRequest> batch)
+	{
+		// Outputs that may already hold these bytes are read back in the same
+		// batched rounds as inputs, only when the sizes match
+		std::vector<ReadResult> existing;
+		std::vector<size_t> sizes;
+		std::vector<size_t> compared;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (batch[i].keepUnchanged && !batch[i].remove && !batch[i].data.empty())
+			{
+				existing.push_back({ batch[i].path });
+				sizes.push_back(batch[i].data.size());
+				compared.push_back(i);
+			}
+		}
+
+		if (!existing.empty() && !read(existing, sizes))
+			return false;
+
+		for (size_t k = 0; k < compared.size(); k++)
+		{
+			auto& request = batch[compared[k]];
+			request.unchanged = !existing[k].error && existing[k].data == request.data;
+		}
+
+		std::vector<int> fds(batch.size(), -1);
+		unsigned count = 0;
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (batch[i].unchanged)
+				continue;
+
+			if (batch[i].remove && !_unlinkAt)
+			{
+				if (::unlink(batch[i].path.c_str()) < 0 && errno != ENOENT)
+					batch[i].error = errno;
+				continue;
+			}
+
+			auto *open = nextSqe();
+			open->opcode = batch[i].remove ? IORING_OP_UNLINKAT : IORING_OP_OPENAT;
+			open->fd = AT_FDCWD;
+			open->addr = uint64_t(batch[i].path.c_str());
+			if (!batch[i].remove)
+			{
+				open->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+				open->len = 0644;
+			}
+			open->user_data = i;
+			count++;
+		}
+
+		bool ok = submitAndWait(count, [&](const io_uring_cqe& cqe) {
+			auto& request = batch[cqe.user_data];
+			if (request.remove)
+			{
+				if (cqe.res < 0 && cqe.res != -ENOENT)
+					request.error = -cqe.res;
+			}
+			else if (cqe.res < 0)
+				request.error = -cqe.res;
+			else
+				fds[cqe.user_data] = cqe.res;
+		});
+
+		if (!ok)
+		{
+			closeFiles(fds, {});
+			return false;
+		}
+
+		count = 0;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (fds[i] < 0)
+				continue;
+
+			if (!batch[i].data.empty())
+			{
+				auto *write = nextSqe();
+				write->opcode = IORING_OP_WRITE;
+				write->fd = fds[i];
+				write->addr = uint64_t(batch[i].data.data());
+				write->len = unsigned(batch[i].data.size());
+				write->flags = IOSQE_IO_LINK;
+				write->user_data = i * 2;
+				count++;
+			}
+
+			auto *close = nextSqe();
+			close->opcode = IORING_OP_CLOSE;
+			close->fd = fds[i];
+			close->user_data = i * 2 + 1;
+			count++;
+		}
+
+		std::vector<size_t> transferred(batch.size(), 0);
+		std::vector<uint8_t> closed(batch.size(), 0);
+		ok = submitAndWait(count, [&](const io_uring_cqe& cqe) {
+			size_t i = cqe.user_data / 2;
+			if (cqe.user_data % 2 == 1)
+				closed[i] = cqe.res != -ECANCELED;
+			else if (cqe.res < 0)
+				batch[i].error = -cqe.res;
+			else
+				transferred[i] = size_t(cqe.res);
+		});
+
+		if (!ok)
+		{
+			closeFiles(fds, closed);
+			return false;
+		}
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (fds[i] < 0)
+				continue;
+
+			const auto& data = batch[i].data;
+			if (!batch[i].error && transferred[i] < data.size())
+			{
+				if (closed[i])
+				{
+					batch[i].error = 0;
+					writeFile(batch[i]);
+				}
+				else
+				{
+					while (transferred[i] < data.size())
+					{
+						auto n = pwrite(fds[i], data.data() + transferred[i], data.size() - transferred[i], off_t(transferred[i]));
+						if (n < 0)
+						{
+							batch[i].error = errno;
+							break;
+						}
+						transferred[i] += size_t(n);
+					}
+				}
+			}
+
+			if (!closed[i] && ::close(fds[i]) < 0 && !batch[i].error)
+				batch[i].error = errno;
+		}
+
+		return true;
+	}
+
+private:
+	// Marks the completion of the cancel request drain() submits
+	static constexpr uint64_t CANCEL_TAG = ~uint64_t(0);
+
+	Ring() = default;
+
+	bool setup(unsigned entries)
+	{
+		io_uring_params params{};
+		_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+		if (_fd < 0)
+			return false;
+
+		// Open, statx, read, write and close need 5.6 or later
+		std::vector<uint8_t> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+		auto *probe = reinterpret_cast<io_uring_probe *>(probeBuffer.data());
+		if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+			return false;
+
+		auto supported = [probe](unsigned op) {
+			return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+		};
+
+		for (auto op : { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE })
+		{
+			if (!supported(op))
+				return false;
+		}
+
+		// Optional, removes fall back to unlink() and a broken ring is waited out
+		_unlinkAt = supported(IORING_OP_UNLINKAT);
+		_asyncCancel = supported(IORING_OP_ASYNC_CANCEL);
+
+		_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+		_sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+		if (_sqRing == MAP_FAILED)
+		{
+			_sqRing = nullptr;
+			return false;
+		}
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			_cqRing = _sqRing;
+		else
+		{
+			_cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+			if (_cqRing == MAP_FAILED)
+			{
+				_cqRing = nullptr;
+				return false;
+			}
+		}
+
+		_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void *sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+		if (sqes == MAP_FAILED)
+			return false;
+		_sqes = static_cast<io_uring_sqe *>(sqes);
+
+		auto *sq = static_cast<uint8_t *>(_sqRing);
+		auto *cq = static_cast<uint8_t *>(_cqRing);
+		_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+		_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+		_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+		_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+		_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+		_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+		_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	// Batches never exceed the ring, every round is waited for before the next
+	io_uring_sqe *nextSqe()
+	{
+		unsigned tail = std::atomic_ref(*_sqTail).load(std::memory_order_relaxed) + _pending;
+		unsigned index = tail & _sqMask;
+
+		auto *sqe = &_sqes[index];
+		*sqe = io_uring_sqe{};
+		_sqArray[index] = index;
+		_pending++;
+		return sqe;
+	}
+
+	// Makes the entries written by nextSqe visible to the kernel, returns how many
+	unsigned publish()
+	{
+		auto tail = std::atomic_ref(*_sqTail);
+		tail.store(tail.load(std::memory_order_relaxed) + _pending, std::memory_order_release);
+		return std::exchange(_pending, 0u);
+	}
+
+	// Closes the files a failed round left open
+	static void closeFiles(std::span<const int> fds, std::span<const uint8_t> closed)
+	{
+		for (size_t i = 0; i < fds.size(); i++)
+		{
+			if (fds[i] >= 0 && (closed.empty() || !closed[i]))
+				::close(fds[i]);
+		}
+	}
+
+	// Hands the posted completions to handler, returns how many there were
+	template<typename Handler>
+	unsigned reap(Handler& handler)
+	{
+		auto cqTail = std::atomic_ref(*_cqTail);
+		auto cqHead = std::atomic_ref(*_cqHead);
+		unsigned head = cqHead.load(std::memory_order_relaxed);
+		unsigned count = 0;
+
+		while (head != cqTail.load(std::memory_order_acquire))
+		{
+			const auto& cqe = _cqes[head & _cqMask];
+			if (cqe.user_data != CANCEL_TAG)
+			{
+				handler(cqe);
+				count++;
+			}
+			head++;
+		}
+
+		cqHead.store(head, std::memory_order_release);
+		return count;
+	}
+
+	// Returns false when io_uring_enter fails for good before everything completed.
+	// The entries already submitted point into the caller's buffers, so they're
+	// cancelled and waited for before returning, nothing of the round is left to
+	// complete later
+	template<typename Handler>
+	bool submitAndWait(unsigned count, Handler&& handler)
+	{
+		if (count == 0)
+			return true;
+
+		unsigned toSubmit = publish();
+		unsigned completed = 0;
+		while (completed < count)
+		{
+			int ret = int(syscall(__NR_io_uring_enter, _fd, toSubmit, count - completed, IORING_ENTER_GETEVENTS, nullptr, 0));
+			if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				// Entries the kernel never took stay in the queue, they're only
+				// submitted by another io_uring_enter and the ring is done with
+				drain(count - toSubmit - completed, toSubmit == 0, handler);
+				return false;
+			}
+			if (ret > 0)
+				toSubmit -= std::min(toSubmit, unsigned(ret));
+
+			completed += reap(handler);
+		}
+
+		return true;
+	}
+
+	template<typename Handler>
+	void drain(unsigned inFlight, bool canCancel, Handler& handler)
+	{
+#ifdef IORING_ASYNC_CANCEL_ANY
+		// Reads from a pipe or a slow device could otherwise take arbitrarily
+		// long. Kernels before 5.19 reject the flags and it's waited out
+		if (inFlight > 0 && canCancel && _asyncCancel)
+		{
+			auto *cancel = nextSqe();
+			cancel->opcode = IORING_OP_ASYNC_CANCEL;
+			cancel->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+			cancel->user_data = CANCEL_TAG;
+			syscall(__NR_io_uring_enter, _fd, publish(), 0, 0, nullptr, 0);
+		}
+#endif
+
+		while (inFlight > 0)
+		{
+			inFlight -= std::min(inFlight, reap(handler));
+			if (inFlight == 0)
+				break;
+
+			// Completions are still posted while io_uring_enter fails, poll for them then
+			if (syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	int _fd = -1;
+	void *_sqRing = nullptr;
+	void *_cqRing = nullptr;
+	size_t _sqRingSize = 0;
+	size_t _cqRingSize = 0;
+	io_uring_sqe *_sqes = nullptr;
+	size_t _sqesSize = 0;
+	bool _unlinkAt = false;
+	bool _asyncCancel = false;
+
+	unsigned *_sqTail = nullptr;
+	unsigned *_sqArray = nullptr;
+	unsigned _sqMask = 0;
+	unsigned *_cqHead = nullptr;
+	unsigned *_cqTail = nullptr;
+	unsigned _cqMask = 0;
+	io_uring_cqe *_cqes = nullptr;
+	unsigned _pending = 0;
+};
+
+#else
+
+class FilePipeline::Ring
+{
+public:
+	static std::unique_ptr<Ring> create(unsigned) { return nullptr; }
+	bool read(std::span<ReadResult>) { return false; }
+	bool write(std::span<WriteRequest>) { return false; }
+};
+
+#endif
+
+FilePipeline::FilePipeline(size_t window)
+	: _window(std::max<size_t>(window, 1))
+{
+	_readRing = Ring::create(RING_BATCH * 2);
+	if (_readRing)
+		_writeRing = Ring::create(RING_BATCH * 2);
+
+	_ioUring = _readRing && _writeRing;
+	if (!_ioUring)
+		_readRing.reset();
+
+	// A single thread keeps the ring busy, blocking reads overlap on a few threads
+	_batchSize = _ioUring ? RING_BATCH : 1;
+	size_t readers = _ioUring ? 1 : std::clamp<size_t>(std::thread::hardware_concurrency(), 1, 4);
+
+	for (size_t i = 0; i < readers; i++)
+		_readers.emplace_back(&FilePipeline::readLoop, this);
+	_writer = std::thread(&FilePipeline::writeLoop, this);
+}
+
+FilePipeline::FilePipeline(const std::vector<std::filesystem::path>& paths, size_t window)
+	: FilePipeline(window)
+{
+	for (const auto& path : paths)
+		add(path);
+	close();
+}
+
+FilePipeline::~FilePipeline()
+{
+	{
+		std::scoped_lock lock(_readMutex, _writeMutex);
+		_stopping = true;
+	}
+	_readCv.notify_all();
+	_writeCv.notify_all();
+
+	for (auto& reader : _readers)
+		reader.join();
+
+	// The writer drains the queue before exiting
+	_writer.join();
+}
+
+void FilePipeline::readLoop()
+{
+	std::vector<ReadResult> batch;
+
+	for (;;)
+	{
+		size_t first, last;
+		{
+			std::unique_lock lock(_readMutex);
+			_readCv.wait(lock, [this] {
+				bool pending = _claimed < _paths.size();
+				return _stopping || (pending && _claimed < _consumed + _window) || (!pending && _closed);
+			});
+
+			if (_stopping || _claimed >= _paths.size())
+				return;
+
+			first = _claimed;
+			last = std::min({ first + _batchSize, _paths.size(), _consumed + _window });
+			_claimed = last;
+
+			batch.resize(last - first);
+			for (size_t i = first; i < last; i++)
+				batch[i - first] = { _paths[i] };
+		}
+
+		// A ring that broke is dropped, the batch and everything after it is read
+		// with blocking I/O
+		if (!_readRing || !_readRing->read(batch))
+		{
+			if (_readRing)
+			{
+				_readRing.reset();
+				for (auto& result : batch)
+					result = { result.path };
+			}
+
+			for (auto& result : batch)
+				readFile(result);
+		}
+
+		{
+			std::scoped_lock lock(_readMutex);
+			for (size_t i = first; i < last; i++)
+			{
+				_slots[i] = std::move(batch[i - first]);
+				_ready[i] = 1;
+			}
+		}
+		_readCv.notify_all();
+	}
+}
+
+void FilePipeline::add(std::filesystem::path path)
+{
+	{
+		std::scoped_lock lock(_readMutex);
+		_paths.push_back(std::move(path));
+		_slots.emplace_back();
+		_ready.push_back(0);
+	}
+	_readCv.notify_all();
+}
+
+void FilePipeline::close()
+{
+	{
+		std::scoped_lock lock(_readMutex);
+		_closed = true;
+	}
+	_readCv.notify_all();
+}
+
+std::optional<FilePipeline::ReadResult> FilePipeline::next()
+{
+	std::unique_lock lock(_readMutex);
+	_readCv.wait(lock, [this] {
+		return _consumed < _paths.size() ? _ready[_consumed] != 0 : _closed;
+	});
+
+	if (_consumed >= _paths.size())
+		return std::nullopt;
+
+	ReadResult result = std::move(_slots[_consumed]);
+	_consumed++;
+	lock.unlock();
+
+	// Frees up room in the read-ahead window
+	_readCv.notify_all();
+	return result;
+}
+
+std::shared_future<bool> FilePipeline::write(std::filesystem::path path, std::span<const uint8_t> data, bool keepUnchanged)
+{
+	WriteRequest request{ std::move(path), std::string(data.begin(), data.end()) };
+	request.keepUnchanged = keepUnchanged;
+
+	auto unchanged = request.done.get_future().share();
+	queueWrite(std::move(request));
+	return unchanged;
+}
+
+void FilePipeline::remove(std::filesystem::path path)
+{
+	WriteRequest request{ std::move(path) };
+	request.remove = true;
+	queueWrite(std::move(request));
+}
+
+void FilePipeline::queueWrite(WriteRequest request)
+{
+	{
+		std::scoped_lock lock(_writeMutex);
+		_writes.push_back(std::move(request));
+	}
+	_writeCv.notify_all();
+}
+
+void FilePipeline::writeLoop()
+{
+	std::vector<WriteRequest> batch;
+	std::unordered_set<std::filesystem::path::string_type> paths;
+
+	for (;;)
+	{
+		{
+			std::unique_lock lock(_writeMutex);
+			_writeCv.wait(lock, [this] { return _stopping || !_writes.empty(); });
+
+			if (_writes.empty())
+				return;
+
+			// Whatever queued up while the last batch was written goes out together.
+			// A batch opens all its files before writing any, so a path that's
+			// already in it starts the next one, keeping writes to a file in order
+			paths.clear();
+			while (!_writes.empty() && batch.size() < RING_BATCH
+				&& paths.insert(_writes.front().path.lexically_normal().native()).second)
+			{
+				batch.push_back(std::move(_writes.front()));
+				_writes.pop_front();
+			}
+			_writesInFlight = batch.size();
+		}
+
+		if (!_writeRing || !_writeRing->write(batch))
+		{
+			if (_writeRing)
+			{
+				_writeRing.reset();
+				for (auto& request : batch)
+				{
+					request.error = 0;
+					request.unchanged = false;
+				}
+			}
+
+			for (auto& request : batch)
+				writeFile(request);
+		}
+
+		{
+			std::scoped_lock lock(_writeMutex);
+			for (auto& request : batch)
+			{
+				if (request.error)
+					_failedWrites++;
+				request.done.set_value(request.unchanged);
+			}
+			_writesInFlight = 0;
+		}
+		_writeCv.notify_all();
+		batch.clear();
+	}
+}
+
+size_t FilePipeline::finish()
+{
+	std::unique_lock lock(_writeMutex);
+	_writeCv.wait(lock, [this] { return _writes.empty() && _writesInFlight == 0; });
+	return _failedWrites;
+}
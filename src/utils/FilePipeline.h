@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef FILEPIPELINE_H
+#define FILEPIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Batched file I/O for compiling many files.
+ *
+ * Input files are read ahead of the consumer on background threads and handed
+ * out in the order they were added by next(). Paths can be added while files
+ * are already being read, so a directory walk can feed it as it goes. Writes are queued and flushed in batches by a
+ * writer thread, which also compares outputs against what's already on disk and
+ * removes stale files, so the threads handing it buffers never block on the
+ * filesystem. On Linux the batches go through io_uring (a handful of
+ * io_uring_enter calls per batch instead of open/stat/read/close per file),
+ * elsewhere or when io_uring is unavailable a few threads do plain blocking I/O.
+ * A ring that fails mid-batch is drained and dropped, the rest of the pipeline
+ * then uses the blocking fallback.
+ */
+class FilePipeline
+{
+public:
+	struct ReadResult
+	{
+		std::filesystem::path path;
+		std::string data{};
+		int error = 0;	// errno value, 0 on success
+	};
+
+	struct WriteRequest
+	{
+		std::filesystem::path path;
+		std::string data{};
+		int error = 0;
+		bool keepUnchanged = false;	// leave the file alone when it already holds data
+		bool remove = false;		// unlink path instead of writing it
+		bool unchanged = false;		// set when keepUnchanged found the same contents
+		std::promise<bool> done{};	// set to unchanged once the request was carried out
+	};
+
+	// Reads at most window files ahead of the consumer
+	explicit FilePipeline(size_t window = 256);
+	explicit FilePipeline(const std::vector<std::filesystem::path>& paths, size_t window = 256);
+	~FilePipeline();
+
+	FilePipeline(const FilePipeline&) = delete;
+	FilePipeline& operator=(const FilePipeline&) = delete;
+
+	bool usesIoUring() const { return _ioUring; }
+
+	// Thread-safe, close() once all paths have been added
+	void add(std::filesystem::path path);
+	void close();
+
+	// Next file in the order added, blocks until it has been read. Empty once
+	// the pipeline is closed and every file has been handed out
+	std::optional<ReadResult> next();
+
+	// With keepUnchanged an existing file that already holds data isn't rewritten,
+	// so it keeps its mtime. The future tells whether that was the case. Writes
+	// and removes of the same path are carried out in the order they're queued
+	std::shared_future<bool> write(std::filesystem::path path, std::span<const uint8_t> data, bool keepUnchanged = false);
+
+	// Removes the file if it exists, queued in order with the writes
+	void remove(std::filesystem::path path);
+
+	// Waits for the queued writes, returns the number that failed
+	size_t finish();
+
+private:
+	class Ring;
+
+	void readLoop();
+	void writeLoop();
+	void queueWrite(WriteRequest request);
+
+	// Slots are filled by the readers and moved out by next(), deques so
+	// adding paths doesn't move the slots of files being read
+	std::deque<std::filesystem::path> _paths;
+	std::deque<ReadResult> _slots;
+	std::deque<uint8_t> _ready;
+	size_t _window;
+	size_t _batchSize = 1;
+	size_t _claimed = 0;	// next path handed to a reader
+	size_t _consumed = 0;	// next path handed out by next()
+	bool _ioUring = false;
+	bool _closed = false;
+	bool _stopping = false;
+
+	// One ring per thread using it, null when io_uring isn't available
+	std::unique_ptr<Ring> _readRing;
+	std::unique_ptr<Ring> _writeRing;
+
+	std::mutex _readMutex;
+	std::condition_variable _readCv;
+	std::vector<std::thread> _readers;
+
+	std::mutex _writeMutex;
+	std::condition_variable _writeCv;
+	std::deque<WriteRequest> _writes;
+	size_t _writesInFlight = 0;
+	size_t _failedWrites = 0;
+	std::thread _writer;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <unordered_set>
+#include "FileWatcher.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+namespace
+{
+	constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (_fd >= 0)
+		close(_fd);
+}
+
+bool FileWatcher::open(const std::filesystem::path& root, std::string& error)
+{
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_fd < 0)
+	{
+		error = "inotify_init1 failed: " + std::string(strerror(errno));
+		return false;
+	}
+
+	_root = root;
+	addDirectory(root, nullptr, clock::now());
+	if (_directories.empty())
+	{
+		error = "Cannot watch " + root.string() + ": " + std::string(strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+void FileWatcher::addDirectory(const std::filesystem::path& dir, std::vector<Change>* changes, clock::time_point seen)
+{
+	auto add = [this](const std::filesystem::path& path) {
+		int wd = inotify_add_watch(_fd, path.c_str(), WATCH_MASK);
+		if (wd >= 0)
+			_directories[wd] = path;
+	};
+
+	add(dir);
+
+	std::error_code ec;
+	auto options = std::filesystem::directory_options::skip_permission_denied;
+	for (std::filesystem::recursive_directory_iterator it(dir, options, ec), end; !ec && it != end; it.increment(ec))
+	{
+		std::error_code typeEc;
+		if (it->is_symlink(typeEc))
+			continue;
+
+		if (it->is_directory(typeEc))
+		{
+			if (it->path().filename() == ".git")
+				it.disable_recursion_pending();
+			else
+				add(it->path());
+		}
+		else if (changes)
+			changes->push_back({ it->path(), seen });
+	}
+}
+
+std::vector<FileWatcher::Change> FileWatcher::wait(std::chrono::milliseconds debounce)
+{
+	std::vector<Change> changes;
+	std::unordered_set<std::string> reported;
+	clock::time_point firstEvent;
+
+	// Events are aligned to inotify_event in the buffer
+	alignas(inotify_event) char buffer[64 * 1024];
+
+	for (;;)
+	{
+		int timeout = -1;
+		if (!changes.empty())
+		{
+			auto deadline = firstEvent + debounce * 10;
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+			timeout = int(std::clamp(remaining, std::chrono::milliseconds(0), debounce).count());
+		}
+
+		pollfd pfd{ _fd, POLLIN, 0 };
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0 && errno == EINTR)
+			continue;
+
+		if (ready <= 0)
+		{
+			if (!changes.empty())
+				return changes;
+			continue;
+		}
+
+		auto now = clock::now();
+		ssize_t length = read(_fd, buffer, sizeof(buffer));
+		if (length <= 0)
+			continue;
+
+		size_t before = changes.size();
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+			offset += ssize_t(sizeof(inotify_event) + event->len);
+
+			// Events were dropped (a checkout touching thousands of files), so
+			// which ones changed is unknown. Rescanning re-adds the watches and
+			// reports every file, unchanged outputs aren't rewritten
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				addDirectory(_root, &changes, now);
+				continue;
+			}
+
+			if (event->mask & IN_IGNORED)
+			{
+				_directories.erase(event->wd);
+				continue;
+			}
+
+			auto dir = _directories.find(event->wd);
+			if (dir == _directories.end() || event->len == 0)
+				continue;
+
+			auto path = dir->second / event->name;
+			if (event->mask & IN_ISDIR)
+			{
+				if (event->mask & (IN_CREATE | IN_MOVED_TO) && path.filename() != ".git")
+					addDirectory(path, &changes, now);
+			}
+			else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+				changes.push_back({ std::move(path), now });
+		}
+
+		if (before == 0 && !changes.empty())
+			firstEvent = now;
+
+		// Keep the first sighting of every file
+		changes.erase(std::remove_if(changes.begin() + before, changes.end(), [&](const Change& change) {
+			return !reported.insert(change.path.string()).second;
+		}), changes.end());
+	}
+}
+
+#else
+
+FileWatcher::~FileWatcher()
+{
+}
+
+bool FileWatcher::open(const std::filesystem::path&, std::string& error)
+{
+	error = "Watch mode requires inotify (Linux)";
+	return false;
+}
+
+void FileWatcher::addDirectory(const std::filesystem::path&, std::vector<Change>*, clock::time_point)
+{
+}
+
+std::vector<FileWatcher::Change> FileWatcher::wait(std::chrono::milliseconds)
+{
+	return {};
+}
+
+#endif
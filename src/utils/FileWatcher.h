@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Recursive directory watch on inotify (Linux only, open() fails elsewhere).
+ * Reports files that were written and closed or moved into the tree,
+ * directories created later are watched as they appear. When the kernel's
+ * event queue overflows, every file in the tree is reported.
+ */
+class FileWatcher
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Change
+	{
+		std::filesystem::path path;
+		clock::time_point seen;		// first event for the file, for edit-to-output latency
+	};
+
+	FileWatcher() = default;
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Returns false with error set when the tree can't be watched
+	bool open(const std::filesystem::path& root, std::string& error);
+
+	// Blocks until something changes, then keeps collecting until the tree has
+	// been quiet for debounce (at most 10x debounce). Every file is reported once
+	std::vector<Change> wait(std::chrono::milliseconds debounce);
+
+	size_t directoryCount() const { return _directories.size(); }
+
+private:
+	// Watches a directory and everything below it, files already inside are
+	// added to changes (a directory moved or copied into the tree)
+	void addDirectory(const std::filesystem::path& dir, std::vector<Change>* changes, clock::time_point seen);
+
+	int _fd = -1;
+	std::filesystem::path _root;
+	std::unordered_map<int, std::filesystem::path> _directories;
+};
+
+#endif
@@ -0,0 +1,383 @@
+#include <cstdio>
+#include "JsonLine.h"
+
+namespace
+{
+	class Parser
+	{
+	public:
+		Parser(std::string_view text, std::string& error)
+			: _text(text), _error(error)
+		{
+		}
+
+		bool parseObject(jsonline::Object& object)
+		{
+			skipSpace();
+			if (!expect('{'))
+				return false;
+
+			skipSpace();
+			if (peek() == '}')
+				_pos++;
+			else
+			{
+				for (;;)
+				{
+					skipSpace();
+					std::string key;
+					if (!parseString(key))
+						return false;
+
+					skipSpace();
+					if (!expect(':'))
+						return false;
+
+					skipSpace();
+					auto start = _pos;
+					jsonline::Value value;
+					if (!parseValue(value))
+						return false;
+					value.raw = _text.substr(start, _pos - start);
+					object[std::move(key)] = std::move(value);
+
+					skipSpace();
+					if (peek() == ',')
+					{
+						_pos++;
+						continue;
+					}
+					if (!expect('}'))
+						return false;
+					break;
+				}
+			}
+
+			skipSpace();
+			if (_pos != _text.size())
+				return fail("Trailing characters after the object");
+			return true;
+		}
+
+	private:
+		char peek() const
+		{
+			return _pos < _text.size() ? _text[_pos] : '\0';
+		}
+
+		void skipSpace()
+		{
+			while (_pos < _text.size() && (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\r' || _text[_pos] == '\n'))
+				_pos++;
+		}
+
+		bool fail(std::string message)
+		{
+			_error = std::move(message) + " at offset " + std::to_string(_pos);
+			return false;
+		}
+
+		bool expect(char c)
+		{
+			if (peek() != c)
+				return fail(std::string("Expected '") + c + "'");
+			_pos++;
+			return true;
+		}
+
+		bool parseValue(jsonline::Value& value)
+		{
+			char c = peek();
+			if (c == '"')
+			{
+				value.kind = jsonline::Value::Kind::String;
+				return parseString(value.text);
+			}
+
+			if (c == '{' || c == '[')
+				return fail("Nested objects and arrays aren't supported");
+
+			for (std::string_view literal : { "true", "false", "null" })
+			{
+				if (_text.substr(_pos, literal.size()) == literal)
+				{
+					value.kind = literal == "null" ? jsonline::Value::Kind::Null : jsonline::Value::Kind::Bool;
+					value.text = literal;
+					_pos += literal.size();
+					return true;
+				}
+			}
+
+			return parseNumber(value);
+		}
+
+		bool digits()
+		{
+			auto start = _pos;
+			while (_pos < _text.size() && _text[_pos] >= '0' && _text[_pos] <= '9')
+				_pos++;
+			return _pos > start;
+		}
+
+		bool parseNumber(jsonline::Value& value)
+		{
+			auto start = _pos;
+			if (peek() == '-')
+				_pos++;
+			if (!digits())
+				return fail("Invalid value");
+
+			if (peek() == '.')
+			{
+				_pos++;
+				if (!digits())
+					return fail("Invalid number");
+			}
+
+			if (peek() == 'e' || peek() == 'E')
+			{
+				_pos++;
+				if (peek() == '+' || peek() == '-')
+					_pos++;
+				if (!digits())
+					return fail("Invalid number");
+			}
+
+			value.kind = jsonline::Value::Kind::Number;
+			value.text = _text.substr(start, _pos - start);
+			return true;
+		}
+
+		bool parseHex(uint32_t& val)
+		{
+			if (_text.size() - _pos < 4)
+				return fail("Truncated \\u escape");
+
+			val = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				char c = _text[_pos++];
+				val <<= 4;
+				if (c >= '0' && c <= '9')
+					val |= uint32_t(c - '0');
+				else if (c >= 'a' && c <= 'f')
+					val |= uint32_t(c - 'a' + 10);
+				else if (c >= 'A' && c <= 'F')
+					val |= uint32_t(c - 'A' + 10);
+				else
+					return fail("Invalid \\u escape");
+			}
+			return true;
+		}
+
+		static void appendUtf8(std::string& out, uint32_t cp)
+		{
+			if (cp < 0x80)
+				out.push_back(char(cp));
+			else if (cp < 0x800)
+			{
+				out.push_back(char(0xC0 | (cp >> 6)));
+				out.push_back(char(0x80 | (cp & 0x3F)));
+			}
+			else if (cp < 0x10000)
+			{
+				out.push_back(char(0xE0 | (cp >> 12)));
+				out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(char(0x80 | (cp & 0x3F)));
+			}
+			else
+			{
+				out.push_back(char(0xF0 | (cp >> 18)));
+				out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+				out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+				out.push_back(char(0x80 | (cp & 0x3F)));
+			}
+		}
+
+		bool parseString(std::string& out)
+		{
+			if (!expect('"'))
+				return false;
+
+			for (;;)
+			{
+				// Copy runs without escapes in one go
+				auto end = _text.find_first_of("\"\\", _pos);
+				if (end == std::string_view::npos)
+					return fail("Unterminated string");
+
+				for (auto i = _pos; i < end; i++)
+				{
+					if (uint8_t(_text[i]) < 0x20)
+					{
+						_pos = i;
+						return fail("Control character in string");
+					}
+				}
+
+				out.append(_text.substr(_pos, end - _pos));
+				_pos = end + 1;
+				if (_text[end] == '"')
+					return true;
+
+				if (_pos >= _text.size())
+					return fail("Unterminated string");
+
+				char escape = _text[_pos++];
+				switch (escape)
+				{
+					case '"': out.push_back('"'); break;
+					case '\\': out.push_back('\\'); break;
+					case '/': out.push_back('/'); break;
+					case 'b': out.push_back('\b'); break;
+					case 'f': out.push_back('\f'); break;
+					case 'n': out.push_back('\n'); break;
+					case 'r': out.push_back('\r'); break;
+					case 't': out.push_back('\t'); break;
+					case 'u':
+					{
+						uint32_t cp;
+						if (!parseHex(cp))
+							return false;
+
+						// Surrogate pairs combine into one code point, lone halves become U+FFFD
+						if (cp >= 0xD800 && cp < 0xDC00 && _text.substr(_pos, 2) == "\\u")
+						{
+							auto save = _pos;
+							_pos += 2;
+							uint32_t low;
+							if (!parseHex(low))
+								return false;
+
+							if (low >= 0xDC00 && low < 0xE000)
+								cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+							else
+								_pos = save;
+						}
+
+						if (cp >= 0xD800 && cp < 0xE000)
+							cp = 0xFFFD;
+						appendUtf8(out, cp);
+						break;
+					}
+					default:
+						_pos--;
+						return fail("Invalid escape");
+				}
+			}
+		}
+
+		std::string_view _text;
+		std::string& _error;
+		size_t _pos = 0;
+	};
+}
+
+namespace jsonline
+{
+	bool parseObject(std::string_view line, Object& object, std::string& error)
+	{
+		Parser parser(line, error);
+		return parser.parseObject(object);
+	}
+
+	std::string encodeBase64(std::span<const uint8_t> data)
+	{
+		static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+		std::string out;
+		out.reserve((data.size() + 2) / 3 * 4);
+
+		size_t i = 0;
+		for (; i + 2 < data.size(); i += 3)
+		{
+			uint32_t chunk = uint32_t(data[i]) << 16 | uint32_t(data[i + 1]) << 8 | data[i + 2];
+			out.push_back(ALPHABET[chunk >> 18]);
+			out.push_back(ALPHABET[(chunk >> 12) & 0x3F]);
+			out.push_back(ALPHABET[(chunk >> 6) & 0x3F]);
+			out.push_back(ALPHABET[chunk & 0x3F]);
+		}
+
+		if (i < data.size())
+		{
+			uint32_t chunk = uint32_t(data[i]) << 16 | (i + 1 < data.size() ? uint32_t(data[i + 1]) << 8 : 0);
+			out.push_back(ALPHABET[chunk >> 18]);
+			out.push_back(ALPHABET[(chunk >> 12) & 0x3F]);
+			out.push_back(i + 1 < data.size() ? ALPHABET[(chunk >> 6) & 0x3F] : '=');
+			out.push_back('=');
+		}
+
+		return out;
+	}
+
+	void Writer::key(std::string_view key)
+	{
+		if (!_first)
+			_out.push_back(',');
+		_first = false;
+		appendString(key);
+		_out.push_back(':');
+	}
+
+	void Writer::appendString(std::string_view val)
+	{
+		_out.push_back('"');
+		for (char c : val)
+		{
+			switch (c)
+			{
+				case '"': _out.append("\\\""); break;
+				case '\\': _out.append("\\\\"); break;
+				case '\n': _out.append("\\n"); break;
+				case '\r': _out.append("\\r"); break;
+				case '\t': _out.append("\\t"); break;
+				default:
+					if (uint8_t(c) < 0x20)
+					{
+						char escape[8];
+						snprintf(escape, sizeof(escape), "\\u%04x", unsigned(c));
+						_out.append(escape);
+					}
+					else
+						_out.push_back(c);
+			}
+		}
+		_out.push_back('"');
+	}
+
+	void Writer::raw(std::string_view key, std::string_view json)
+	{
+		this->key(key);
+		_out.append(json);
+	}
+
+	void Writer::string(std::string_view key, std::string_view val)
+	{
+		this->key(key);
+		appendString(val);
+	}
+
+	void Writer::boolean(std::string_view key, bool val)
+	{
+		this->key(key);
+		_out.append(val ? "true" : "false");
+	}
+
+	void Writer::number(std::string_view key, double val)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "%.3f", val);
+		raw(key, text);
+	}
+
+	void Writer::number(std::string_view key, uint64_t val)
+	{
+		raw(key, std::to_string(val));
+	}
+
+	const std::string& Writer::finish()
+	{
+		_out.push_back('}');
+		return _out;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#ifndef JSONLINE_H
+#define JSONLINE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/*
+ * Just enough JSON for newline-delimited request/response streams: requests
+ * are flat objects of scalars, responses are built field by field into a
+ * single line.
+ */
+namespace jsonline
+{
+	struct Value
+	{
+		enum class Kind : uint8_t
+		{
+			Null,
+			Bool,
+			Number,
+			String
+		};
+
+		Kind kind = Kind::Null;
+		std::string text;	// unescaped for strings, the literal otherwise
+		std::string raw;	// as written in the input, to echo it back
+	};
+
+	using Object = std::unordered_map<std::string, Value>;
+
+	// Parses one flat object, nested objects and arrays are rejected. Sets error on failure
+	bool parseObject(std::string_view line, Object& object, std::string& error);
+
+	std::string encodeBase64(std::span<const uint8_t> data);
+
+	// Builds {"key":value,...} without the trailing newline
+	class Writer
+	{
+	public:
+		Writer() : _out("{") {}
+
+		void raw(std::string_view key, std::string_view json);
+		void string(std::string_view key, std::string_view val);
+		void boolean(std::string_view key, bool val);
+		void number(std::string_view key, double val);		// three decimals, for timings
+		void number(std::string_view key, uint64_t val);
+
+		// Array of strings, from any range of string-like elements
+		template<typename Range>
+		void strings(std::string_view key, const Range& values)
+		{
+			this->key(key);
+			_out.push_back('[');
+			bool first = true;
+			for (const auto& val : values)
+			{
+				if (!first)
+					_out.push_back(',');
+				appendString(val);
+				first = false;
+			}
+			_out.push_back(']');
+		}
+
+		const std::string& finish();
+
+	private:
+		void key(std::string_view key);
+		void appendString(std::string_view val);
+
+		std::string _out;
+		bool _first = true;
+	};
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept
+{
+	*this = std::move(o);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept
+{
+	if (this != &o)
+	{
+		close();
+		_mapping = std::exchange(o._mapping, nullptr);
+		_size = std::exchange(o._size, 0);
+#if defined(_WIN32)
+		_mappingHandle = std::exchange(o._mappingHandle, nullptr);
+#endif
+		_fallback = std::move(o._fallback);
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		if (HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr))
+		{
+			if (void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+			{
+				_mapping = view;
+				_mappingHandle = mapping;
+				_size = size_t(size.QuadPart);
+			}
+			else
+				CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+
+	if (_mapping)
+		return true;
+
+	std::ifstream stream(filename, std::ios::binary);
+	if (!stream)
+		return false;
+
+	_fallback.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	return !stream.bad();
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void *view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED)
+		{
+			_mapping = view;
+			_size = size_t(st.st_size);
+		}
+	}
+
+	// Read through the same descriptor, reopening a pipe would wait for another writer
+	bool success = true;
+	if (!_mapping)
+	{
+		uint8_t buffer[64 * 1024];
+		while (ssize_t count = ::read(fd, buffer, sizeof(buffer)))
+		{
+			if (count < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				_fallback.clear();
+				success = false;
+				break;
+			}
+			_fallback.insert(_fallback.end(), buffer, buffer + count);
+		}
+	}
+	::close(fd);
+	return success;
+#endif
+}
+
+void MappedFile::close()
+{
+	if (_mapping)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(_mapping);
+		CloseHandle(_mappingHandle);
+		_mappingHandle = nullptr;
+#else
+		munmap(_mapping, _size);
+#endif
+		_mapping = nullptr;
+		_size = 0;
+	}
+
+	_fallback.clear();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Read-only file contents, memory mapped where the platform allows it and
+ * read into memory otherwise (empty files, pipes, mmap failures).
+ * Pairs with BytecodeView to inspect compiled files without copying them.
+ */
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(MappedFile&& o) noexcept;
+	MappedFile& operator=(MappedFile&& o) noexcept;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false when the file can't be opened or read
+	bool open(const std::string& filename);
+	void close();
+
+	bool isMapped() const { return _mapping != nullptr; }
+
+	std::span<const uint8_t> data() const
+	{
+		return _mapping ? std::span<const uint8_t>(static_cast<const uint8_t *>(_mapping), _size) : std::span<const uint8_t>(_fallback);
+	}
+
+private:
+	void *_mapping = nullptr;
+	size_t _size = 0;
+#if defined(_WIN32)
+	void *_mappingHandle = nullptr;
+#endif
+	std::vector<uint8_t> _fallback;
+};
+
+#endif
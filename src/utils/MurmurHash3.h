@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef MURMURHASH3_H
+#define MURMURHASH3_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+ * MurmurHash3 x64 128-bit (Austin Appleby, public domain).
+ *
+ * Stable across platforms and runs, unlike std::hash, so the result can be
+ * written into compiled output and compared between builds. Not a
+ * cryptographic hash.
+ */
+namespace murmur3
+{
+	using Hash128 = std::array<uint64_t, 2>;
+
+	inline uint64_t rotl64(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t fmix64(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdULL;
+		k ^= k >> 33;
+		k *= 0xc4ceb9fe1a85ec53ULL;
+		k ^= k >> 33;
+		return k;
+	}
+
+	// Little-endian block read, so the hash doesn't depend on the host byte order
+	inline uint64_t readBlock(const uint8_t *p)
+	{
+		uint64_t k = 0;
+		for (int i = 7; i >= 0; i--)
+			k = (k << 8) | p[i];
+		return k;
+	}
+
+	inline Hash128 hash128(const void *key, size_t len, uint64_t seed = 0)
+	{
+		const auto *data = static_cast<const uint8_t *>(key);
+		const size_t nblocks = len / 16;
+
+		uint64_t h1 = seed;
+		uint64_t h2 = seed;
+
+		constexpr uint64_t c1 = 0x87c37b91114253d5ULL;
+		constexpr uint64_t c2 = 0x4cf5ad432745937fULL;
+
+		for (size_t i = 0; i < nblocks; i++)
+		{
+			uint64_t k1 = readBlock(data + i * 16);
+			uint64_t k2 = readBlock(data + i * 16 + 8);
+
+			k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+			h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+			k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+			h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+		}
+
+		const uint8_t *tail = data + nblocks * 16;
+		uint64_t k1 = 0;
+		uint64_t k2 = 0;
+
+		switch (len & 15)
+		{
+			case 15: k2 ^= uint64_t(tail[14]) << 48; [[fallthrough]];
+			case 14: k2 ^= uint64_t(tail[13]) << 40; [[fallthrough]];
+			case 13: k2 ^= uint64_t(tail[12]) << 32; [[fallthrough]];
+			case 12: k2 ^= uint64_t(tail[11]) << 24; [[fallthrough]];
+			case 11: k2 ^= uint64_t(tail[10]) << 16; [[fallthrough]];
+			case 10: k2 ^= uint64_t(tail[9]) << 8; [[fallthrough]];
+			case 9:
+				k2 ^= uint64_t(tail[8]);
+				k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+				[[fallthrough]];
+			case 8: k1 ^= uint64_t(tail[7]) << 56; [[fallthrough]];
+			case 7: k1 ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+			case 6: k1 ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+			case 5: k1 ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+			case 4: k1 ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+			case 3: k1 ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+			case 2: k1 ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+			case 1:
+				k1 ^= uint64_t(tail[0]);
+				k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+				break;
+			default:
+				break;
+		}
+
+		h1 ^= uint64_t(len);
+		h2 ^= uint64_t(len);
+
+		h1 += h2;
+		h2 += h1;
+
+		h1 = fmix64(h1);
+		h2 = fmix64(h2);
+
+		h1 += h2;
+		h2 += h1;
+
+		return { h1, h2 };
+	}
+}
+
+#endif
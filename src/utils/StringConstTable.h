@@ -0,0 +1,159 @@
+#pragma once
+
+#ifndef STRINGCONSTTABLE_H
+#define STRINGCONSTTABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Interned string table used by the bytecode emitter.
+ *
+ * Every string is stored exactly once, null-terminated, in one contiguous
+ * block that is laid out the same way as the string table segment. Lookups
+ * go through an open-addressing (linear probing) index keyed by string_view,
+ * so looking up an existing constant never constructs a temporary string.
+ */
+class StringConstTable
+{
+	struct Entry
+	{
+		uint32_t offset;
+		uint32_t length;
+		size_t hash;
+	};
+
+public:
+	static constexpr int32_t npos = -1;
+
+	explicit StringConstTable(size_t reserveBytes = 4096, size_t reserveEntries = 128)
+	{
+		_data.reserve(reserveBytes);
+		_entries.reserve(reserveEntries);
+		_slots.assign(slotCountFor(reserveEntries), 0);
+	}
+
+	/// <summary>
+	/// Returns the index of the string, inserting a copy of it if
+	/// it is not in the table yet
+	/// </summary>
+	int32_t insert(std::string_view str)
+	{
+		auto hash = std::hash<std::string_view>{}(str);
+
+		size_t slot = probe(str, hash);
+		if (_slots[slot] != 0)
+			return int32_t(_slots[slot] - 1);
+
+		// keep the load factor under 3/4, probe again since the slot moved
+		if ((_entries.size() + 1) * 4 > _slots.size() * 3)
+		{
+			rehash(_slots.size() * 2);
+			slot = probe(str, hash);
+		}
+
+		_entries.push_back(Entry{ uint32_t(_data.length()), uint32_t(str.length()), hash });
+		_data.append(str);
+		_data.push_back('\0');
+
+		_slots[slot] = uint32_t(_entries.size());
+		return int32_t(_entries.size() - 1);
+	}
+
+	/// <summary>
+	/// Returns the index of the string, or npos if it is not in the table
+	/// </summary>
+	int32_t find(std::string_view str) const
+	{
+		auto slot = _slots[probe(str, std::hash<std::string_view>{}(str))];
+		return slot != 0 ? int32_t(slot - 1) : npos;
+	}
+
+	std::string_view at(size_t idx) const
+	{
+		const auto& entry = _entries[idx];
+		return { _data.data() + entry.offset, entry.length };
+	}
+
+	std::string_view operator[](size_t idx) const
+	{
+		return at(idx);
+	}
+
+	size_t size() const
+	{
+		return _entries.size();
+	}
+
+	bool empty() const
+	{
+		return _entries.empty();
+	}
+
+	/// <summary>
+	/// Raw table contents, each string followed by a null-terminator
+	/// </summary>
+	std::string_view data() const
+	{
+		return _data;
+	}
+
+	void clear()
+	{
+		_data.clear();
+		_entries.clear();
+		std::fill(_slots.begin(), _slots.end(), 0);
+	}
+
+private:
+	std::string _data;
+	std::vector<Entry> _entries;
+
+	// entry index + 1, zero marks an empty slot. Size is always a power of two
+	std::vector<uint32_t> _slots;
+
+	static size_t slotCountFor(size_t entries)
+	{
+		size_t count = 16;
+		while (count * 3 < entries * 4)
+			count <<= 1;
+		return count;
+	}
+
+	size_t probe(std::string_view str, size_t hash) const
+	{
+		const size_t mask = _slots.size() - 1;
+
+		for (size_t i = hash & mask;; i = (i + 1) & mask)
+		{
+			auto slot = _slots[i];
+			if (slot == 0)
+				return i;
+
+			const auto& entry = _entries[slot - 1];
+			if (entry.hash == hash && entry.length == str.length() && at(slot - 1) == str)
+				return i;
+		}
+	}
+
+	void rehash(size_t count)
+	{
+		_slots.assign(count, 0);
+
+		const size_t mask = count - 1;
+		for (size_t idx = 0; idx < _entries.size(); idx++)
+		{
+			size_t i = _entries[idx].hash & mask;
+			while (_slots[i] != 0)
+				i = (i + 1) & mask;
+
+			_slots[i] = uint32_t(idx + 1);
+		}
+	}
+};
+
+#endif
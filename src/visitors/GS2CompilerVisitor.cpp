@@ -49,44 +49,143 @@ opcode::Opcode getExpressionOpCode(ExpressionOp op)
 	}
 }
 
-GS2CompilerVisitor::GS2CompilerVisitor(ParserContext & context, GS2BuiltInFunctions & builtin)
-	: parserContext(context), builtIn(builtin),
+GS2CompilerVisitor::GS2CompilerVisitor(ParserContext & context)
+	: parserContext(context),
 	_isCopyAssignment(false), _isInlineConditional(true), _isInsideExpression(false), _newObjectCount(0)
 {
+	label_refs.reserve(256);
+	label_addr.reserve(256);
+
+	// label 0 is reserved to mean "no label" (ex: break outside of a loop)
+	label_addr.push_back(unset_address);
+
 	fail_label = success_label = exit_label = createLabel();
 	break_label = continue_label = 0;
 }
 
 GS2CompilerVisitor::label_id GS2CompilerVisitor::createLabel()
 {
-	static label_id counter = 0;
-	auto id = ++counter;
-	return id;
+	label_addr.push_back(unset_address);
+	return label_id(label_addr.size() - 1);
 }
 
 void GS2CompilerVisitor::writeLabels()
 {
-	for (const auto& [label, locs] : label_locs)
+	for (const auto& ref : label_refs)
 	{
-		if (label == exit_label)
+		if (ref.label == exit_label)
 			continue;
 
-		auto label_iter = label_addr.find(label);
-		if (label_iter != label_addr.end())
+		auto write_addr = label_addr[ref.label];
+		if (write_addr != unset_address)
+			byteCode.setJumpTarget(ref.jump, write_addr);
+	}
+}
+
+bool GS2CompilerVisitor::isOperandChainLink(const ExpressionNode *node)
+{
+	if (node->NodeType() == ExpressionStrConcatNode::NodeName)
+		return true;
+
+	if (node->NodeType() != ExpressionBinaryOpNode::NodeName)
+		return false;
+
+	switch (static_cast<const ExpressionBinaryOpNode *>(node)->op)
+	{
+		case ExpressionOp::Plus:
+		case ExpressionOp::Minus:
+		case ExpressionOp::Multiply:
+		case ExpressionOp::Divide:
+		case ExpressionOp::Mod:
+		case ExpressionOp::Pow:
+		case ExpressionOp::BitwiseAnd:
+		case ExpressionOp::BitwiseOr:
+		case ExpressionOp::BitwiseXor:
+		case ExpressionOp::BitwiseLeftShift:
+		case ExpressionOp::BitwiseRightShift:
+		case ExpressionOp::LessThan:
+		case ExpressionOp::LessThanOrEqual:
+		case ExpressionOp::GreaterThan:
+		case ExpressionOp::GreaterThanOrEqual:
+		case ExpressionOp::Equal:
+		case ExpressionOp::NotEqual:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+void GS2CompilerVisitor::visitOperandChain(ExpressionBinaryOpNode *node)
+{
+	// Collect the left spine, then emit the leftmost operand and every
+	// link's right-hand side from the innermost link outwards
+	std::vector<ExpressionBinaryOpNode *> spine;
+	ExpressionNode *expr = node;
+	while (isOperandChainLink(expr))
+	{
+		auto link = static_cast<ExpressionBinaryOpNode *>(expr);
+		spine.push_back(link);
+		expr = link->left;
+	}
+
+	expr->visit(this);
+	for (auto it = spine.rbegin(); it != spine.rend(); ++it)
+		emitChainLink(*it);
+}
+
+/*
+ * Everything a chain link emits after its left operand: the conversions,
+ * the right operand and the operator
+ */
+void GS2CompilerVisitor::emitChainLink(ExpressionBinaryOpNode *node)
+{
+	if (node->NodeType() == ExpressionStrConcatNode::NodeName)
+	{
+		auto concat = static_cast<ExpressionStrConcatNode *>(node);
+		byteCode.emitConversionOp(concat->left->expressionType(), ExpressionType::EXPR_STRING);
+
+		switch (concat->sep)
 		{
-			auto write_addr = label_iter->second;
+			case ' ':
+			case '\t':
+			case '\n':
+				auto id = byteCode.getStringConst(std::string_view(&concat->sep, 1));
+				byteCode.emit(opcode::OP_TYPE_STRING);
+				byteCode.emitDynamicNumberUnsigned(id);
 
-			for (const auto& loc : locs)
-			{
-				byteCode.emit(short(write_addr), loc);
-			}
+				byteCode.emit(opcode::OP_JOIN);
+				break;
 		}
+
+		concat->right->visit(this);
+		byteCode.emitConversionOp(concat->right->expressionType(), ExpressionType::EXPR_STRING);
+
+		byteCode.emit(opcode::OP_JOIN);
+		return;
 	}
+
+	auto opCode = getExpressionOpCode(node->op);
+	assert(opCode != opcode::Opcode::OP_NONE);
+
+	// Equality compares the operands as they are
+	if (node->op == ExpressionOp::Equal || node->op == ExpressionOp::NotEqual)
+	{
+		node->right->visit(this);
+		byteCode.emit(opCode);
+		return;
+	}
+
+	byteCode.emitConversionOp(node->left->expressionType(), ExpressionType::EXPR_NUMBER);
+	node->right->visit(this);
+	byteCode.emitConversionOp(node->right->expressionType(), ExpressionType::EXPR_NUMBER);
+
+	byteCode.emit(opCode);
 }
 
 void GS2CompilerVisitor::Visit(Node *node)
 {
-	std::string errorMsg = std::format("unimplemented node type {}", node->NodeType());
+	std::string errorMsg = std::string("unimplemented node type ") + node->NodeType();
 	parserContext.addError({ ErrorLevel::E_ERROR, GS2CompilerError::ErrorCategory::Compiler, errorMsg });
 
 #ifdef DBGEMITTERS
@@ -104,6 +203,7 @@ void GS2CompilerVisitor::Visit(StatementBlock *node)
    for (const auto& n : node->statements)
 	{
 		assert(n != nullptr);
+		markSourceLocation(n);
 		n->visit(this);
 	}
 }
@@ -114,14 +214,12 @@ void GS2CompilerVisitor::Visit(StatementFnDeclNode *node)
 	printf("Declare function: %s\n", node->ident->c_str());
 #endif
 
-	size_t jmpLoc = 0;
+	size_t jmpLoc = SIZE_MAX;
 
 	if (node->emit_prejump)
 	{
-		byteCode.emit(opcode::OP_SET_INDEX);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0)); // replaced with jump index to last opcode
-		jmpLoc = byteCode.getBytecodePos();
+		// replaced with jump index to last opcode
+		jmpLoc = byteCode.emitJump(opcode::OP_SET_INDEX);
 	}
 
 	bool is_universe = false;
@@ -205,10 +303,7 @@ void GS2CompilerVisitor::Visit(ExpressionTernaryOpNode *node)
 		if (!IsBooleanReturningOp(byteCode.getLastOp()))
 			byteCode.emitConversionOp(node->condition->expressionType(), ExpressionType::EXPR_NUMBER);
 
-		byteCode.emit(opcode::OP_IF);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-		addLocation(new_fail_label, byteCode.getBytecodePos() - 2);
+		addLocation(new_fail_label, byteCode.emitJump(opcode::OP_IF));
 
 		node->leftExpr->visit(this);
 
@@ -218,10 +313,7 @@ void GS2CompilerVisitor::Visit(ExpressionTernaryOpNode *node)
 	}
 
 	// emit a jump to the end of this else block for the previous if-block
-	byteCode.emit(opcode::OP_SET_INDEX);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-	addLocation(new_success_label, byteCode.getBytecodePos() - 2);
+	addLocation(new_success_label, byteCode.emitJump(opcode::OP_SET_INDEX));
 
 	node->rightExpr->visit(this);
 	setLocation(new_success_label, byteCode.getOpIndex());
@@ -232,6 +324,12 @@ void GS2CompilerVisitor::Visit(ExpressionTernaryOpNode *node)
 
 void GS2CompilerVisitor::Visit(ExpressionBinaryOpNode *node)
 {
+	if (isOperandChainLink(node))
+	{
+		visitOperandChain(node);
+		return;
+	}
+
 	if (node->op == ExpressionOp::LogicalAnd || node->op == ExpressionOp::LogicalOr)
 	{
 		label_id save_labels[] = { fail_label, success_label };
@@ -265,17 +363,11 @@ void GS2CompilerVisitor::Visit(ExpressionBinaryOpNode *node)
 
 			if (is_inline_cond)
 			{
-				byteCode.emit(opcode::OP_AND);
-				byteCode.emit(char(0xF4));
-				byteCode.emit(short(0));
-				addLocation(fail_label, byteCode.getBytecodePos() - 2);
+				addLocation(fail_label, byteCode.emitJump(opcode::OP_AND));
 			}
 			else
 			{
-				byteCode.emit(opcode::OP_IF);
-				byteCode.emit(char(0xF4));
-				byteCode.emit(short(0));
-				addLocation(fail_label, byteCode.getBytecodePos() - 2);
+				addLocation(fail_label, byteCode.emitJump(opcode::OP_IF));
 			}
 
 			node->right->visit(this);
@@ -289,13 +381,9 @@ void GS2CompilerVisitor::Visit(ExpressionBinaryOpNode *node)
 			node->left->visit(this);
 			byteCode.emitConversionOp(node->left->expressionType(), ExpressionType::EXPR_NUMBER);
 
-			byteCode.emit(opcode::OP_OR);
-			byteCode.emit(char(0xF4));
-			byteCode.emit(short(0));
-			addLocation(success_label, byteCode.getBytecodePos() - 2);
+			addLocation(success_label, byteCode.emitJump(opcode::OP_OR));
 
 			setLocation(new_fail_label, byteCode.getOpIndex());
-			auto success_label_copy = success_label;
 			success_label = tmp_success_label;
 			fail_label = tmp_fail_label;
 
@@ -325,47 +413,6 @@ void GS2CompilerVisitor::Visit(ExpressionBinaryOpNode *node)
 
 	switch (node->op)
 	{
-		case ExpressionOp::Plus:
-		case ExpressionOp::Minus:
-		case ExpressionOp::Multiply:
-		case ExpressionOp::Divide:
-		case ExpressionOp::Mod:
-		case ExpressionOp::Pow:
-		case ExpressionOp::BitwiseAnd:
-		case ExpressionOp::BitwiseOr:
-		case ExpressionOp::BitwiseXor:
-		case ExpressionOp::BitwiseLeftShift:
-		case ExpressionOp::BitwiseRightShift:
-		case ExpressionOp::LessThan:
-		case ExpressionOp::LessThanOrEqual:
-		case ExpressionOp::GreaterThan:
-		case ExpressionOp::GreaterThanOrEqual:
-		{
-			node->left->visit(this);
-			byteCode.emitConversionOp(node->left->expressionType(), ExpressionType::EXPR_NUMBER);
-			node->right->visit(this);
-			byteCode.emitConversionOp(node->right->expressionType(), ExpressionType::EXPR_NUMBER);
-
-			auto opCode = getExpressionOpCode(node->op);
-			assert(opCode != opcode::Opcode::OP_NONE);
-
-			byteCode.emit(opCode);
-			return;
-		}
-
-		case ExpressionOp::Equal:
-		case ExpressionOp::NotEqual:
-		{
-			node->left->visit(this);
-			node->right->visit(this);
-
-			auto opCode = getExpressionOpCode(node->op);
-			assert(opCode != opcode::Opcode::OP_NONE);
-
-			byteCode.emit(opCode);
-			return;
-		}
-
 		case ExpressionOp::PlusAssign:
 		case ExpressionOp::MinusAssign:
 		case ExpressionOp::MultiplyAssign:
@@ -468,9 +515,12 @@ void GS2CompilerVisitor::Visit(ExpressionBinaryOpNode *node)
 			byteCode.emit(opCode);
 			return;
 		}
+
+		default:
+			break;
 	}
 
-	std::string errorMsg = std::format("Undefined opcode in BinaryExpression {}: {} {}", static_cast<int>(node->op), std::string{ExpressionOpToString(node->op)}, node->toString());
+	std::string errorMsg = "Undefined opcode in BinaryExpression " + std::to_string(static_cast<int>(node->op)) + ": " + std::string{ExpressionOpToString(node->op)} + " " + node->toString();
 	parserContext.addError({ ErrorLevel::E_ERROR, GS2CompilerError::ErrorCategory::Compiler, std::move(errorMsg) });
 }
 
@@ -576,6 +626,9 @@ void GS2CompilerVisitor::Visit(ExpressionUnaryOpNode* node)
 
 				return;
 			}
+
+			default:
+				break;
 		}
 	}
 	else
@@ -596,35 +649,19 @@ void GS2CompilerVisitor::Visit(ExpressionUnaryOpNode* node)
 				byteCode.emit(opcode::OP_INDEX_DEC);
 				return;
 			}
+
+			default:
+				break;
 		}
 	}
 
-	std::string errorMsg = std::format("Undefined opcode in UnaryExpression {}: {}", static_cast<int>(node->op), ExpressionOpToString(node->op));
+	std::string errorMsg = "Undefined opcode in UnaryExpression " + std::to_string(static_cast<int>(node->op)) + ": " + std::string{ExpressionOpToString(node->op)};
 	parserContext.addError({ ErrorLevel::E_ERROR, GS2CompilerError::ErrorCategory::Compiler, std::move(errorMsg) });
 }
 
 void GS2CompilerVisitor::Visit(ExpressionStrConcatNode *node)
 {
-	node->left->visit(this);
-	byteCode.emitConversionOp(node->left->expressionType(), ExpressionType::EXPR_STRING);
-
-	switch (node->sep)
-	{
-		case ' ':
-		case '\t':
-		case '\n':
-			auto id = byteCode.getStringConst(std::string(1, node->sep));
-			byteCode.emit(opcode::OP_TYPE_STRING);
-			byteCode.emitDynamicNumberUnsigned(id);
-
-			byteCode.emit(opcode::OP_JOIN);
-			break;
-	}
-
-	node->right->visit(this);
-	byteCode.emitConversionOp(node->right->expressionType(), ExpressionType::EXPR_STRING);
-
-	byteCode.emit(opcode::OP_JOIN);
+	visitOperandChain(node);
 }
 
 void GS2CompilerVisitor::Visit(ExpressionCastNode* node)
@@ -695,6 +732,8 @@ void GS2CompilerVisitor::Visit(ExpressionInOpNode *node)
 
 void GS2CompilerVisitor::Visit(ExpressionConstantNode *node)
 {
+	markSourceLocation(node);
+
 	switch (node->type)
 	{
 		case ExpressionConstantNode::ConstantType::TRUE_T:
@@ -726,6 +765,8 @@ void GS2CompilerVisitor::Visit(ExpressionIdentifierNode *node)
 		{"pi", opcode::OP_PI}
 	};
 
+	markSourceLocation(node);
+
 	// This is only true for the leading identifier
 	// this.testobj.field, it would be true for the first node (this) but false for
 	// the second node (testobj) and third node (field) that way reserved keywords
@@ -756,12 +797,14 @@ void GS2CompilerVisitor::Visit(ExpressionIdentifierNode *node)
 
 void GS2CompilerVisitor::Visit(ExpressionIntegerNode *node)
 {
+	markSourceLocation(node);
 	byteCode.emit(opcode::OP_TYPE_NUMBER);
 	byteCode.emitDynamicNumber(node->val);
 }
 
 void GS2CompilerVisitor::Visit(ExpressionNumberNode *node)
 {
+	markSourceLocation(node);
 	byteCode.emit(opcode::OP_TYPE_NUMBER);
 	byteCode.emitDoubleNumber(*node->val);
 }
@@ -775,7 +818,7 @@ void GS2CompilerVisitor::Visit(ExpressionPostfixNode* node)
 		node->nodes.back()->isAssignment = true;
 
 	auto count = node->nodes.size();
-	for (auto i = 0; i < count; i++)
+	for (size_t i = 0; i < count; i++)
 	{
 		node->nodes[i]->visit(this);
 
@@ -808,6 +851,8 @@ void GS2CompilerVisitor::Visit(ExpressionStringConstNode *node)
 	printf("String: %s\n", node->val->c_str());
 #endif
 
+	markSourceLocation(node);
+
 	auto id = byteCode.getStringConst(*node->val);
 
 	byteCode.emit(opcode::OP_TYPE_STRING);
@@ -833,20 +878,17 @@ void GS2CompilerVisitor::Visit(ExpressionFnCallNode *node)
 	auto isObjectCall = (node->objExpr != nullptr);
 
 	// Build-in commands
-	auto& cmdList = (isObjectCall ? builtIn.builtInObjMap : builtIn.builtInCmdMap);
 	std::string funcName = node->funcExpr->toString();
 
 #ifdef DBGEMITTERS
 	printf("Call Function: %s (obj call: %d)\n", funcName.c_str(), isObjectCall ? 1 : 0);
 #endif
 
-	auto iter = cmdList.find(funcName);
-	BuiltInCmd cmd = (iter != cmdList.end() ? iter->second : (isObjectCall ? defaultObjCall : defaultCall));
+	const BuiltInCmd *found = (isObjectCall ? GS2BuiltInFunctions::findObjCmd(funcName) : GS2BuiltInFunctions::findCmd(funcName));
+	const BuiltInCmd& cmd = (found ? *found : (isObjectCall ? defaultObjCall : defaultCall));
 
 	{
 		auto argumentVisitFn = [&](auto arg_iter, auto arg_iter_end, auto sig_iter, auto sig_iter_end) {
-			const auto& sig = cmd.sig;
-
 			// we need to skip over the return value
 			if (sig_iter != sig_iter_end)
 				++sig_iter;
@@ -970,16 +1012,13 @@ void GS2CompilerVisitor::Visit(ExpressionFnCallNode *node)
 void GS2CompilerVisitor::Visit(ExpressionFnObject *node)
 {
 	// We are emitting the jump before the function-decl node
-	byteCode.emit(opcode::OP_SET_INDEX);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-	auto jmpLoc = byteCode.getBytecodePos();
+	auto jmpLoc = byteCode.emitJump(opcode::OP_SET_INDEX);
 
 	// Visit the function declaration node
 	Visit(&node->fnNode);
 
 	// Emit jump for the above index, skipping over the lambda function
-	byteCode.emit(short(byteCode.getOpIndex()), jmpLoc - 2);
+	byteCode.setJumpTarget(jmpLoc, byteCode.getOpIndex());
 
 	// this
 	byteCode.emit(opcode::OP_THIS);
@@ -1042,10 +1081,7 @@ void GS2CompilerVisitor::Visit(StatementIfNode* node)
 		// set the break point to the start of the OP_IF instruction
 		setLocation(new_success_label, byteCode.getOpIndex());
 
-		byteCode.emit(opcode::OP_IF);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-		addLocation(new_fail_label, byteCode.getBytecodePos() - 2);
+		addLocation(new_fail_label, byteCode.emitJump(opcode::OP_IF));
 
 		node->thenBlock->visit(this);
 
@@ -1062,14 +1098,10 @@ void GS2CompilerVisitor::Visit(StatementIfNode* node)
 	if (node->elseBlock)
 	{
 		// emit a jump to the end of this else block for the previous if-block
-		byteCode.emit(opcode::OP_SET_INDEX);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-
-		auto elseLoc = byteCode.getBytecodePos() - 2;
+		auto elseLoc = byteCode.emitJump(opcode::OP_SET_INDEX);
 
 		node->elseBlock->visit(this);
-		byteCode.emit(short(byteCode.getOpIndex()), elseLoc);
+		byteCode.setJumpTarget(elseLoc, byteCode.getOpIndex());
 
 		success_label = save_labels[0];
 		fail_label = save_labels[1];
@@ -1084,7 +1116,7 @@ void GS2CompilerVisitor::Visit(ExpressionNewArrayNode *node)
 	byteCode.emitDynamicNumber(node->dimensions[0]);
 	byteCode.emit(opcode::OP_ARRAY_NEW);
 
-	for (auto i = 1; i < node->dimensions.size(); i++)
+	for (size_t i = 1; i < node->dimensions.size(); i++)
 	{
 		byteCode.emit(opcode::OP_TYPE_NUMBER);
 		byteCode.emitDynamicNumber(node->dimensions[i]);
@@ -1141,10 +1173,7 @@ void GS2CompilerVisitor::Visit(StatementWhileNode *node)
 
 		byteCode.emitConversionOp(node->expr->expressionType(), ExpressionType::EXPR_NUMBER);
 
-		byteCode.emit(opcode::OP_IF);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-		addLocation(new_break_label, byteCode.getBytecodePos() - 2);
+		addLocation(new_break_label, byteCode.emitJump(opcode::OP_IF));
 
 		// Increment loop count
 		byteCode.emit(opcode::OP_CMD_CALL);
@@ -1152,10 +1181,7 @@ void GS2CompilerVisitor::Visit(StatementWhileNode *node)
 		node->block->visit(this);
 
 		// Jump back to condition
-		byteCode.emit(opcode::OP_SET_INDEX);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-		addLocation(new_continue_label, byteCode.getBytecodePos() - 2);
+		addLocation(new_continue_label, byteCode.emitJump(opcode::OP_SET_INDEX));
 
 		// Set the fail breakpoint to after the while-statement
 		setLocation(new_break_label, byteCode.getOpIndex());
@@ -1168,36 +1194,30 @@ void GS2CompilerVisitor::Visit(StatementWhileNode *node)
 	break_label = save_labels[3];
 }
 
-void GS2CompilerVisitor::Visit(StatementBreakNode* node)
+void GS2CompilerVisitor::Visit(StatementBreakNode*)
 {
 	if (break_label <= 0)
 	{
-		std::string errorMsg = std::format("`break` outside loop detected");
+		std::string errorMsg = "`break` outside loop detected";
 		parserContext.addError({ ErrorLevel::E_WARNING, GS2CompilerError::ErrorCategory::Compiler, std::move(errorMsg) });
 		return;
 	}
 
 	// Emit jump out of loop
-	byteCode.emit(opcode::OP_SET_INDEX);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-	addLocation(break_label, byteCode.getBytecodePos() - 2);
+	addLocation(break_label, byteCode.emitJump(opcode::OP_SET_INDEX));
 }
 
-void GS2CompilerVisitor::Visit(StatementContinueNode* node)
+void GS2CompilerVisitor::Visit(StatementContinueNode*)
 {
 	if (continue_label <= 0)
 	{
-		std::string errorMsg = std::format("`continue` outside loop detected");
+		std::string errorMsg = "`continue` outside loop detected";
 		parserContext.addError({ ErrorLevel::E_WARNING, GS2CompilerError::ErrorCategory::Compiler, std::move(errorMsg) });
 		return;
 	}
 
 	// Emit jump back to the loop-condition
-	byteCode.emit(opcode::OP_SET_INDEX);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-	addLocation(continue_label, byteCode.getBytecodePos() - 2);
+	addLocation(continue_label, byteCode.emitJump(opcode::OP_SET_INDEX));
 }
 
 void GS2CompilerVisitor::Visit(StatementForNode *node)
@@ -1231,13 +1251,9 @@ void GS2CompilerVisitor::Visit(StatementForNode *node)
 		break_label = new_break_label;
 		continue_label = new_continue_label;
 
-		// Emit if-loop on conditional expression, with a failed jump to the end-block
-		byteCode.emit(opcode::OP_IF);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-
-		// Add break location for the jump out of the loop
-		addLocation(new_break_label, byteCode.getBytecodePos() - 2);
+		// Emit if-loop on conditional expression, with a failed jump to the end-block.
+		// The jump is registered under the break label to jump out of the loop
+		addLocation(new_break_label, byteCode.emitJump(opcode::OP_IF));
 
 		// Increment loop count
 		byteCode.emit(opcode::OP_CMD_CALL);
@@ -1299,18 +1315,14 @@ void GS2CompilerVisitor::Visit(StatementNewNode* node)
 	// with statement
 	byteCode.emit(opcode::OP_CONV_TO_OBJECT);
 
-	byteCode.emit(opcode::OP_WITH);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-
-	auto withLoc = byteCode.getBytecodePos() - 2;
+	auto withLoc = byteCode.emitJump(opcode::OP_WITH);
 
 	int prevNewObjectCount = _newObjectCount++;
 	if (node->stmtBlock)
 		node->stmtBlock->visit(this);
 
 	byteCode.emit(opcode::OP_WITHEND);
-	byteCode.emit(short(byteCode.getOpIndex()), withLoc);
+	byteCode.setJumpTarget(withLoc, byteCode.getOpIndex());
 
 	///////
 	// call addcontrol
@@ -1334,16 +1346,12 @@ void GS2CompilerVisitor::Visit(StatementWithNode* node)
 	node->expr->visit(this);
 	byteCode.emit(opcode::OP_CONV_TO_OBJECT);
 
-	byteCode.emit(opcode::OP_WITH);
-	byteCode.emit(char(0xF4));
-	byteCode.emit(short(0));
-
-	auto withLoc = byteCode.getBytecodePos() - 2;
+	auto withLoc = byteCode.emitJump(opcode::OP_WITH);
 	if (node->block)
 		node->block->visit(this);
 
 	byteCode.emit(opcode::OP_WITHEND);
-	byteCode.emit(short(byteCode.getOpIndex()), withLoc);
+	byteCode.setJumpTarget(withLoc, byteCode.getOpIndex());
 }
 
 void GS2CompilerVisitor::Visit(ExpressionListNode* node)
@@ -1380,12 +1388,9 @@ void GS2CompilerVisitor::Visit(StatementForEachNode *node)
 		continue_label = new_continue_label;
 
 		auto startLoopOp = byteCode.getOpIndex();
-		byteCode.emit(opcode::OP_FOREACH);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
 
 		// Add break location for the jump out of the loop
-		addLocation(new_break_label, byteCode.getBytecodePos() - 2);
+		addLocation(new_break_label, byteCode.emitJump(opcode::OP_FOREACH));
 
 		byteCode.emit(opcode::OP_CMD_CALL);
 		node->block->visit(this);
@@ -1440,10 +1445,7 @@ void GS2CompilerVisitor::Visit(StatementSwitchNode* node)
 		std::vector<label_id> caseStartOp;
 
 		// jump to case-test
-		byteCode.emit(opcode::OP_SET_INDEX);
-		byteCode.emit(char(0xF4));
-		byteCode.emit(short(0));
-		size_t caseTestLoc = byteCode.getBytecodePos() - 2;
+		auto caseTestLoc = byteCode.emitJump(opcode::OP_SET_INDEX);
 
 		// case-list:
 		for (const auto& caseNode : node->cases)
@@ -1451,8 +1453,7 @@ void GS2CompilerVisitor::Visit(StatementSwitchNode* node)
 			auto new_case_label = createLabel();
 			setLocation(new_case_label, byteCode.getOpIndex());
 
-			for (const auto& caseExpr : caseNode.exprList)
-				caseStartOp.push_back(new_case_label);
+			caseStartOp.insert(caseStartOp.end(), caseNode.exprList.size(), new_case_label);
 
 			break_label = new_break_label;
 			continue_label = new_case_label;
@@ -1460,7 +1461,7 @@ void GS2CompilerVisitor::Visit(StatementSwitchNode* node)
 		}
 
 		// case-test:
-		byteCode.emit(short(byteCode.getOpIndex()), caseTestLoc);
+		byteCode.setJumpTarget(caseTestLoc, byteCode.getOpIndex());
 		node->expr->visit(this);
 
 		size_t i = 0;
@@ -6,7 +6,6 @@
 #include <set>
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include "ast/astvisitor.h"
 #include "GS2Bytecode.h"
 #include "GS2BuiltInFunctions.h"
@@ -19,11 +18,22 @@ class GS2CompilerVisitor : public NodeVisitor
 	using jmp_address = uint32_t;
 
 	public:
-		GS2CompilerVisitor(ParserContext& context, GS2BuiltInFunctions& builtin);
+		GS2CompilerVisitor(ParserContext& context);
 
 		Buffer getByteCode();
+		Buffer getLineTable(const linetable::Fingerprint& fingerprint) const;
 		const std::set<std::string>& getJoinedClasses() const;
 
+		size_t getLabelCount() const;
+		size_t getStringCount() const;
+		size_t getStringTableBytes() const;
+
+		/**
+		 * Record the source location of emitted operations, retrievable
+		 * with getLineTable() once the bytecode is finalized and fingerprinted
+		 */
+		void enableLineTable();
+
 	public:
 		virtual void Visit(Node *node);
 		virtual void Visit(StatementNode *node);
@@ -62,7 +72,6 @@ class GS2CompilerVisitor : public NodeVisitor
 	private:
 		GS2Bytecode byteCode;
 		ParserContext& parserContext;
-		GS2BuiltInFunctions& builtIn;
 		std::set<std::string> joinedClasses;
 
 		bool _isCopyAssignment;
@@ -70,15 +79,37 @@ class GS2CompilerVisitor : public NodeVisitor
 		bool _isInsideExpression;
 		int _newObjectCount;
 
+		// Left-associative chains (a + b + c ...) nest one level per operator,
+		// these compile them without recursing once per term
+		static bool isOperandChainLink(const ExpressionNode *node);
+		void visitOperandChain(ExpressionBinaryOpNode *node);
+		void emitChainLink(ExpressionBinaryOpNode *node);
+
 		// Jump-labels
+		//
+		// Label ids are handed out sequentially per compile, so the address of a
+		// label is stored directly at its index, and every jump that needs to be
+		// patched is appended to a single flat list.
+		struct label_ref
+		{
+			label_id label;
+			size_t jump;
+		};
+
+		static constexpr jmp_address unset_address = UINT32_MAX;
+
 		label_id success_label, fail_label, exit_label;
 		label_id break_label, continue_label;
-		std::unordered_map<label_id, std::vector<size_t>> label_locs;
-		std::unordered_map<label_id, jmp_address> label_addr;
+		std::vector<label_ref> label_refs;
+		std::vector<jmp_address> label_addr;
+
+		// Source locations are taken from statements and leaf expressions, any
+		// operations emitted afterwards are attributed to the same location
+		void markSourceLocation(const Node *node);
 
 		// Jump-label functions
 		label_id createLabel();
-		void addLocation(label_id label, size_t loc);
+		void addLocation(label_id label, size_t jump);
 		void setLocation(label_id label, jmp_address addr);
 		void writeLabels();
 };
@@ -90,14 +121,48 @@ inline Buffer GS2CompilerVisitor::getByteCode()
 	return byteCode.getByteCode();
 }
 
+inline Buffer GS2CompilerVisitor::getLineTable(const linetable::Fingerprint& fingerprint) const
+{
+	return byteCode.getLineTable(fingerprint);
+}
+
 inline const std::set<std::string>& GS2CompilerVisitor::getJoinedClasses() const
 {
 	return joinedClasses;
 }
 
-inline void GS2CompilerVisitor::addLocation(label_id label, size_t loc)
+inline size_t GS2CompilerVisitor::getLabelCount() const
+{
+	// label 0 is reserved
+	return label_addr.size() - 1;
+}
+
+inline size_t GS2CompilerVisitor::getStringCount() const
+{
+	return byteCode.getStringCount();
+}
+
+inline size_t GS2CompilerVisitor::getStringTableBytes() const
+{
+	return byteCode.getStringTableBytes();
+}
+
+inline void GS2CompilerVisitor::enableLineTable()
+{
+	byteCode.enableLineTable();
+}
+
+inline void GS2CompilerVisitor::markSourceLocation(const Node *node)
+{
+	// Constants are detached from the tree and visited in place of the identifier
+	// referencing them, so they keep the location of the reference
+	if (node->parent)
+		byteCode.setSourceLocation(node->lineNumber, node->columnNumber);
+}
+
+inline void GS2CompilerVisitor::addLocation(label_id label, size_t jump)
 {
-	label_locs[label].push_back(loc);
+	label_refs.push_back({ label, jump });
 }
 
 inline void GS2CompilerVisitor::setLocation(label_id label, jmp_address addr)
@@ -1,166 +1,83 @@
 #include "GS2Decompiler.h"
+#include "GS2Context.h"
+#ifndef __EMSCRIPTEN__
 #include <fstream>
+#endif
 #include <sstream>
 #include <algorithm>
 #include <cstring>
 #include <iomanip>
+#include <iterator>
+#include <span>
 
 namespace gs2decompiler {
 
-enum {
-    SEGMENT_GS1FLAGS = 1,
-    SEGMENT_FUNCTIONTABLE = 2,
-    SEGMENT_STRINGTABLE = 3,
-    SEGMENT_BYTECODE = 4
-};
-
 GS2Decompiler::GS2Decompiler() {
 }
 
 GS2Decompiler::~GS2Decompiler() {
 }
 
+#ifndef __EMSCRIPTEN__
 bool GS2Decompiler::loadBytecode(const std::string& filename) {
-    // Clear previous state
-    bytecodeData.clear();
-    stringTable.clear();
-    functions.clear();
-    functionInstructions.clear();
-    jumpTargets.clear();
-    error.clear();
-
-    // Read file
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
+    MappedFile file;
+    if (!file.open(filename)) {
         setError("Cannot open file: " + filename);
         return false;
     }
 
-    file.seekg(0, std::ios::end);
-    size_t fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    // Keep the mapping alive for as long as the view refers to it
+    bool result = loadBytecode(file.data());
+    mappedFile = std::move(file);
+    return result;
+}
+#endif
 
-    bytecodeData.resize(fileSize);
-    file.read(reinterpret_cast<char*>(bytecodeData.data()), fileSize);
+bool GS2Decompiler::loadBytecode(const uint8_t* data, size_t length) {
+    std::vector<uint8_t> copy(data, data + length);
+    bool result = loadBytecode(std::span<const uint8_t>(copy));
+    ownedData = std::move(copy);
+    return result;
+}
 
-    if (!file) {
-        setError("Failed to read file: " + filename);
-        return false;
-    }
+bool GS2Decompiler::loadBytecode(std::span<const uint8_t> data) {
+    // Clear previous state
+    view = BytecodeView(BytecodeView::skipHeader(data));
+    ownedData.clear();
+#ifndef __EMSCRIPTEN__
+    mappedFile.close();
+#endif
+    functions.clear();
+    instructions.clear();
+    lineTable.clear();
+    error.clear();
 
     // Parse segments
-    if (!parseSegments()) {
+    if (!view.index()) {
+        setError(view.error());
         return false;
     }
 
+    parseFunctionTable();
+
     // Decode instructions for each function
     return decodeInstructions();
 }
 
-bool GS2Decompiler::parseSegments() {
-    size_t pos = 0;
-
-    while (pos < bytecodeData.size()) {
-        // Need at least 8 bytes for segment header
-        if (pos + 8 > bytecodeData.size()) {
-            // End of file reached
-            break;
-        }
-
-        // Read segment type and length (big-endian 32-bit integers)
-        uint32_t segType = (static_cast<uint32_t>(bytecodeData[pos]) << 24) |
-                          (static_cast<uint32_t>(bytecodeData[pos + 1]) << 16) |
-                          (static_cast<uint32_t>(bytecodeData[pos + 2]) << 8) |
-                          static_cast<uint32_t>(bytecodeData[pos + 3]);
-
-        uint32_t segLength = (static_cast<uint32_t>(bytecodeData[pos + 4]) << 24) |
-                            (static_cast<uint32_t>(bytecodeData[pos + 5]) << 16) |
-                            (static_cast<uint32_t>(bytecodeData[pos + 6]) << 8) |
-                            static_cast<uint32_t>(bytecodeData[pos + 7]);
-
-        pos += 8;
-
-        // Validate segment type
-        if (segType < 1 || segType > 4) {
-            setError("Invalid segment type: " + std::to_string(segType));
-            return false;
-        }
-
-        if (pos + segLength > bytecodeData.size()) {
-            setError("Segment extends beyond file bounds");
-            return false;
-        }
-
-        switch (segType) {
-            case SEGMENT_GS1FLAGS:
-                if (!parseGS1Flags(pos, segLength))
-                    return false;
-                break;
-            case SEGMENT_FUNCTIONTABLE:
-                if (!parseFunctionTable(pos, segLength))
-                    return false;
-                break;
-            case SEGMENT_STRINGTABLE:
-                if (!parseStringTable(pos, segLength))
-                    return false;
-                break;
-            case SEGMENT_BYTECODE:
-                if (!parseBytecodeSegment(pos, segLength))
-                    return false;
-                break;
-            default:
-                break;
-        }
-
-        pos += segLength;
-    }
-
-    return true;
-}
-
-bool GS2Decompiler::parseGS1Flags(size_t offset, size_t length) {
-    // GS1 flags - not needed for decompilation
-    return true;
-}
-
-bool GS2Decompiler::parseFunctionTable(size_t offset, size_t length) {
-    size_t pos = offset;
-
-    while (pos < offset + length) {
-        if (pos + 4 > bytecodeData.size()) {
-            setError("Invalid function table entry");
-            return false;
-        }
-
-        // Read function opIndex (big-endian)
-        uint32_t opIndex = (static_cast<uint32_t>(bytecodeData[pos]) << 24) |
-                          (static_cast<uint32_t>(bytecodeData[pos + 1]) << 16) |
-                          (static_cast<uint32_t>(bytecodeData[pos + 2]) << 8) |
-                          static_cast<uint32_t>(bytecodeData[pos + 3]);
-        pos += 4;
-
-        // Read null-terminated function name
-        std::string funcName;
-        while (pos < bytecodeData.size() && bytecodeData[pos] != 0) {
-            funcName += static_cast<char>(bytecodeData[pos]);
-            pos++;
-        }
-        if (pos < bytecodeData.size()) {
-            pos++; // Skip null terminator
-        }
-
+bool GS2Decompiler::parseFunctionTable() {
+    for (const auto& entry : view.functions()) {
         FunctionInfo info;
-        info.name = funcName;
-        info.opIndex = opIndex;
+        info.name = entry.name;
+        info.opIndex = entry.opIndex;
         info.endOpIndex = 0; // Will be determined later
         functions.push_back(info);
     }
 
     // Sort functions by opIndex
-    std::sort(functions.begin(), functions.end(),
-              [](const FunctionInfo& a, const FunctionInfo& b) {
-                  return a.opIndex < b.opIndex;
-              });
+    std::stable_sort(functions.begin(), functions.end(),
+                     [](const FunctionInfo& a, const FunctionInfo& b) {
+                         return a.opIndex < b.opIndex;
+                     });
 
     // Set end indices
     for (size_t i = 0; i < functions.size(); i++) {
@@ -174,222 +91,146 @@ bool GS2Decompiler::parseFunctionTable(size_t offset, size_t length) {
     return true;
 }
 
-bool GS2Decompiler::parseStringTable(size_t offset, size_t length) {
-    size_t pos = offset;
+void InstructionStream::clear() {
+    ops.clear();
+    offsets.clear();
+    operands.clear();
+    jumpTargetBits.clear();
+}
 
-    while (pos < offset + length) {
-        std::string str;
-        while (pos < bytecodeData.size() && bytecodeData[pos] != 0) {
-            str += static_cast<char>(bytecodeData[pos]);
-            pos++;
-        }
-        if (pos < bytecodeData.size()) {
-            pos++; // Skip null terminator
-        }
-        stringTable.push_back(str);
-    }
+void InstructionStream::reserve(size_t count) {
+    ops.reserve(count);
+    offsets.reserve(count);
+    operands.reserve(count);
+}
 
-    return true;
+void InstructionStream::push(opcode::Opcode op, uint32_t offset, int32_t operand) {
+    ops.push_back(static_cast<uint8_t>(op));
+    offsets.push_back(offset);
+    operands.push_back(operand);
 }
 
-bool GS2Decompiler::parseBytecodeSegment(size_t offset, size_t length) {
-    // Store bytecode references for each function
-    for (auto& func : functions) {
-        // Calculate actual bytecode offset for this function
-        // The opIndex is relative to the bytecode segment
-        size_t funcStart = offset + func.opIndex;
-        size_t funcEnd = (func.endOpIndex == UINT32_MAX) ?
-                        (offset + length) : (offset + func.endOpIndex);
-
-        // Bounds check
-        if (funcStart > bytecodeData.size()) {
-            funcStart = bytecodeData.size();
-        }
-        if (funcEnd > bytecodeData.size()) {
-            funcEnd = bytecodeData.size();
+void InstructionStream::setJumpTargets(const std::vector<uint32_t>& targets) {
+    jumpTargetBits.assign((size() + 63) / 64, 0);
+    for (uint32_t target : targets) {
+        if (target < size()) {
+            jumpTargetBits[target / 64] |= uint64_t(1) << (target % 64);
         }
+    }
+}
 
-        // Extract bytecode for this function
-        if (funcStart <= funcEnd && funcStart <= bytecodeData.size()) {
-            func.bytecode.assign(bytecodeData.begin() + funcStart,
-                                bytecodeData.begin() + funcEnd);
+bool GS2Decompiler::decodeInstructions() {
+    // Decode the whole bytecode segment, so every instruction gets its
+    // absolute operation index. Most operations are a single byte
+    auto code = view.code();
+    instructions.reserve(code.size() / 2);
+
+    std::vector<uint32_t> targets;
+    BytecodeView::Op op;
+    for (size_t pos = 0; BytecodeView::decodeOp(code, pos, op); pos += op.length) {
+        // Jump targets are absolute operation indices
+        if (BytecodeView::operandKind(op.op) == BytecodeView::OperandKind::Jump && op.length > 2) {
+            targets.push_back(static_cast<uint32_t>(op.operand));
         }
+
+        instructions.push(op.op, static_cast<uint32_t>(op.offset), op.operand);
     }
 
-    return true;
-}
+    instructions.setJumpTargets(targets);
 
-bool GS2Decompiler::readDynamicNumber(size_t& pos, int32_t& outVal) {
-    // This is for reading from function bytecode, not the main bytecodeData
-    // We'll implement this per-function in decodeInstructions
-    return false;
-}
+    // Slice the instruction stream into functions by operation index
+    for (auto& func : functions) {
+        auto first = std::min<size_t>(func.opIndex, instructions.size());
+        auto last = std::min<size_t>(func.endOpIndex, instructions.size());
+        if (last < first) {
+            last = first;
+        }
 
-bool GS2Decompiler::readDynamicNumberUnsigned(size_t& pos, uint32_t& outVal) {
-    return false;
-}
+        size_t byteStart = first < instructions.size() ? instructions.offset(first) : code.size();
+        size_t byteEnd = last < instructions.size() ? instructions.offset(last) : code.size();
+        func.bytecode = code.subspan(byteStart, byteEnd - byteStart);
+        func.firstInstruction = first;
+        func.lastInstruction = last;
+    }
 
-bool GS2Decompiler::readDoubleNumber(size_t& pos, std::string& outVal) {
-    return false;
+    return true;
 }
 
-bool GS2Decompiler::decodeInstructions() {
-    // For each function, decode its bytecode into instructions
-    for (const auto& func : functions) {
-        std::vector<Instruction> instructions;
-        const auto& funcBytecode = func.bytecode;
-        size_t pos = 0;
-
-        while (pos < funcBytecode.size()) {
-            Instruction inst;
-            inst.bytecodeOffset = pos;
-
-            if (pos >= funcBytecode.size()) {
-                break;
+std::string_view GS2Decompiler::getOperandString(size_t opIndex) const {
+    auto code = view.code();
+    size_t offset = instructions.offset(opIndex);
+
+    switch (BytecodeView::operandKind(instructions.op(opIndex))) {
+        case BytecodeView::OperandKind::Number:
+            // Doubles are stored as text after the 0xF6 prefix
+            if (offset + 1 < code.size() && code[offset + 1] == 0xF6) {
+                auto text = code.subspan(offset + 2);
+                auto end = std::find(text.begin(), text.end(), uint8_t(0));
+                return { reinterpret_cast<const char*>(text.data()), static_cast<size_t>(end - text.begin()) };
             }
+            break;
 
-            inst.op = static_cast<opcode::Opcode>(funcBytecode[pos]);
-            pos++;
-
-            // Read operands based on opcode
-            switch (inst.op) {
-                case opcode::OP_SET_INDEX:
-                case opcode::OP_SET_INDEX_TRUE:
-                case opcode::OP_JMP:
-                case opcode::OP_IF:
-                case opcode::OP_AND:
-                case opcode::OP_OR:
-                case opcode::OP_WITH:
-                case opcode::OP_FOREACH:
-                case opcode::OP_WITHEND:
-                    // These have a jump offset operand (big-endian 16-bit)
-                    if (pos + 2 <= funcBytecode.size()) {
-                        uint16_t jumpOffset = (static_cast<uint16_t>(funcBytecode[pos]) << 8) |
-                                              static_cast<uint16_t>(funcBytecode[pos + 1]);
-                        inst.operandInt = static_cast<int16_t>(jumpOffset);
-                        pos += 2;
-
-                        // Calculate target opIndex for jump tracking
-                        if (inst.op == opcode::OP_JMP || inst.op == opcode::OP_IF ||
-                            inst.op == opcode::OP_AND || inst.op == opcode::OP_OR ||
-                            inst.op == opcode::OP_SET_INDEX || inst.op == opcode::OP_SET_INDEX_TRUE) {
-                            uint32_t currentOpIndex = instructions.size();
-                            uint32_t targetOpIndex = currentOpIndex + inst.operandInt;
-                            jumpTargets[targetOpIndex] = true;
-                        }
-                    }
-                    break;
-
-                case opcode::OP_TYPE_NUMBER: {
-                    // Followed by a dynamic number
-                    if (pos >= funcBytecode.size()) break;
-
-                    uint8_t numPrefix = funcBytecode[pos];
-                    pos++;
-
-                    if (numPrefix == 0xF6) {
-                        // Double number as string
-                        std::string doubleStr;
-                        while (pos < funcBytecode.size() && funcBytecode[pos] != 0) {
-                            doubleStr += static_cast<char>(funcBytecode[pos]);
-                            pos++;
-                        }
-                        if (pos < funcBytecode.size()) pos++; // Skip null
-                        inst.operandString = doubleStr;
-                    } else if (numPrefix >= 0xF0 && numPrefix <= 0xF5) {
-                        // Integer
-                        bool isSigned = (numPrefix >= 0xF3);
-                        int byteCount = 1 << (numPrefix % 3);
-
-                        if (pos + byteCount <= funcBytecode.size()) {
-                            if (byteCount == 1) {
-                                int8_t val = static_cast<int8_t>(funcBytecode[pos]);
-                                inst.operandInt = val;
-                            } else if (byteCount == 2) {
-                                int16_t val = (static_cast<int16_t>(funcBytecode[pos]) << 8) |
-                                             static_cast<int16_t>(funcBytecode[pos + 1]);
-                                inst.operandInt = val;
-                            } else if (byteCount == 4) {
-                                int32_t val = (static_cast<int32_t>(funcBytecode[pos]) << 24) |
-                                             (static_cast<int32_t>(funcBytecode[pos + 1]) << 16) |
-                                             (static_cast<int32_t>(funcBytecode[pos + 2]) << 8) |
-                                             static_cast<int32_t>(funcBytecode[pos + 3]);
-                                inst.operandInt = val;
-                            }
-                            pos += byteCount;
-                        }
-                    }
-                    break;
-                }
-
-                case opcode::OP_TYPE_STRING:
-                case opcode::OP_TYPE_VAR: {
-                    // Followed by an unsigned dynamic number (string table index)
-                    if (pos >= funcBytecode.size()) break;
-
-                    uint8_t numPrefix = funcBytecode[pos];
-                    pos++;
-
-                    if (numPrefix >= 0xF0 && numPrefix <= 0xF2) {
-                        int byteCount = 1 << (numPrefix - 0xF0);
-                        uint32_t strIdx = 0;
-
-                        if (pos + byteCount <= funcBytecode.size()) {
-                            if (byteCount == 1) {
-                                strIdx = static_cast<uint8_t>(funcBytecode[pos]);
-                            } else if (byteCount == 2) {
-                                strIdx = (static_cast<uint16_t>(funcBytecode[pos]) << 8) |
-                                        static_cast<uint16_t>(funcBytecode[pos + 1]);
-                            } else if (byteCount == 4) {
-                                strIdx = (static_cast<uint32_t>(funcBytecode[pos]) << 24) |
-                                        (static_cast<uint32_t>(funcBytecode[pos + 1]) << 16) |
-                                        (static_cast<uint32_t>(funcBytecode[pos + 2]) << 8) |
-                                        static_cast<uint32_t>(funcBytecode[pos + 3]);
-                            }
-                            pos += byteCount;
-
-                            inst.operandInt = strIdx;
-                            if (strIdx < stringTable.size()) {
-                                inst.operandString = stringTable[strIdx];
-                            }
-                        }
-                    }
-                    break;
-                }
-
-                default:
-                    // Most opcodes have no immediate operands
-                    break;
+        case BytecodeView::OperandKind::StringRef:
+            // Only when the index was fully encoded
+            if (instructions.length(opIndex, code.size()) > 2) {
+                return view.string(static_cast<uint32_t>(instructions.operand(opIndex)));
             }
+            break;
 
-            instructions.push_back(inst);
-        }
-
-        functionInstructions[func.name] = instructions;
+        default:
+            break;
     }
 
-    return true;
+    return {};
 }
 
 std::string GS2Decompiler::decompile() {
-    return generateSource();
+    std::ostringstream output;
+    decompile(output);
+    return output.str();
 }
 
-std::string GS2Decompiler::generateSource() {
-    std::stringstream output;
+void GS2Decompiler::decompile(std::ostream& output) const {
+    generateFunctions(output, 0, functions.size());
+}
 
-    for (const auto& func : functions) {
-        output << generateFunction(func) << "\n\n";
+void GS2Decompiler::decompile(std::ostream& output, CustomThreadPool<DecompilerThreadJob>& pool) const {
+    // Group neighbouring functions so small functions don't each pay for a job
+    std::vector<std::future<DecompilerThreadJob::job_result>> chunks;
+
+    size_t first = 0;
+    while (first < functions.size()) {
+        size_t last = first;
+        size_t ops = 0;
+        while (last < functions.size() && (last == first || ops < parallel_chunk_ops)) {
+            ops += functions[last].lastInstruction - functions[last].firstInstruction;
+            last++;
+        }
+
+        chunks.push_back(pool.queue(DecompilerThreadJob([this, first, last] {
+            std::ostringstream chunk;
+            generateFunctions(chunk, first, last);
+            return DecompilerThreadJob::job_result{ chunk.str() };
+        })));
+        first = last;
     }
 
-    return output.str();
+    // Written in function order as soon as each chunk is ready
+    for (auto& chunk : chunks) {
+        output << chunk.get().output;
+    }
 }
 
-std::string GS2Decompiler::generateFunction(const FunctionInfo& func) {
-    std::stringstream output;
+void GS2Decompiler::generateFunctions(std::ostream& output, size_t first, size_t last) const {
+    for (size_t i = first; i < last; i++) {
+        generateFunction(output, functions[i]);
+        output << "\n\n";
+    }
+}
 
+void GS2Decompiler::generateFunction(std::ostream& output, const FunctionInfo& func) const {
     // Parse function name for public/object qualifiers
-    std::string funcName = func.name;
+    std::string funcName(func.name);
     bool isPublic = false;
     bool hasObject = false;
     std::string objectName;
@@ -428,46 +269,63 @@ std::string GS2Decompiler::generateFunction(const FunctionInfo& func) {
     output << "  // Function: " << func.name << "\n";
     output << "  // Opcodes: " << func.bytecode.size() << " bytes\n";
 
-    auto it = functionInstructions.find(func.name);
-    if (it != functionInstructions.end()) {
-        const auto& instructions = it->second;
-        for (const auto& inst : instructions) {
-            output << "  // " << opcode::OpcodeToString(inst.op);
-            if (!inst.operandString.empty()) {
-                output << " \"" << inst.operandString << "\"";
-            } else if (inst.operandInt != 0) {
-                output << " " << inst.operandInt;
+    {
+        uint32_t lastLine = 0;
+        for (size_t i = func.firstInstruction; i < func.lastInstruction; i++) {
+            if (instructions.isJumpTarget(static_cast<uint32_t>(i))) {
+                output << "  // jump target " << i << "\n";
+            }
+            if (uint32_t line = getSourceLine(static_cast<uint32_t>(i)); line != 0 && line != lastLine) {
+                output << "  // line " << line << "\n";
+                lastLine = line;
+            }
+
+            output << "  // " << opcode::OpcodeToString(instructions.op(i));
+            if (auto text = getOperandString(i); !text.empty()) {
+                output << " \"" << text << "\"";
+            } else if (instructions.operand(i) != 0) {
+                output << " " << instructions.operand(i);
             }
             output << "\n";
         }
     }
 
     output << "}";
-
-    return output.str();
 }
 
-std::string GS2Decompiler::generateStatement(uint32_t& opIndex, int indent, const FunctionInfo& func) {
-    return "";
-}
+#ifndef __EMSCRIPTEN__
+bool GS2Decompiler::loadLineTable(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return false;
+    }
 
-std::string GS2Decompiler::generateExpression(uint32_t& opIndex, const FunctionInfo& func) {
-    return "";
-}
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    linetable::Fingerprint fingerprint;
+    if (!linetable::decode(data.data(), data.size(), lineTable, fingerprint)) {
+        lineTable.clear();
+        setError("Cannot read line table: " + filename);
+        return false;
+    }
 
-std::string GS2Decompiler::getStringFromTable(int32_t index) {
-    if (index >= 0 && index < static_cast<int32_t>(stringTable.size())) {
-        return stringTable[index];
+    // Left over from an earlier build, its op indices don't match this bytecode
+    if (fingerprint != GS2Context::ComputeFingerprint(view.data())) {
+        lineTable.clear();
+        setError("Line table was written for different bytecode: " + filename);
+        return false;
     }
-    return "";
-}
 
-std::string GS2Decompiler::indentString(int level) {
-    return std::string(level * 2, ' ');
+    return true;
 }
-
-bool GS2Decompiler::isJumpTarget(uint32_t opIndex) const {
-    return jumpTargets.find(opIndex) != jumpTargets.end();
+#endif
+
+uint32_t GS2Decompiler::getSourceLine(uint32_t opIndex) const {
+    // Each entry covers every operation up to the next entry
+    auto it = std::upper_bound(lineTable.begin(), lineTable.end(), opIndex,
+                               [](uint32_t idx, const linetable::Entry& entry) {
+                                   return idx < entry.opIndex;
+                               });
+    return it != lineTable.begin() ? std::prev(it)->line : 0;
 }
 
 } // namespace gs2decompiler
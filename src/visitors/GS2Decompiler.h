@@ -3,74 +3,65 @@
 #ifndef GS2DECOMPILER_H
 #define GS2DECOMPILER_H
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 #include <functional>
+#include <ostream>
 #include "opcodes.h"
+#include "DecompilerThreadJob.h"
 #include "encoding/buffer.h"
+#include "encoding/bytecodeview.h"
+#include "encoding/linetable.h"
+#include "utils/ContextThreadPool.h"
+#ifndef __EMSCRIPTEN__
+#include "utils/MappedFile.h"
+#endif
 
 namespace gs2decompiler {
 
-// Represents a single function with its bytecode range
+// Represents a single function with its bytecode range, name and bytecode
+// are views into the loaded data
 struct FunctionInfo {
-    std::string name;
+    std::string_view name;
     uint32_t opIndex;
     uint32_t endOpIndex;
-    std::vector<uint8_t> bytecode;
+    std::span<const uint8_t> bytecode;
+    size_t firstInstruction = 0;  // operation index range within the instruction stream
+    size_t lastInstruction = 0;
 };
 
-// Represents a decoded instruction
-struct Instruction {
-    opcode::Opcode op;
-    size_t bytecodeOffset;
-    int32_t operandInt;
-    double operandDouble;
-    std::string operandString;
-
-    Instruction() : op(opcode::OP_NONE), bytecodeOffset(0), operandInt(0), operandDouble(0.0) {}
-};
-
-// Stack simulation for operands
-struct StackOperand {
-    enum class Type {
-        NUMBER,
-        STRING,
-        VAR,
-        ARRAY,
-        OBJECT,
-        BOOLEAN,
-        NULL_VAL,
-        UNKNOWN
-    };
-
-    Type type;
-    std::string value;
-    bool isLValue;  // Can be assigned to
-
-    StackOperand() : type(Type::UNKNOWN), isLValue(false) {}
-    StackOperand(Type t, const std::string& v, bool lval = false)
-        : type(t), value(v), isLValue(lval) {}
-};
-
-// Control flow information
-struct ControlFlowInfo {
-    enum class CFType {
-        IF,
-        ELSE,
-        WHILE,
-        FOR,
-        FOREACH,
-        SWITCH,
-        WITH
-    };
-
-    CFType type;
-    uint32_t startOpIndex;
-    uint32_t endOpIndex;
-    int indentLevel;
+// Decoded bytecode segment as parallel arrays indexed by absolute operation
+// index. Operands are stored as integers (jump target, number, string table
+// index), any text is read back from the bytecode on demand
+class InstructionStream {
+public:
+    void clear();
+    void reserve(size_t count);
+    void push(opcode::Opcode op, uint32_t offset, int32_t operand);
+    size_t size() const { return ops.size(); }
+
+    opcode::Opcode op(size_t opIndex) const { return static_cast<opcode::Opcode>(ops[opIndex]); }
+    uint32_t offset(size_t opIndex) const { return offsets[opIndex]; }
+    int32_t operand(size_t opIndex) const { return operands[opIndex]; }
+
+    // Encoded length, the last operation runs to the end of the segment
+    size_t length(size_t opIndex, size_t codeLength) const {
+        return (opIndex + 1 < offsets.size() ? offsets[opIndex + 1] : codeLength) - offsets[opIndex];
+    }
+
+    // Jump targets outside the stream are ignored
+    void setJumpTargets(const std::vector<uint32_t>& targets);
+    bool isJumpTarget(uint32_t opIndex) const {
+        return opIndex < size() && (jumpTargetBits[opIndex / 64] >> (opIndex % 64)) & 1;
+    }
 
-    ControlFlowInfo() : type(CFType::IF), startOpIndex(0), endOpIndex(0), indentLevel(0) {}
+private:
+    std::vector<uint8_t> ops;
+    std::vector<uint32_t> offsets;      // byte offset within the bytecode segment
+    std::vector<int32_t> operands;
+    std::vector<uint64_t> jumpTargetBits;
 };
 
 class GS2Decompiler {
@@ -78,69 +69,83 @@ public:
     GS2Decompiler();
     ~GS2Decompiler();
 
-    // Load bytecode from file
+    // Bytecode may carry the GS2Context::CreateHeader prefix, which is skipped
+
+#ifndef __EMSCRIPTEN__
+    // Load bytecode from file, memory mapped where possible. Not in the wasm
+    // build, which only decompiles buffers handed to it
     bool loadBytecode(const std::string& filename);
+#endif
+
+    // Load bytecode from memory, the data is copied
+    bool loadBytecode(const uint8_t* data, size_t length);
+
+    // Load bytecode from memory without copying, the data must outlive the
+    // decompiler or the next load
+    bool loadBytecode(std::span<const uint8_t> data);
+
+    // Reader over the currently loaded bytecode
+    const BytecodeView& getView() const { return view; }
+
+#ifndef __EMSCRIPTEN__
+    // Load a line table (see encoding/linetable.h) used to annotate the output
+    // with source line numbers. Must be called after loadBytecode, tables
+    // written for different bytecode are rejected. Not in the wasm build,
+    // which has no filesystem, use setLineTable there
+    bool loadLineTable(const std::string& filename);
+#endif
+    void setLineTable(std::vector<linetable::Entry> entries) { lineTable = std::move(entries); }
 
     // Decompile to string
     std::string decompile();
 
+    // Decompile straight into a stream, one function at a time
+    void decompile(std::ostream& output) const;
+
+    // Render functions in parallel on the pool. Output is written in function
+    // order as each chunk of functions finishes
+    void decompile(std::ostream& output, CustomThreadPool<DecompilerThreadJob>& pool) const;
+
     // Get error message if something went wrong
     std::string getError() const { return error; }
 
 private:
     // Segment parsing
-    bool parseSegments();
-    bool parseGS1Flags(size_t offset, size_t length);
-    bool parseFunctionTable(size_t offset, size_t length);
-    bool parseStringTable(size_t offset, size_t length);
-    bool parseBytecodeSegment(size_t offset, size_t length);
-
-    // Dynamic number reading
-    bool readDynamicNumber(size_t& pos, int32_t& outVal);
-    bool readDynamicNumberUnsigned(size_t& pos, uint32_t& outVal);
-    bool readDoubleNumber(size_t& pos, std::string& outVal);
+    bool parseFunctionTable();
 
     // Instruction decoding
     bool decodeInstructions();
-    Instruction* getNextInstruction(size_t& pos);
-    size_t getInstructionSize(opcode::Opcode op, size_t pos);
+    std::string_view getOperandString(size_t opIndex) const;
 
     // Source code generation
-    std::string generateSource();
-    std::string generateFunction(const FunctionInfo& func);
-    std::string generateStatement(uint32_t& opIndex, int indent, const FunctionInfo& func);
-    std::string generateExpression(uint32_t& opIndex, const FunctionInfo& func);
-
-    // Helper methods for expression generation
-    std::string generateBinaryOpExpression(uint32_t& opIndex, const FunctionInfo& func,
-                                          const std::string& opStr);
-    std::string generateUnaryOpExpression(uint32_t& opIndex, const FunctionInfo& func,
-                                          const std::string& opStr, bool prefix);
-    std::string generateFunctionCall(uint32_t& opIndex, const FunctionInfo& func);
-    std::string generateMemberAccess(uint32_t& opIndex, const FunctionInfo& func);
-
-    // Control flow reconstruction
-    bool analyzeControlFlow(const FunctionInfo& func);
-    bool isJumpTarget(uint32_t opIndex) const;
-
-    // Utility
-    std::string getStringFromTable(int32_t index);
-    std::string indentString(int level);
+    void generateFunctions(std::ostream& output, size_t first, size_t last) const;
+    void generateFunction(std::ostream& output, const FunctionInfo& func) const;
+
+    // Line table lookup, returns 0 when the operation has no known location
+    uint32_t getSourceLine(uint32_t opIndex) const;
+
     void setError(const std::string& err) { error = err; }
 
 private:
-    // Raw bytecode data
-    std::vector<uint8_t> bytecodeData;
+    // Minimum number of operations rendered per parallel job
+    static constexpr size_t parallel_chunk_ops = 4096;
+
+    // Backing storage when the data isn't owned by the caller
+    std::vector<uint8_t> ownedData;
+#ifndef __EMSCRIPTEN__
+    MappedFile mappedFile;
+#endif
 
-    // Parsed segments
-    std::vector<std::string> stringTable;
+    // Segments, strings and function code of the loaded data
+    BytecodeView view;
     std::vector<FunctionInfo> functions;
 
-    // Decoded instructions per function
-    std::unordered_map<std::string, std::vector<Instruction>> functionInstructions;
+    // Decoded instructions of the whole bytecode segment, functions refer to
+    // ranges. Also holds the jump targets for control flow analysis
+    InstructionStream instructions;
 
-    // Control flow analysis data
-    std::unordered_map<uint32_t, bool> jumpTargets;
+    // Optional opIndex -> source location mapping, sorted by opIndex
+    std::vector<linetable::Entry> lineTable;
 
     // State
     std::string error;
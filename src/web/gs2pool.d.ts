@@ -0,0 +1,34 @@
+export interface GS2PoolOptions {
+    size?: number;
+    workerUrl?: string | URL;
+    moduleUrl?: string | URL;
+    options?: {
+        emitLineTable?: boolean;
+        collectStats?: boolean;
+        deterministicHeader?: boolean;
+        headerSalt?: number;
+    };
+}
+
+export interface GS2CompileRequest {
+    source: string;
+    type?: string;
+    name?: string;
+}
+
+export interface GS2CompileResult {
+    success: boolean;
+    bytecode: ArrayBuffer;
+    errors: string[];
+    fingerprint: string;
+    stats: Record<string, unknown> | null;
+}
+
+export declare class GS2CompilerPool {
+    constructor(options?: GS2PoolOptions);
+    readonly ready: Promise<void>;
+    readonly size: number;
+    compile(source: string, request?: { type?: string; name?: string }): Promise<GS2CompileResult>;
+    compileMany(requests: Array<string | GS2CompileRequest>): Promise<GS2CompileResult[]>;
+    terminate(): void;
+}
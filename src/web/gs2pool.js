@@ -0,0 +1,154 @@
+/*
+ * Compiles scripts off the main thread on a pool of Web Workers, each running
+ * its own wasm GS2Context (gs2worker.js). Jobs queue in the page and go to
+ * whichever worker is idle, so a large class doesn't hold up the ones behind it.
+ *
+ *   const pool = new GS2CompilerPool({ size: 4 });
+ *   const { success, bytecode, errors } = await pool.compile(source);
+ *   const results = await pool.compileMany([{ source, type: 'weapon', name: 'Foo' }]);
+ *   pool.terminate();
+ *
+ * bytecode is an ArrayBuffer of exactly the compiled length, transferred from
+ * the worker without another copy.
+ */
+const DEFAULT_BASE = new URL('.', import.meta.url);
+
+export class GS2CompilerPool {
+    /*
+     * size:      number of workers, defaults to hardwareConcurrency
+     * workerUrl: gs2worker.js, defaults to next to this module
+     * moduleUrl: gs2test.js, defaults to next to this module
+     * options:   CompilerOptions applied to every worker's context
+     */
+    constructor({ size, workerUrl, moduleUrl, options } = {}) {
+        size = Math.max(1, size || (globalThis.navigator && navigator.hardwareConcurrency) || 4);
+        workerUrl = workerUrl || new URL('gs2worker.js', DEFAULT_BASE);
+        moduleUrl = String(moduleUrl || new URL('gs2test.js', DEFAULT_BASE));
+
+        this._queue = [];
+        this._pending = new Map();
+        this._running = new Map();   // worker -> job id
+        this._idle = [];
+        this._nextId = 1;
+        this._closed = false;
+
+        this._workers = [];
+        const started = [];
+        for (let i = 0; i < size; i++) {
+            const worker = new Worker(workerUrl);
+            this._workers.push(worker);
+            started.push(new Promise((resolve, reject) => {
+                worker.onmessage = (event) => {
+                    const message = event.data;
+                    if (message.ready) {
+                        worker.onmessage = (e) => this._onResult(worker, e.data);
+                        worker.onerror = (e) => this._onCrash(worker, e);
+                        this._release(worker);
+                        resolve();
+                    } else if (message.fatal) {
+                        reject(new Error(`gs2 worker failed to start: ${message.fatal}`));
+                    }
+                };
+                worker.onerror = (event) => reject(new Error(`gs2 worker failed to start: ${event.message}`));
+            }));
+            worker.postMessage({ init: { moduleUrl, options } });
+        }
+
+        // Resolves once every worker has loaded the module, jobs can be queued before that.
+        // If any worker fails to start the pool shuts down and rejects its jobs
+        this.ready = Promise.all(started).then(() => undefined);
+        this.ready.catch((e) => this._shutdown(e));
+    }
+
+    get size() {
+        return this._workers.length;
+    }
+
+    /*
+     * Compiles one script. With a type the bytecode gets the script header, as
+     * compile_code does in the C API
+     */
+    compile(source, { type, name } = {}) {
+        if (this._closed)
+            return Promise.reject(new Error('GS2CompilerPool was terminated'));
+
+        return new Promise((resolve, reject) => {
+            const job = { id: this._nextId++, source, type, name, resolve, reject };
+            this._queue.push(job);
+            this._dispatch();
+        });
+    }
+
+    // Results are in the order of requests, each is a string or { source, type, name }
+    compileMany(requests) {
+        return Promise.all(requests.map((request) =>
+            typeof request === 'string' ? this.compile(request) : this.compile(request.source, request)));
+    }
+
+    // Stops every worker, jobs still queued or running are rejected
+    terminate() {
+        this._shutdown(new Error('GS2CompilerPool was terminated'));
+    }
+
+    _shutdown(error) {
+        this._closed = true;
+        for (const worker of this._workers)
+            worker.terminate();
+        this._workers = [];
+        this._idle = [];
+        this._running.clear();
+        this._failAll(error);
+    }
+
+    _dispatch() {
+        while (this._idle.length > 0 && this._queue.length > 0) {
+            const worker = this._idle.pop();
+            const job = this._queue.shift();
+            this._pending.set(job.id, job);
+            this._running.set(worker, job.id);
+            worker.postMessage({ id: job.id, source: job.source, type: job.type, name: job.name });
+        }
+    }
+
+    _release(worker) {
+        this._running.delete(worker);
+        this._idle.push(worker);
+        this._dispatch();
+    }
+
+    _onResult(worker, message) {
+        const job = this._pending.get(message.id);
+        this._pending.delete(message.id);
+        this._release(worker);
+        if (!job)
+            return;
+
+        if (message.error !== undefined) {
+            job.reject(new Error(message.error));
+            return;
+        }
+
+        const { id, ...result } = message;
+        job.resolve(result);
+    }
+
+    // An uncaught error in a worker, fail its job and keep using the worker
+    _onCrash(worker, event) {
+        if (!this._running.has(worker))
+            return;
+
+        const job = this._pending.get(this._running.get(worker));
+        if (job) {
+            this._pending.delete(job.id);
+            job.reject(new Error(`gs2 worker error: ${event.message}`));
+        }
+        this._release(worker);
+    }
+
+    _failAll(error) {
+        for (const job of [...this._queue, ...this._pending.values()])
+            job.reject(error);
+        this._queue = [];
+        this._pending.clear();
+    }
+}
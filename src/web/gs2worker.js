@@ -0,0 +1,70 @@
+/*
+ * Worker side of GS2CompilerPool (gs2pool.js). Each worker loads its own copy
+ * of the wasm module and keeps one GS2Context for its lifetime.
+ *
+ * Messages in:  { init: { moduleUrl, options } }
+ *               { id, source, type, name }
+ * Messages out: { ready: true } | { fatal: message }
+ *               { id, success, bytecode: ArrayBuffer, errors, fingerprint, stats }
+ *               { id, error: message } when compile throws
+ */
+let context = null;
+
+function compile({ id, source, type, name }) {
+    const response = type
+        ? context.compile(source, type, name || '', true)
+        : context.compile(source);
+
+    try {
+        // The one copy out of wasm memory, into a buffer of the exact length that's
+        // transferred back to the page as is
+        const bytecode = response.getBytecode().slice().buffer;
+
+        const errorList = response.getErrors();
+        const errors = [];
+        for (let i = 0; i < errorList.size(); i++)
+            errors.push(errorList.get(i));
+        errorList.delete();
+
+        return {
+            id,
+            success: response.success,
+            bytecode,
+            errors,
+            fingerprint: response.getFingerprint(),
+            stats: response.getStats(),
+        };
+    } finally {
+        response.delete();
+    }
+}
+
+self.onmessage = async (event) => {
+    const message = event.data;
+
+    if (message.init) {
+        try {
+            const moduleUrl = message.init.moduleUrl;
+            importScripts(moduleUrl);
+
+            // A separate gs2test.wasm is looked up next to gs2test.js, not next to this worker
+            const Module = await GS2Compiler({ locateFile: (path) => new URL(path, moduleUrl).href });
+            context = new Module.GS2Context();
+            if (message.init.options)
+                context.setOptions({ ...context.getOptions(), ...message.init.options });
+            self.postMessage({ ready: true });
+        } catch (e) {
+            self.postMessage({ fatal: String(e && e.message || e) });
+        }
+        return;
+    }
+
+    let result;
+    try {
+        result = compile(message);
+    } catch (e) {
+        self.postMessage({ id: message.id, error: String(e && e.message || e) });
+        return;
+    }
+    self.postMessage(result, [result.bytecode]);
+};
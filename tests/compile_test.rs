@@ -1,4 +1,4 @@
-use gs2compiler::Gs2Context;
+use gs2compiler::{compile_many, Gs2Context};
 
 #[test]
 fn test_success() {
@@ -34,4 +34,70 @@ fn test_fail() {
 
         // Check if the code failed to compile
         assert!(result.is_err());
-}
\ No newline at end of file
+}
+
+#[test]
+fn test_compile_bytes_matches_str() {
+        let code = "function onCreated() { echo(\"Hello, world!\"); }";
+
+        let context = Gs2Context::new();
+        let from_str = context.compile_code(code).unwrap();
+        let from_bytes = context.compile_bytes(code.as_bytes()).unwrap();
+
+        assert!(!from_bytes.is_empty());
+        assert_eq!(from_str, from_bytes);
+}
+
+#[test]
+fn test_compile_script_adds_header() {
+        let code = b"function onCreated() { echo(\"Hello, world!\"); }";
+
+        let context = Gs2Context::new();
+        let bare = context.compile_bytes(code).unwrap();
+        let with_header = context.compile_script(code, "weapon", "TestWeapon").unwrap();
+
+        assert!(with_header.len() > bare.len());
+        assert!(with_header.ends_with(&bare));
+}
+
+#[test]
+fn test_context_is_send() {
+        fn assert_send<T: Send>() {}
+        assert_send::<Gs2Context>();
+
+        // A context created on one thread compiles on another
+        let context = Gs2Context::new();
+        let result = std::thread::spawn(move || context.compile_code("function onCreated() {}"))
+                .join()
+                .unwrap();
+        assert!(result.is_ok());
+}
+
+#[test]
+fn test_compile_many_matches_sequential() {
+        let mut scripts = Vec::new();
+        let mut dirs = vec![std::path::PathBuf::from("tests/scripts")];
+        while let Some(dir) = dirs.pop() {
+                for entry in std::fs::read_dir(dir).unwrap() {
+                        let path = entry.unwrap().path();
+                        if path.is_dir() {
+                                dirs.push(path);
+                        } else {
+                                scripts.push(std::fs::read(path).unwrap());
+                        }
+                }
+        }
+        assert!(!scripts.is_empty());
+
+        let context = Gs2Context::new();
+        let parallel = compile_many(&scripts, 4);
+        assert_eq!(parallel.len(), scripts.len());
+
+        for (script, result) in scripts.iter().zip(parallel) {
+                match (context.compile_bytes(script), result) {
+                        (Ok(expected), Ok(actual)) => assert_eq!(expected, actual),
+                        (Err(expected), Err(actual)) => assert_eq!(expected.to_string(), actual.to_string()),
+                        _ => panic!("compile_many and compile_bytes disagree"),
+                }
+        }
+}
@@ -0,0 +1,221 @@
+/*
+ * Cost fuzzer for GS2Context::compile.
+ *
+ * The objective is compile time per input byte rather than crashes. Every
+ * input sets one libFuzzer extra counter for the cost bucket it reached, so
+ * inputs that reach a new (higher) cost level are kept in the corpus and
+ * mutated further. Inputs over the threshold are minimized while staying
+ * over the threshold, and saved into the regression corpus. Inputs that
+ * don't compile are saved as .gs2fail, as in tests/scripts.
+ *
+ * Environment:
+ *   GS2_FUZZ_COST_THRESHOLD  ns per input byte considered too slow (default 20000)
+ *   GS2_FUZZ_MIN_BYTES       inputs smaller than this are never saved (default 64)
+ *   GS2_FUZZ_REGRESSION_DIR  where slow inputs are written (default tests/fuzz/regressions)
+ *
+ * Built with GS2_FUZZ_REPLAY this file instead produces a standalone
+ * executable that compiles the given files or directories and fails if
+ * any of them is over the threshold, or if a .gs2 input doesn't compile
+ * (a .gs2fail input must not). This is how the regression corpus is run
+ * under ctest.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include "GS2Context.h"
+
+namespace
+{
+	struct FuzzConfig
+	{
+		double thresholdNsPerByte = 20000.0;
+		size_t minBytes = 64;
+		std::filesystem::path regressionDir = "tests/fuzz/regressions";
+	};
+
+	const FuzzConfig& config()
+	{
+		static const FuzzConfig cfg = [] {
+			FuzzConfig c;
+			if (auto env = std::getenv("GS2_FUZZ_COST_THRESHOLD"))
+				c.thresholdNsPerByte = std::atof(env);
+			if (auto env = std::getenv("GS2_FUZZ_MIN_BYTES"))
+				c.minBytes = size_t(std::atoll(env));
+			if (auto env = std::getenv("GS2_FUZZ_REGRESSION_DIR"))
+				c.regressionDir = env;
+			return c;
+		}();
+		return cfg;
+	}
+
+	GS2Context& context()
+	{
+		static GS2Context ctx;
+		return ctx;
+	}
+
+	double measureCost(const std::string& script)
+	{
+		auto start = std::chrono::steady_clock::now();
+		context().compile(script);
+		auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		return ns / double(std::max<size_t>(script.length(), 1));
+	}
+
+	bool compiles(const std::string& script)
+	{
+		return context().compile(script).success;
+	}
+
+	// Single measurements are noisy, take the fastest of a few runs before
+	// treating an input as slow
+	double confirmCost(const std::string& script, int runs = 3)
+	{
+		double best = measureCost(script);
+		for (int i = 1; i < runs; i++)
+			best = std::min(best, measureCost(script));
+		return best;
+	}
+
+	bool isSlow(const std::string& script)
+	{
+		return script.length() >= config().minBytes && confirmCost(script) > config().thresholdNsPerByte;
+	}
+
+	/*
+	 * Delta-debugging style minimization: repeatedly try removing chunks,
+	 * halving the chunk size, keeping any removal that leaves the input slow
+	 */
+	std::string minimize(std::string input)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+		for (size_t chunk = input.length() / 2; chunk > 0; chunk /= 2)
+		{
+			size_t offset = 0;
+			while (offset < input.length())
+			{
+				if (std::chrono::steady_clock::now() > deadline)
+					return input;
+
+				std::string candidate = input;
+				candidate.erase(offset, chunk);
+
+				if (isSlow(candidate))
+					input = std::move(candidate);
+				else
+					offset += chunk;
+			}
+		}
+
+		return input;
+	}
+
+	void saveRegression(const std::string& input, double cost)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(config().regressionDir, ec);
+
+		char name[64];
+		snprintf(name, sizeof(name), "slow-%016zx.%s", std::hash<std::string>{}(input), compiles(input) ? "gs2" : "gs2fail");
+
+		auto path = config().regressionDir / name;
+		std::ofstream file(path, std::ios::binary);
+		file.write(input.data(), std::streamsize(input.length()));
+
+		fprintf(stderr, "gs2fuzz: saved %s (%zu bytes, %.0f ns/byte)\n", path.string().c_str(), input.length(), cost);
+	}
+}
+
+#ifndef GS2_FUZZ_REPLAY
+
+#if defined(__linux__)
+// libFuzzer treats every non-zero byte in this section as a feature
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t costCounters[64];
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	std::string script(reinterpret_cast<const char *>(data), size);
+	double cost = measureCost(script);
+
+	// Two buckets per doubling of ns/byte
+	auto bucket = size_t(std::clamp(std::log2(std::max(cost, 1.0)) * 2.0, 0.0, double(std::size(costCounters) - 1)));
+	costCounters[bucket] = 1;
+
+	if (cost > config().thresholdNsPerByte && isSlow(script))
+	{
+		auto minimized = minimize(std::move(script));
+		saveRegression(minimized, confirmCost(minimized));
+	}
+
+	return 0;
+}
+
+#else
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s FILE|DIR...\n", argv[0]);
+		return 2;
+	}
+
+	int checked = 0, slow = 0, wrong = 0;
+
+	auto replay = [&](const std::filesystem::path& path) {
+		std::ifstream file(path, std::ios::binary);
+		std::string script((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		bool expectSuccess = path.extension() != ".gs2fail";
+		bool compiled = compiles(script);
+		double cost = confirmCost(script);
+		bool tooSlow = cost > config().thresholdNsPerByte;
+
+		const char *status = "ok  ";
+		if (compiled != expectSuccess)
+			status = "FAIL";
+		else if (tooSlow)
+			status = "SLOW";
+
+		printf("%s %s: %zu bytes, %.0f ns/byte%s\n", status, path.string().c_str(), script.length(), cost,
+			compiled == expectSuccess ? "" : (compiled ? ", expected a compile error" : ", failed to compile"));
+		checked++;
+		if (tooSlow)
+			slow++;
+		if (compiled != expectSuccess)
+			wrong++;
+	};
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::filesystem::path path = argv[i];
+		if (std::filesystem::is_directory(path))
+		{
+			for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+			{
+				auto ext = entry.path().extension();
+				if (entry.is_regular_file() && (ext == ".gs2" || ext == ".gs2fail"))
+					replay(entry.path());
+			}
+		}
+		else
+			replay(path);
+	}
+
+	printf("%d inputs checked, %d over %.0f ns/byte, %d with the wrong compile result\n", checked, slow, config().thresholdNsPerByte, wrong);
+	return slow > 0 || wrong > 0 ? 1 : 0;
+}
+
+#endif
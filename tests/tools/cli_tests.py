@@ -0,0 +1,1088 @@
+#!/usr/bin/env python3
+"""
+GS2 Command Line Tests
+End-to-end checks of gs2test behaviour that a single bytecode baseline can't
+show, e.g. output that must not depend on the number of jobs, or files that
+must be left alone. Each check works in its own temporary directory, on copies
+of the test scripts or on scripts it generates.
+"""
+
+import argparse
+import base64
+import ctypes
+import json
+import os
+import queue
+import re
+import resource
+import shutil
+import socket
+import stat
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from pathlib import Path
+from typing import Callable, Dict, List, Tuple
+
+def find_compiler(project_root: Path) -> Path:
+    for path in [project_root / "bin" / "gs2test",
+                 project_root / "build" / "gs2test",
+                 project_root / "build" / "Release" / "gs2test"]:
+        if path.exists():
+            return path
+    raise FileNotFoundError("Could not find gs2test compiler executable. Please build the project first.")
+
+def run(compiler: Path, *args) -> str:
+    result = subprocess.run([str(compiler), *map(str, args)], capture_output=True, text=True, timeout=120)
+    if result.returncode != 0:
+        raise AssertionError(f"gs2test {' '.join(map(str, args))} exited with {result.returncode}: {result.stdout}{result.stderr}")
+    return result.stdout
+
+def copy_scripts(scripts_dir: Path, target: Path) -> Path:
+    """The compiling test scripts, error_cases left out"""
+    shutil.copytree(scripts_dir, target, ignore=shutil.ignore_patterns("error_cases"))
+    return target
+
+def outputs(directory: Path) -> Dict[str, bytes]:
+    return {str(path.relative_to(directory)): path.read_bytes() for path in sorted(directory.rglob("*.gs2bc"))}
+
+def check_jobs_deterministic(compiler: Path, scripts_dir: Path, work: Path):
+    """A directory compiled on several jobs gives the same bytecode as on one"""
+    serial = outputs(compile_directory(compiler, scripts_dir, work / "serial", 1))
+    parallel = outputs(compile_directory(compiler, scripts_dir, work / "parallel", 8))
+
+    if not serial:
+        raise AssertionError("No bytecode was written")
+    if serial.keys() != parallel.keys():
+        raise AssertionError(f"Different files written: {sorted(serial.keys() ^ parallel.keys())}")
+
+    differing = [name for name in serial if serial[name] != parallel[name]]
+    if differing:
+        raise AssertionError(f"Bytecode differs between -j 1 and -j 8: {differing}")
+
+def compile_directory(compiler: Path, scripts_dir: Path, target: Path, jobs: int) -> Path:
+    copy_scripts(scripts_dir, target)
+    run(compiler, target, "-j", jobs)
+    return target
+
+def long_jump_script(statements: int) -> str:
+    """An if whose body is too long for 16-bit jump targets, after a short one"""
+    lines = ["function onCreated() {",
+             "  if (this.b)",
+             "    this.w = 3;",
+             "  if (this.a) {"]
+    lines += [f"    this.x = {i};" for i in range(statements)]
+    lines += ["  } else {",
+              "    this.y = 1;",
+              "  }",
+              "  this.z = 2;",
+              "}"]
+    return "\n".join(lines) + "\n"
+
+def disassembled_ops(text: str) -> List[str]:
+    """The operations of a script's only function, indexed like jump targets. The
+    function starts at operation 1, after the jump over its body"""
+    body = text.split("// Opcodes:", 1)[1]
+    return ["OP_SET_INDEX"] + [line.strip()[3:] for line in body.splitlines() if line.strip().startswith("// OP_")]
+
+def check_long_jumps(compiler: Path, scripts_dir: Path, work: Path):
+    """Jumps past operation 32767 get 32-bit targets and disassemble to the right operation"""
+    script = work / "long_jumps.gs2"
+    script.write_text(long_jump_script(10000))
+    run(compiler, script)
+
+    bytecode = script.with_suffix(".gs2bc")
+    run(compiler, "-d", bytecode, "-o", work / "long_jumps.txt")
+    ops = disassembled_ops((work / "long_jumps.txt").read_text())
+
+    jumps = [(i, op.split()) for i, op in enumerate(ops) if i > 0 and op.split()[0] in ("OP_IF", "OP_SET_INDEX")]
+    if len(jumps) != 3:
+        raise AssertionError(f"Expected 3 jumps, found {[op for _, op in jumps]}")
+
+    # The short if skips to the long one, which skips to its else, and the end
+    # of its body jumps over the else. Each lands on a "this.<variable>" statement
+    expected = ['"a"', '"y"', '"z"']
+    for (index, (name, target)), variable in zip(jumps, expected):
+        target = int(target)
+        if target <= index or target + 1 >= len(ops) or ops[target + 1] != f"OP_TYPE_VAR {variable}":
+            raise AssertionError(f"{name} at {index} jumps to {target}, which isn't the statement using this.{variable[1:-1]}")
+
+    if int(jumps[1][1][1]) <= 32767 or int(jumps[2][1][1]) <= 32767:
+        raise AssertionError("The script is too short to need 32-bit jump targets")
+    if b"\xf5" not in bytecode.read_bytes():
+        raise AssertionError("No 32-bit jump operand was written")
+
+def parallel_disassembly_script(functions: int, statements: int) -> str:
+    """Functions whose jumps land past the 4096-operation chunks a parallel
+    disassembly splits the file into, then one with 32-bit jump targets"""
+    lines = []
+    for f in range(functions):
+        lines += [f"function f{f}() {{",
+                  f"  if (this.a{f}) {{"]
+        lines += [f"    this.x = {f * statements + i};" for i in range(statements)]
+        lines += ["  } else {",
+                  f"    this.y = {f};",
+                  "  }",
+                  f"  for (temp.i = 0; temp.i < {f}; temp.i++)",
+                  "    this.z += 0.5;",
+                  "}"]
+    return "\n".join(lines) + "\n" + long_jump_script(10000)
+
+def check_parallel_disassembly(compiler: Path, scripts_dir: Path, work: Path):
+    """Disassembly on several jobs writes the same text as on one, both for a file
+    large enough to be split by function and for a directory split by file"""
+    script = work / "large.gs2"
+    script.write_text(parallel_disassembly_script(40, 1500))
+    run(compiler, script)
+
+    bytecode = script.with_suffix(".gs2bc")
+    if bytecode.stat().st_size <= 2 * 64 * 1024:
+        raise AssertionError(f"{bytecode.name} is too small to disassemble in parallel ({bytecode.stat().st_size} bytes)")
+
+    run(compiler, "-d", bytecode, "-o", work / "serial.txt", "-j", 1)
+    run(compiler, "-d", bytecode, "-o", work / "parallel.txt", "-j", 8)
+    if (work / "serial.txt").read_bytes() != (work / "parallel.txt").read_bytes():
+        raise AssertionError(f"Disassembly of {bytecode.name} differs between -j 1 and -j 8")
+
+    listings = {}
+    for jobs in (1, 8):
+        directory = compile_directory(compiler, scripts_dir, work / f"disassembled_{jobs}", 1)
+        shutil.copy(bytecode, directory / bytecode.name)
+        for source in directory.rglob("*.gs2"):
+            source.unlink()
+        run(compiler, "-d", directory, "-j", jobs)
+        listings[jobs] = {str(path.relative_to(directory)): path.read_bytes() for path in sorted(directory.rglob("*.gs2"))}
+
+    if len(listings[1]) != len(outputs(work / "disassembled_1")):
+        raise AssertionError(f"Wrote {len(listings[1])} listings for {len(outputs(work / 'disassembled_1'))} bytecode files")
+    if listings[1].keys() != listings[8].keys():
+        raise AssertionError(f"Different files written: {sorted(listings[1].keys() ^ listings[8].keys())}")
+
+    differing = [name for name in listings[1] if listings[1][name] != listings[8][name]]
+    if differing:
+        raise AssertionError(f"Disassembly differs between -j 1 and -j 8: {differing}")
+
+def bytecode_segment(segment_type: int, body: bytes) -> bytes:
+    return struct.pack(">II", segment_type, len(body)) + body
+
+def known_bytecode() -> bytes:
+    """Hand-assembled bytecode using every operand encoding, with its function
+    table out of operation order"""
+    strings = ["a", "b"] + [f"s{i}" for i in range(2, 300)]
+    functions = [(15, "late"), (0, "early")]
+    code = b"".join([
+        bytes([0x17, 0x33]),                            # OP_TYPE_ARRAY, OP_FUNC_PARAMS_END
+        bytes([0x14, 0xF3, 0xFF]),                      # OP_TYPE_NUMBER -1
+        bytes([0x14, 0xF4, 0xFF, 0x38]),                # OP_TYPE_NUMBER -200
+        bytes([0x14, 0xF5, 0xFF, 0xFE, 0x79, 0x60]),    # OP_TYPE_NUMBER -100000
+        bytes([0x14, 0xF6]) + b"-2.5\0",               # OP_TYPE_NUMBER "-2.5"
+        bytes([0x14, 0xF0, 0x05]),                      # OP_TYPE_NUMBER 5
+        bytes([0x14, 0xF1, 0x01, 0x2C]),                # OP_TYPE_NUMBER 300
+        bytes([0x14, 0xF2, 0x00, 0x01, 0x86, 0xA0]),    # OP_TYPE_NUMBER 100000
+        bytes([0x04, 0xF3, 0x0D]),                      # OP_IF 13
+        bytes([0x16, 0xF0, 0x01]),                      # OP_TYPE_VAR "b"
+        bytes([0x15, 0xF1, 0x01, 0x2B]),                # OP_TYPE_STRING "s299"
+        bytes([0x0A, 0xF4, 0x00, 0x0E]),                # OP_JMP 14
+        bytes([0x16, 0xF2, 0x00, 0x00, 0x00, 0x02]),    # OP_TYPE_VAR "s2"
+        bytes([0x07]),                                  # OP_RET
+        bytes([0x17, 0x33]),                            # late starts at operation 15
+        bytes([0x14, 0xF6]) + b"1e+300\0",             # OP_TYPE_NUMBER "1e+300"
+        bytes([0x01, 0xF5, 0x00, 0x00, 0x00, 0x13]),    # OP_SET_INDEX 19
+        bytes([0x07]),                                  # OP_RET
+    ])
+    return (bytecode_segment(1, bytes(4))
+            + bytecode_segment(2, b"".join(struct.pack(">I", op) + name.encode() + b"\0" for op, name in functions))
+            + bytecode_segment(3, b"".join(string.encode() + b"\0" for string in strings))
+            + bytecode_segment(4, code))
+
+def check_disassembly_golden(compiler: Path, scripts_dir: Path, work: Path):
+    """The bytecode in tests/disassembly disassembles to the listings next to it.
+    Between them the files use every operand encoding and jump opcode"""
+    golden = scripts_dir.parent / "disassembly"
+    if (golden / "known.gs2bc").read_bytes() != known_bytecode():
+        raise AssertionError("tests/disassembly/known.gs2bc is out of date with known_bytecode()")
+
+    corpus = work / "disassembly"
+    shutil.copytree(golden, corpus, ignore=shutil.ignore_patterns("*.gs2"))
+    run(compiler, "-d", corpus)
+
+    expected = sorted(path.name for path in golden.glob("*.gs2"))
+    written = sorted(path.name for path in corpus.glob("*.gs2"))
+    if written != expected:
+        raise AssertionError(f"Wrote listings {written}, expected {expected}")
+
+    differing = [name for name in expected if (corpus / name).read_bytes() != (golden / name).read_bytes()]
+    if differing:
+        raise AssertionError(f"Disassembly differs from tests/disassembly: {differing}")
+
+def check_known_bytecode(compiler: Path, scripts_dir: Path, work: Path):
+    """Hand-assembled bytecode disassembles to its listing in tests/disassembly, read
+    from a mapped file, from a pipe (read without mapping) and from an empty file"""
+    expected = (scripts_dir.parent / "disassembly" / "known.gs2").read_text()
+    bytecode = work / "known.gs2bc"
+    bytecode.write_bytes(known_bytecode())
+    run(compiler, "-d", bytecode, "-o", work / "known.txt")
+    if (work / "known.txt").read_text() != expected:
+        raise AssertionError(f"Disassembly of known bytecode differs:\n{(work / 'known.txt').read_text()}")
+
+    # A pipe can't be mapped, MappedFile reads it instead
+    pipe = work / "pipe.gs2bc"
+    os.mkfifo(pipe)
+    writer = threading.Thread(target=pipe.write_bytes, args=(known_bytecode(),), daemon=True)
+    writer.start()
+    try:
+        subprocess.run([str(compiler), "-d", str(pipe), "-o", str(work / "pipe.txt")], capture_output=True, timeout=10)
+    except subprocess.TimeoutExpired:
+        raise AssertionError("gs2test -d didn't finish reading bytecode from a pipe")
+    writer.join(timeout=10)
+    if (work / "pipe.txt").read_text() != expected:
+        raise AssertionError(f"Disassembly of known bytecode read from a pipe differs:\n{(work / 'pipe.txt').read_text()}")
+
+    empty = work / "empty.gs2bc"
+    empty.write_bytes(b"")
+    run(compiler, "-d", empty, "-o", work / "empty.txt")
+    if (work / "empty.txt").read_bytes() != b"":
+        raise AssertionError("Disassembly of an empty file isn't empty")
+
+FINGERPRINT_RE = re.compile(r"-> fingerprint ([0-9a-f]{32})")
+
+def compile_fingerprint(compiler: Path, script: Path) -> str:
+    match = FINGERPRINT_RE.search(run(compiler, script, "-v"))
+    if not match:
+        raise AssertionError(f"gs2test -v printed no fingerprint for {script.name}")
+    return match.group(1)
+
+def check_same_output_path(compiler: Path, scripts_dir: Path, work: Path):
+    """Scripts that share an output (name.gs2 and name.txt both write name.gs2bc) leave
+    it holding one of their outputs, not a mix of two writes to the same file"""
+    short_source = STDIO_SOURCE
+    long_source = "function onCreated() {\n" + "".join(f"  this.v{i} = \"{'x' * 40}{i}\";\n" for i in range(200)) + "}\n"
+
+    references = work / "references"
+    references.mkdir()
+    (references / "short.gs2").write_text(short_source)
+    (references / "long.gs2").write_text(long_source)
+    run(compiler, references)
+    expected = {(references / "short.gs2bc").read_bytes(), (references / "long.gs2bc").read_bytes()}
+
+    # Listed in pairs, the long one first, so both writes of a pair tend to meet in one batch
+    shared = work / "shared"
+    shared.mkdir()
+    files = []
+    for i in range(500):
+        (shared / f"script{i}.gs2").write_text(long_source)
+        (shared / f"script{i}.txt").write_text(short_source)
+        files += [shared / f"script{i}.gs2", shared / f"script{i}.txt"]
+
+    for jobs in (1, 8):
+        for output in shared.glob("*.gs2bc"):
+            output.unlink()
+        run(compiler, *files, "-j", jobs)
+        mixed = [path.name for path in sorted(shared.glob("*.gs2bc")) if path.read_bytes() not in expected]
+        if mixed:
+            raise AssertionError(f"-j {jobs} left {len(mixed)} outputs that match neither script, e.g. {mixed[:3]}")
+
+# A tree for the discovery filters, file to whether it's compiled without
+# --include/--exclude and with DISCOVERY_FILTERS
+DISCOVERY_IGNORE_FILES = {
+    ".gs2ignore": "# scripts kept for reference\n*_old.gs2\n!keep_old.gs2\n/top_only.gs2\ntmp*/\n",
+    "sub/.gs2ignore": "generated/\n!b_old.gs2\n/local.gs2\ndeep/*.txt\n",
+}
+DISCOVERY_TREE = {
+    "a.gs2": (True, True),
+    "a_old.gs2": (False, False),              # *_old.gs2
+    "keep_old.gs2": (True, True),             # negated again
+    "top_only.gs2": (False, False),           # anchored to the root
+    "tmpfile.gs2": (True, False),             # tmp*/ only matches directories
+    "tmpdir/x.gs2": (False, False),
+    ".git/h.gs2": (False, False),             # never walked
+    "notes.md": (False, False),               # not a script
+    "sub/top_only.gs2": (True, True),         # the anchor is the root, not sub
+    "sub/b_old.gs2": (True, False),           # sub's negation overrides the root's rule
+    "sub/c_old.gs2": (False, False),
+    "sub/local.gs2": (False, False),          # anchored to sub
+    "sub/generated/g.gs2": (False, False),
+    "sub/deep/local.gs2": (True, False),
+    "sub/deep/m.gs2": (True, False),
+    "sub/deep/n.txt": (False, False),         # deep/*.txt, relative to sub
+    "sub/deep/o.txt.gs2": (True, False),
+}
+# Names at any depth for '?' and the bracket classes, "sub/**" crosses directories
+# and excluding sub/deep prunes the whole directory
+DISCOVERY_FILTERS = ("--include", "sub/**", "--include", "?.gs2", "--include", "k[a-f]*.gs2",
+                     "--exclude", "sub/deep", "--exclude", "[!k]*_old.gs2")
+
+def write_discovery_tree(root: Path, files: List[str]):
+    for name in files:
+        path = root / name
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(STDIO_SOURCE)
+
+def compiled_outputs(root: Path) -> List[str]:
+    return sorted(str(path.relative_to(root).with_suffix("").as_posix()) for path in root.rglob("*.gs2bc"))
+
+def check_discovery(compiler: Path, scripts_dir: Path, work: Path):
+    """Directory and watch mode pick the same scripts from a tree with nested
+    .gs2ignore files, --include and --exclude globs, and a .git directory"""
+    for filtered, args in ((False, ()), (True, DISCOVERY_FILTERS)):
+        expected = sorted(str(Path(name).with_suffix("").as_posix())
+                          for name, picked in DISCOVERY_TREE.items() if picked[filtered])
+
+        batch = work / ("batch_filtered" if filtered else "batch")
+        batch.mkdir()
+        for name, contents in DISCOVERY_IGNORE_FILES.items():
+            (batch / name).parent.mkdir(parents=True, exist_ok=True)
+            (batch / name).write_text(contents)
+        write_discovery_tree(batch, list(DISCOVERY_TREE))
+        run(compiler, batch, *args)
+        if compiled_outputs(batch) != expected:
+            raise AssertionError(f"Directory mode{' with filters' if filtered else ''} compiled {compiled_outputs(batch)}, expected {expected}")
+
+        # Watch mode sees the same files saved one by one and filters each on its own
+        watched = work / ("watch_filtered" if filtered else "watch")
+        for name, contents in DISCOVERY_IGNORE_FILES.items():
+            (watched / name).parent.mkdir(parents=True, exist_ok=True)
+            (watched / name).write_text(contents)
+        for name in DISCOVERY_TREE:
+            (watched / name).parent.mkdir(parents=True, exist_ok=True)
+
+        watcher = WatchProcess(compiler, watched, args=args)
+        try:
+            write_discovery_tree(watched, list(DISCOVERY_TREE))
+            watcher.reported([name for name, picked in DISCOVERY_TREE.items() if picked[filtered]])
+
+            # Saved after the rest were reported, so anything filtered wrongly was compiled by now
+            (watched / "sub" / "top_only.gs2").write_text(STDIO_SOURCE + "\n")
+            watcher.reported(["sub/top_only.gs2"])
+        finally:
+            watcher.stop()
+
+        if compiled_outputs(watched) != expected:
+            raise AssertionError(f"Watch mode{' with filters' if filtered else ''} compiled {compiled_outputs(watched)}, expected {expected}")
+
+def check_unchanged_output(compiler: Path, scripts_dir: Path, work: Path):
+    """Comment and whitespace edits keep the fingerprint, and the unchanged output isn't rewritten"""
+    script = work / "formatting.gs2"
+    output = script.with_suffix(".gs2bc")
+    script.write_text("function onCreated() {\n  this.x = 1;\n  echo(this.x);\n}\n")
+    fingerprint = compile_fingerprint(compiler, script)
+
+    # An old mtime, so a rewrite shows even on filesystems with coarse timestamps
+    old_mtime = output.stat().st_mtime_ns - 10_000_000_000
+    os.utime(output, ns=(old_mtime, old_mtime))
+    contents = output.read_bytes()
+
+    script.write_text("// reformatted\nfunction onCreated()\n{\n\tthis.x   =  1; /* same value */\n\n\techo( this.x );\n}\n")
+    if compile_fingerprint(compiler, script) != fingerprint:
+        raise AssertionError("Fingerprint changed with only comments and whitespace edited")
+    if output.read_bytes() != contents or output.stat().st_mtime_ns != old_mtime:
+        raise AssertionError("Unchanged bytecode was rewritten")
+
+    script.write_text("function onCreated() {\n  this.x = 2;\n  echo(this.x);\n}\n")
+    if compile_fingerprint(compiler, script) == fingerprint:
+        raise AssertionError("Fingerprint didn't change with the bytecode")
+    if output.stat().st_mtime_ns == old_mtime:
+        raise AssertionError("Changed bytecode wasn't written")
+
+BUNDLE_HEADER = struct.Struct("<4sIIIQQQ")
+BUNDLE_ENTRY = struct.Struct("<IIQQ")
+
+def read_bundle(data: bytes) -> Dict[str, Tuple[int, bytes]]:
+    """Script name to its payload offset and payload, checking the layout on the way"""
+    magic, version, count, alignment, index_offset, names_offset, file_size = BUNDLE_HEADER.unpack_from(data)
+    if magic != b"GS2B" or version != 1 or alignment != 16 or file_size != len(data):
+        raise AssertionError(f"Bad bundle header: {magic!r} v{version}, alignment {alignment}, size {file_size}/{len(data)}")
+
+    names = []
+    scripts = {}
+    for i in range(count):
+        name_offset, name_length, data_offset, data_length = BUNDLE_ENTRY.unpack_from(data, index_offset + i * BUNDLE_ENTRY.size)
+        start = names_offset + name_offset
+        name = data[start:start + name_length].decode()
+        if data_offset % alignment:
+            raise AssertionError(f"Payload of {name} starts at {data_offset}, not aligned to {alignment}")
+        if data_offset + data_length > len(data):
+            raise AssertionError(f"Payload of {name} runs past the end of the bundle")
+        names.append(name)
+        scripts[name] = (data_offset, data[data_offset:data_offset + data_length])
+
+    if names != sorted(names, key=str.encode) or len(set(names)) != len(names):
+        raise AssertionError(f"Bundle index isn't sorted by unique name: {names}")
+    return scripts
+
+def bundle_api(compiler: Path):
+    """The C API from the shared library, None for static builds"""
+    library = compiler.parent.parent / "lib" / "libgs2compiler.so"
+    if not library.exists():
+        return None
+
+    api = ctypes.CDLL(str(library))
+    api.get_context.restype = ctypes.c_void_p
+    api.set_deterministic_header.argtypes = [ctypes.c_void_p, ctypes.c_bool, ctypes.c_uint64]
+    api.compile_code.restype = CompileResponse
+    api.compile_code.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+    api.delete_context.argtypes = [ctypes.c_void_p]
+    api.bundle_open.restype = ctypes.c_void_p
+    api.bundle_open.argtypes = [ctypes.c_char_p]
+    api.bundle_count.restype = ctypes.c_size_t
+    api.bundle_count.argtypes = [ctypes.c_void_p]
+    api.bundle_lookup.restype = ctypes.c_int
+    api.bundle_lookup.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                  ctypes.POINTER(ctypes.POINTER(ctypes.c_ubyte)), ctypes.POINTER(ctypes.c_size_t)]
+    api.bundle_find.restype = ctypes.POINTER(ctypes.c_ubyte)
+    api.bundle_find.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_size_t)]
+    api.bundle_close.argtypes = [ctypes.c_void_p]
+    return api
+
+def bundle_lookup(api, handle, name: str) -> Tuple[int, bytes]:
+    data = ctypes.POINTER(ctypes.c_ubyte)()
+    length = ctypes.c_size_t()
+    status = api.bundle_lookup(handle, name.encode(), ctypes.byref(data), ctypes.byref(length))
+    return status, ctypes.string_at(data, length.value) if status == 1 else b""
+
+def disassembly_api(compiler: Path):
+    """The disassembly functions from the shared library, None for static builds"""
+    library = compiler.parent.parent / "lib" / "libgs2compiler.so"
+    if not library.exists():
+        return None
+
+    api = ctypes.CDLL(str(library))
+    api.get_context.restype = ctypes.c_void_p
+    api.set_deterministic_header.argtypes = [ctypes.c_void_p, ctypes.c_bool, ctypes.c_uint64]
+    api.compile_code.restype = CompileResponse
+    api.compile_code.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+    api.delete_context.argtypes = [ctypes.c_void_p]
+    api.disassemble.restype = ctypes.c_void_p
+    api.disassemble.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+    api.disassembly_success.restype = ctypes.c_bool
+    api.disassembly_success.argtypes = [ctypes.c_void_p]
+    api.disassembly_text.restype = ctypes.c_char_p
+    api.disassembly_text.argtypes = [ctypes.c_void_p]
+    api.disassembly_length.restype = ctypes.c_size_t
+    api.disassembly_length.argtypes = [ctypes.c_void_p]
+    api.free_disassembly.argtypes = [ctypes.c_void_p]
+    api.disassemble_to_buffer.restype = ctypes.c_int64
+    api.disassemble_to_buffer.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t]
+    return api
+
+def api_disassemble(api, bytecode: bytes) -> Tuple[bool, bytes]:
+    """disassembly_success and the text (or error) of disassemble, checked against disassembly_length"""
+    handle = api.disassemble(bytecode, len(bytecode))
+    try:
+        text = api.disassembly_text(handle)
+        if api.disassembly_length(handle) != len(text):
+            raise AssertionError(f"disassembly_length is {api.disassembly_length(handle)} for {len(text)} bytes of text")
+        return api.disassembly_success(handle), text
+    finally:
+        api.free_disassembly(handle)
+
+def check_disassembly_c_api(compiler: Path, scripts_dir: Path, work: Path):
+    """disassemble and disassemble_to_buffer match gs2test -d with and without a header,
+    report the full length to a short buffer and reject bytecode they can't read,
+    skipped for static builds"""
+    api = disassembly_api(compiler)
+    if api is None:
+        return
+
+    script = work / "script.gs2"
+    script.write_text(STDIO_SOURCE)
+    run(compiler, script)
+    bytecode = script.with_suffix(".gs2bc").read_bytes()
+    run(compiler, "-d", script.with_suffix(".gs2bc"), "-o", work / "script.txt")
+    expected = (work / "script.txt").read_bytes()
+
+    context = api.get_context()
+    api.set_deterministic_header(context, True, 0)
+    try:
+        response = api.compile_code(context, STDIO_SOURCE.encode(), b"weapon", b"script")
+        if not response.Success:
+            raise AssertionError("compile_code failed")
+        with_header = ctypes.string_at(response.ByteCode, response.ByteCodeSize)
+    finally:
+        api.delete_context(context)
+    if not with_header.endswith(bytecode) or len(with_header) == len(bytecode):
+        raise AssertionError("compile_code didn't write a header before the bytecode")
+
+    for name, data in (("without a header", bytecode), ("with a header", with_header)):
+        if api_disassemble(api, data) != (True, expected):
+            raise AssertionError(f"disassemble of bytecode {name} differs from gs2test -d")
+
+        buffer = ctypes.create_string_buffer(len(expected) + 1)
+        if api.disassemble_to_buffer(data, len(data), buffer, len(buffer)) != len(expected) or buffer.raw != expected + b"\0":
+            raise AssertionError(f"disassemble_to_buffer of bytecode {name} differs from gs2test -d")
+
+    # A short buffer gets what fits and a terminator, and the bytes past it are untouched
+    buffer = ctypes.create_string_buffer(b"#" * 64, 64)
+    if api.disassemble_to_buffer(bytecode, len(bytecode), buffer, 17) != len(expected):
+        raise AssertionError("disassemble_to_buffer didn't return the full length to a short buffer")
+    if buffer.raw[:17] != expected[:16] + b"\0" or buffer.raw[17:] != b"#" * 47:
+        raise AssertionError(f"disassemble_to_buffer wrote {buffer.raw!r} to a 17-byte buffer")
+    if api.disassemble_to_buffer(bytecode, len(bytecode), None, 0) != len(expected):
+        raise AssertionError("disassemble_to_buffer didn't return the length without a buffer")
+
+    broken = {"truncated": bytecode[:len(bytecode) // 2],
+              "truncated after a header": with_header[:len(with_header) - len(bytecode) // 2],
+              "an unknown segment": b"\0\0\0\x09\0\0\0\x04abcd",
+              "a segment past the end": bytecode[:4] + b"\0\0\xff\xff" + bytecode[8:]}
+    for name, data in broken.items():
+        success, error = api_disassemble(api, data)
+        if success or not error:
+            raise AssertionError(f"disassemble accepted bytecode that is {name}")
+        buffer = ctypes.create_string_buffer(b"#" * 8, 8)
+        if api.disassemble_to_buffer(data, len(data), buffer, len(buffer)) != -1 or buffer.raw != b"#" * 8:
+            raise AssertionError(f"disassemble_to_buffer didn't return -1 for bytecode that is {name}")
+
+def check_bundle(compiler: Path, scripts_dir: Path, work: Path):
+    """gs2test -b bundles every script as CreateHeader writes it, and broken bundles are rejected"""
+    sources = copy_scripts(scripts_dir, work / "scripts")
+    bundle_path = work / "scripts.gs2pack"
+    run(compiler, sources, "-b", bundle_path)
+    bundle = bundle_path.read_bytes()
+    scripts = read_bundle(bundle)
+
+    # The same scripts compiled one by one, for the bytecode behind each header
+    separate = copy_scripts(scripts_dir, work / "separate")
+    run(compiler, separate)
+    expected = {str(path.relative_to(separate).with_suffix("").as_posix()): path.read_bytes()
+                for path in separate.rglob("*.gs2bc")}
+    if scripts.keys() != expected.keys():
+        raise AssertionError(f"Bundled scripts differ from the compiled files: {sorted(scripts.keys() ^ expected.keys())}")
+    for name, (_, payload) in scripts.items():
+        if not payload.endswith(expected[name]):
+            raise AssertionError(f"Bundled {name} doesn't end with the bytecode gs2test writes for it")
+
+    api = bundle_api(compiler)
+    if api is not None:
+        check_bundle_c_api(api, sources, bundle, scripts, work)
+
+    # Both files are named dupe, the first one found is bundled and the other is an error
+    duplicates = work / "duplicates"
+    duplicates.mkdir()
+    (duplicates / "dupe.gs2").write_text(STDIO_SOURCE)
+    (duplicates / "dupe.txt").write_text(STDIO_SOURCE.replace("this.x = 1", "this.x = 2"))
+    output = run(compiler, duplicates, "-b", work / "duplicates.gs2pack")
+    if "Another script is already bundled as dupe" not in output:
+        raise AssertionError(f"Duplicate script names weren't reported:\n{output}")
+    if list(read_bundle((work / "duplicates.gs2pack").read_bytes())) != ["dupe"]:
+        raise AssertionError("Duplicate script names didn't leave one bundled script")
+
+def check_bundle_c_api(api, sources: Path, bundle: bytes, scripts: Dict[str, Tuple[int, bytes]], work: Path):
+    """bundle_open/bundle_lookup return the CreateHeader output, truncated and corrupt bundles are caught"""
+    context = api.get_context()
+    api.set_deterministic_header(context, True, 0)
+    try:
+        for name, (_, payload) in scripts.items():
+            source = next(path for path in sources.glob(name + ".*") if path.suffix in (".gs2", ".txt"))
+            response = api.compile_code(context, source.read_bytes(), b"weapon", name.encode())
+            if not response.Success or ctypes.string_at(response.ByteCode, response.ByteCodeSize) != payload:
+                raise AssertionError(f"Bundled {name} differs from compile_code with a content checksum")
+    finally:
+        api.delete_context(context)
+
+    handle = api.bundle_open(str(work / "scripts.gs2pack").encode())
+    if not handle:
+        raise AssertionError("bundle_open rejected the bundle")
+    try:
+        if api.bundle_count(handle) != len(scripts):
+            raise AssertionError(f"bundle_count is {api.bundle_count(handle)}, not {len(scripts)}")
+        for name, (_, payload) in scripts.items():
+            if bundle_lookup(api, handle, name) != (1, payload):
+                raise AssertionError(f"bundle_lookup didn't return {name}")
+        if bundle_lookup(api, handle, "missing/script")[0] != 0:
+            raise AssertionError("bundle_lookup found a script that isn't bundled")
+    finally:
+        api.bundle_close(handle)
+
+    truncated = work / "truncated.gs2pack"
+    truncated.write_bytes(bundle[:-1])
+    if api.bundle_open(str(truncated).encode()):
+        raise AssertionError("bundle_open accepted a truncated bundle")
+
+    # open() only checks the header, the first entry's payload now starts past the end
+    first = min(scripts, key=str.encode)
+    index_offset = BUNDLE_HEADER.unpack_from(bundle)[4]
+    corrupt = work / "corrupt.gs2pack"
+    corrupt.write_bytes(bundle[:index_offset + 8] + struct.pack("<Q", len(bundle)) + bundle[index_offset + 16:])
+    handle = api.bundle_open(str(corrupt).encode())
+    if not handle:
+        raise AssertionError("bundle_open rejected a bundle with a valid header")
+    try:
+        if bundle_lookup(api, handle, first)[0] != -1:
+            raise AssertionError("bundle_lookup didn't report the out of bounds entry as corrupt")
+        length = ctypes.c_size_t()
+        if api.bundle_find(handle, first.encode(), ctypes.byref(length)):
+            raise AssertionError("bundle_find returned an out of bounds entry")
+    finally:
+        api.bundle_close(handle)
+
+STDIO_SOURCE = "function onCreated() {\n  this.x = 1;\n  echo(this.x);\n}\n"
+
+# Address space for a process under test, compiling huge_script() runs out of it
+MEMORY_LIMIT = 256 * 1024 * 1024
+
+def limit_memory():
+    resource.setrlimit(resource.RLIMIT_AS, (MEMORY_LIMIT, MEMORY_LIMIT))
+
+def runs_in_memory_limit(compiler: Path) -> bool:
+    """False where the binaries can't start that small, e.g. sanitizer builds"""
+    result = subprocess.run([str(compiler), "--help"], capture_output=True, preexec_fn=limit_memory, timeout=30)
+    return result.returncode == 0
+
+def huge_script() -> str:
+    return "function onCreated() {\n" + "  this.x = this.y + 1;\n" * 400_000 + "}\n"
+
+def check_stdio(compiler: Path, scripts_dir: Path, work: Path):
+    """--stdio answers every request once by id, with the bytecode a file compile
+    writes, and with an error for failing, incomplete and malformed lines"""
+    script = work / "stdio.gs2"
+    script.write_text(STDIO_SOURCE)
+    run(compiler, script)
+    expected = script.with_suffix(".gs2bc").read_bytes()
+
+    # More requests than the jobs take at once, so reading stdin has to wait on them
+    requests = [json.dumps({"id": i, "name": f"script{i}", "source": STDIO_SOURCE}) for i in range(40)]
+    requests += [json.dumps({"id": "typed", "name": "bow", "type": "weapon", "source": STDIO_SOURCE}),
+                 json.dumps({"id": "failing", "source": "function onCreated( {"}),
+                 json.dumps({"id": "no_source", "name": "empty"}),
+                 "{not json",
+                 ""]
+
+    result = subprocess.run([str(compiler), "--stdio", "-j", "2"], input="\n".join(requests) + "\n",
+                            capture_output=True, text=True, timeout=120)
+    if result.returncode != 0:
+        raise AssertionError(f"gs2test --stdio exited with {result.returncode}: {result.stderr}")
+
+    results: Dict[str, List[dict]] = {}
+    for line in result.stdout.splitlines():
+        response = json.loads(line)
+        results.setdefault(json.dumps(response["id"]), []).append(response)
+
+    expected_ids = [json.dumps(i) for i in range(40)] + ['"typed"', '"failing"', '"no_source"', "null"]
+    if sorted(results) != sorted(expected_ids) or any(len(lines) != 1 for lines in results.values()):
+        raise AssertionError(f"Expected one result per request, got ids {sorted(results)}")
+
+    for i in range(40):
+        response = results[json.dumps(i)][0]
+        if not response["success"] or base64.b64decode(response["bytecode"]) != expected:
+            raise AssertionError(f"Request {i} didn't return the bytecode the file compile wrote")
+
+    typed = results['"typed"'][0]
+    bytecode = base64.b64decode(typed.get("bytecode", ""))
+    if not typed["success"] or b"weapon,bow," not in bytecode or not bytecode.endswith(expected):
+        raise AssertionError("The typed request didn't get the script header in front of the bytecode")
+
+    for key, message in (('"failing"', "malformed input"), ('"no_source"', '"source"'), ("null", "Invalid request")):
+        response = results[key][0]
+        if response["success"] or "bytecode" in response or not any(message in err for err in response["errors"]):
+            raise AssertionError(f"Request {key} should fail with \"{message}\", got {response}")
+
+    if runs_in_memory_limit(compiler):
+        check_stdio_out_of_memory(compiler)
+
+def check_stdio_out_of_memory(compiler: Path):
+    """A compile that runs out of memory gets an error line, and the other requests still compile"""
+    requests = [json.dumps({"id": "huge", "source": huge_script()}), json.dumps({"id": "small", "source": STDIO_SOURCE})]
+    result = subprocess.run([str(compiler), "--stdio", "-j", "2"], input="\n".join(requests) + "\n",
+                            capture_output=True, text=True, preexec_fn=limit_memory, timeout=120)
+    if result.returncode != 0:
+        raise AssertionError(f"gs2test --stdio exited with {result.returncode} after running out of memory: {result.stderr}")
+
+    results = {response["id"]: response for response in map(json.loads, result.stdout.splitlines())}
+    if sorted(results) != ["huge", "small"] or len(result.stdout.splitlines()) != 2:
+        raise AssertionError(f"Expected one result per request, got {result.stdout.splitlines()}")
+    if results["huge"]["success"] or not any("Compile failed" in err for err in results["huge"]["errors"]):
+        raise AssertionError(f"The compile that ran out of memory wasn't reported: {results['huge']}")
+    if not results["small"]["success"]:
+        raise AssertionError("The request next to the one that ran out of memory failed")
+
+# gs2d wire format, see src/daemon/DaemonProtocol.h
+DAEMON_COMPILE, DAEMON_BATCH, DAEMON_CHECK, DAEMON_DISASSEMBLE = 1, 2, 3, 4
+STATUS_OK, STATUS_BAD_REQUEST, STATUS_UNSUPPORTED, STATUS_INTERNAL = 0, 1, 2, 3
+
+# Requests one connection may have unanswered, MAX_IN_FLIGHT in src/gs2d.cpp
+DAEMON_MAX_IN_FLIGHT = 64
+
+def daemon_blob(data: bytes) -> bytes:
+    return struct.pack("<I", len(data)) + data
+
+def daemon_compile_body(source: str, script_type: str = "", name: str = "") -> bytes:
+    if not script_type:
+        return struct.pack("<BQ", 0, 0) + daemon_blob(source.encode())
+    return struct.pack("<BQ", 1, 0) + daemon_blob(script_type.encode()) + daemon_blob(name.encode()) + daemon_blob(source.encode())
+
+def daemon_send(sock: socket.socket, request_type: int, request_id: int, body: bytes):
+    payload = struct.pack("<BI", request_type, request_id) + body
+    sock.sendall(struct.pack("<I", len(payload)) + payload)
+
+def daemon_receive(sock: socket.socket) -> Tuple[int, int, bytes]:
+    """Reads one response, returns its id, status and body"""
+    def read(length: int) -> bytes:
+        data = b""
+        while len(data) < length:
+            chunk = sock.recv(length - len(data))
+            if not chunk:
+                raise AssertionError("gs2d closed the connection")
+            data += chunk
+        return data
+
+    payload = read(struct.unpack("<I", read(4))[0])
+    _, request_id, status, _ = struct.unpack_from("<BIBQ", payload)
+    return request_id, status, payload[14:]
+
+class DaemonReader:
+    def __init__(self, data: bytes):
+        self.data, self.pos = data, 0
+
+    def unpack(self, fmt: str):
+        values = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += struct.calcsize(fmt)
+        return values[0] if len(values) == 1 else values
+
+    def blob(self) -> bytes:
+        length = self.unpack("<I")
+        self.pos += length
+        return self.data[self.pos - length:self.pos]
+
+    def response(self) -> dict:
+        """A CompilerResponse, without stats"""
+        success = self.unpack("<B") != 0
+        errors = []
+        for _ in range(self.unpack("<I")):
+            self.unpack("<BB")
+            errors.append(self.blob().decode())
+        classes = [self.blob().decode() for _ in range(self.unpack("<I"))]
+        bytecode, _ = self.blob(), self.blob()
+        self.unpack("<QQ")
+        if self.unpack("<B"):
+            raise AssertionError("gs2d sent stats that weren't asked for")
+        return {"success": success, "errors": errors, "classes": classes, "bytecode": bytecode}
+
+def start_daemon(daemon: Path, socket_path: Path, preexec_fn=None) -> subprocess.Popen:
+    process = subprocess.Popen([str(daemon), "--socket", str(socket_path), "-j", "2"],
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True, preexec_fn=preexec_fn)
+    if "listening" not in process.stdout.readline():
+        process.kill()
+        raise AssertionError("gs2d didn't start listening")
+    return process
+
+def check_daemon(compiler: Path, scripts_dir: Path, work: Path):
+    """gs2d answers compile, compile-batch, check and disassemble requests, pipelined
+    on one connection, rejects bad and unknown requests, and serves gs2d_connect"""
+    daemon = compiler.with_name("gs2d")
+    if not daemon.exists():
+        raise AssertionError(f"gs2d wasn't built next to {compiler.name}")
+
+    script = work / "daemon.gs2"
+    script.write_text(STDIO_SOURCE)
+    run(compiler, script)
+    expected = script.with_suffix(".gs2bc").read_bytes()
+
+    socket_path = work / "gs2d.sock"
+    process = start_daemon(daemon, socket_path)
+    try:
+        if stat.S_IMODE(socket_path.stat().st_mode) != 0o600:
+            raise AssertionError(f"gs2d socket has mode {oct(stat.S_IMODE(socket_path.stat().st_mode))}, not 0600")
+
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.settimeout(60)
+            sock.connect(str(socket_path))
+
+            batch = [daemon_compile_body(STDIO_SOURCE), daemon_compile_body("function onCreated( {"),
+                     daemon_compile_body(STDIO_SOURCE, "weapon", "bow")]
+
+            # All sent before any response is read, the answers can come back in any order
+            daemon_send(sock, DAEMON_COMPILE, 1, daemon_compile_body(STDIO_SOURCE))
+            daemon_send(sock, DAEMON_CHECK, 2, daemon_compile_body("function onCreated( {"))
+            daemon_send(sock, DAEMON_BATCH, 3, struct.pack("<I", len(batch)) + b"".join(batch))
+            daemon_send(sock, DAEMON_DISASSEMBLE, 4, daemon_blob(expected))
+            daemon_send(sock, DAEMON_DISASSEMBLE, 5, daemon_blob(b"not bytecode"))
+            daemon_send(sock, DAEMON_COMPILE, 6, daemon_compile_body(STDIO_SOURCE)[:5])
+            daemon_send(sock, 99, 7, b"")
+            daemon_send(sock, DAEMON_CHECK, 8, daemon_compile_body(STDIO_SOURCE))
+
+            responses = dict((request_id, (status, body)) for request_id, status, body in
+                             (daemon_receive(sock) for _ in range(8)))
+            if sorted(responses) != list(range(1, 9)):
+                raise AssertionError(f"Expected responses to ids 1-8, got {sorted(responses)}")
+
+            statuses = {request_id: status for request_id, (status, _) in responses.items()}
+            if statuses != {1: STATUS_OK, 2: STATUS_OK, 3: STATUS_OK, 4: STATUS_OK, 5: STATUS_OK,
+                            6: STATUS_BAD_REQUEST, 7: STATUS_UNSUPPORTED, 8: STATUS_OK}:
+                raise AssertionError(f"Unexpected statuses {statuses}")
+
+            compiled = DaemonReader(responses[1][1]).response()
+            if not compiled["success"] or compiled["bytecode"] != expected:
+                raise AssertionError("compile didn't return the bytecode gs2test writes")
+
+            failed = DaemonReader(responses[2][1]).response()
+            checked = DaemonReader(responses[8][1]).response()
+            if failed["success"] or not failed["errors"] or not checked["success"] or checked["bytecode"]:
+                raise AssertionError("check should report errors only and send no bytecode")
+
+            reader = DaemonReader(responses[3][1])
+            items = [reader.response() for _ in range(reader.unpack("<I"))]
+            if len(items) != 3 or [item["success"] for item in items] != [True, False, True]:
+                raise AssertionError(f"compile-batch results out of order: {[item['success'] for item in items]}")
+            if items[0]["bytecode"] != expected or not items[2]["bytecode"].endswith(expected) \
+                    or b"weapon,bow," not in items[2]["bytecode"]:
+                raise AssertionError("compile-batch returned the wrong bytecode")
+
+            reader = DaemonReader(responses[4][1])
+            if reader.unpack("<B") != 1 or "echo" not in reader.blob().decode():
+                raise AssertionError("disassemble didn't return the script's disassembly")
+            if DaemonReader(responses[5][1]).unpack("<B") != 0:
+                raise AssertionError("disassemble accepted something that isn't bytecode")
+
+            # More than the in-flight limit sent at once, the daemon holds the rest back but answers all
+            count = DAEMON_MAX_IN_FLIGHT * 3
+            for request_id in range(count):
+                daemon_send(sock, DAEMON_CHECK, 100 + request_id, daemon_compile_body(STDIO_SOURCE))
+            answered = sorted(daemon_receive(sock)[0] for _ in range(count))
+            if answered != list(range(100, 100 + count)):
+                raise AssertionError(f"{count} pipelined requests weren't each answered once")
+
+        check_daemon_c_api(compiler, socket_path, expected)
+    finally:
+        process.terminate()
+        process.wait(timeout=30)
+
+    if socket_path.exists():
+        raise AssertionError("gs2d left its socket behind")
+
+    if runs_in_memory_limit(compiler):
+        check_daemon_out_of_memory(daemon, work)
+
+def check_daemon_out_of_memory(daemon: Path, work: Path):
+    """A request that runs the daemon out of memory is answered with the internal
+    status and the daemon keeps serving"""
+    process = start_daemon(daemon, work / "gs2d-oom.sock", limit_memory)
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.settimeout(60)
+            sock.connect(str(work / "gs2d-oom.sock"))
+
+            daemon_send(sock, DAEMON_COMPILE, 1, daemon_compile_body(huge_script()))
+            request_id, status, _ = daemon_receive(sock)
+            if (request_id, status) != (1, STATUS_INTERNAL):
+                raise AssertionError(f"Out of memory compile answered with status {status}, not internal")
+
+            daemon_send(sock, DAEMON_COMPILE, 2, daemon_compile_body(STDIO_SOURCE))
+            request_id, status, body = daemon_receive(sock)
+            if (request_id, status) != (2, STATUS_OK) or not DaemonReader(body).response()["success"]:
+                raise AssertionError("gs2d stopped serving after a request ran out of memory")
+    finally:
+        process.terminate()
+        process.wait(timeout=30)
+
+class CompileResponse(ctypes.Structure):
+    _fields_ = [("Success", ctypes.c_bool), ("ErrMsg", ctypes.c_char_p),
+                ("ByteCode", ctypes.POINTER(ctypes.c_ubyte)), ("ByteCodeSize", ctypes.c_uint32)]
+
+def check_daemon_c_api(compiler: Path, socket_path: Path, expected: bytes):
+    """gs2d_connect handles compile through the daemon, skipped for static builds"""
+    library = compiler.parent.parent / "lib" / "libgs2compiler.so"
+    if not library.exists():
+        return
+
+    api = ctypes.CDLL(str(library))
+    api.gs2d_connect.restype = ctypes.c_void_p
+    api.gs2d_connect.argtypes = [ctypes.c_char_p]
+    api.compile_code_no_header.restype = CompileResponse
+    api.compile_code_no_header.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    api.gs2d_last_latency_ns.restype = ctypes.c_uint64
+    api.gs2d_last_latency_ns.argtypes = [ctypes.c_void_p]
+    api.delete_context.argtypes = [ctypes.c_void_p]
+
+    if api.gs2d_connect(str(socket_path.with_name("missing.sock")).encode()):
+        raise AssertionError("gs2d_connect returned a handle without a daemon")
+
+    context = api.gs2d_connect(str(socket_path).encode())
+    if not context:
+        raise AssertionError("gs2d_connect couldn't reach the daemon")
+    try:
+        response = api.compile_code_no_header(context, STDIO_SOURCE.encode())
+        if not response.Success or ctypes.string_at(response.ByteCode, response.ByteCodeSize) != expected:
+            raise AssertionError("compile_code_no_header through gs2d_connect returned the wrong bytecode")
+        if api.gs2d_last_latency_ns(context) == 0:
+            raise AssertionError("gs2d_last_latency_ns reported nothing")
+    finally:
+        api.delete_context(context)
+
+WATCH_LINE_RE = re.compile(r"\[watch\] (\S+): (compiled|unchanged) in [0-9.]+ ms, ([0-9.]+) ms since save")
+
+class WatchProcess:
+    """gs2test --watch on a directory, its output collected on a thread"""
+    def __init__(self, compiler: Path, directory: Path, preexec_fn=None, args: Tuple[str, ...] = ()):
+        self.process = subprocess.Popen([str(compiler), "--watch", str(directory), "-j", "2", *args],
+                                        stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True,
+                                        preexec_fn=preexec_fn)
+        self.lines: "queue.Queue[str]" = queue.Queue()
+        threading.Thread(target=self._read, daemon=True).start()
+
+        if "Watching" not in self.lines.get(timeout=30):
+            raise AssertionError("gs2test --watch didn't start watching")
+
+    def _read(self):
+        for line in self.process.stdout:
+            self.lines.put(line)
+
+    def saved(self, name: str, timeout: float = 30) -> Tuple[str, float]:
+        """Waits for the report on name, returns compiled or unchanged and the ms since the save"""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            try:
+                line = self.lines.get(timeout=max(deadline - time.monotonic(), 0.01))
+            except queue.Empty:
+                break
+            match = WATCH_LINE_RE.match(line)
+            if match and match.group(1) == name:
+                return match.group(2), float(match.group(3))
+            if "[ERROR]" in line:
+                raise AssertionError(f"Watch mode reported an error: {line.strip()}")
+        raise AssertionError(f"Watch mode didn't report {name}")
+
+    def reported(self, names: List[str], timeout: float = 30) -> List[str]:
+        """Waits until all of names were compiled, returns every name reported meanwhile"""
+        seen = []
+        deadline = time.monotonic() + timeout
+        while not set(names) <= set(seen) and time.monotonic() < deadline:
+            try:
+                line = self.lines.get(timeout=max(deadline - time.monotonic(), 0.01))
+            except queue.Empty:
+                break
+            match = WATCH_LINE_RE.match(line)
+            if match:
+                seen.append(match.group(1))
+        if not set(names) <= set(seen):
+            raise AssertionError(f"Watch mode didn't report {sorted(set(names) - set(seen))}")
+        return seen
+
+    def failed(self, name: str, timeout: float = 60) -> str:
+        """Waits for name to be reported as failed, returns the error line"""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            try:
+                line = self.lines.get(timeout=max(deadline - time.monotonic(), 0.01))
+            except queue.Empty:
+                break
+            if line.startswith(f"[watch] {name}: failed"):
+                return self.lines.get(timeout=5).strip()
+        raise AssertionError(f"Watch mode didn't report {name} as failed")
+
+    def stop(self):
+        self.process.terminate()
+        self.process.wait(timeout=30)
+
+def check_watch(compiler: Path, scripts_dir: Path, work: Path):
+    """Saving a script under --watch recompiles it to the same bytecode a one-off
+    compile writes, in new directories too, and formatting edits leave it alone"""
+    reference = work / "reference.gs2"
+    reference.write_text(STDIO_SOURCE)
+    run(compiler, reference)
+    expected = reference.with_suffix(".gs2bc").read_bytes()
+
+    watched = work / "watched"
+    (watched / "sub").mkdir(parents=True)
+    watcher = WatchProcess(compiler, watched)
+    try:
+        script = watched / "sub" / "edit.gs2"
+        output = script.with_suffix(".gs2bc")
+        script.write_text(STDIO_SOURCE)
+        status, _ = watcher.saved("sub/edit.gs2")
+        if status != "compiled" or output.read_bytes() != expected:
+            raise AssertionError("The saved script wasn't compiled to the expected bytecode")
+
+        mtime = output.stat().st_mtime_ns
+        script.write_text("// reformatted\n" + STDIO_SOURCE.replace("  ", "\t"))
+        status, _ = watcher.saved("sub/edit.gs2")
+        if status != "unchanged" or output.stat().st_mtime_ns != mtime:
+            raise AssertionError("A formatting-only save rewrote the output")
+
+        # A directory created while watching is picked up, with the script saved in it
+        (watched / "later").mkdir()
+        time.sleep(0.1)
+        (watched / "later" / "new.gs2").write_text(STDIO_SOURCE)
+        status, _ = watcher.saved("later/new.gs2")
+        if status != "compiled" or (watched / "later" / "new.gs2bc").read_bytes() != expected:
+            raise AssertionError("A script in a new directory wasn't compiled")
+    finally:
+        watcher.stop()
+
+    if runs_in_memory_limit(compiler):
+        check_watch_out_of_memory(compiler, work, expected)
+
+def check_watch_out_of_memory(compiler: Path, work: Path, expected: bytes):
+    """A compile that runs out of memory is reported and watching goes on"""
+    watched = work / "watched_oom"
+    watched.mkdir()
+    watcher = WatchProcess(compiler, watched, limit_memory)
+    try:
+        (watched / "huge.gs2").write_text(huge_script())
+        error = watcher.failed("huge.gs2")
+        if "[ERROR]" not in error:
+            raise AssertionError(f"The compile that ran out of memory had no error line: {error}")
+
+        (watched / "small.gs2").write_text(STDIO_SOURCE)
+        status, _ = watcher.saved("small.gs2")
+        if status != "compiled" or (watched / "small.gs2bc").read_bytes() != expected:
+            raise AssertionError("Watch mode stopped compiling after a compile ran out of memory")
+    finally:
+        watcher.stop()
+
+CHECKS: Dict[str, Callable[[Path, Path, Path], None]] = {
+    "bundle": check_bundle,
+    "daemon": check_daemon,
+    "discovery": check_discovery,
+    "disassembly_c_api": check_disassembly_c_api,
+    "disassembly_golden": check_disassembly_golden,
+    "jobs_deterministic": check_jobs_deterministic,
+    "known_bytecode": check_known_bytecode,
+    "long_jumps": check_long_jumps,
+    "parallel_disassembly": check_parallel_disassembly,
+    "same_output_path": check_same_output_path,
+    "stdio": check_stdio,
+    "unchanged_output": check_unchanged_output,
+    "watch": check_watch,
+}
+
+def main():
+    parser = argparse.ArgumentParser(description="GS2 Command Line Tests")
+    parser.add_argument("--project-root", type=Path, default=Path.cwd(),
+                       help="Path to project root directory")
+    parser.add_argument("--compiler", type=Path,
+                       help="Compiler executable (default: search PROJECT_ROOT)")
+    parser.add_argument("--scripts-dir", type=Path,
+                       help="Directory containing test scripts (default: PROJECT_ROOT/tests/scripts)")
+    parser.add_argument("--check", choices=sorted(CHECKS), action="append",
+                       help="Check to run, may be repeated (default: all)")
+
+    args = parser.parse_args()
+
+    try:
+        compiler = (args.compiler or find_compiler(args.project_root)).resolve()
+    except FileNotFoundError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 3
+
+    scripts_dir = args.scripts_dir or args.project_root / "tests" / "scripts"
+    failures: List[str] = []
+
+    for name in args.check or CHECKS:
+        with tempfile.TemporaryDirectory(prefix="gs2cli-") as work:
+            try:
+                CHECKS[name](compiler, scripts_dir, Path(work))
+                print(f"{name}: PASS")
+            except AssertionError as e:
+                print(f"{name}: FAIL, {e}")
+                failures.append(name)
+
+    if failures:
+        print(f"\nFailed checks: {', '.join(failures)}")
+        return 1
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+GS2 Scaling Corpus Generator
+Emits synthetic GS2 programs whose size is controlled by a single parameter,
+used to check how compile time and memory grow with input size.
+"""
+
+import argparse
+import sys
+from pathlib import Path
+from typing import Callable, Dict
+
+def gen_functions(n: int) -> str:
+    """N small functions, each called from onCreated"""
+    lines = []
+    for i in range(n):
+        lines.append(f"function func{i}(a, b) {{")
+        lines.append(f"  temp.x = a * {i} + b;")
+        lines.append(f"  return temp.x;")
+        lines.append("}")
+    lines.append("function onCreated() {")
+    for i in range(n):
+        lines.append(f"  this.r{i % 64} = func{i}({i}, {i + 1});")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_expression_depth(d: int) -> str:
+    """A single expression D operators deep (left-associative chain)"""
+    ops = ["+", "-", "*", "+"]
+    expr = "1"
+    parts = [expr]
+    for i in range(d):
+        parts.append(f" {ops[i % len(ops)]} this.v{i % 16}")
+    return "function onCreated() {\n  this.result = " + "".join(parts) + ";\n}\n"
+
+def gen_switch_cases(c: int) -> str:
+    """A switch with C cases"""
+    lines = ["function onCreated() {", "  switch (this.value) {"]
+    for i in range(c):
+        lines.append(f"    case {i}:")
+        lines.append(f"      this.out = {i * 2};")
+        lines.append("      break;")
+    lines.append("    default:")
+    lines.append("      this.out = -1;")
+    lines.append("  }")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_string_table(s: int) -> str:
+    """S distinct string constants"""
+    lines = ["function onCreated() {"]
+    for i in range(s):
+        lines.append(f'  this.s{i % 32} = "string constant number {i}";')
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+def gen_nesting_depth(k: int) -> str:
+    """Blocks nested K deep, alternating if/while/for"""
+    lines = ["function onCreated() {"]
+    for i in range(k):
+        indent = "  " * (i + 1)
+        kind = i % 3
+        if kind == 0:
+            lines.append(f"{indent}if (this.a{i % 8} > {i}) {{")
+        elif kind == 1:
+            lines.append(f"{indent}while (this.b{i % 8} < {i}) {{")
+        else:
+            lines.append(f"{indent}for (temp.i{i % 8} = 0; temp.i{i % 8} < {i}; temp.i{i % 8}++) {{")
+        lines.append(f"{indent}  this.c{i % 8} += {i};")
+    for i in reversed(range(k)):
+        lines.append("  " * (i + 1) + "}")
+    lines.append("}")
+    return "\n".join(lines) + "\n"
+
+# name -> (generator, default sizes). Sizes double so the growth exponent can be fit
+SHAPES: Dict[str, Callable[[int], str]] = {
+    "functions": gen_functions,
+    "expression_depth": gen_expression_depth,
+    "switch_cases": gen_switch_cases,
+    "string_table": gen_string_table,
+    "nesting_depth": gen_nesting_depth,
+}
+
+DEFAULT_SIZES: Dict[str, list] = {
+    "functions": [250, 500, 1000, 2000, 4000],
+    "expression_depth": [250, 500, 1000, 2000, 4000],
+    "switch_cases": [250, 500, 1000, 2000, 4000],
+    "string_table": [500, 1000, 2000, 4000, 8000],
+    "nesting_depth": [32, 64, 128, 256, 512],
+}
+
+def generate(shape: str, size: int) -> str:
+    return SHAPES[shape](size)
+
+def main():
+    parser = argparse.ArgumentParser(description="GS2 Scaling Corpus Generator")
+    parser.add_argument("output_dir", type=Path, help="Directory to write the generated scripts to")
+    parser.add_argument("--shape", choices=sorted(SHAPES), action="append",
+                       help="Shape to generate, may be repeated (default: all)")
+    parser.add_argument("--sizes", type=lambda v: [int(x) for x in v.split(",")],
+                       help="Comma separated sizes (default: per-shape doubling series)")
+
+    args = parser.parse_args()
+    args.output_dir.mkdir(parents=True, exist_ok=True)
+
+    for shape in args.shape or sorted(SHAPES):
+        for size in args.sizes or DEFAULT_SIZES[shape]:
+            path = args.output_dir / f"{shape}_{size}.gs2"
+            path.write_text(generate(shape, size))
+            print(f"{path}")
+
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
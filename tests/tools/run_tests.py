@@ -11,6 +11,9 @@ import hashlib
 import subprocess
 import argparse
 import time
+import math
+import re
+import statistics
 from pathlib import Path
 from typing import Dict, List, Tuple, Optional
 from dataclasses import dataclass, asdict
@@ -25,6 +28,7 @@ class TestResult:
     bytecode_size: int
     error_message: str = ""
     warnings: List[str] = None
+    line_table: List[List[int]] = None
 
     def __post_init__(self):
         if self.warnings is None:
@@ -39,17 +43,94 @@ class BaselineData:
     expected_failure: bool = False
     error_message: str = ""
     metadata: Dict = None
+    line_table: List[List[int]] = None
 
     def __post_init__(self):
         if self.metadata is None:
             self.metadata = {}
 
+# gs2test --stats, the same parse + codegen + finalize time scaling_test.py uses
+STATS_RE = re.compile(r"parse ([\d.]+) ms, codegen ([\d.]+) ms, finalize ([\d.]+) ms")
+
+def read_varint(data: bytes, pos: int) -> Tuple[int, int]:
+    """Decodes one LEB128 varint, returning it and the position after it"""
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+def decode_line_table(data: bytes) -> List[List[int]]:
+    """Decodes a .gs2lines file (see src/encoding/linetable.h) into [op, line, column] entries"""
+    if data[:4] != b"GS2L" or data[4] != 2:
+        raise ValueError("Not a version 2 line table")
+
+    # Skip the bytecode fingerprint
+    count, pos = read_varint(data, 5 + 16)
+    entries = []
+    op = line = 0
+    for _ in range(count):
+        op_delta, pos = read_varint(data, pos)
+        line_zigzag, pos = read_varint(data, pos)
+        column, pos = read_varint(data, pos)
+        op += op_delta
+        line += (line_zigzag >> 1) ^ -(line_zigzag & 1)
+        entries.append([op, line, column])
+    return entries
+
+def mann_whitney_u(a: List[float], b: List[float]) -> Tuple[float, float]:
+    """Two-sided Mann-Whitney U test, normal approximation with tie and continuity correction.
+    Returns (U statistic for a, p-value)"""
+    n1, n2 = len(a), len(b)
+    if n1 == 0 or n2 == 0:
+        return 0.0, 1.0
+
+    combined = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    ranks = [0.0] * len(combined)
+    tie_term = 0.0
+    i = 0
+    while i < len(combined):
+        j = i
+        while j + 1 < len(combined) and combined[j + 1][0] == combined[i][0]:
+            j += 1
+        avg_rank = (i + j) / 2.0 + 1.0
+        for k in range(i, j + 1):
+            ranks[k] = avg_rank
+        t = j - i + 1
+        tie_term += t ** 3 - t
+        i = j + 1
+
+    rank_sum_a = sum(rank for rank, (_, group) in zip(ranks, combined) if group == 0)
+    u_a = rank_sum_a - n1 * (n1 + 1) / 2.0
+
+    n = n1 + n2
+    mu = n1 * n2 / 2.0
+    variance = n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1)))
+    if variance <= 0:
+        return u_a, 1.0
+
+    delta = u_a - mu
+    z = (abs(delta) - 0.5) / math.sqrt(variance) if delta != 0 else 0.0
+    return u_a, math.erfc(max(z, 0.0) / math.sqrt(2.0))
+
+def min_trials_for_alpha(alpha: float, limit: int = 1000) -> Optional[int]:
+    """Fewest trials per compiler whose best possible Mann-Whitney p-value (every
+    trial of one compiler faster than every trial of the other) is below alpha.
+    With few trials no difference is ever significant, e.g. 4 are needed at 0.05"""
+    for n in range(2, limit + 1):
+        if mann_whitney_u(list(range(n)), list(range(n, 2 * n)))[1] < alpha:
+            return n
+    return None
+
 class GS2TestRunner:
     """Main test runner class"""
 
     def __init__(self, project_root: Path, scripts_dir: Path = None,
                  baselines_dir: Path = None, output_dir: Path = None,
-                 reports_dir: Path = None):
+                 reports_dir: Path = None, compiler_path: Path = None):
         self.project_root = project_root
         self.test_dir = project_root / "tests"
 
@@ -66,7 +147,7 @@ class GS2TestRunner:
         self.reports_dir.mkdir(parents=True, exist_ok=True)
 
         # Find the compiler executable
-        self.compiler_path = self._find_compiler()
+        self.compiler_path = compiler_path or self._find_compiler()
 
     def _find_compiler(self) -> Path:
         """Find the GS2 compiler executable"""
@@ -94,20 +175,32 @@ class GS2TestRunner:
         # Get all .gs2 files recursively
         return list(self.scripts_dir.rglob("*.gs2"))
 
-    def _compile_script(self, script_path: Path) -> Tuple[bool, bytes, str, float]:
-        """Compile a single script and return results"""
-        start_time = time.time()
+    def _compile_script(self, script_path: Path, compiler_path: Optional[Path] = None,
+                        use_stats: bool = False) -> Tuple[bool, bytes, str, float]:
+        """Compile a single script and return results. With use_stats the time is the
+        compiler's own --stats phase time rather than that of the whole process"""
+        start_time = time.perf_counter()
+
+        command = [str(compiler_path or self.compiler_path), str(script_path)]
+        if self._wants_line_table(script_path):
+            command.append("-l")
+        if use_stats:
+            command.append("--stats")
 
         try:
             # Run the compiler
             result = subprocess.run(
-                [str(self.compiler_path), str(script_path)],
+                command,
                 capture_output=True,
                 text=True,
                 timeout=30  # 30 second timeout
             )
 
-            compilation_time = time.time() - start_time
+            compilation_time = time.perf_counter() - start_time
+
+            stats = STATS_RE.search(result.stdout) if use_stats else None
+            if stats:
+                compilation_time = sum(float(ms) for ms in stats.groups()) / 1000.0
 
             # Check if compilation was successful
             success = result.returncode == 0
@@ -136,12 +229,24 @@ class GS2TestRunner:
             return success, bytecode, error_message, compilation_time
 
         except subprocess.TimeoutExpired:
-            compilation_time = time.time() - start_time
+            compilation_time = time.perf_counter() - start_time
             return False, b"", "Compilation timeout", compilation_time
         except Exception as e:
-            compilation_time = time.time() - start_time
+            compilation_time = time.perf_counter() - start_time
             return False, b"", str(e), compilation_time
 
+    def _reports_stats(self, compiler_path: Path, script_path: Path) -> bool:
+        """Whether the compiler prints --stats phase times (older builds don't have the option)"""
+        try:
+            result = subprocess.run([str(compiler_path), str(script_path), "--stats"],
+                                    capture_output=True, text=True, timeout=30)
+        except (subprocess.TimeoutExpired, OSError):
+            return False
+
+        script_path.with_suffix(script_path.suffix + "bc").unlink(missing_ok=True)
+        script_path.with_suffix(".gs2lines").unlink(missing_ok=True)
+        return result.returncode == 0 and STATS_RE.search(result.stdout) is not None
+
     def _get_baseline_path(self, script_path: Path) -> Path:
         """Get the baseline file path for a script"""
         relative_path = script_path.relative_to(self.scripts_dir)
@@ -155,7 +260,23 @@ class GS2TestRunner:
         relative_path = script_path.relative_to(self.scripts_dir)
         return "error_cases" in relative_path.parts
 
-    def _save_baseline(self, script_path: Path, success: bool, bytecode: bytes, error_message: str):
+    def _wants_line_table(self, script_path: Path) -> bool:
+        """Scripts in line_tables are compiled with -l and their line table is part of the baseline"""
+        relative_path = script_path.relative_to(self.scripts_dir)
+        return "line_tables" in relative_path.parts
+
+    def _read_line_table(self, script_path: Path) -> Optional[List[List[int]]]:
+        """Decode and remove the .gs2lines file written next to the script's bytecode"""
+        lines_file = script_path.with_suffix(".gs2lines")
+        if not lines_file.exists():
+            return None
+
+        data = lines_file.read_bytes()
+        lines_file.unlink()
+        return decode_line_table(data)
+
+    def _save_baseline(self, script_path: Path, success: bool, bytecode: bytes, error_message: str,
+                       line_table: Optional[List[List[int]]] = None):
         """Save baseline data for a script"""
         baseline_path = self._get_baseline_path(script_path)
         expected_failure = self._is_expected_failure(script_path)
@@ -170,11 +291,16 @@ class GS2TestRunner:
                 "script_path": str(script_path.relative_to(self.scripts_dir)),
                 "generated_at": time.strftime("%Y-%m-%d %H:%M:%S"),
                 "compiler_version": self._get_compiler_version()
-            }
+            },
+            line_table=line_table
         )
 
+        data = asdict(baseline_data)
+        if line_table is None:
+            del data["line_table"]
+
         with open(baseline_path, 'w') as f:
-            json.dump(asdict(baseline_data), f, indent=2)
+            json.dump(data, f, indent=2)
 
         # Also save raw bytecode for debugging
         if bytecode:
@@ -218,6 +344,7 @@ class GS2TestRunner:
     def run_test(self, script_path: Path) -> TestResult:
         """Run a single test"""
         success, bytecode, error_message, compilation_time = self._compile_script(script_path)
+        line_table = self._read_line_table(script_path) if self._wants_line_table(script_path) else None
 
         bytecode_hash = hashlib.sha256(bytecode).hexdigest() if bytecode else ""
 
@@ -227,7 +354,8 @@ class GS2TestRunner:
             compilation_time=compilation_time,
             bytecode_hash=bytecode_hash,
             bytecode_size=len(bytecode),
-            error_message=error_message
+            error_message=error_message,
+            line_table=line_table
         )
 
     def compare_with_baseline(self, test_result: TestResult, baseline: BaselineData) -> List[str]:
@@ -253,6 +381,9 @@ class GS2TestRunner:
             if test_result.bytecode_size != baseline.bytecode_size:
                 differences.append(f"Bytecode size changed: {baseline.bytecode_size} -> {test_result.bytecode_size}")
 
+            if baseline.line_table is not None and test_result.line_table != baseline.line_table:
+                differences.append(f"Line table changed: {baseline.line_table} -> {test_result.line_table}")
+
         # For expected failures, check if they still fail appropriately
         if baseline.expected_failure and test_result.success:
             differences.append(f"Script was expected to fail but compiled successfully")
@@ -315,7 +446,8 @@ class GS2TestRunner:
             if update_baselines or baseline is None:
                 # Save new baseline
                 success, bytecode, error_message, _ = self._compile_script(script_path)
-                self._save_baseline(script_path, success, bytecode, error_message)
+                line_table = self._read_line_table(script_path) if self._wants_line_table(script_path) else None
+                self._save_baseline(script_path, success, bytecode, error_message, line_table)
                 if baseline is None:
                     results["new_tests"].append(test_info)
                     print(f"  -> Created new baseline")
@@ -354,6 +486,140 @@ class GS2TestRunner:
 
         return results
 
+    def run_benchmark_comparison(self, reference_path: Path, category: Optional[str] = None,
+                                 trials: int = 7, threshold: float = 5.0, alpha: float = 0.05,
+                                 quiet: bool = False) -> Dict:
+        """Compile the corpus with the current and a reference compiler over repeated trials.
+
+        Trials alternate between the two compilers so drift (thermal, other load) hits both
+        equally. Per-script times are compared with a Mann-Whitney U test, and the run is
+        a regression when the median corpus throughput drops by more than `threshold` percent
+        and the per-trial corpus times differ significantly. When both compilers support
+        --stats, times are their parse + codegen + finalize phases, so process startup
+        and file I/O don't dilute the difference."""
+        script_files = sorted(path for path in self._get_script_files(category)
+                              if not self._is_expected_failure(path))
+
+        if not script_files:
+            raise ValueError("No test scripts found")
+
+        compilers = {"current": self.compiler_path, "reference": reference_path}
+
+        # Warm up the page cache and both binaries, only scripts that both
+        # compilers accept are timed
+        accepted = []
+        last_error = ""
+        for script_path in script_files:
+            results = [self._compile_script(script_path, compiler) for compiler in compilers.values()]
+            if all(success for success, _, _, _ in results):
+                accepted.append(script_path)
+            else:
+                last_error = next(error for success, _, error, _ in results if not success)
+                if not quiet:
+                    print(f"Skipping {script_path.relative_to(self.scripts_dir)}: {last_error.strip()[:80]}")
+
+        if not accepted:
+            raise RuntimeError(f"No script compiled with both compilers, last error: {last_error.strip()}")
+
+        script_files = accepted
+        source_bytes = {path: path.stat().st_size for path in script_files}
+        use_stats = all(self._reports_stats(compiler, script_files[0]) for compiler in compilers.values())
+
+        times = {name: {path: [] for path in script_files} for name in compilers}
+        sizes = {name: {} for name in compilers}
+        trial_totals = {name: [] for name in compilers}
+
+        if not quiet:
+            print(f"Comparing {self.compiler_path} against {reference_path}")
+            print(f"{len(script_files)} scripts, {trials} trials each")
+            print("Timing: " + ("--stats parse + codegen + finalize" if use_stats else "whole process, a compiler lacks --stats"))
+
+        for trial in range(trials):
+            order = list(compilers.items()) if trial % 2 == 0 else list(reversed(compilers.items()))
+            for name, compiler in order:
+                total = 0.0
+                for script_path in script_files:
+                    success, bytecode, error_message, elapsed = self._compile_script(script_path, compiler, use_stats)
+                    times[name][script_path].append(elapsed)
+                    sizes[name][script_path] = len(bytecode) if success else None
+                    total += elapsed
+                trial_totals[name].append(total)
+
+            if not quiet:
+                print(f"  trial {trial + 1}/{trials}: current {trial_totals['current'][-1] * 1000:.3f} ms, "
+                      f"reference {trial_totals['reference'][-1] * 1000:.3f} ms")
+
+        total_bytes = sum(source_bytes.values())
+        throughput = {}
+        for name in compilers:
+            median_total = sum(statistics.median(times[name][path]) for path in script_files)
+            throughput[name] = total_bytes / median_total if median_total > 0 else 0.0
+
+        regression_pct = 0.0
+        if throughput["reference"] > 0:
+            regression_pct = (throughput["reference"] - throughput["current"]) / throughput["reference"] * 100.0
+
+        _, corpus_p = mann_whitney_u(trial_totals["current"], trial_totals["reference"])
+
+        scripts = []
+        slower, faster = 0, 0
+        for script_path in script_files:
+            cur, ref = times["current"][script_path], times["reference"][script_path]
+            _, p_value = mann_whitney_u(cur, ref)
+            cur_median, ref_median = statistics.median(cur), statistics.median(ref)
+            change_pct = (cur_median - ref_median) / ref_median * 100.0 if ref_median > 0 else 0.0
+            significant = p_value < alpha
+            if significant:
+                if cur_median > ref_median:
+                    slower += 1
+                else:
+                    faster += 1
+
+            scripts.append({
+                "script": str(script_path.relative_to(self.scripts_dir)),
+                "current_median": cur_median,
+                "reference_median": ref_median,
+                "change_pct": change_pct,
+                "p_value": p_value,
+                "significant": significant,
+                "current_size": sizes["current"][script_path],
+                "reference_size": sizes["reference"][script_path],
+            })
+
+        compared = [s for s in scripts if s["current_size"] is not None and s["reference_size"] is not None]
+        current_output = sum(s["current_size"] for s in compared)
+        reference_output = sum(s["reference_size"] for s in compared)
+        size_change_pct = ((current_output - reference_output) / reference_output * 100.0
+                           if reference_output > 0 else 0.0)
+        size_changed = [s["script"] for s in compared if s["current_size"] != s["reference_size"]]
+
+        throughput_regressed = regression_pct > threshold and corpus_p < alpha
+        size_regressed = size_change_pct > threshold
+
+        return {
+            "summary": {
+                "scripts": len(script_files),
+                "trials": trials,
+                "timing": "stats" if use_stats else "process",
+                "threshold_pct": threshold,
+                "alpha": alpha,
+                "current_throughput_mbps": throughput["current"] / (1024 * 1024),
+                "reference_throughput_mbps": throughput["reference"] / (1024 * 1024),
+                "throughput_regression_pct": regression_pct,
+                "corpus_p_value": corpus_p,
+                "scripts_slower": slower,
+                "scripts_faster": faster,
+                "current_output_bytes": current_output,
+                "reference_output_bytes": reference_output,
+                "output_size_change_pct": size_change_pct,
+                "output_size_changed": size_changed,
+                "regressed": throughput_regressed or size_regressed,
+            },
+            "compilers": {name: str(path) for name, path in compilers.items()},
+            "trial_totals": trial_totals,
+            "tests": scripts,
+        }
+
     def generate_report(self, results: Dict, output_file: Optional[Path] = None) -> Path:
         """Generate detailed test report"""
         if output_file is None:
@@ -363,7 +629,7 @@ class GS2TestRunner:
         # Add metadata
         results["metadata"] = {
             "generated_at": time.strftime("%Y-%m-%d %H:%M:%S"),
-            "compiler_path": str(self.compiler_path.relative_to(self.project_root)),
+            "compiler_path": str(self.compiler_path),
             "compiler_version": self._get_compiler_version()
         }
 
@@ -372,6 +638,59 @@ class GS2TestRunner:
 
         return output_file
 
+def run_comparison(runner: GS2TestRunner, args) -> int:
+    """Benchmark comparison mode, returns the process exit code"""
+    if not args.compare_with.exists():
+        raise FileNotFoundError(f"Reference compiler not found: {args.compare_with}")
+
+    min_trials = min_trials_for_alpha(args.alpha)
+    if min_trials is None:
+        raise ValueError(f"--alpha {args.alpha} can't be reached by the Mann-Whitney U test")
+    trials = max(args.trials, min_trials)
+    if trials != args.trials:
+        print(f"Note: using {trials} trials, the fewest that can reach --alpha {args.alpha}", file=sys.stderr)
+
+    results = runner.run_benchmark_comparison(
+        args.compare_with,
+        category=args.category,
+        trials=trials,
+        threshold=args.regression_threshold,
+        alpha=args.alpha,
+        quiet=args.quiet
+    )
+
+    timestamp = time.strftime("%Y%m%d_%H%M%S")
+    report_file = runner.generate_report(results, args.output_report or
+                                         runner.reports_dir / f"benchmark_report_{timestamp}.json")
+    summary = results["summary"]
+
+    if not args.quiet:
+        print(f"\n{'='*60}")
+        print(f"Benchmark Comparison:")
+        print(f"  Scripts: {summary['scripts']} x {summary['trials']} trials")
+        print(f"  Current throughput:   {summary['current_throughput_mbps']:.3f} MB/s")
+        print(f"  Reference throughput: {summary['reference_throughput_mbps']:.3f} MB/s")
+        print(f"  Throughput regression: {summary['throughput_regression_pct']:+.2f}% "
+              f"(threshold {summary['threshold_pct']}%, p={summary['corpus_p_value']:.4f})")
+        print(f"  Significantly slower scripts: {summary['scripts_slower']}, faster: {summary['scripts_faster']}")
+        print(f"  Output size change: {summary['output_size_change_pct']:+.2f}% "
+              f"({summary['reference_output_bytes']} -> {summary['current_output_bytes']} bytes, "
+              f"{len(summary['output_size_changed'])} scripts differ)")
+        print(f"  Report saved to: {report_file}")
+
+        if args.show_timing:
+            print(f"\nPer-script medians (microseconds):")
+            for test in results["tests"]:
+                marker = "*" if test["significant"] else " "
+                print(f"  {marker} {test['script']}: {int(test['reference_median'] * 1_000_000):,} -> "
+                      f"{int(test['current_median'] * 1_000_000):,} μs ({test['change_pct']:+.1f}%, p={test['p_value']:.3f})")
+
+    if summary["regressed"]:
+        print(f"Performance regression detected")
+        return 1
+
+    return 0
+
 def main():
     parser = argparse.ArgumentParser(description="GS2 Parser Test Suite Runner")
     parser.add_argument("--category", help="Run tests only for specific category")
@@ -393,6 +712,16 @@ def main():
                        help="Suppress verbose output")
     parser.add_argument("--show-timing", action="store_true",
                        help="Show detailed compilation timing for each test")
+    parser.add_argument("--compiler", type=Path,
+                       help="Compiler executable to test (default: search PROJECT_ROOT)")
+    parser.add_argument("--compare-with", type=Path, metavar="REFERENCE",
+                       help="Benchmark against a reference compiler instead of checking baselines")
+    parser.add_argument("--trials", type=int, default=7,
+                       help="Trials per compiler in comparison mode, raised to the fewest that can reach --alpha (default: 7)")
+    parser.add_argument("--regression-threshold", type=float, default=5.0,
+                       help="Allowed median throughput/output size regression in percent (default: 5)")
+    parser.add_argument("--alpha", type=float, default=0.05,
+                       help="Significance level for the Mann-Whitney U test (default: 0.05)")
 
     args = parser.parse_args()
 
@@ -401,7 +730,11 @@ def main():
                               scripts_dir=args.scripts_dir,
                               baselines_dir=args.baselines_dir,
                               output_dir=args.output_dir,
-                              reports_dir=args.reports_dir)
+                              reports_dir=args.reports_dir,
+                              compiler_path=args.compiler)
+
+        if args.compare_with:
+            sys.exit(run_comparison(runner, args))
 
         # Run tests
         results = runner.run_all_tests(
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+GS2 Scaling Test
+Compiles each synthetic shape from gen_scaling_corpus.py at doubling sizes and
+asserts that compile time and memory grow near-linearly with the input size.
+
+Compile time is taken from `gs2test --stats` (parse + codegen + finalize), so
+process startup doesn't flatten the curve. Memory is the peak RSS of the
+compiler process above that of an empty script. RSS moves in page and arena
+sized steps, so memory is only fitted over sizes that grow it by more than
+--memory-floor, and not at all when fewer than 3 sizes do. The growth exponent
+is the least-squares slope of log(cost) against log(input bytes).
+"""
+
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+from typing import List, Optional, Tuple
+
+sys.path.insert(0, str(Path(__file__).resolve().parent))
+from gen_scaling_corpus import SHAPES, DEFAULT_SIZES, generate
+
+MIN_MEMORY_POINTS = 3
+
+STATS_RE = re.compile(r"parse ([\d.]+) ms, codegen ([\d.]+) ms, finalize ([\d.]+) ms")
+
+def find_compiler(project_root: Path) -> Path:
+    for path in [project_root / "bin" / "gs2test",
+                 project_root / "build" / "gs2test",
+                 project_root / "build" / "Release" / "gs2test"]:
+        if path.exists():
+            return path
+    raise FileNotFoundError("Could not find gs2test compiler executable. Please build the project first.")
+
+def compile_once(compiler: Path, script: Path) -> Tuple[float, Optional[int]]:
+    """Returns (compile time in ms, peak rss in bytes or None)"""
+    proc = subprocess.Popen([str(compiler), str(script), "--stats"],
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+    # --stats output is a few lines, so reading both pipes before waiting can't block
+    stdout, stderr = proc.stdout.read(), proc.stderr.read()
+
+    max_rss = None
+    if hasattr(os, "wait4"):
+        _, status, usage = os.wait4(proc.pid, 0)
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        # ru_maxrss is in kilobytes on Linux, bytes on macOS
+        max_rss = usage.ru_maxrss if sys.platform == "darwin" else usage.ru_maxrss * 1024
+    else:
+        proc.wait()
+
+    match = STATS_RE.search(stdout)
+    if proc.returncode != 0 or not match or "[ERROR]" in stdout:
+        raise RuntimeError(f"Failed to compile {script.name}: {stdout.strip()} {stderr.strip()}")
+
+    return sum(float(v) for v in match.groups()), max_rss
+
+def measure(compiler: Path, script: Path, repeats: int) -> Tuple[float, Optional[int]]:
+    """Fastest time and smallest rss over a few runs"""
+    results = [compile_once(compiler, script) for _ in range(repeats)]
+    rss_values = [rss for _, rss in results if rss is not None]
+    return min(t for t, _ in results), (min(rss_values) if rss_values else None)
+
+def growth_exponent(sizes: List[float], costs: List[float]) -> float:
+    """Least-squares slope of log(cost) over log(size)"""
+    points = [(math.log(s), math.log(c)) for s, c in zip(sizes, costs) if s > 0 and c > 0]
+    if len(points) < 2:
+        return 0.0
+
+    mean_x = sum(x for x, _ in points) / len(points)
+    mean_y = sum(y for _, y in points) / len(points)
+    var_x = sum((x - mean_x) ** 2 for x, _ in points)
+    if var_x == 0:
+        return 0.0
+    return sum((x - mean_x) * (y - mean_y) for x, y in points) / var_x
+
+def main():
+    parser = argparse.ArgumentParser(description="GS2 Scaling Test")
+    parser.add_argument("--project-root", type=Path, default=Path.cwd(),
+                       help="Path to project root directory")
+    parser.add_argument("--compiler", type=Path,
+                       help="Compiler executable (default: search PROJECT_ROOT)")
+    parser.add_argument("--shape", choices=sorted(SHAPES), action="append",
+                       help="Shape to test, may be repeated (default: all)")
+    parser.add_argument("--repeats", type=int, default=3,
+                       help="Runs per size, the fastest is used (default: 3)")
+    parser.add_argument("--max-time-exponent", type=float, default=1.3,
+                       help="Fail when compile time grows faster than size^N (default: 1.3)")
+    parser.add_argument("--max-memory-exponent", type=float, default=1.3,
+                       help="Fail when memory grows faster than size^N (default: 1.3)")
+    parser.add_argument("--memory-floor", type=int, default=1024,
+                       help="Ignore sizes whose rss is less than this many KiB over an empty script's (default: 1024)")
+    parser.add_argument("--quiet", action="store_true",
+                       help="Only print failures and the summary")
+
+    args = parser.parse_args()
+
+    try:
+        compiler = args.compiler or find_compiler(args.project_root)
+    except FileNotFoundError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 3
+
+    failures = []
+
+    with tempfile.TemporaryDirectory(prefix="gs2scaling_") as tmp:
+        tmp_dir = Path(tmp)
+
+        empty_script = tmp_dir / "empty.gs2"
+        empty_script.write_text("function onCreated() {}\n")
+        _, base_rss = measure(compiler, empty_script, args.repeats)
+
+        for shape in args.shape or sorted(SHAPES):
+            sizes, times = [], []
+            memory_sizes, memory = [], []
+
+            for size in DEFAULT_SIZES[shape]:
+                script = tmp_dir / f"{shape}_{size}.gs2"
+                script.write_text(generate(shape, size))
+
+                elapsed, rss = measure(compiler, script, args.repeats)
+                sizes.append(script.stat().st_size)
+                times.append(elapsed)
+                if rss is not None and base_rss is not None and rss - base_rss > args.memory_floor * 1024:
+                    memory_sizes.append(sizes[-1])
+                    memory.append(rss - base_rss)
+
+                if not args.quiet:
+                    rss_text = f", {rss / 1024:.0f} KiB rss" if rss is not None else ""
+                    print(f"  {shape:<18} n={size:<6} {sizes[-1]:>9} bytes {elapsed:>9.3f} ms{rss_text}")
+
+            time_exp = growth_exponent(sizes, times)
+            mem_exp = growth_exponent(memory_sizes, memory) if len(memory) >= MIN_MEMORY_POINTS else None
+
+            status = "ok"
+            if time_exp > args.max_time_exponent:
+                failures.append(f"{shape}: compile time grows as size^{time_exp:.2f}")
+                status = "FAIL"
+            if mem_exp is not None and mem_exp > args.max_memory_exponent:
+                failures.append(f"{shape}: memory grows as size^{mem_exp:.2f}")
+                status = "FAIL"
+
+            if mem_exp is not None:
+                mem_text = f", memory exponent {mem_exp:.2f} over {len(memory)} sizes"
+            elif base_rss is not None:
+                mem_text = f", memory not fitted ({len(memory)} sizes above {args.memory_floor} KiB)"
+            else:
+                mem_text = ""
+            print(f"{status:<4} {shape}: time exponent {time_exp:.2f}{mem_text}")
+
+    if failures:
+        print(f"\nScaling regressions detected:")
+        for failure in failures:
+            print(f"  {failure}")
+        return 1
+
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())